@@ -0,0 +1,185 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stress benchmark for the flood governor.
+ *
+ * Opens a number of terminals that each run a command flooding them with
+ * output, and measures how late a 10ms main loop timeout fires, which
+ * is what the user sees as input and redraw latency. Run it once with and
+ * once without --no-governor to compare.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include <gtk/gtk.h>
+#include <vte/vte.h>
+
+#include "terminal-debug.h"
+#include "terminal-flood-governor.h"
+#include "terminal-timer-wheel.h"
+
+#define PROBE_INTERVAL (10) /* ms */
+
+static int n_terminals = 8;
+static int duration = 20;
+static int threshold = 100;
+static gboolean no_governor = FALSE;
+static char *command = NULL;
+
+static GArray *latencies; /* gint64, us */
+static gint64 last_probe;
+static GList *governors;
+
+static gboolean
+probe_cb (gpointer user_data)
+{
+  gint64 now, late;
+
+  now = g_get_monotonic_time ();
+  late = MAX (now - last_probe - PROBE_INTERVAL * 1000, 0);
+  g_array_append_val (latencies, late);
+  last_probe = now;
+
+  return TRUE;
+}
+
+static gboolean
+done_cb (gpointer user_data)
+{
+  gtk_main_quit ();
+  return FALSE;
+}
+
+static int
+compare_latency (gconstpointer a,
+                 gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static gint64
+percentile (double p)
+{
+  guint i;
+
+  i = (guint) (p * (latencies->len - 1));
+  return g_array_index (latencies, gint64, i);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  const GOptionEntry options[] = {
+    { "terminals", 'n', 0, G_OPTION_ARG_INT, &n_terminals, "Number of terminals", "N" },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Seconds to run", "SECONDS" },
+    { "threshold", 't', 0, G_OPTION_ARG_INT, &threshold, "Updates per second that count as flooding", "N" },
+    { "command", 'c', 0, G_OPTION_ARG_STRING, &command, "Flooding shell command", "COMMAND" },
+    { "no-governor", 0, 0, G_OPTION_ARG_NONE, &no_governor, "Don't throttle", NULL },
+    { NULL }
+  };
+  TerminalTimerWheel *wheel;
+  GtkWidget *window, *box;
+  GError *error = NULL;
+  GList *l;
+  guint n_throttled = 0;
+  int i;
+
+  if (!gtk_init_with_args (&argc, &argv, NULL, options, NULL, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  _terminal_debug_init ();
+
+  if (command == NULL)
+    command = g_strdup ("while :; do seq 1 100000; done");
+
+  wheel = terminal_timer_wheel_new (250);
+  latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+  gtk_container_add (GTK_CONTAINER (window), box);
+
+  for (i = 0; i < n_terminals; i++) {
+    GtkWidget *terminal;
+    char *child_argv[] = { (char *) "/bin/sh", (char *) "-c", command, NULL };
+
+    terminal = vte_terminal_new ();
+    vte_terminal_set_size (VTE_TERMINAL (terminal), 80, 5);
+    gtk_box_pack_start (GTK_BOX (box), terminal, TRUE, TRUE, 0);
+
+    if (!vte_terminal_fork_command_full (VTE_TERMINAL (terminal),
+                                         VTE_PTY_DEFAULT,
+                                         NULL, child_argv, NULL,
+                                         0, NULL, NULL,
+                                         NULL, &error)) {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+    if (!no_governor) {
+      TerminalFloodGovernor *governor;
+
+      governor = terminal_flood_governor_new (VTE_TERMINAL (terminal), wheel);
+      terminal_flood_governor_set_limits (governor, threshold, 1);
+      /* Only the first one counts as the visible tab */
+      terminal_flood_governor_set_visible (governor, i == 0);
+      governors = g_list_prepend (governors, governor);
+    }
+  }
+
+  gtk_widget_show_all (window);
+
+  last_probe = g_get_monotonic_time ();
+  g_timeout_add (PROBE_INTERVAL, probe_cb, NULL);
+  g_timeout_add_seconds (duration, done_cb, NULL);
+
+  gtk_main ();
+
+  for (l = governors; l != NULL; l = l->next)
+    if (terminal_flood_governor_get_throttled (l->data))
+      n_throttled++;
+
+  if (latencies->len == 0) {
+    g_printerr ("No samples\n");
+    return EXIT_FAILURE;
+  }
+
+  g_array_sort (latencies, compare_latency);
+
+  g_print ("terminals: %d, governor: %s, samples: %u\n",
+           n_terminals, no_governor ? "off" : "on", latencies->len);
+  g_print ("main loop lateness: p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           percentile (0.50) / 1000.,
+           percentile (0.99) / 1000.,
+           percentile (1.00) / 1000.);
+  g_print ("throttled at the end: %u\n", n_throttled);
+
+  g_list_free_full (governors, g_object_unref);
+  gtk_widget_destroy (window);
+  terminal_timer_wheel_free (wheel);
+  g_array_free (latencies, TRUE);
+  g_free (command);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Typing latency benchmark for the session recorder.
+ *
+ * A keystroke goes to the child's PTY, whose line discipline echoes it,
+ * and the echo comes back. This measures that round trip once directly
+ * on a PTY, as without recording, and once through a recorder relaying
+ * between two PTYs, as with recording. Both the keystroke and the echo
+ * cross the relay, and the echo gets recorded.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "terminal-debug.h"
+#include "terminal-recorder.h"
+
+static int iterations = 10000;
+static gboolean timing = FALSE;
+static char *directory = NULL;
+
+static int
+open_pty (int *slave)
+{
+  int master;
+
+  master = posix_openpt (O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (master == -1 || grantpt (master) != 0 || unlockpt (master) != 0)
+    g_error ("Failed to open a PTY: %s", g_strerror (errno));
+
+  *slave = open (ptsname (master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (*slave == -1)
+    g_error ("Failed to open a PTY: %s", g_strerror (errno));
+
+  return master;
+}
+
+static void
+set_raw (int fd,
+         gboolean echo)
+{
+  struct termios attrs;
+
+  tcgetattr (fd, &attrs);
+  cfmakeraw (&attrs);
+  if (echo)
+    attrs.c_lflag |= ECHO;
+  tcsetattr (fd, TCSANOW, &attrs);
+}
+
+static int
+compare_latency (gconstpointer a,
+                 gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Writes one byte to @fd and waits for it to come back */
+static void
+measure (const char *label,
+         int fd)
+{
+  GArray *latencies;
+  struct pollfd pfd;
+  gint64 start;
+  char c;
+  int i;
+
+  latencies = g_array_sized_new (FALSE, FALSE, sizeof (gint64), iterations);
+
+  for (i = 0; i < iterations; i++) {
+    gint64 latency;
+
+    c = 'a' + i % 26;
+    start = g_get_monotonic_time ();
+    if (write (fd, &c, 1) != 1)
+      g_error ("Write failed: %s", g_strerror (errno));
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll (&pfd, 1, 1000) != 1 || read (fd, &c, 1) != 1)
+      g_error ("No echo");
+
+    latency = g_get_monotonic_time () - start;
+    g_array_append_val (latencies, latency);
+  }
+
+  g_array_sort (latencies, compare_latency);
+  g_print ("%-10s p50 %4" G_GINT64_FORMAT " µs, p99 %4" G_GINT64_FORMAT " µs, max %5" G_GINT64_FORMAT " µs\n",
+           label,
+           g_array_index (latencies, gint64, iterations / 2),
+           g_array_index (latencies, gint64, iterations * 99 / 100),
+           g_array_index (latencies, gint64, iterations - 1));
+
+  g_array_free (latencies, TRUE);
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  const GOptionEntry options[] = {
+    { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Keystrokes to send", "N" },
+    { "timing", 't', 0, G_OPTION_ARG_NONE, &timing, "Record in asciicast format", NULL },
+    { "directory", 'd', 0, G_OPTION_ARG_FILENAME, &directory, "Where to put the recording", "DIR" },
+    { NULL }
+  };
+  GOptionContext *context;
+  TerminalRecorder *recorder;
+  GError *error = NULL;
+  int child_master, child_slave, terminal_master, terminal_slave;
+  gboolean temporary;
+
+  context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (context, options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+  g_option_context_free (context);
+
+  if (iterations < 1)
+    iterations = 1;
+
+  _terminal_debug_init ();
+
+  temporary = directory == NULL;
+  if (temporary) {
+    directory = g_dir_make_tmp ("bench-record-XXXXXX", &error);
+    if (directory == NULL) {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* The child's line discipline does the echoing */
+  child_master = open_pty (&child_slave);
+  set_raw (child_slave, TRUE);
+
+  measure ("direct", child_master);
+
+  terminal_master = open_pty (&terminal_slave);
+  set_raw (terminal_slave, FALSE);
+
+  recorder = terminal_recorder_new (child_master, terminal_slave,
+                                    directory, "bench", 0, timing,
+                                    &error);
+  if (recorder == NULL) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  measure ("recorded", terminal_master);
+
+  terminal_recorder_free (recorder);
+  close (terminal_master);
+  close (child_master);
+  close (child_slave);
+
+  if (temporary) {
+    const char *name;
+    GDir *dir;
+
+    dir = g_dir_open (directory, 0, NULL);
+    while (dir != NULL && (name = g_dir_read_name (dir)) != NULL) {
+      char *path;
+
+      path = g_build_filename (directory, name, NULL);
+      g_unlink (path);
+      g_free (path);
+    }
+    if (dir != NULL)
+      g_dir_close (dir);
+    g_rmdir (directory);
+  }
+  g_free (directory);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,718 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Throughput benchmark for TerminalScreen.
+ *
+ * Feeds byte streams into a TerminalScreen in a window, either as fast as
+ * the main loop takes them or with the timing they were captured with,
+ * and reports throughput, frames drawn, main loop stalls and the peak RSS
+ * during each run.
+ *
+ * The streams are either generated (build-log, ncurses, ls, long-lines),
+ * which makes runs comparable across machines, or loaded from capture
+ * files: raw byte dumps, or asciicast v2 files such as the ones written
+ * with the record-output profile setting, optionally gzipped.
+ *
+ * It needs a display, so run it under Xvfb on headless machines, and the
+ * compiled schemas:
+ *
+ *   GSETTINGS_SCHEMA_DIR=. xvfb-run ./bench-replay --json
+ *
+ * Unless --profile is given, it uses the in-memory settings backend so
+ * that runs use the default profile settings.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gtk/gtk.h>
+
+#include "terminal-app.h"
+#include "terminal-debug.h"
+#include "terminal-screen.h"
+#include "terminal-screen-container.h"
+
+#define CHUNK_SIZE     (16 * 1024)
+#define PROBE_INTERVAL (10)  /* ms */
+#define QUIET_TIME     (500) /* ms without changes after the last feed */
+
+typedef struct {
+  gint64 time; /* µs from the start */
+  gsize end; /* offset in the data */
+} ReplayEvent;
+
+typedef struct {
+  char *name;
+  GByteArray *data;
+  GArray *events; /* of ReplayEvent, or NULL without timing */
+} Capture;
+
+static char **workloads = NULL;
+static char **capture_files = NULL;
+static char *profile_name = NULL;
+static int size = 16; /* MiB */
+static gboolean timed = FALSE;
+static gboolean json = FALSE;
+
+/* The current run */
+static TerminalScreen *screen;
+static Capture *capture;
+static gsize fed;
+static guint next_event;
+static gint64 start_time, last_change;
+static guint frames;
+static GArray *stalls; /* gint64, µs */
+static gint64 last_probe;
+static glong peak_rss; /* KiB, of the current run */
+static guint feed_source_id, probe_source_id, quiet_source_id;
+static GMainLoop *run_loop;
+
+/* Generated workloads */
+
+static void
+generate_build_log (GString *s,
+                    GRand *rand)
+{
+  guint module, file;
+
+  module = g_rand_int_range (rand, 0, 100);
+  file = g_rand_int_range (rand, 0, 10000);
+
+  if (g_rand_int_range (rand, 0, 50) == 0)
+    g_string_append_printf (s,
+                            "src/module%03u/file%04u.c:%d:%d: \033[01;35mwarning: \033[0m"
+                            "unused variable \342\200\230x%u\342\200\231 [\033[01;35m-Wunused-variable\033[0m]\n",
+                            module, file,
+                            g_rand_int_range (rand, 1, 2000), g_rand_int_range (rand, 1, 80),
+                            g_rand_int (rand));
+  else
+    g_string_append_printf (s, "  CC       src/module%03u/file%04u.o\n", module, file);
+}
+
+static void
+generate_ncurses (GString *s,
+                  GRand *rand)
+{
+  int row, col;
+
+  /* One full screen redraw, like top or htop */
+  g_string_append (s, "\033[H\033[7m  PID USER      PR  NI    VIRT    RES  %CPU COMMAND\033[27m");
+  for (row = 2; row <= 24; row++) {
+    g_string_append_printf (s, "\033[%d;1H\033[3%d;4%dm", row,
+                            g_rand_int_range (rand, 0, 8), g_rand_int_range (rand, 0, 8));
+    for (col = 0; col < 80; col++)
+      g_string_append_c (s, (char) g_rand_int_range (rand, 'a', 'z' + 1));
+    g_string_append (s, "\033[0m\033[K");
+  }
+}
+
+static void
+generate_ls (GString *s,
+             GRand *rand)
+{
+  static const char *colors[] = { "01;34", "01;32", "01;36", "00", "01;31", "01;35" };
+  int i, n;
+
+  g_string_append_printf (s, "\n./dir%u/sub%u:\n", g_rand_int (rand) % 1000, g_rand_int (rand) % 1000);
+  n = g_rand_int_range (rand, 1, 40);
+  for (i = 0; i < n; i++)
+    g_string_append_printf (s, "\033[%sm%s%u\033[0m%s",
+                            colors[g_rand_int_range (rand, 0, G_N_ELEMENTS (colors))],
+                            i % 3 ? "file" : "directory-with-a-long-name",
+                            g_rand_int (rand) % 100000,
+                            i % 4 == 3 ? "\n" : "  ");
+  g_string_append_c (s, '\n');
+}
+
+static void
+generate_long_lines (GString *s,
+                     GRand *rand)
+{
+  int i;
+
+  for (i = 0; i < 64 * 1024; i++)
+    g_string_append_c (s, (char) g_rand_int_range (rand, ' ', '~' + 1));
+  g_string_append (s, "\r\n");
+}
+
+static Capture *
+capture_generate (const char *name,
+                  GError **error)
+{
+  static const struct {
+    const char *name;
+    void (* generate) (GString *, GRand *);
+  } generators[] = {
+    { "build-log",  generate_build_log  },
+    { "ncurses",    generate_ncurses    },
+    { "ls",         generate_ls         },
+    { "long-lines", generate_long_lines }
+  };
+  Capture *c;
+  GString *s;
+  GRand *rand;
+  gsize target;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (generators); i++)
+    if (strcmp (name, generators[i].name) == 0)
+      break;
+  if (i == G_N_ELEMENTS (generators)) {
+    g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                 "Unknown workload \"%s\"", name);
+    return NULL;
+  }
+
+  /* The same bytes on every run */
+  rand = g_rand_new_with_seed (42);
+  target = (gsize) size * 1024 * 1024;
+  s = g_string_sized_new (target + 128 * 1024);
+  while (s->len < target)
+    generators[i].generate (s, rand);
+  g_rand_free (rand);
+
+  c = g_new0 (Capture, 1);
+  c->name = g_strdup (name);
+  c->data = g_byte_array_new ();
+  g_byte_array_append (c->data, (const guint8 *) s->str, s->len);
+  g_string_free (s, TRUE);
+
+  return c;
+}
+
+/* Capture files */
+
+/* Parses the JSON string starting after the opening quote at *p */
+static gboolean
+parse_json_string (const char **p,
+                   const char *end,
+                   GByteArray *out)
+{
+  const char *q = *p;
+
+  while (q < end && *q != '"') {
+    gunichar c;
+    char utf8[6];
+    int len;
+
+    if (*q != '\\') {
+      g_byte_array_append (out, (const guint8 *) q, 1);
+      q++;
+      continue;
+    }
+
+    if (++q >= end)
+      return FALSE;
+
+    switch (*q++) {
+      case '"':  c = '"';  break;
+      case '\\': c = '\\'; break;
+      case '/':  c = '/';  break;
+      case 'b':  c = '\b'; break;
+      case 'f':  c = '\f'; break;
+      case 'n':  c = '\n'; break;
+      case 'r':  c = '\r'; break;
+      case 't':  c = '\t'; break;
+      case 'u': {
+        char hex[5];
+
+        if (end - q < 4)
+          return FALSE;
+        memcpy (hex, q, 4);
+        hex[4] = '\0';
+        c = (gunichar) g_ascii_strtoull (hex, NULL, 16);
+        q += 4;
+
+        /* A surrogate pair */
+        if (c >= 0xd800 && c < 0xdc00 &&
+            end - q >= 6 && q[0] == '\\' && q[1] == 'u') {
+          gunichar low;
+
+          memcpy (hex, q + 2, 4);
+          low = (gunichar) g_ascii_strtoull (hex, NULL, 16);
+          if (low >= 0xdc00 && low < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            q += 6;
+          }
+        }
+        break;
+      }
+      default:
+        return FALSE;
+    }
+
+    len = g_unichar_to_utf8 (c, utf8);
+    g_byte_array_append (out, (const guint8 *) utf8, len);
+  }
+
+  if (q >= end)
+    return FALSE;
+
+  *p = q + 1;
+  return TRUE;
+}
+
+/* Reads the output events of an asciicast v2 file, skipping the others */
+static gboolean
+parse_asciicast (Capture *c,
+                 const char *text,
+                 gsize len,
+                 GError **error)
+{
+  const char *p, *end, *eol;
+  guint line = 1;
+
+  c->events = g_array_new (FALSE, FALSE, sizeof (ReplayEvent));
+
+  end = text + len;
+  p = memchr (text, '\n', len);
+  p = p ? p + 1 : end;
+
+  for (; p < end; p = eol + 1) {
+    ReplayEvent event;
+    char *after;
+    double time;
+
+    line++;
+    eol = memchr (p, '\n', end - p);
+    if (eol == NULL)
+      eol = end;
+
+    while (p < eol && g_ascii_isspace (*p))
+      p++;
+    if (p == eol)
+      continue;
+    if (*p != '[')
+      goto fail;
+
+    time = g_ascii_strtod (p + 1, &after);
+    p = after;
+    while (p < eol && (*p == ',' || g_ascii_isspace (*p)))
+      p++;
+    if (eol - p < 4 || p[0] != '"' || p[2] != '"')
+      goto fail;
+    if (p[1] != 'o')
+      continue;
+    p += 3;
+    while (p < eol && (*p == ',' || g_ascii_isspace (*p)))
+      p++;
+    if (p >= eol || *p != '"')
+      goto fail;
+    p++;
+    if (!parse_json_string (&p, eol, c->data))
+      goto fail;
+
+    event.time = (gint64) (time * G_USEC_PER_SEC);
+    event.end = c->data->len;
+    g_array_append_val (c->events, event);
+  }
+
+  return TRUE;
+
+fail:
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+               "%s:%u: not an asciicast v2 event", c->name, line);
+  return FALSE;
+}
+
+static Capture *
+capture_load (const char *path,
+              GError **error)
+{
+  GFile *file;
+  GInputStream *stream;
+  GOutputStream *memory;
+  Capture *c = NULL;
+  const char *text;
+  gsize len;
+
+  file = g_file_new_for_commandline_arg (path);
+  stream = G_INPUT_STREAM (g_file_read (file, NULL, error));
+  g_object_unref (file);
+  if (stream == NULL)
+    return NULL;
+
+  if (g_str_has_suffix (path, ".gz")) {
+    GConverter *decompressor;
+    GInputStream *compressed = stream;
+
+    decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+    stream = g_converter_input_stream_new (compressed, decompressor);
+    g_object_unref (decompressor);
+    g_object_unref (compressed);
+  }
+
+  memory = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  if (g_output_stream_splice (memory, stream,
+                              G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE | G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+                              NULL, error) < 0)
+    goto out;
+
+  text = g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (memory));
+  len = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (memory));
+
+  c = g_new0 (Capture, 1);
+  c->name = g_path_get_basename (path);
+  c->data = g_byte_array_new ();
+
+  if (len > 12 && memcmp (text, "{\"version\":", 11) == 0) {
+    if (!parse_asciicast (c, text, len, error)) {
+      g_array_free (c->events, TRUE);
+      g_byte_array_unref (c->data);
+      g_free (c->name);
+      g_free (c);
+      c = NULL;
+    }
+  } else {
+    g_byte_array_append (c->data, (const guint8 *) text, len);
+  }
+
+out:
+  g_object_unref (memory);
+  g_object_unref (stream);
+
+  return c;
+}
+
+static void
+capture_free (Capture *c)
+{
+  if (c->events)
+    g_array_free (c->events, TRUE);
+  g_byte_array_unref (c->data);
+  g_free (c->name);
+  g_free (c);
+}
+
+/* Running */
+
+static void
+feed (gsize end)
+{
+  vte_terminal_feed (VTE_TERMINAL (screen), (const char *) capture->data->data + fed, end - fed);
+  fed = end;
+}
+
+static gboolean
+quiet_cb (gpointer user_data)
+{
+  if (g_get_monotonic_time () - last_change < QUIET_TIME * 1000)
+    return TRUE;
+
+  quiet_source_id = 0;
+  g_main_loop_quit (run_loop);
+  return FALSE;
+}
+
+static void
+feeding_done (void)
+{
+  feed_source_id = 0;
+  last_change = g_get_monotonic_time ();
+  quiet_source_id = g_timeout_add (QUIET_TIME / 4, quiet_cb, NULL);
+}
+
+static gboolean
+feed_fast_cb (gpointer user_data)
+{
+  feed (MIN (fed + CHUNK_SIZE, capture->data->len));
+  if (fed < capture->data->len)
+    return TRUE;
+
+  feeding_done ();
+  return FALSE;
+}
+
+static gboolean
+feed_timed_cb (gpointer user_data)
+{
+  ReplayEvent *event;
+  gint64 elapsed;
+
+  elapsed = g_get_monotonic_time () - start_time;
+  while (next_event < capture->events->len &&
+         (event = &g_array_index (capture->events, ReplayEvent, next_event))->time <= elapsed) {
+    feed (event->end);
+    next_event++;
+  }
+
+  if (next_event == capture->events->len) {
+    feeding_done ();
+    return FALSE;
+  }
+
+  event = &g_array_index (capture->events, ReplayEvent, next_event);
+  feed_source_id = g_timeout_add (MAX ((event->time - elapsed) / 1000, 1), feed_timed_cb, NULL);
+  return FALSE;
+}
+
+/* The current RSS in KiB, or -1. Unlike getrusage()'s ru_maxrss, which
+ * is the peak over the whole process, this lets each run report its own.
+ */
+static glong
+current_rss (void)
+{
+  static int fd = -1;
+  char buf[128];
+  ssize_t len;
+  unsigned long resident;
+
+  if (fd == -1)
+    fd = open ("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+
+  len = pread (fd, buf, sizeof (buf) - 1, 0);
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+
+  if (sscanf (buf, "%*u %lu", &resident) != 1)
+    return -1;
+
+  return (glong) (resident * (sysconf (_SC_PAGESIZE) / 1024));
+}
+
+static void
+sample_rss (void)
+{
+  peak_rss = MAX (peak_rss, current_rss ());
+}
+
+static gboolean
+probe_cb (gpointer user_data)
+{
+  gint64 now, late;
+
+  now = g_get_monotonic_time ();
+  late = MAX (now - last_probe - PROBE_INTERVAL * 1000, 0);
+  g_array_append_val (stalls, late);
+  last_probe = now;
+
+  sample_rss ();
+
+  return TRUE;
+}
+
+static void
+contents_changed_cb (VteTerminal *terminal,
+                     gpointer user_data)
+{
+  last_change = g_get_monotonic_time ();
+}
+
+static gboolean
+draw_cb (GtkWidget *widget,
+         cairo_t *cr,
+         gpointer user_data)
+{
+  frames++;
+  return FALSE;
+}
+
+static int
+compare_stall (gconstpointer a,
+               gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a, y = *(const gint64 *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static double
+stall_percentile (double p)
+{
+  if (stalls->len == 0)
+    return 0.;
+
+  return g_array_index (stalls, gint64, (guint) (p * (stalls->len - 1))) / 1000.;
+}
+
+static void
+run (Capture *c)
+{
+  gboolean use_timing;
+  double seconds, mb_per_s;
+  char *name;
+
+  capture = c;
+  fed = 0;
+  next_event = 0;
+  frames = 0;
+  stalls = g_array_new (FALSE, FALSE, sizeof (gint64));
+  use_timing = timed && c->events != NULL;
+
+  vte_terminal_reset (VTE_TERMINAL (screen), TRUE, TRUE);
+
+  peak_rss = -1;
+  sample_rss ();
+
+  run_loop = g_main_loop_new (NULL, FALSE);
+
+  start_time = last_change = last_probe = g_get_monotonic_time ();
+  probe_source_id = g_timeout_add (PROBE_INTERVAL, probe_cb, NULL);
+  if (use_timing)
+    feed_source_id = g_timeout_add (0, feed_timed_cb, NULL);
+  else
+    feed_source_id = g_idle_add_full (G_PRIORITY_LOW, feed_fast_cb, NULL, NULL);
+
+  g_main_loop_run (run_loop);
+
+  g_source_remove (probe_source_id);
+  g_main_loop_unref (run_loop);
+
+  seconds = MAX (last_change - start_time, 1) / (double) G_USEC_PER_SEC;
+  mb_per_s = fed / seconds / (1024. * 1024.);
+  sample_rss ();
+  g_array_sort (stalls, compare_stall);
+
+  if (json) {
+    name = g_strescape (c->name, NULL);
+    g_print ("{\"workload\": \"%s\", \"timed\": %s, \"bytes\": %" G_GSIZE_FORMAT ", "
+             "\"seconds\": %.3f, \"mb_per_s\": %.2f, \"frames\": %u, "
+             "\"stall_p50_ms\": %.2f, \"stall_p99_ms\": %.2f, \"stall_max_ms\": %.2f, "
+             "\"peak_rss_kib\": %ld}\n",
+             name, use_timing ? "true" : "false", fed,
+             seconds, mb_per_s, frames,
+             stall_percentile (0.50), stall_percentile (0.99), stall_percentile (1.00),
+             peak_rss);
+    g_free (name);
+  } else {
+    g_print ("%-16s %9.2f MB/s %6u frames   stalls p50 %6.1f p99 %6.1f max %7.1f ms   peak RSS %ld KiB\n",
+             c->name, mb_per_s, frames,
+             stall_percentile (0.50), stall_percentile (0.99), stall_percentile (1.00),
+             peak_rss);
+  }
+
+  g_array_free (stalls, TRUE);
+  stalls = NULL;
+  capture = NULL;
+}
+
+static gboolean
+run_all_cb (GPtrArray *captures)
+{
+  guint i;
+
+  for (i = 0; i < captures->len; i++)
+    run (g_ptr_array_index (captures, i));
+
+  gtk_main_quit ();
+  return FALSE;
+}
+
+static gboolean
+start_cb (GtkWidget *widget,
+          GdkEvent *event,
+          GPtrArray *captures)
+{
+  g_signal_handlers_disconnect_by_func (widget, G_CALLBACK (start_cb), captures);
+
+  /* Outside of the event handler, and after the first frame */
+  g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc) run_all_cb, captures, NULL);
+  return FALSE;
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  const GOptionEntry options[] = {
+    { "workload", 'w', 0, G_OPTION_ARG_STRING_ARRAY, &workloads,
+      "Generated workload: build-log, ncurses, ls or long-lines; all of them by default", "NAME" },
+    { "capture", 'c', 0, G_OPTION_ARG_FILENAME_ARRAY, &capture_files,
+      "Raw or asciicast v2 capture to replay", "FILE" },
+    { "size", 's', 0, G_OPTION_ARG_INT, &size, "Size of generated workloads in MiB", "MIB" },
+    { "timed", 't', 0, G_OPTION_ARG_NONE, &timed, "Replay asciicast captures with their timing", NULL },
+    { "profile", 'p', 0, G_OPTION_ARG_STRING, &profile_name, "Use this profile from the user's settings", "NAME" },
+    { "json", 0, 0, G_OPTION_ARG_NONE, &json, "Print one JSON object per workload", NULL },
+    { NULL }
+  };
+  static const char *default_workloads[] = { "build-log", "ncurses", "ls", "long-lines", NULL };
+  GApplication *app;
+  GSettings *profile;
+  GtkWidget *window, *container;
+  GPtrArray *captures;
+  GError *error = NULL;
+  guint i;
+
+  if (!gtk_init_with_args (&argc, &argv, NULL, options, NULL, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  _terminal_debug_init ();
+
+  if (profile_name == NULL)
+    g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+  captures = g_ptr_array_new_with_free_func ((GDestroyNotify) capture_free);
+  if (workloads == NULL && capture_files == NULL)
+    workloads = g_strdupv ((char **) default_workloads);
+  size = MAX (size, 1);
+
+  for (i = 0; workloads != NULL && workloads[i] != NULL; i++) {
+    Capture *c;
+
+    if ((c = capture_generate (workloads[i], &error)) == NULL)
+      goto fail;
+    g_ptr_array_add (captures, c);
+  }
+  for (i = 0; capture_files != NULL && capture_files[i] != NULL; i++) {
+    Capture *c;
+
+    if ((c = capture_load (capture_files[i], &error)) == NULL)
+      goto fail;
+    g_ptr_array_add (captures, c);
+  }
+
+  app = terminal_app_new ("org.gnome.Terminal.BenchReplay");
+  g_application_set_default (app);
+
+  profile = terminal_app_get_profile (TERMINAL_APP (app), profile_name);
+  screen = terminal_screen_new (profile, NULL, NULL, NULL, NULL, 1.0);
+  g_object_unref (profile);
+
+  g_signal_connect (screen, "contents-changed", G_CALLBACK (contents_changed_cb), NULL);
+  g_signal_connect_after (screen, "draw", G_CALLBACK (draw_cb), NULL);
+
+  window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  container = terminal_screen_container_new (screen);
+  gtk_container_add (GTK_CONTAINER (window), container);
+
+  /* Start once the screen is on the display */
+  g_signal_connect (window, "map-event", G_CALLBACK (start_cb), captures);
+  gtk_widget_show_all (window);
+
+  gtk_main ();
+
+  gtk_widget_destroy (window);
+  g_object_unref (app);
+  g_ptr_array_free (captures, TRUE);
+
+  return EXIT_SUCCESS;
+
+fail:
+  g_printerr ("%s\n", error->message);
+  g_error_free (error);
+  g_ptr_array_free (captures, TRUE);
+  return EXIT_FAILURE;
+}
@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -43,6 +44,10 @@
 #include "terminal-gdbus-generated.h"
 #include "terminal-defines.h"
 #include "terminal-client-utils.h"
+#include "terminal-trace.h"
+
+/* How long --timing waits for the terminal's first frame, in ms */
+#define TIMING_TIMEOUT (10000)
 
 static gboolean quiet = FALSE;
 
@@ -122,6 +127,9 @@ usage (gint *argc, gchar **argv[], gboolean use_stdout)
   s = g_strdup_printf (_("Commands:\n"
                          "  help    Shows this information\n"
                          "  open    Create a new terminal\n"
+                         "  attach  Show a headless terminal in a window\n"
+                         "  detach  Remove a terminal from its window, keeping it running\n"
+                         "  upgrade Restart the server, keeping all terminals running\n"
                          "\n"
                          "Use \"%s COMMAND --help\" to get help on each command.\n"),
                        program_name);
@@ -179,16 +187,31 @@ typedef struct
   char   *profile;
   char   *title;
   double  zoom;
+  gboolean headless;
 
   /* Exec options */
   GUnixFDList *fd_list;
   GArray *fd_array;
 
+  int    nice;
+  char  *scheduling_policy;
+  char  *io_priority_class;
+  char  *cpu_affinity;
+  GVariantBuilder *resource_limits;
+
+  char    *follow_file;
+  gboolean follow_stdin;
+
   /* Processing options */
   gboolean wait;
+  gboolean timing;
+  char    *trace_file;
+
+  char    *trace_id;
 
   /* Flags */
   guint zoom_set          : 1;
+  guint nice_set          : 1;
   guint active            : 1;
 } OptionData;
 
@@ -323,6 +346,70 @@ option_fd_cb (const gchar *option_name,
   return TRUE;
 }
 
+static gboolean
+option_nice_cb (const gchar *option_name,
+                const gchar *value,
+                gpointer     user_data,
+                GError     **error)
+{
+  OptionData *data = user_data;
+  char *end = NULL;
+  gint64 nice;
+
+  errno = 0;
+  nice = g_ascii_strtoll (value, &end, 10);
+  if (errno != 0 || end == value || *end != '\0' || nice < -20 || nice > 19) {
+    g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+                 _("\"%s\" is not a valid nice value"), value);
+    return FALSE;
+  }
+
+  data->nice = (int) nice;
+  data->nice_set = TRUE;
+
+  return TRUE;
+}
+
+static gboolean
+option_rlimit_cb (const gchar *option_name,
+                  const gchar *value,
+                  gpointer     user_data,
+                  GError     **error)
+{
+  OptionData *data = user_data;
+  const char *eq;
+  char *name, *end = NULL;
+  guint64 limit;
+
+  eq = strchr (value, '=');
+  if (eq == NULL || eq == value)
+    goto invalid;
+
+  if (strcmp (eq + 1, "unlimited") == 0)
+    limit = G_MAXUINT64;
+  else {
+    errno = 0;
+    limit = g_ascii_strtoull (eq + 1, &end, 10);
+    if (errno != 0 || end == eq + 1 || *end != '\0')
+      goto invalid;
+  }
+
+  if (data->resource_limits == NULL)
+    data->resource_limits = g_variant_builder_new (G_VARIANT_TYPE ("a{st}"));
+
+  /* The server checks the name */
+  name = g_strndup (value, eq - value);
+  g_variant_builder_add (data->resource_limits, "{st}", name, limit);
+  g_free (name);
+
+  return TRUE;
+
+ invalid:
+  g_set_error (error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+               _("\"%s\" is not a valid resource limit; use NAME=VALUE"), value);
+  return FALSE;
+}
+
 static GOptionContext *
 get_goption_context (OptionData *data)
 {
@@ -360,6 +447,8 @@ get_goption_context (OptionData *data)
     { "zoom", 0, 0, G_OPTION_ARG_CALLBACK, option_zoom_cb,
       N_("Set the terminal's zoom factor (1.0 = normal size)"),
       N_("ZOOM") },
+    { "headless", 0, 0, G_OPTION_ARG_NONE, &data->headless,
+      N_("Run the terminal without a window, and print its object path"), NULL },
     { NULL, 0, 0, 0, NULL, NULL, NULL }
   };
 
@@ -372,12 +461,30 @@ get_goption_context (OptionData *data)
       N_("Forward stderr"), NULL },
     { "fd", 0, 0, G_OPTION_ARG_CALLBACK, option_fd_cb,
       N_("Forward file descriptor"), N_("FD") },
+    { "nice", 0, 0, G_OPTION_ARG_CALLBACK, option_nice_cb,
+      N_("Run the command with the given nice value"), N_("NICE") },
+    { "scheduling-policy", 0, 0, G_OPTION_ARG_STRING, &data->scheduling_policy,
+      N_("Run the command with the given scheduling policy (normal, batch or idle)"), N_("POLICY") },
+    { "io-priority-class", 0, 0, G_OPTION_ARG_STRING, &data->io_priority_class,
+      N_("Run the command with the given I/O scheduling class (default, best-effort or idle)"), N_("CLASS") },
+    { "cpu-affinity", 0, 0, G_OPTION_ARG_STRING, &data->cpu_affinity,
+      N_("Run the command on the given CPUs; for example: 0-3,6"), N_("CPUS") },
+    { "rlimit", 0, 0, G_OPTION_ARG_CALLBACK, option_rlimit_cb,
+      N_("Limit a resource of the command; for example: nofile=1024"), N_("NAME=VALUE") },
+    { "follow", 0, 0, G_OPTION_ARG_FILENAME, &data->follow_file,
+      N_("Show the end of a file and everything appended to it, instead of running a command"), N_("FILE") },
+    { "follow-stdin", 0, 0, G_OPTION_ARG_NONE, &data->follow_stdin,
+      N_("Show everything written to stdin, instead of running a command"), NULL },
     { NULL, 0, 0, 0, NULL, NULL, NULL }
   };
 
   const GOptionEntry processing_goptions[] = {
     { "wait", 0, 0, G_OPTION_ARG_NONE, &data->wait,
       N_("Wait until the child exits"), NULL },
+    { "timing", 0, 0, G_OPTION_ARG_NONE, &data->timing,
+      N_("Print how long each stage of opening the terminal took"), NULL },
+    { "trace-file", 0, 0, G_OPTION_ARG_FILENAME, &data->trace_file,
+      N_("Write the stages of opening the terminal to a Chrome trace file"), N_("FILE") },
     { NULL, 0, 0, 0, NULL, NULL, NULL }
   };
 
@@ -469,6 +576,15 @@ option_data_free (OptionData *data)
   if (data->fd_array)
     g_array_free (data->fd_array, TRUE);
 
+  g_free (data->scheduling_policy);
+  g_free (data->io_priority_class);
+  g_free (data->cpu_affinity);
+  if (data->resource_limits)
+    g_variant_builder_unref (data->resource_limits);
+  g_free (data->follow_file);
+  g_free (data->trace_file);
+  g_free (data->trace_id);
+
   g_free (data);
 }
 
@@ -512,6 +628,19 @@ parse_arguments (int *argcp,
   }
   g_option_context_free (context);
 
+  if ((data->follow_file != NULL || data->follow_stdin) && data->exec_argc > 0) {
+    g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                         "Cannot both follow a file and run a command");
+    option_data_free (data);
+    return NULL;
+  }
+  if (data->follow_file != NULL && data->follow_stdin) {
+    g_set_error_literal (error, G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+                         "Cannot follow a file and stdin at the same time");
+    option_data_free (data);
+    return NULL;
+  }
+
   if (data->working_directory == NULL) {
     char *cwd;
 
@@ -549,6 +678,9 @@ build_create_options_variant (OptionData *data)
                                                   data->title,
                                                   data->start_maximized,
                                                   data->start_fullscreen);
+  if (data->headless)
+    g_variant_builder_add (&builder, "{sv}", "headless", g_variant_new_boolean (TRUE));
+  terminal_client_append_trace_id (&builder, data->trace_id);
 
   return g_variant_builder_end (&builder);
 }
@@ -568,6 +700,7 @@ build_exec_options_variant (OptionData *data,
 
   terminal_client_append_exec_options (&builder,
                                        data->working_directory);
+  terminal_client_append_trace_id (&builder, data->trace_id);
 
   if (data->fd_array != NULL) {
     int i, n_fds;
@@ -587,11 +720,61 @@ build_exec_options_variant (OptionData *data,
     g_variant_builder_close (&builder); /* v */
 
     g_variant_builder_close (&builder); /* {sv} */
+  }
 
-    *fd_list = data->fd_list;
-    data->fd_list = NULL;
-  } else {
-    *fd_list = NULL;
+  if (data->follow_file != NULL) {
+    char *path, *cwd;
+
+    /* The server has a different working directory */
+    if (g_path_is_absolute (data->follow_file)) {
+      path = g_strdup (data->follow_file);
+    } else {
+      cwd = g_get_current_dir ();
+      path = g_build_filename (cwd, data->follow_file, NULL);
+      g_free (cwd);
+    }
+    g_variant_builder_add (&builder, "{sv}", "view-path", g_variant_new_bytestring (path));
+    g_free (path);
+  }
+
+  if (data->follow_stdin) {
+    int idx;
+
+    if (data->fd_list == NULL)
+      data->fd_list = g_unix_fd_list_new ();
+    idx = g_unix_fd_list_append (data->fd_list, STDIN_FILENO, NULL);
+    if (idx != -1)
+      g_variant_builder_add (&builder, "{sv}", "view-fd", g_variant_new_handle (idx));
+  }
+
+  *fd_list = data->fd_list;
+  data->fd_list = NULL;
+
+  if (data->nice_set ||
+      data->scheduling_policy != NULL ||
+      data->io_priority_class != NULL ||
+      data->cpu_affinity != NULL ||
+      data->resource_limits != NULL) {
+    GVariantBuilder resources;
+
+    g_variant_builder_init (&resources, G_VARIANT_TYPE ("a{sv}"));
+    if (data->nice_set)
+      g_variant_builder_add (&resources, "{sv}", "nice", g_variant_new_int32 (data->nice));
+    if (data->scheduling_policy != NULL)
+      g_variant_builder_add (&resources, "{sv}", "scheduling-policy",
+                             g_variant_new_string (data->scheduling_policy));
+    if (data->io_priority_class != NULL)
+      g_variant_builder_add (&resources, "{sv}", "io-priority-class",
+                             g_variant_new_string (data->io_priority_class));
+    if (data->cpu_affinity != NULL)
+      g_variant_builder_add (&resources, "{sv}", "cpu-affinity",
+                             g_variant_new_string (data->cpu_affinity));
+    if (data->resource_limits != NULL)
+      g_variant_builder_add (&resources, "{sv}", "resource-limits",
+                             g_variant_builder_end (data->resource_limits));
+
+    g_variant_builder_add (&builder, "{sv}", "resources",
+                           g_variant_builder_end (&resources));
   }
 
   return g_variant_builder_end (&builder);
@@ -613,6 +796,26 @@ receiver_child_exited_cb (TerminalReceiver *receiver,
     g_main_loop_quit (data->loop);
 }
 
+static void
+finish_timing (OptionData *data,
+               TerminalReceiver *receiver,
+               TerminalTrace *trace)
+{
+  GError *error = NULL;
+
+  if (!terminal_client_wait_for_trace (receiver, trace, TIMING_TIMEOUT))
+    _printerr ("Timed out waiting for the terminal's first frame\n");
+
+  if (data->timing)
+    terminal_client_print_trace (trace);
+
+  if (data->trace_file != NULL &&
+      !terminal_client_write_trace (trace, data->trace_file, &error)) {
+    _printerr ("Failed to write trace: %s\n", error->message);
+    g_error_free (error);
+  }
+}
+
 static gboolean
 handle_open (int *argc,
              char ***argv,
@@ -628,6 +831,7 @@ handle_open (int *argc,
   char *object_path;
   GVariant *arguments;
   GUnixFDList *fd_list;
+  TerminalTrace *trace;
 
   modify_argv0_for_command (argc, argv, "open");
 
@@ -638,6 +842,13 @@ handle_open (int *argc,
     return FALSE;
   }
 
+  /* Only ask the server to record spans if somebody is going to look */
+  if (data->timing || data->trace_file != NULL) {
+    data->trace_id = terminal_client_new_trace_id ();
+    trace = terminal_trace_new (data->trace_id);
+  } else
+    trace = NULL;
+
   factory = terminal_factory_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
                                                      G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
                                                      G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
@@ -652,10 +863,12 @@ handle_open (int *argc,
                 TERMINAL_APPLICATION_ID, TERMINAL_FACTORY_OBJECT_PATH,
                 error->message);
     g_error_free (error);
+    terminal_trace_free (trace);
     option_data_free (data);
     return FALSE;
   }
 
+  terminal_trace_begin (trace, "CreateInstance");
   if (!terminal_factory_call_create_instance_sync 
          (factory,
           build_create_options_variant (data),
@@ -666,12 +879,18 @@ handle_open (int *argc,
     _printerr ("Error creating terminal: %s\n", error->message);
     g_error_free (error);
     g_object_unref (factory);
+    terminal_trace_free (trace);
     option_data_free (data);
     return FALSE;
   }
+  terminal_trace_end (trace, "CreateInstance");
 
   g_object_unref (factory);
 
+  /* So the terminal can be attached later */
+  if (data->headless)
+    g_print ("%s\n", object_path);
+
   receiver = terminal_receiver_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
                                                        G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
                                                        data->server_app_id ? data->server_app_id
@@ -684,6 +903,7 @@ handle_open (int *argc,
     _printerr ("Failed to create proxy for terminal: %s\n", error->message);
     g_error_free (error);
     g_free (object_path);
+    terminal_trace_free (trace);
     option_data_free (data);
     return FALSE;
   }
@@ -691,6 +911,7 @@ handle_open (int *argc,
   g_free (object_path);
 
   arguments = build_exec_options_variant (data, &fd_list);
+  terminal_trace_begin (trace, "Exec");
   if (!terminal_receiver_call_exec_sync (receiver,
                                          arguments,
                                          g_variant_new_bytestring_array ((const char * const *) data->exec_argv, data->exec_argc),
@@ -703,10 +924,16 @@ handle_open (int *argc,
     g_error_free (error);
     g_clear_object (&fd_list);
     g_object_unref (receiver);
+    terminal_trace_free (trace);
     option_data_free (data);
     return FALSE;
   }
   g_clear_object (&fd_list);
+  terminal_trace_end (trace, "Exec");
+
+  if (trace != NULL)
+    finish_timing (data, receiver, trace);
+  terminal_trace_free (trace);
 
   if (data->wait) {
     WaitData wait_data;
@@ -734,6 +961,121 @@ handle_open (int *argc,
   return TRUE;
 }
 
+static gboolean
+handle_attach (int *argc,
+               char ***argv,
+               const char *command)
+{
+  OptionData *data;
+  TerminalReceiver *receiver;
+  GError *error = NULL;
+  gboolean attach;
+  gboolean result;
+
+  modify_argv0_for_command (argc, argv, command);
+  attach = strcmp (command, "attach") == 0;
+
+  data = parse_arguments (argc, argv, &error);
+  if (data == NULL) {
+    _printerr ("Error parsing arguments: %s\n", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  if (*argc != 2 || !g_variant_is_object_path ((*argv)[1])) {
+    _printerr ("Usage: %s OBJECT-PATH\n", (*argv)[0]);
+    option_data_free (data);
+    return FALSE;
+  }
+
+  receiver = terminal_receiver_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
+                                                       G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                       G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                       data->server_app_id ? data->server_app_id
+                                                                           : TERMINAL_APPLICATION_ID,
+                                                       (*argv)[1],
+                                                       NULL /* cancellable */,
+                                                       &error);
+  if (receiver == NULL) {
+    g_dbus_error_strip_remote_error (error);
+    _printerr ("Failed to create proxy for terminal: %s\n", error->message);
+    g_error_free (error);
+    option_data_free (data);
+    return FALSE;
+  }
+
+  if (attach)
+    result = terminal_receiver_call_attach_sync (receiver,
+                                                 build_create_options_variant (data),
+                                                 NULL /* cancellable */,
+                                                 &error);
+  else
+    result = terminal_receiver_call_detach_sync (receiver,
+                                                 NULL /* cancellable */,
+                                                 &error);
+  if (!result) {
+    g_dbus_error_strip_remote_error (error);
+    _printerr ("Error: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  g_object_unref (receiver);
+  option_data_free (data);
+
+  return result;
+}
+
+static gboolean
+handle_upgrade (int *argc,
+                char ***argv)
+{
+  OptionData *data;
+  TerminalFactory *factory;
+  GError *error = NULL;
+  gboolean result;
+
+  modify_argv0_for_command (argc, argv, "upgrade");
+
+  data = parse_arguments (argc, argv, &error);
+  if (data == NULL) {
+    _printerr ("Error parsing arguments: %s\n", error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  factory = terminal_factory_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                     G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                     data->server_app_id ? data->server_app_id
+                                                                         : TERMINAL_APPLICATION_ID,
+                                                     TERMINAL_FACTORY_OBJECT_PATH,
+                                                     NULL /* cancellable */,
+                                                     &error);
+  if (factory == NULL) {
+    g_dbus_error_strip_remote_error (error);
+    _printerr ("Error constructing proxy for %s:%s: %s\n", 
+                TERMINAL_APPLICATION_ID, TERMINAL_FACTORY_OBJECT_PATH,
+                error->message);
+    g_error_free (error);
+    option_data_free (data);
+    return FALSE;
+  }
+
+  result = terminal_factory_call_upgrade_sync (factory,
+                                               NULL /* cancellable */,
+                                               &error);
+  if (!result) {
+    g_dbus_error_strip_remote_error (error);
+    _printerr ("Error: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  g_object_unref (factory);
+  option_data_free (data);
+
+  return result;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static gchar *
@@ -832,6 +1174,27 @@ main (gint argc, gchar *argv[])
         ret = EXIT_SUCCESS;
       goto out;
     }
+  else if (g_strcmp0 (command, "attach") == 0 ||
+           g_strcmp0 (command, "detach") == 0)
+    {
+      if (request_completion)
+        {
+          /* do nothing */
+        }
+      else if (handle_attach (&argc, &argv, command))
+        ret = EXIT_SUCCESS;
+      goto out;
+    }
+  else if (g_strcmp0 (command, "upgrade") == 0)
+    {
+      if (request_completion)
+        {
+          /* do nothing */
+        }
+      else if (handle_upgrade (&argc, &argv))
+        ret = EXIT_SUCCESS;
+      goto out;
+    }
   else if (g_strcmp0 (command, "complete") == 0 && argc == 4 && !request_completion)
     {
       const gchar *completion_line;
@@ -901,7 +1264,7 @@ main (gint argc, gchar *argv[])
     {
       if (request_completion)
         {
-          g_print ("help \nopen \n");
+          g_print ("help \nopen \nattach \ndetach \nupgrade \n");
           ret = EXIT_SUCCESS;
           goto out;
         }
@@ -0,0 +1,299 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* gnome-terminal-fdholder: keeps the PTYs of a gnome-terminal-server
+ * open while it restarts.
+ *
+ * The server deposits a copy of each terminal's PTY master here. If the
+ * server disconnects while deposits remain, because it crashed or is
+ * being upgraded, the holder starts the command given after "--", which
+ * reconnects and retrieves them. It gives up after a few quick failures,
+ * and exits once nothing is left to hold.
+ */
+
+#include <config.h>
+
+#include <locale.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+
+#include "terminal-debug.h"
+#include "terminal-handover.h"
+
+#define MAX_RESPAWNS      (3)
+#define RESPAWN_INTERVAL  (60) /* s */
+#define CONNECT_TIMEOUT   (30) /* s */
+
+typedef struct {
+  GVariant *state;
+  GUnixFDList *fd_list;
+} Deposit;
+
+static int listen_fd = -1;
+static char **server_argv = NULL;
+
+static GMainLoop *loop;
+static GHashTable *deposits; /* key → Deposit */
+static GSocket *client;
+static GSource *client_source;
+static guint connect_timeout_id;
+static gint64 respawn_times[MAX_RESPAWNS];
+static guint n_respawns;
+
+static void
+deposit_free (Deposit *deposit)
+{
+  g_variant_unref (deposit->state);
+  g_object_unref (deposit->fd_list);
+  g_slice_free (Deposit, deposit);
+}
+
+static gboolean
+connect_timeout_cb (gpointer data)
+{
+  connect_timeout_id = 0;
+
+  g_printerr ("gnome-terminal-fdholder: the server did not come back, giving up\n");
+  g_main_loop_quit (loop);
+
+  return FALSE;
+}
+
+static void
+respawn_server (void)
+{
+  GError *error = NULL;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+  if (n_respawns == MAX_RESPAWNS &&
+      now - respawn_times[0] < (gint64) RESPAWN_INTERVAL * G_USEC_PER_SEC) {
+    g_printerr ("gnome-terminal-fdholder: the server keeps failing, giving up\n");
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  if (n_respawns == MAX_RESPAWNS) {
+    memmove (respawn_times, respawn_times + 1, sizeof (respawn_times[0]) * (MAX_RESPAWNS - 1));
+    n_respawns--;
+  }
+  respawn_times[n_respawns++] = now;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Holding %u terminals, restarting the server\n",
+                         g_hash_table_size (deposits));
+
+  if (!g_spawn_async (NULL, server_argv, NULL, 0, NULL, NULL, NULL, &error)) {
+    g_printerr ("gnome-terminal-fdholder: failed to start the server: %s\n", error->message);
+    g_error_free (error);
+    g_main_loop_quit (loop);
+    return;
+  }
+
+  connect_timeout_id = g_timeout_add_seconds (CONNECT_TIMEOUT, connect_timeout_cb, NULL);
+}
+
+static void
+disconnect_client (void)
+{
+  g_source_destroy (client_source);
+  g_source_unref (client_source);
+  client_source = NULL;
+  g_socket_close (client, NULL);
+  g_object_unref (client);
+  client = NULL;
+
+  if (g_hash_table_size (deposits) == 0)
+    g_main_loop_quit (loop);
+  else
+    respawn_server ();
+}
+
+static void
+send_deposits (void)
+{
+  GHashTableIter iter;
+  gpointer key;
+  Deposit *deposit;
+  GError *error = NULL;
+
+  g_hash_table_iter_init (&iter, deposits);
+  while (g_hash_table_iter_next (&iter, &key, (gpointer *) &deposit)) {
+    if (!terminal_handover_send_message (client, TERMINAL_HANDOVER_ENTRY,
+                                         GPOINTER_TO_UINT (key),
+                                         deposit->state, deposit->fd_list,
+                                         &error))
+      goto fail;
+  }
+
+  if (terminal_handover_send_message (client, TERMINAL_HANDOVER_END, 0, NULL, NULL, &error))
+    return;
+
+fail:
+  g_printerr ("gnome-terminal-fdholder: failed to hand over: %s\n", error->message);
+  g_error_free (error);
+}
+
+static gboolean
+client_cb (GSocket *socket,
+           GIOCondition condition,
+           gpointer data)
+{
+  GVariant *state;
+  GUnixFDList *fd_list;
+  GError *error = NULL;
+  char *command;
+  guint key;
+
+  if (!terminal_handover_receive_message (socket, &command, &key, &state, &fd_list, &error)) {
+    if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CLOSED))
+      g_printerr ("gnome-terminal-fdholder: %s\n", error->message);
+    g_error_free (error);
+    disconnect_client ();
+    return FALSE;
+  }
+
+  if (strcmp (command, TERMINAL_HANDOVER_DEPOSIT) == 0 && key != 0) {
+    Deposit *deposit;
+
+    deposit = g_slice_new (Deposit);
+    deposit->state = g_variant_ref (state);
+    deposit->fd_list = g_object_ref (fd_list);
+    g_hash_table_replace (deposits, GUINT_TO_POINTER (key), deposit);
+  } else if (strcmp (command, TERMINAL_HANDOVER_FORGET) == 0) {
+    g_hash_table_remove (deposits, GUINT_TO_POINTER (key));
+  } else if (strcmp (command, TERMINAL_HANDOVER_RETRIEVE) == 0) {
+    send_deposits ();
+  } else if (strcmp (command, TERMINAL_HANDOVER_RELEASE) == 0) {
+    g_hash_table_remove_all (deposits);
+  }
+
+  g_free (command);
+  g_variant_unref (state);
+  g_object_unref (fd_list);
+
+  return TRUE;
+}
+
+static gboolean
+listener_cb (GSocket *listener,
+             GIOCondition condition,
+             gpointer data)
+{
+  GSocket *socket;
+
+  socket = g_socket_accept (listener, NULL, NULL);
+  if (socket == NULL)
+    return TRUE;
+
+  /* Only one server at a time */
+  if (client != NULL) {
+    g_socket_close (socket, NULL);
+    g_object_unref (socket);
+    return TRUE;
+  }
+
+  if (connect_timeout_id != 0) {
+    g_source_remove (connect_timeout_id);
+    connect_timeout_id = 0;
+  }
+
+  client = socket;
+  client_source = g_socket_create_source (client, G_IO_IN | G_IO_HUP | G_IO_ERR, NULL);
+  g_source_set_callback (client_source, (GSourceFunc) client_cb, NULL, NULL);
+  g_source_attach (client_source, NULL);
+
+  return TRUE;
+}
+
+static const GOptionEntry options[] = {
+  { "listen-fd", 0, 0, G_OPTION_ARG_INT, &listen_fd, "The listening socket", "FD" },
+  { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &server_argv, NULL, "COMMAND" },
+  { NULL }
+};
+
+int
+main (int argc,
+      char **argv)
+{
+  GOptionContext *context;
+  GSocket *listener;
+  GSocketAddress *address;
+  GSource *source;
+  GError *error = NULL;
+
+  setlocale (LC_ALL, "");
+
+  g_type_init ();
+
+  _terminal_debug_init ();
+
+  context = g_option_context_new (NULL);
+  g_option_context_add_main_entries (context, options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("Failed to parse arguments: %s\n", error->message);
+    exit (EXIT_FAILURE);
+  }
+  g_option_context_free (context);
+
+  if (listen_fd < 0 || server_argv == NULL) {
+    g_printerr ("Usage: gnome-terminal-fdholder --listen-fd FD -- COMMAND\n");
+    exit (EXIT_FAILURE);
+  }
+
+  /* Outlive the server's session and process group */
+  setsid ();
+  if (chdir ("/") < 0)
+    exit (EXIT_FAILURE);
+
+  listener = g_socket_new_from_fd (listen_fd, &error);
+  if (listener == NULL) {
+    g_printerr ("Invalid listening socket: %s\n", error->message);
+    exit (EXIT_FAILURE);
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  deposits = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) deposit_free);
+
+  source = g_socket_create_source (listener, G_IO_IN, NULL);
+  g_source_set_callback (source, (GSourceFunc) listener_cb, NULL, NULL);
+  g_source_attach (source, NULL);
+
+  /* The server that started us connects right away */
+  connect_timeout_id = g_timeout_add_seconds (CONNECT_TIMEOUT, connect_timeout_cb, NULL);
+
+  g_main_loop_run (loop);
+
+  /* Closing the PTYs hangs up whatever is left */
+  g_hash_table_destroy (deposits);
+
+  address = g_socket_get_local_address (listener, NULL);
+  if (G_IS_UNIX_SOCKET_ADDRESS (address))
+    g_unlink (g_unix_socket_address_get_path (G_UNIX_SOCKET_ADDRESS (address)));
+  g_clear_object (&address);
+
+  g_source_destroy (source);
+  g_source_unref (source);
+  g_object_unref (listener);
+  g_main_loop_unref (loop);
+  g_strfreev (server_argv);
+
+  return EXIT_SUCCESS;
+}
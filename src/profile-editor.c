@@ -802,6 +802,9 @@ terminal_profile_edit (GSettings  *profile,
                                 (GSettingsBindGetMapping) string_to_enum,
                                 (GSettingsBindSetMapping) enum_to_string,
                                 vte_terminal_cursor_shape_get_type, NULL);
+  g_settings_bind (profile, TERMINAL_PROFILE_CPU_AFFINITY_KEY,
+                   gtk_builder_get_object (builder, "cpu-affinity-entry"),
+                   "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
   g_settings_bind (profile, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY,
                    gtk_builder_get_object (builder, "custom-command-entry"),
                    "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
@@ -845,13 +848,35 @@ terminal_profile_edit (GSettings  *profile,
                                 (GSettingsBindGetMapping) s_to_rgba,
                                 (GSettingsBindSetMapping) rgba_to_s,
                                 NULL, NULL);
+  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_IO_PRIORITY_CLASS_KEY,
+                                gtk_builder_get_object (builder,
+                                                        "io-priority-class-combobox"),
+                                "active",
+                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                (GSettingsBindGetMapping) string_to_enum,
+                                (GSettingsBindSetMapping) enum_to_string,
+                                terminal_io_priority_class_get_type, NULL);
   g_settings_bind (profile, TERMINAL_PROFILE_LOGIN_SHELL_KEY,
                    gtk_builder_get_object (builder,
                                            "login-shell-checkbutton"),
                    "active", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+  g_settings_bind (profile, TERMINAL_PROFILE_NICE_KEY,
+                   gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
+                                                   (gtk_builder_get_object
+                                                    (builder,
+                                                     "nice-spinbutton"))),
+                   "value", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
   g_settings_bind (profile, TERMINAL_PROFILE_VISIBLE_NAME_KEY,
                    gtk_builder_get_object (builder, "profile-name-entry"),
                    "text", G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET);
+  g_settings_bind_with_mapping (profile, TERMINAL_PROFILE_SCHEDULING_POLICY_KEY,
+                                gtk_builder_get_object (builder,
+                                                        "scheduling-policy-combobox"),
+                                "active",
+                                G_SETTINGS_BIND_GET | G_SETTINGS_BIND_SET,
+                                (GSettingsBindGetMapping) string_to_enum,
+                                (GSettingsBindSetMapping) enum_to_string,
+                                terminal_scheduling_policy_get_type, NULL);
   g_settings_bind (profile, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY,
                    gtk_spin_button_get_adjustment (GTK_SPIN_BUTTON
                                                    (gtk_builder_get_object
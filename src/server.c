@@ -38,6 +38,10 @@
 #include "terminal-defines.h"
 
 static char *app_id = NULL;
+static gboolean recover = FALSE;
+
+#define RECOVER_WAIT_INTERVAL (100 * 1000) /* µs */
+#define RECOVER_WAIT_TRIES    (50)
 
 static gboolean
 option_app_id_cb (const gchar *option_name,
@@ -59,9 +63,49 @@ option_app_id_cb (const gchar *option_name,
 
 static const GOptionEntry options[] = {
   { "app-id", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_CALLBACK, option_app_id_cb, "Application ID", "ID" },
+  { "recover", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &recover, "Take over the terminals of a previous server", NULL },
   { NULL }
 };
 
+/* The fd holder starts us as soon as the previous server disconnects
+ * from it, which may be before the bus has noticed that it's gone.
+ */
+static void
+wait_for_name_release (const char *name)
+{
+  GDBusConnection *connection;
+  GVariant *reply;
+  gboolean has_owner;
+  guint i;
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+  if (connection == NULL)
+    return;
+
+  for (i = 0; i < RECOVER_WAIT_TRIES; i++) {
+    reply = g_dbus_connection_call_sync (connection,
+                                         "org.freedesktop.DBus",
+                                         "/org/freedesktop/DBus",
+                                         "org.freedesktop.DBus",
+                                         "NameHasOwner",
+                                         g_variant_new ("(s)", name),
+                                         G_VARIANT_TYPE ("(b)"),
+                                         G_DBUS_CALL_FLAGS_NONE,
+                                         -1, NULL, NULL);
+    if (reply == NULL)
+      break;
+
+    g_variant_get (reply, "(b)", &has_owner);
+    g_variant_unref (reply);
+    if (!has_owner)
+      break;
+
+    g_usleep (RECOVER_WAIT_INTERVAL);
+  }
+
+  g_object_unref (connection);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -79,6 +123,7 @@ main (int argc, char **argv)
   g_type_init ();
 
   _terminal_debug_init ();
+  _terminal_debug_perf_mark ("main");
 
   // FIXMEchpe: just use / here but make sure #565328 doesn't regress
   /* Change directory to $HOME so we don't prevent unmounting, e.g. if the
@@ -91,20 +136,29 @@ main (int argc, char **argv)
 
   g_set_application_name (_("Terminal"));
 
+  _terminal_debug_perf_begin ("gtk_init_with_args");
   if (!gtk_init_with_args (&argc, &argv, "", options, NULL, &error)) {
     g_printerr ("Failed to parse arguments: %s\n", error->message);
     g_error_free (error);
     exit (EXIT_FAILURE);
   }
+  _terminal_debug_perf_end ("gtk_init_with_args");
+
+  if (recover)
+    wait_for_name_release (app_id ? app_id : TERMINAL_APPLICATION_ID);
 
+  _terminal_debug_perf_begin ("terminal_app_new");
   app = terminal_app_new (app_id);
   g_free (app_id);
+  _terminal_debug_perf_end ("terminal_app_new");
 
+  _terminal_debug_perf_begin ("g_application_register");
   if (!g_application_register (app, NULL, &error)) {
     g_printerr ("Failed to register application: %s\n", error->message);
     g_error_free (error);
     goto out;
   }
+  _terminal_debug_perf_end ("g_application_register");
 
   if (g_application_get_is_remote (app)) {
     /* How the fuck did this happen? */
@@ -112,9 +166,14 @@ main (int argc, char **argv)
     goto out;
   }
 
+  terminal_app_connect_fd_holder (TERMINAL_APP (app));
+
   exit_code = g_application_run (app, 0, NULL);
 
 out:
+  /* In case startup never got as far as a terminal's first output */
+  _terminal_debug_perf_finish ();
+
   g_object_unref (app);
 
   return exit_code;
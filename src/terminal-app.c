@@ -38,20 +38,27 @@
 #include "terminal-debug.h"
 #include "terminal-app.h"
 #include "terminal-accels.h"
+#include "terminal-broker.h"
+#include "terminal-mdi-container.h"
 #include "terminal-screen.h"
 #include "terminal-screen-container.h"
 #include "terminal-window.h"
 #include "terminal-util.h"
+#include "terminal-watchdog.h"
 #include "profile-editor.h"
 #include "terminal-encoding.h"
 #include "terminal-schemas.h"
 #include "terminal-gdbus.h"
 #include "terminal-defines.h"
+#include "terminal-process-tracker.h"
+#include "terminal-processes-dialog.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #ifdef WITH_DCONF
 #include <dconf-client.h>
@@ -62,6 +69,22 @@
 
 #define SYSTEM_PROXY_SETTINGS_SCHEMA            "org.gnome.system.proxy"
 
+#define TIMER_WHEEL_RESOLUTION                  (250) /* ms */
+
+/* Even long-hidden terminals keep this much scrollback */
+#define SCROLLBACK_MIN_LINES                    (100)
+#define SCROLLBACK_REBALANCE_DELAY              (1000) /* ms */
+/* Headless terminals keep at most this much, budget or not */
+#define SCROLLBACK_HEADLESS_MAX_LINES           (10000)
+
+/* Under memory pressure, the scrollback budget is divided by this */
+#define MEMORY_PRESSURE_BUDGET_DIVISOR          (4)
+#define MEMORY_PRESSURE_FILE                    "/proc/pressure/memory"
+/* 150ms of stalls within 2s; unprivileged triggers need a 2s window */
+#define MEMORY_PRESSURE_TRIGGER                 "some 150000 2000000"
+#define MEMORY_PRESSURE_THRESHOLD               (10.0) /* % of "some avg10" */
+#define MEMORY_PRESSURE_POLL_INTERVAL           (10) /* s */
+
 /*
  * Session state is stored entirely in the RestartCommand command line.
  *
@@ -102,6 +125,26 @@ struct _TerminalApp
   GSettings *desktop_interface_settings;
   GSettings *system_proxy_settings;
 
+  TerminalProcessTracker *process_tracker;
+  TerminalRegistry *registry;
+  TerminalEvents *events;
+  TerminalTimerWheel *timer_wheel;
+
+  GList *headless_screens; /* owned */
+
+  TerminalHandover *handover;
+  TerminalBroker *broker; /* NULL in shards */
+  TerminalWatchdog *watchdog;
+  TerminalLatencyMonitor latency_monitor;
+  guint64 n_settings_changes;
+
+  guint scrollback_budget; /* lines, 0 for none */
+  guint scrollback_rebalance_id;
+  gboolean memory_pressure;
+  GIOChannel *memory_pressure_channel;
+  guint memory_pressure_watch_id;
+  guint memory_pressure_poll_id;
+
 #ifdef WITH_DCONF
   DConfClient *dconf_client;
 #endif
@@ -1090,6 +1133,479 @@ terminal_app_manage_profiles (TerminalApp     *app,
 #endif
 }
 
+/* Scrollback budget
+ *
+ * All terminals share the scrollback-budget. Each one is guaranteed
+ * SCROLLBACK_MIN_LINES, or an equal share if the budget doesn't cover that
+ * for all of them, and the rest is split up: terminals are ranked by when
+ * they were last visible, visible ones first, and each one in turn gets what
+ * its profile asks for, but at most half of what's left; the last one gets
+ * the rest. So the terminals the user looks at keep most of their history,
+ * long-hidden ones are trimmed down to the minimum, and all together never
+ * go over the budget.
+ * Headless terminals are never shown, and are capped even without a
+ * budget, so output keeps accumulating in a bounded buffer.
+ */
+
+/**
+ * terminal_app_list_screens:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer container): all screens of @app, in its windows
+ *   and headless
+ */
+GList *
+terminal_app_list_screens (TerminalApp *app)
+{
+  GList *windows, *l, *screens = NULL;
+
+  windows = gtk_application_get_windows (GTK_APPLICATION (app));
+  for (l = windows; l != NULL; l = l->next) {
+    TerminalMdiContainer *container;
+
+    if (!TERMINAL_IS_WINDOW (l->data))
+      continue;
+
+    container = TERMINAL_MDI_CONTAINER (terminal_window_get_mdi_container (TERMINAL_WINDOW (l->data)));
+    screens = g_list_concat (terminal_mdi_container_list_screens (container), screens);
+  }
+
+  return g_list_concat (screens, g_list_copy (app->headless_screens));
+}
+
+static int
+compare_screens_by_last_shown (gconstpointer a,
+                               gconstpointer b)
+{
+  gint64 ta = terminal_screen_get_last_shown ((TerminalScreen *) a);
+  gint64 tb = terminal_screen_get_last_shown ((TerminalScreen *) b);
+
+  /* Most recent first */
+  if (ta > tb)
+    return -1;
+  if (ta < tb)
+    return 1;
+  return 0;
+}
+
+static void
+terminal_app_rebalance_scrollback (TerminalApp *app)
+{
+  GList *screens, *l;
+  glong remaining, min_lines;
+  guint n_screens;
+
+  if (app->scrollback_rebalance_id != 0) {
+    terminal_timer_wheel_remove (app->timer_wheel, app->scrollback_rebalance_id);
+    app->scrollback_rebalance_id = 0;
+  }
+
+  screens = terminal_app_list_screens (app);
+
+  if (app->scrollback_budget == 0) {
+    for (l = screens; l != NULL; l = l->next)
+      _terminal_screen_set_scrollback_limit (TERMINAL_SCREEN (l->data),
+                                             g_list_find (app->headless_screens, l->data) ?
+                                               SCROLLBACK_HEADLESS_MAX_LINES : -1);
+    g_list_free (screens);
+    return;
+  }
+
+  remaining = app->scrollback_budget;
+  if (app->memory_pressure)
+    remaining /= MEMORY_PRESSURE_BUDGET_DIVISOR;
+
+  n_screens = g_list_length (screens);
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Distributing %ld scrollback lines over %u terminals%s\n",
+                         remaining, n_screens,
+                         app->memory_pressure ? " under memory pressure" : "");
+
+  /* Set the minimums aside first, so they come out of the budget */
+  if (n_screens > 0) {
+    min_lines = MIN (SCROLLBACK_MIN_LINES, remaining / (glong) n_screens);
+    remaining -= min_lines * (glong) n_screens;
+  } else
+    min_lines = 0;
+
+  screens = g_list_sort (screens, compare_screens_by_last_shown);
+  for (l = screens; l != NULL; l = l->next) {
+    TerminalScreen *screen = l->data;
+    glong wanted, share, extra;
+
+    wanted = terminal_screen_get_scrollback_lines (screen);
+    share = l->next != NULL ? remaining / 2 : remaining;
+
+    extra = wanted < 0 ? share : CLAMP (wanted - min_lines, 0, share);
+    if (g_list_find (app->headless_screens, screen))
+      extra = MIN (extra, MAX (0, SCROLLBACK_HEADLESS_MAX_LINES - min_lines));
+
+    _terminal_screen_set_scrollback_limit (screen, min_lines + extra);
+
+    remaining -= extra;
+  }
+
+  g_list_free (screens);
+}
+
+static void
+terminal_app_rebalance_scrollback_cb (TerminalApp *app)
+{
+  app->scrollback_rebalance_id = 0;
+  terminal_app_rebalance_scrollback (app);
+}
+
+static void
+terminal_app_set_memory_pressure (TerminalApp *app,
+                                  gboolean pressure)
+{
+  if (app->memory_pressure == pressure)
+    return;
+
+  app->memory_pressure = pressure;
+  terminal_app_rebalance_scrollback (app);
+}
+
+static gboolean
+read_memory_pressure (double *avg10)
+{
+  char *contents, *p;
+  gboolean retval = FALSE;
+
+  if (!g_file_get_contents (MEMORY_PRESSURE_FILE, &contents, NULL, NULL))
+    return FALSE;
+
+  if ((p = strstr (contents, "some avg10=")) != NULL) {
+    *avg10 = g_ascii_strtod (p + strlen ("some avg10="), NULL);
+    retval = TRUE;
+  }
+
+  g_free (contents);
+  return retval;
+}
+
+static gboolean
+terminal_app_memory_pressure_poll_cb (TerminalApp *app)
+{
+  double avg10;
+
+  if (!read_memory_pressure (&avg10)) {
+    app->memory_pressure_poll_id = 0;
+    return FALSE;
+  }
+
+  terminal_app_set_memory_pressure (app, avg10 >= MEMORY_PRESSURE_THRESHOLD);
+
+  /* With a trigger, we only need to poll to notice when the pressure is over */
+  if (app->memory_pressure_watch_id != 0 && !app->memory_pressure) {
+    app->memory_pressure_poll_id = 0;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+terminal_app_start_memory_pressure_poll (TerminalApp *app)
+{
+  if (app->memory_pressure_poll_id != 0)
+    return;
+
+  app->memory_pressure_poll_id = g_timeout_add_seconds (MEMORY_PRESSURE_POLL_INTERVAL,
+                                                        (GSourceFunc) terminal_app_memory_pressure_poll_cb,
+                                                        app);
+}
+
+static gboolean
+terminal_app_memory_pressure_trigger_cb (GIOChannel *channel,
+                                         GIOCondition condition,
+                                         TerminalApp *app)
+{
+  if (condition & G_IO_ERR) {
+    /* The trigger is gone; close it and fall back to polling */
+    app->memory_pressure_watch_id = 0;
+    g_io_channel_unref (app->memory_pressure_channel);
+    app->memory_pressure_channel = NULL;
+    terminal_app_start_memory_pressure_poll (app);
+    return FALSE;
+  }
+
+  terminal_app_set_memory_pressure (app, TRUE);
+  terminal_app_start_memory_pressure_poll (app);
+
+  return TRUE;
+}
+
+static void
+terminal_app_start_memory_pressure_monitor (TerminalApp *app)
+{
+  int fd;
+
+  if (app->memory_pressure_watch_id != 0 || app->memory_pressure_poll_id != 0)
+    return;
+
+  if (!g_file_test (MEMORY_PRESSURE_FILE, G_FILE_TEST_EXISTS))
+    return;
+
+  /* Prefer a PSI trigger, which only wakes us up when there is pressure */
+  fd = open (MEMORY_PRESSURE_FILE, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd != -1 &&
+      write (fd, MEMORY_PRESSURE_TRIGGER, strlen (MEMORY_PRESSURE_TRIGGER) + 1) < 0) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Failed to set up memory pressure trigger: %s\n",
+                           g_strerror (errno));
+    close (fd);
+    fd = -1;
+  }
+
+  if (fd == -1) {
+    terminal_app_start_memory_pressure_poll (app);
+    return;
+  }
+
+  app->memory_pressure_channel = g_io_channel_unix_new (fd);
+  g_io_channel_set_close_on_unref (app->memory_pressure_channel, TRUE);
+  app->memory_pressure_watch_id = g_io_add_watch (app->memory_pressure_channel,
+                                                  G_IO_PRI | G_IO_ERR,
+                                                  (GIOFunc) terminal_app_memory_pressure_trigger_cb,
+                                                  app);
+}
+
+static void
+terminal_app_stop_memory_pressure_monitor (TerminalApp *app)
+{
+  if (app->memory_pressure_watch_id != 0) {
+    g_source_remove (app->memory_pressure_watch_id);
+    app->memory_pressure_watch_id = 0;
+  }
+  if (app->memory_pressure_channel != NULL) {
+    g_io_channel_unref (app->memory_pressure_channel);
+    app->memory_pressure_channel = NULL;
+  }
+  if (app->memory_pressure_poll_id != 0) {
+    g_source_remove (app->memory_pressure_poll_id);
+    app->memory_pressure_poll_id = 0;
+  }
+
+  app->memory_pressure = FALSE;
+}
+
+static void
+terminal_app_scrollback_budget_notify_cb (GSettings   *settings,
+                                          const char  *key,
+                                          TerminalApp *app)
+{
+  app->scrollback_budget = g_settings_get_uint (settings, TERMINAL_SETTING_SCROLLBACK_BUDGET_KEY);
+
+  if (app->scrollback_budget > 0)
+    terminal_app_start_memory_pressure_monitor (app);
+  else
+    terminal_app_stop_memory_pressure_monitor (app);
+
+  terminal_app_rebalance_scrollback (app);
+}
+
+static void
+terminal_app_stall_threshold_notify_cb (GSettings   *settings,
+                                        const char  *key,
+                                        TerminalApp *app)
+{
+  guint threshold;
+
+  threshold = g_settings_get_uint (settings, TERMINAL_SETTING_STALL_THRESHOLD_KEY);
+
+  terminal_watchdog_free (app->watchdog);
+  app->watchdog = threshold > 0 ? terminal_watchdog_new (threshold) : NULL;
+}
+
+static void
+terminal_app_latency_monitor_notify_cb (GSettings   *settings,
+                                        const char  *key,
+                                        TerminalApp *app)
+{
+  GList *screens, *l;
+
+  app->latency_monitor = g_settings_get_enum (settings, TERMINAL_SETTING_LATENCY_MONITOR_KEY);
+
+  /* Show or hide the overlays */
+  screens = terminal_app_list_screens (app);
+  for (l = screens; l != NULL; l = l->next)
+    gtk_widget_queue_draw (GTK_WIDGET (l->data));
+  g_list_free (screens);
+}
+
+static void
+terminal_app_settings_changed_cb (GSettings   *settings,
+                                  const char  *key,
+                                  TerminalApp *app)
+{
+  terminal_app_count_settings_change (app);
+}
+
+/* Crash recovery and upgrades
+ *
+ * The fd holder keeps a copy of the PTY master of every terminal,
+ * and starts a new server that takes them over once this one goes
+ * away without releasing them.
+ */
+
+static void
+terminal_app_release_fd_holder (TerminalApp *app)
+{
+  GList *screens, *l;
+
+  if (app->handover == NULL)
+    return;
+
+  screens = terminal_app_list_screens (app);
+  for (l = screens; l != NULL; l = l->next)
+    terminal_screen_forget_deposit (TERMINAL_SCREEN (l->data));
+  g_list_free (screens);
+
+  terminal_handover_free (app->handover);
+  app->handover = NULL;
+}
+
+static gboolean
+terminal_app_ensure_fd_holder (TerminalApp *app,
+                               GError **error)
+{
+  GList *screens, *l;
+
+  if (app->handover != NULL)
+    return TRUE;
+
+  app->handover = terminal_handover_new (g_application_get_application_id (G_APPLICATION (app)),
+                                         TRUE, error);
+  if (app->handover == NULL)
+    return FALSE;
+
+  screens = terminal_app_list_screens (app);
+  for (l = screens; l != NULL; l = l->next)
+    terminal_screen_deposit (TERMINAL_SCREEN (l->data), NULL, FALSE);
+  g_list_free (screens);
+
+  return TRUE;
+}
+
+static void
+terminal_app_crash_recovery_notify_cb (GSettings   *settings,
+                                       const char  *key,
+                                       TerminalApp *app)
+{
+  GError *error = NULL;
+
+  if (!g_settings_get_boolean (settings, TERMINAL_SETTING_CRASH_RECOVERY_KEY)) {
+    terminal_app_release_fd_holder (app);
+    return;
+  }
+
+  if (!terminal_app_ensure_fd_holder (app, &error)) {
+    g_printerr ("Failed to start the fd holder: %s\n", error->message);
+    g_error_free (error);
+  }
+}
+
+static int
+compare_handover_entries (gconstpointer a,
+                          gconstpointer b)
+{
+  GVariant *sa = ((const TerminalHandoverEntry *) a)->state;
+  GVariant *sb = ((const TerminalHandoverEntry *) b)->state;
+  guint32 wa = 0, wb = 0;
+  gint32 pa = 0, pb = 0;
+
+  g_variant_lookup (sa, "window", "u", &wa);
+  g_variant_lookup (sb, "window", "u", &wb);
+  if (wa != wb)
+    return wa < wb ? -1 : 1;
+
+  g_variant_lookup (sa, "position", "i", &pa);
+  g_variant_lookup (sb, "position", "i", &pb);
+  return pa - pb;
+}
+
+static TerminalWindow *
+terminal_app_get_restored_window (TerminalApp *app,
+                                  GVariant *state,
+                                  GHashTable *windows)
+{
+  TerminalWindow *window;
+  guint32 id = 0;
+  const char *role;
+  gboolean maximized, fullscreen;
+
+  /* Terminals recovered from a crash have no layout, and share a window */
+  g_variant_lookup (state, "window", "u", &id);
+
+  window = g_hash_table_lookup (windows, GUINT_TO_POINTER (id));
+  if (window != NULL)
+    return window;
+
+  window = terminal_app_new_window (app, NULL);
+  g_hash_table_insert (windows, GUINT_TO_POINTER (id), window);
+
+  if (g_variant_lookup (state, "role", "&s", &role))
+    gtk_window_set_role (GTK_WINDOW (window), role);
+  if (g_variant_lookup (state, "fullscreen", "b", &fullscreen) && fullscreen)
+    gtk_window_fullscreen (GTK_WINDOW (window));
+  if (g_variant_lookup (state, "maximized", "b", &maximized) && maximized)
+    gtk_window_maximize (GTK_WINDOW (window));
+
+  return window;
+}
+
+static gboolean
+terminal_app_restore_screen (TerminalApp *app,
+                             TerminalHandoverEntry *entry,
+                             GHashTable *windows,
+                             GError **error)
+{
+  TerminalWindow *window = NULL;
+  TerminalScreen *screen;
+  GSettings *profile;
+  const char *profile_name, *title, *cwd;
+  gboolean headless, active;
+  double zoom;
+  char *object_path;
+
+  if (!g_variant_lookup (entry->state, "profile", "&s", &profile_name))
+    profile_name = NULL;
+  if (!g_variant_lookup (entry->state, "title", "&s", &title))
+    title = NULL;
+  if (!g_variant_lookup (entry->state, "cwd", "^&ay", &cwd))
+    cwd = NULL;
+  if (!g_variant_lookup (entry->state, "zoom", "d", &zoom))
+    zoom = 1.0;
+
+  profile = terminal_app_get_profile (app, profile_name);
+  screen = terminal_screen_new (profile, NULL, title, cwd, NULL, zoom);
+  g_object_unref (profile);
+
+  g_object_ref_sink (screen);
+  if (!terminal_screen_adopt (screen, entry->state, entry->fd_list, entry->key, error)) {
+    gtk_widget_destroy (GTK_WIDGET (screen));
+    g_object_unref (screen);
+    return FALSE;
+  }
+
+  if (g_variant_lookup (entry->state, "headless", "b", &headless) && headless) {
+    terminal_app_add_headless_screen (app, screen);
+  } else {
+    window = terminal_app_get_restored_window (app, entry->state, windows);
+    terminal_window_add_screen (window, screen, -1);
+    if (!g_variant_lookup (entry->state, "active", "b", &active) || active)
+      terminal_window_switch_screen (window, screen);
+  }
+
+  object_path = terminal_factory_impl_export_screen (screen, window);
+  g_free (object_path);
+  g_object_unref (screen);
+
+  return TRUE;
+}
+
 /* App menu callbacks */
 
 static void
@@ -1174,8 +1690,12 @@ terminal_app_startup (GApplication *application)
 static void
 terminal_app_init (TerminalApp *app)
 {
+  _terminal_debug_perf_begin ("terminal_app_init");
+
   gtk_window_set_default_icon_name (GNOME_TERMINAL_ICON_NAME);
 
+  _terminal_debug_perf_begin ("settings");
+
   /* Desktop proxy settings */
   app->system_proxy_settings = g_settings_new (SYSTEM_PROXY_SETTINGS_SCHEMA);
 
@@ -1185,7 +1705,11 @@ terminal_app_init (TerminalApp *app)
   /* Terminal global settings */
   app->global_settings = g_settings_new (TERMINAL_SETTING_SCHEMA);
 
+  _terminal_debug_perf_end ("settings");
+
+  _terminal_debug_perf_begin ("terminal_encodings_get_builtins");
   app->encodings = terminal_encodings_get_builtins ();
+  _terminal_debug_perf_end ("terminal_encodings_get_builtins");
   terminal_app_encoding_list_notify_cb (app->global_settings, "encodings", app);
   g_signal_connect (app->global_settings,
                     "changed::encodings",
@@ -1202,7 +1726,9 @@ terminal_app_init (TerminalApp *app)
   backend = g_settings_backend_get_default ();
   if (strcmp (G_OBJECT_TYPE_NAME (backend), "DConfSettingsBackend") == 0) {
     app->dconf_client = dconf_client_new (NULL, NULL, NULL, NULL);
+    _terminal_debug_perf_begin ("terminal_app_dconf_get_profile_list");
     terminal_app_dconf_get_profile_list (app);
+    _terminal_debug_perf_end ("terminal_app_dconf_get_profile_list");
   }
   g_object_unref (backend);
 }
@@ -1218,7 +1744,41 @@ terminal_app_init (TerminalApp *app)
 
   terminal_app_ensure_any_profiles (app);
 
+  app->process_tracker = terminal_process_tracker_new ();
+  app->events = terminal_events_new ();
+  app->registry = terminal_registry_new (app->process_tracker, app->events);
+  app->timer_wheel = terminal_timer_wheel_new (TIMER_WHEEL_RESOLUTION);
+
+  terminal_app_scrollback_budget_notify_cb (app->global_settings, TERMINAL_SETTING_SCROLLBACK_BUDGET_KEY, app);
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_SCROLLBACK_BUDGET_KEY,
+                    G_CALLBACK (terminal_app_scrollback_budget_notify_cb),
+                    app);
+
+  terminal_app_stall_threshold_notify_cb (app->global_settings, TERMINAL_SETTING_STALL_THRESHOLD_KEY, app);
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_STALL_THRESHOLD_KEY,
+                    G_CALLBACK (terminal_app_stall_threshold_notify_cb),
+                    app);
+
+  terminal_app_latency_monitor_notify_cb (app->global_settings, TERMINAL_SETTING_LATENCY_MONITOR_KEY, app);
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_LATENCY_MONITOR_KEY,
+                    G_CALLBACK (terminal_app_latency_monitor_notify_cb),
+                    app);
+
+  g_signal_connect (app->global_settings, "changed",
+                    G_CALLBACK (terminal_app_settings_changed_cb), app);
+  g_signal_connect (app->desktop_interface_settings, "changed",
+                    G_CALLBACK (terminal_app_settings_changed_cb), app);
+  g_signal_connect (app->system_proxy_settings, "changed",
+                    G_CALLBACK (terminal_app_settings_changed_cb), app);
+
+  _terminal_debug_perf_begin ("terminal_accels_init");
   terminal_accels_init ();
+  _terminal_debug_perf_end ("terminal_accels_init");
+
+  _terminal_debug_perf_end ("terminal_app_init");
 }
 
 static void
@@ -1234,6 +1794,30 @@ terminal_app_finalize (GObject *object)
   g_signal_handlers_disconnect_by_func (app->global_settings,
                                         G_CALLBACK (terminal_app_encoding_list_notify_cb),
                                         app);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_scrollback_budget_notify_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_crash_recovery_notify_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_stall_threshold_notify_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_latency_monitor_notify_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->global_settings,
+                                        G_CALLBACK (terminal_app_settings_changed_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->desktop_interface_settings,
+                                        G_CALLBACK (terminal_app_settings_changed_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (app->system_proxy_settings,
+                                        G_CALLBACK (terminal_app_settings_changed_cb),
+                                        app);
+  terminal_watchdog_free (app->watchdog);
+  terminal_handover_free (app->handover);
+  terminal_app_stop_memory_pressure_monitor (app);
 
   g_hash_table_destroy (app->profiles);
 #if 0
@@ -1247,6 +1831,11 @@ terminal_app_finalize (GObject *object)
   g_object_unref (app->desktop_interface_settings);
   g_object_unref (app->system_proxy_settings);
 
+  terminal_registry_free (app->registry);
+  terminal_events_free (app->events);
+  g_object_unref (app->process_tracker);
+  terminal_timer_wheel_free (app->timer_wheel);
+
   terminal_accels_shutdown ();
 
   G_OBJECT_CLASS (terminal_app_parent_class)->finalize (object);
@@ -1261,6 +1850,7 @@ terminal_app_dbus_register (GApplication    *application,
   TerminalApp *app = TERMINAL_APP (application);
   TerminalObjectSkeleton *object;
   TerminalFactory *factory;
+  TerminalStats *stats;
 
   if (!G_APPLICATION_CLASS (terminal_app_parent_class)->dbus_register (application,
                                                                        connection,
@@ -1272,6 +1862,9 @@ terminal_app_dbus_register (GApplication    *application,
   factory = terminal_factory_impl_new ();
   terminal_object_skeleton_set_factory (object, factory);
   g_object_unref (factory);
+  stats = terminal_stats_impl_new ();
+  terminal_object_skeleton_set_stats (object, stats);
+  g_object_unref (stats);
 
   app->object_manager = g_dbus_object_manager_server_new (TERMINAL_OBJECT_PATH_PREFIX);
   g_dbus_object_manager_server_export (app->object_manager, G_DBUS_OBJECT_SKELETON (object));
@@ -1279,6 +1872,11 @@ terminal_app_dbus_register (GApplication    *application,
 
   /* And export the object */
   g_dbus_object_manager_server_set_connection (app->object_manager, connection);
+
+  if (!terminal_broker_is_shard (g_application_get_application_id (application)))
+    app->broker = terminal_broker_new (connection,
+                                       g_application_get_application_id (application));
+
   return TRUE;
 }
 
@@ -1289,6 +1887,9 @@ terminal_app_dbus_unregister (GApplication    *application,
 {
   TerminalApp *app = TERMINAL_APP (application);
 
+  terminal_broker_free (app->broker);
+  app->broker = NULL;
+
   if (app->object_manager) {
     g_dbus_object_manager_server_unexport (app->object_manager, TERMINAL_FACTORY_OBJECT_PATH);
     g_object_unref (app->object_manager);
@@ -1381,6 +1982,10 @@ terminal_app_new_terminal (TerminalApp     *app,
   terminal_window_switch_screen (window, screen);
   gtk_widget_grab_focus (GTK_WIDGET (screen));
 
+  /* So D-Bus clients can find it too */
+  if (app->object_manager != NULL)
+    g_free (terminal_factory_impl_export_screen (screen, window));
+
   /* Launch the child on idle */
   _terminal_screen_launch_child_on_idle (screen);
 
@@ -1410,6 +2015,13 @@ terminal_app_edit_encodings (TerminalApp     *app,
   terminal_encoding_dialog_show (transient_parent);
 }
 
+void
+terminal_app_show_processes (TerminalApp     *app,
+                             GtkWindow       *transient_parent)
+{
+  terminal_processes_dialog_show (transient_parent);
+}
+
 /**
  * terminal_profile_get_list:
  *
@@ -1624,3 +2236,390 @@ terminal_app_get_object_manager (TerminalApp *app)
   g_warn_if_fail (app->object_manager != NULL);
   return app->object_manager;
 }
+
+/**
+ * terminal_app_get_process_tracker:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the #TerminalProcessTracker shared by all screens
+ */
+TerminalProcessTracker *
+terminal_app_get_process_tracker (TerminalApp *app)
+{
+  return app->process_tracker;
+}
+
+/**
+ * terminal_app_get_registry:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the #TerminalRegistry of exported terminals
+ */
+TerminalRegistry *
+terminal_app_get_registry (TerminalApp *app)
+{
+  return app->registry;
+}
+
+/**
+ * terminal_app_get_events:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the #TerminalEvents with the event subscriptions
+ */
+TerminalEvents *
+terminal_app_get_events (TerminalApp *app)
+{
+  return app->events;
+}
+
+/**
+ * terminal_app_get_timer_wheel:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the #TerminalTimerWheel shared by all screens,
+ *   for coarse per-screen timeouts
+ */
+TerminalTimerWheel *
+terminal_app_get_timer_wheel (TerminalApp *app)
+{
+  return app->timer_wheel;
+}
+
+static void
+terminal_app_headless_screen_close_cb (TerminalScreen *screen,
+                                       TerminalApp *app)
+{
+  gtk_widget_destroy (GTK_WIDGET (screen));
+}
+
+static void
+terminal_app_headless_screen_destroy_cb (TerminalScreen *screen,
+                                         TerminalApp *app)
+{
+  terminal_app_remove_headless_screen (app, screen);
+}
+
+/**
+ * terminal_app_add_headless_screen:
+ * @app: a #TerminalApp
+ * @screen: a #TerminalScreen that isn't in any window
+ *
+ * Keeps @screen and its child alive without a window. The screen is
+ * never realized, so its output costs no layout or drawing; it only
+ * fills the scrollback, which is capped. The server keeps running as
+ * long as there are headless screens.
+ */
+void
+terminal_app_add_headless_screen (TerminalApp *app,
+                                  TerminalScreen *screen)
+{
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  g_return_if_fail (gtk_widget_get_parent (GTK_WIDGET (screen)) == NULL);
+  g_return_if_fail (g_list_find (app->headless_screens, screen) == NULL);
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] now headless\n",
+                         screen);
+
+  app->headless_screens = g_list_prepend (app->headless_screens, g_object_ref_sink (screen));
+
+  g_signal_connect (screen, "close-screen",
+                    G_CALLBACK (terminal_app_headless_screen_close_cb), app);
+  g_signal_connect (screen, "destroy",
+                    G_CALLBACK (terminal_app_headless_screen_destroy_cb), app);
+
+  g_application_hold (G_APPLICATION (app));
+
+  terminal_app_rebalance_scrollback (app);
+}
+
+/**
+ * terminal_app_remove_headless_screen:
+ * @app: a #TerminalApp
+ * @screen: a #TerminalScreen
+ *
+ * Drops @app's reference to @screen if it is headless, e.g. before
+ * adding it to a window. Callers that want to keep @screen need to
+ * hold a reference of their own.
+ *
+ * Returns: %TRUE if @screen was headless
+ */
+gboolean
+terminal_app_remove_headless_screen (TerminalApp *app,
+                                     TerminalScreen *screen)
+{
+  GList *l;
+
+  l = g_list_find (app->headless_screens, screen);
+  if (l == NULL)
+    return FALSE;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] no longer headless\n",
+                         screen);
+
+  app->headless_screens = g_list_delete_link (app->headless_screens, l);
+
+  g_signal_handlers_disconnect_by_func (screen,
+                                        G_CALLBACK (terminal_app_headless_screen_close_cb),
+                                        app);
+  g_signal_handlers_disconnect_by_func (screen,
+                                        G_CALLBACK (terminal_app_headless_screen_destroy_cb),
+                                        app);
+
+  /* Lift the headless cap; the budget catches up on the next rebalance */
+  _terminal_screen_set_scrollback_limit (screen, -1);
+  terminal_app_queue_scrollback_rebalance (app);
+
+  g_object_unref (screen);
+  g_application_release (G_APPLICATION (app));
+
+  return TRUE;
+}
+
+/**
+ * terminal_app_queue_scrollback_rebalance:
+ * @app: a #TerminalApp
+ *
+ * Schedules redistributing the scrollback budget among all terminals,
+ * e.g. because a terminal was shown, hidden, or changed its profile.
+ * Does nothing when there is no budget.
+ */
+void
+terminal_app_queue_scrollback_rebalance (TerminalApp *app)
+{
+  if (app->scrollback_budget == 0 || app->scrollback_rebalance_id != 0)
+    return;
+
+  app->scrollback_rebalance_id = terminal_timer_wheel_add (app->timer_wheel,
+                                                           SCROLLBACK_REBALANCE_DELAY,
+                                                           (TerminalTimerFunc) terminal_app_rebalance_scrollback_cb,
+                                                           app);
+}
+
+/**
+ * terminal_app_get_broker:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the broker that spreads new terminals
+ *   across servers, or %NULL if @app is itself a shard
+ */
+TerminalBroker *
+terminal_app_get_broker (TerminalApp *app)
+{
+  return app->broker;
+}
+
+/**
+ * terminal_app_get_watchdog:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the main loop stall watchdog, or %NULL if
+ *   it isn't enabled
+ */
+TerminalWatchdog *
+terminal_app_get_watchdog (TerminalApp *app)
+{
+  return app->watchdog;
+}
+
+/**
+ * terminal_app_get_latency_monitor:
+ * @app: a #TerminalApp
+ *
+ * Returns: whether terminals measure keystroke latency, and whether
+ *   they show it
+ */
+TerminalLatencyMonitor
+terminal_app_get_latency_monitor (TerminalApp *app)
+{
+  return app->latency_monitor;
+}
+
+/**
+ * terminal_app_count_settings_change:
+ * @app: a #TerminalApp
+ *
+ * Counts a settings change handled by @app or one of its terminals.
+ */
+void
+terminal_app_count_settings_change (TerminalApp *app)
+{
+  app->n_settings_changes++;
+}
+
+/**
+ * terminal_app_get_n_settings_changes:
+ * @app: a #TerminalApp
+ *
+ * Returns: the number of settings changes handled since @app started
+ */
+guint64
+terminal_app_get_n_settings_changes (TerminalApp *app)
+{
+  return app->n_settings_changes;
+}
+
+/**
+ * terminal_app_get_handover:
+ * @app: a #TerminalApp
+ *
+ * Returns: (transfer none): the connection to the fd holder, or %NULL
+ *   if there is none
+ */
+TerminalHandover *
+terminal_app_get_handover (TerminalApp *app)
+{
+  return app->handover;
+}
+
+/**
+ * terminal_app_connect_fd_holder:
+ * @app: a #TerminalApp
+ *
+ * Connects to the fd holder, starting one if crash recovery is enabled,
+ * and takes over the terminals it holds. To be called once @app owns
+ * its bus name.
+ */
+void
+terminal_app_connect_fd_holder (TerminalApp *app)
+{
+  GHashTable *windows;
+  GHashTableIter iter;
+  GList *entries, *l;
+  gpointer window;
+  gboolean enabled;
+  GError *error = NULL;
+
+  enabled = g_settings_get_boolean (app->global_settings, TERMINAL_SETTING_CRASH_RECOVERY_KEY);
+  g_signal_connect (app->global_settings,
+                    "changed::" TERMINAL_SETTING_CRASH_RECOVERY_KEY,
+                    G_CALLBACK (terminal_app_crash_recovery_notify_cb),
+                    app);
+
+  app->handover = terminal_handover_new (g_application_get_application_id (G_APPLICATION (app)),
+                                         enabled, &error);
+  if (app->handover == NULL) {
+    /* Not having a holder to connect to is the normal case */
+    if (enabled)
+      g_printerr ("Failed to start the fd holder: %s\n", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  entries = terminal_handover_retrieve (app->handover, &error);
+  if (error != NULL) {
+    g_printerr ("Failed to retrieve terminals from the fd holder: %s\n", error->message);
+    g_clear_error (&error);
+  }
+
+  entries = g_list_sort (entries, compare_handover_entries);
+  windows = g_hash_table_new (NULL, NULL);
+
+  for (l = entries; l != NULL; l = l->next) {
+    TerminalHandoverEntry *entry = l->data;
+
+    if (terminal_app_restore_screen (app, entry, windows, &error))
+      continue;
+
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Failed to take over terminal %u: %s\n",
+                           entry->key, error->message);
+    g_clear_error (&error);
+    terminal_handover_forget (app->handover, entry->key);
+  }
+
+  g_hash_table_iter_init (&iter, windows);
+  while (g_hash_table_iter_next (&iter, NULL, &window))
+    gtk_window_present (GTK_WINDOW (window));
+
+  g_hash_table_destroy (windows);
+  g_list_free_full (entries, (GDestroyNotify) terminal_handover_entry_free);
+
+  /* The holder was only around for an upgrade */
+  if (!enabled)
+    terminal_app_release_fd_holder (app);
+}
+
+/**
+ * terminal_app_upgrade:
+ * @app: a #TerminalApp
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Hands all terminals, with their layout and contents, to the fd holder
+ * so that a new server started by it takes them over once @app exits.
+ *
+ * Returns: %TRUE if all terminals with a child were handed over
+ */
+gboolean
+terminal_app_upgrade (TerminalApp *app,
+                      GError **error)
+{
+  GList *windows, *l, *screens, *s;
+  GVariantBuilder builder;
+  GVariant *layout;
+  guint n_failed = 0;
+
+  if (!terminal_app_ensure_fd_holder (app, error))
+    return FALSE;
+
+  windows = gtk_application_get_windows (GTK_APPLICATION (app));
+  for (l = windows; l != NULL; l = l->next) {
+    TerminalWindow *window;
+    TerminalScreen *active;
+    GdkWindowState state = 0;
+    const char *role;
+    int position = 0;
+
+    if (!TERMINAL_IS_WINDOW (l->data))
+      continue;
+
+    window = TERMINAL_WINDOW (l->data);
+    active = terminal_window_get_active (window);
+    role = gtk_window_get_role (GTK_WINDOW (window));
+    if (gtk_widget_get_realized (GTK_WIDGET (window)))
+      state = gdk_window_get_state (gtk_widget_get_window (GTK_WIDGET (window)));
+
+    screens = terminal_mdi_container_list_screens (TERMINAL_MDI_CONTAINER (terminal_window_get_mdi_container (window)));
+    for (s = screens; s != NULL; s = s->next) {
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+      g_variant_builder_add (&builder, "{sv}", "window",
+                             g_variant_new_uint32 (gtk_application_window_get_id (GTK_APPLICATION_WINDOW (window))));
+      g_variant_builder_add (&builder, "{sv}", "position", g_variant_new_int32 (position++));
+      g_variant_builder_add (&builder, "{sv}", "active", g_variant_new_boolean (s->data == active));
+      g_variant_builder_add (&builder, "{sv}", "maximized",
+                             g_variant_new_boolean ((state & GDK_WINDOW_STATE_MAXIMIZED) != 0));
+      g_variant_builder_add (&builder, "{sv}", "fullscreen",
+                             g_variant_new_boolean ((state & GDK_WINDOW_STATE_FULLSCREEN) != 0));
+      if (role != NULL)
+        g_variant_builder_add (&builder, "{sv}", "role", g_variant_new_string (role));
+      layout = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+      if (terminal_screen_get_pty_fd (s->data) != -1 &&
+          !terminal_screen_deposit (s->data, layout, TRUE))
+        n_failed++;
+      g_variant_unref (layout);
+    }
+    g_list_free (screens);
+  }
+
+  for (l = app->headless_screens; l != NULL; l = l->next) {
+    g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&builder, "{sv}", "headless", g_variant_new_boolean (TRUE));
+    layout = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+    if (terminal_screen_get_pty_fd (l->data) != -1 &&
+        !terminal_screen_deposit (l->data, layout, TRUE))
+      n_failed++;
+    g_variant_unref (layout);
+  }
+
+  if (n_failed > 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 "Failed to hand over %u terminals", n_failed);
+    return FALSE;
+  }
+
+  return TRUE;
+}
@@ -23,7 +23,13 @@
 
 #include <gtk/gtk.h>
 
+#include "terminal-broker.h"
 #include "terminal-encoding.h"
+#include "terminal-handover.h"
+#include "terminal-process-tracker.h"
+#include "terminal-registry.h"
+#include "terminal-timer-wheel.h"
+#include "terminal-watchdog.h"
 #include "terminal-screen.h"
 
 G_BEGIN_DECLS
@@ -82,6 +88,8 @@ void terminal_app_edit_keybindings (TerminalApp     *app,
                                     GtkWindow       *transient_parent);
 void terminal_app_edit_encodings   (TerminalApp     *app,
                                     GtkWindow       *transient_parent);
+void terminal_app_show_processes   (TerminalApp     *app,
+                                    GtkWindow       *transient_parent);
 
 GList* terminal_app_get_profile_list (TerminalApp *app);
 
@@ -111,6 +119,41 @@ GSettings *terminal_app_get_proxy_settings (TerminalApp *app);
 
 PangoFontDescription *terminal_app_get_system_font (TerminalApp *app);
 
+TerminalProcessTracker *terminal_app_get_process_tracker (TerminalApp *app);
+
+TerminalRegistry *terminal_app_get_registry (TerminalApp *app);
+
+TerminalEvents *terminal_app_get_events (TerminalApp *app);
+
+TerminalTimerWheel *terminal_app_get_timer_wheel (TerminalApp *app);
+
+void terminal_app_queue_scrollback_rebalance (TerminalApp *app);
+
+void terminal_app_add_headless_screen (TerminalApp *app,
+                                       TerminalScreen *screen);
+
+gboolean terminal_app_remove_headless_screen (TerminalApp *app,
+                                              TerminalScreen *screen);
+
+GList *terminal_app_list_screens (TerminalApp *app);
+
+TerminalBroker *terminal_app_get_broker (TerminalApp *app);
+
+TerminalHandover *terminal_app_get_handover (TerminalApp *app);
+
+TerminalWatchdog *terminal_app_get_watchdog (TerminalApp *app);
+
+TerminalLatencyMonitor terminal_app_get_latency_monitor (TerminalApp *app);
+
+void terminal_app_count_settings_change (TerminalApp *app);
+
+guint64 terminal_app_get_n_settings_changes (TerminalApp *app);
+
+void terminal_app_connect_fd_holder (TerminalApp *app);
+
+gboolean terminal_app_upgrade (TerminalApp *app,
+                               GError **error);
+
 G_END_DECLS
 
 #endif /* !TERMINAL_APP_H */
@@ -0,0 +1,701 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-broker.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "terminal-app.h"
+#include "terminal-debug.h"
+#include "terminal-defines.h"
+#include "terminal-enums.h"
+#include "terminal-gdbus-generated.h"
+#include "terminal-schemas.h"
+
+/* Sharding windows across servers
+ *
+ * With shard-count > 1, the server that owns the application ID hands
+ * some of the terminals it is asked to create to other servers, so that
+ * a terminal that stalls its server only stalls the windows of that one.
+ * Shard 0 is this server; shard N is a gnome-terminal-server running as
+ * "<app-id>.ShardN", started on demand.
+ *
+ * Clients only ever talk to the application ID. A terminal created on a
+ * shard is exported here under a path of our own, which forwards method
+ * calls and signals to and from the shard. Window IDs in those paths
+ * carry the shard in their top bits, so that a new tab for one of its
+ * windows goes to the same shard.
+ */
+
+#define SHARD_SUFFIX          ".Shard"
+#define SHARD_START_TIMEOUT   (10) /* s */
+#define SHARD_WINDOW_ID_SHIFT (24)
+#define SHARD_WINDOW_ID_MASK  ((1U << SHARD_WINDOW_ID_SHIFT) - 1)
+#define MAX_SHARDS            (16)
+
+typedef struct _Shard Shard;
+
+struct _Shard
+{
+  TerminalBroker *broker;
+  guint index;
+  char *name;
+  char *owner; /* unique name, or NULL while the shard isn't running */
+  guint watch_id;
+  guint removed_id;
+  GList *pending; /* of PendingCall, until the shard is running */
+  guint start_timeout_id;
+};
+
+typedef struct
+{
+  Shard *shard;
+  GDBusMethodInvocation *invocation; /* owned until returned */
+  GVariant *options;
+} PendingCall;
+
+typedef struct
+{
+  Shard *shard;
+  char *path;
+  char *remote_path;
+  guint registration_id;
+  guint signal_id;
+} Forward;
+
+struct _TerminalBroker
+{
+  GDBusConnection *connection;
+  GCancellable *cancellable;
+  char *app_id;
+  Shard *shards[MAX_SHARDS]; /* [0] is us */
+  GHashTable *forwards; /* our path → Forward */
+  guint next_shard;
+};
+
+static void terminal_broker_forward_create_instance (Shard *shard,
+                                                     PendingCall *call);
+
+static void
+pending_call_free (PendingCall *call)
+{
+  g_variant_unref (call->options);
+  g_slice_free (PendingCall, call);
+}
+
+/* Returns @error to the caller as the shard reported it */
+static void
+return_error (GDBusMethodInvocation *invocation,
+              GError *error)
+{
+  char *name;
+
+  name = g_dbus_error_get_remote_error (error);
+  if (name == NULL) {
+    g_dbus_method_invocation_take_error (invocation, error);
+    return;
+  }
+
+  g_dbus_error_strip_remote_error (error);
+  g_dbus_method_invocation_return_dbus_error (invocation, name, error->message);
+  g_free (name);
+  g_error_free (error);
+}
+
+static void
+shard_fail_pending (Shard *shard,
+                    const GError *error)
+{
+  GList *l;
+
+  for (l = shard->pending; l != NULL; l = l->next) {
+    PendingCall *call = l->data;
+
+    g_dbus_method_invocation_return_gerror (call->invocation, error);
+    pending_call_free (call);
+  }
+  g_list_free (shard->pending);
+  shard->pending = NULL;
+}
+
+/* Forwarded terminals */
+
+static void
+forward_free (Forward *forward)
+{
+  GDBusConnection *connection = forward->shard->broker->connection;
+
+  _terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+                         "Unexporting %s for %s on %s\n",
+                         forward->path, forward->remote_path, forward->shard->name);
+
+  g_dbus_connection_unregister_object (connection, forward->registration_id);
+  g_dbus_connection_signal_unsubscribe (connection, forward->signal_id);
+  g_free (forward->path);
+  g_free (forward->remote_path);
+  g_slice_free (Forward, forward);
+
+  g_application_release (G_APPLICATION (terminal_app_get ()));
+}
+
+static void
+forward_reply_cb (GDBusConnection *connection,
+                  GAsyncResult *result,
+                  GDBusMethodInvocation *invocation)
+{
+  GUnixFDList *fd_list = NULL;
+  GVariant *reply;
+  GError *error = NULL;
+
+  reply = g_dbus_connection_call_with_unix_fd_list_finish (connection, &fd_list, result, &error);
+  if (reply == NULL) {
+    return_error (invocation, error);
+    return;
+  }
+
+  g_dbus_method_invocation_return_value_with_unix_fd_list (invocation, reply, fd_list);
+  g_variant_unref (reply);
+  if (fd_list != NULL)
+    g_object_unref (fd_list);
+}
+
+static void
+forward_method_call (GDBusConnection *connection,
+                     const char *sender,
+                     const char *object_path,
+                     const char *interface_name,
+                     const char *method_name,
+                     GVariant *parameters,
+                     GDBusMethodInvocation *invocation,
+                     Forward *forward)
+{
+  GDBusMessage *message;
+
+  message = g_dbus_method_invocation_get_message (invocation);
+  g_dbus_connection_call_with_unix_fd_list (connection,
+                                            forward->shard->name,
+                                            forward->remote_path,
+                                            interface_name,
+                                            method_name,
+                                            parameters,
+                                            NULL,
+                                            G_DBUS_CALL_FLAGS_NONE,
+                                            -1,
+                                            g_dbus_message_get_unix_fd_list (message),
+                                            forward->shard->broker->cancellable,
+                                            (GAsyncReadyCallback) forward_reply_cb,
+                                            invocation);
+}
+
+static const GDBusInterfaceVTable forward_vtable = {
+  (GDBusInterfaceMethodCallFunc) forward_method_call,
+  NULL,
+  NULL
+};
+
+static void
+forward_signal_cb (GDBusConnection *connection,
+                   const char *sender_name,
+                   const char *object_path,
+                   const char *interface_name,
+                   const char *signal_name,
+                   GVariant *parameters,
+                   Forward *forward)
+{
+  g_dbus_connection_emit_signal (connection, NULL, forward->path,
+                                 interface_name, signal_name,
+                                 parameters, NULL);
+}
+
+/* Maps the path of a terminal on @shard to ours */
+static char *
+shard_translate_path (Shard *shard,
+                      const char *remote_path)
+{
+  const char *suffix;
+  guint window_id, n;
+
+  if (!g_str_has_prefix (remote_path, TERMINAL_RECEIVER_OBJECT_PATH_PREFIX "/"))
+    return NULL;
+
+  suffix = remote_path + strlen (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX);
+
+  /* gnome-terminal picks the window ID out of the path for further tabs */
+  if (sscanf (suffix, "/window/%u/terminal/%u", &window_id, &n) == 2 &&
+      window_id <= SHARD_WINDOW_ID_MASK)
+    return g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX "/window/%u/terminal/%u",
+                            (shard->index << SHARD_WINDOW_ID_SHIFT) | window_id, n);
+
+  return g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX "/shard/%u%s",
+                          shard->index, suffix);
+}
+
+static char *
+shard_export (Shard *shard,
+              const char *remote_path,
+              GError **error)
+{
+  TerminalBroker *broker = shard->broker;
+  Forward *forward;
+  char *path;
+
+  path = shard_translate_path (shard, remote_path);
+  if (path == NULL) {
+    g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                 "Unexpected terminal %s from %s", remote_path, shard->name);
+    return NULL;
+  }
+
+  if (g_hash_table_lookup (broker->forwards, path) != NULL)
+    return path;
+
+  forward = g_slice_new0 (Forward);
+  forward->shard = shard;
+  forward->path = path;
+  forward->remote_path = g_strdup (remote_path);
+
+  forward->registration_id =
+    g_dbus_connection_register_object (broker->connection,
+                                       path,
+                                       terminal_receiver_interface_info (),
+                                       &forward_vtable,
+                                       forward, NULL,
+                                       error);
+  if (forward->registration_id == 0) {
+    g_free (forward->remote_path);
+    g_slice_free (Forward, forward);
+    g_free (path);
+    return NULL;
+  }
+
+  forward->signal_id =
+    g_dbus_connection_signal_subscribe (broker->connection,
+                                        shard->name,
+                                        TEMRINAL_RECEIVER_INTERFACE_NAME,
+                                        NULL /* all signals */,
+                                        remote_path,
+                                        NULL,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        (GDBusSignalCallback) forward_signal_cb,
+                                        forward, NULL);
+
+  /* Callers may wait for ChildExited from us */
+  g_application_hold (G_APPLICATION (terminal_app_get ()));
+
+  g_hash_table_insert (broker->forwards, forward->path, forward);
+
+  _terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+                         "Exported %s for %s on %s\n",
+                         path, remote_path, shard->name);
+
+  return g_strdup (path);
+}
+
+static void
+shard_unexport_all (Shard *shard)
+{
+  GHashTableIter iter;
+  Forward *forward;
+
+  g_hash_table_iter_init (&iter, shard->broker->forwards);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &forward))
+    if (forward->shard == shard)
+      g_hash_table_iter_remove (&iter);
+}
+
+static void
+shard_interfaces_removed_cb (GDBusConnection *connection,
+                             const char *sender_name,
+                             const char *object_path,
+                             const char *interface_name,
+                             const char *signal_name,
+                             GVariant *parameters,
+                             Shard *shard)
+{
+  const char *remote_path;
+  char *path;
+
+  g_variant_get (parameters, "(&o*)", &remote_path, NULL);
+
+  path = shard_translate_path (shard, remote_path);
+  if (path != NULL)
+    g_hash_table_remove (shard->broker->forwards, path);
+  g_free (path);
+}
+
+/* Starting shards */
+
+static void
+shard_exited_cb (GPid pid,
+                 int status,
+                 gpointer data)
+{
+  g_spawn_close_pid (pid);
+}
+
+static gboolean
+shard_start_timeout_cb (Shard *shard)
+{
+  GError *error;
+
+  shard->start_timeout_id = 0;
+
+  error = g_error_new (G_DBUS_ERROR, G_DBUS_ERROR_TIMEOUT,
+                       "%s did not start", shard->name);
+  shard_fail_pending (shard, error);
+  g_error_free (error);
+
+  return FALSE;
+}
+
+static void
+shard_start (Shard *shard)
+{
+  char *argv[] = {
+    (char *) TERM_LIBEXECDIR "/gnome-terminal-server",
+    (char *) "--app-id", shard->name,
+    NULL
+  };
+  GError *error = NULL;
+  GPid pid;
+
+  if (shard->start_timeout_id != 0)
+    return;
+
+  if (!g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_DO_NOT_REAP_CHILD,
+                      NULL, NULL,
+                      &pid, &error)) {
+    shard_fail_pending (shard, error);
+    g_error_free (error);
+    return;
+  }
+
+  g_child_watch_add (pid, shard_exited_cb, NULL);
+
+  _terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+                         "Started %s as %d\n", shard->name, (int) pid);
+
+  shard->start_timeout_id = g_timeout_add_seconds (SHARD_START_TIMEOUT,
+                                                   (GSourceFunc) shard_start_timeout_cb,
+                                                   shard);
+}
+
+static void
+shard_name_appeared_cb (GDBusConnection *connection,
+                        const char *name,
+                        const char *owner,
+                        Shard *shard)
+{
+  GList *pending, *l;
+
+  g_free (shard->owner);
+  shard->owner = g_strdup (owner);
+
+  if (shard->start_timeout_id != 0) {
+    g_source_remove (shard->start_timeout_id);
+    shard->start_timeout_id = 0;
+  }
+
+  pending = shard->pending;
+  shard->pending = NULL;
+  for (l = pending; l != NULL; l = l->next)
+    terminal_broker_forward_create_instance (shard, l->data);
+  g_list_free (pending);
+}
+
+static void
+shard_name_vanished_cb (GDBusConnection *connection,
+                        const char *name,
+                        Shard *shard)
+{
+  g_free (shard->owner);
+  shard->owner = NULL;
+
+  shard_unexport_all (shard);
+}
+
+static Shard *
+terminal_broker_ensure_shard (TerminalBroker *broker,
+                              guint index)
+{
+  Shard *shard;
+
+  if (broker->shards[index] != NULL)
+    return broker->shards[index];
+
+  shard = g_slice_new0 (Shard);
+  shard->broker = broker;
+  shard->index = index;
+  shard->name = g_strdup_printf ("%s" SHARD_SUFFIX "%u", broker->app_id, index);
+
+  shard->watch_id =
+    g_bus_watch_name_on_connection (broker->connection,
+                                    shard->name,
+                                    G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                    (GBusNameAppearedCallback) shard_name_appeared_cb,
+                                    (GBusNameVanishedCallback) shard_name_vanished_cb,
+                                    shard, NULL);
+  shard->removed_id =
+    g_dbus_connection_signal_subscribe (broker->connection,
+                                        shard->name,
+                                        "org.freedesktop.DBus.ObjectManager",
+                                        "InterfacesRemoved",
+                                        TERMINAL_OBJECT_PATH_PREFIX,
+                                        NULL,
+                                        G_DBUS_SIGNAL_FLAGS_NONE,
+                                        (GDBusSignalCallback) shard_interfaces_removed_cb,
+                                        shard, NULL);
+
+  broker->shards[index] = shard;
+  return shard;
+}
+
+static void
+shard_free (Shard *shard)
+{
+  GDBusConnection *connection = shard->broker->connection;
+  GError *error;
+
+  error = g_error_new_literal (G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                               "The terminal server is shutting down");
+  shard_fail_pending (shard, error);
+  g_error_free (error);
+
+  if (shard->start_timeout_id != 0)
+    g_source_remove (shard->start_timeout_id);
+  g_bus_unwatch_name (shard->watch_id);
+  g_dbus_connection_signal_unsubscribe (connection, shard->removed_id);
+
+  g_free (shard->owner);
+  g_free (shard->name);
+  g_slice_free (Shard, shard);
+}
+
+/* Creating terminals */
+
+static void
+create_instance_cb (GDBusConnection *connection,
+                    GAsyncResult *result,
+                    PendingCall *call)
+{
+  GVariant *reply;
+  GError *error = NULL;
+  const char *remote_path;
+  char *path;
+
+  reply = g_dbus_connection_call_finish (connection, result, &error);
+  if (reply == NULL) {
+    /* Don't touch the shard; the broker may be gone */
+    return_error (call->invocation, error);
+    pending_call_free (call);
+    return;
+  }
+
+  g_variant_get (reply, "(&o)", &remote_path);
+  path = shard_export (call->shard, remote_path, &error);
+  g_variant_unref (reply);
+
+  if (path == NULL)
+    g_dbus_method_invocation_take_error (call->invocation, error);
+  else
+    g_dbus_method_invocation_return_value (call->invocation, g_variant_new ("(o)", path));
+
+  g_free (path);
+  pending_call_free (call);
+}
+
+static void
+terminal_broker_forward_create_instance (Shard *shard,
+                                         PendingCall *call)
+{
+  GVariantBuilder builder;
+  GVariantIter iter;
+  GVariant *value;
+  const char *key;
+
+  /* The shard knows its windows by their own IDs */
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_iter_init (&iter, call->options);
+  while (g_variant_iter_loop (&iter, "{&sv}", &key, &value)) {
+    if (strcmp (key, "window-id") == 0 &&
+        g_variant_is_of_type (value, G_VARIANT_TYPE_UINT32))
+      g_variant_builder_add (&builder, "{sv}", key,
+                             g_variant_new_uint32 (g_variant_get_uint32 (value) & SHARD_WINDOW_ID_MASK));
+    else
+      g_variant_builder_add (&builder, "{sv}", key, value);
+  }
+
+  call->shard = shard;
+  g_dbus_connection_call (shard->broker->connection,
+                          shard->name,
+                          TERMINAL_FACTORY_OBJECT_PATH,
+                          TERMINAL_FACTORY_INTERFACE_NAME,
+                          "CreateInstance",
+                          g_variant_new ("(a{sv})", &builder),
+                          G_VARIANT_TYPE ("(o)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          shard->broker->cancellable,
+                          (GAsyncReadyCallback) create_instance_cb,
+                          call);
+}
+
+static guint
+terminal_broker_pick_shard (TerminalBroker *broker,
+                            GVariant *options)
+{
+  GSettings *settings;
+  const char *key;
+  guint32 window_id;
+  guint n_shards;
+
+  /* A new tab goes where its window is */
+  if (g_variant_lookup (options, "window-id", "u", &window_id))
+    return window_id >> SHARD_WINDOW_ID_SHIFT;
+
+  settings = terminal_app_get_global_settings (terminal_app_get ());
+  n_shards = CLAMP (g_settings_get_uint (settings, TERMINAL_SETTING_SHARD_COUNT_KEY), 1, MAX_SHARDS);
+  if (n_shards == 1)
+    return 0;
+
+  switch (g_settings_get_enum (settings, TERMINAL_SETTING_SHARD_POLICY_KEY)) {
+    case TERMINAL_SHARD_POLICY_PROFILE:
+      if (!g_variant_lookup (options, "profile", "&s", &key))
+        key = "";
+      return g_str_hash (key) % n_shards;
+    case TERMINAL_SHARD_POLICY_DISPLAY:
+      if (!g_variant_lookup (options, "display", "^&ay", &key))
+        key = "";
+      return g_str_hash (key) % n_shards;
+    case TERMINAL_SHARD_POLICY_ROUND_ROBIN:
+    default:
+      return broker->next_shard++ % n_shards;
+  }
+}
+
+/**
+ * terminal_broker_is_shard:
+ * @app_id: an application ID
+ *
+ * Returns: whether @app_id is that of a shard, which doesn't shard
+ *   further
+ */
+gboolean
+terminal_broker_is_shard (const char *app_id)
+{
+  return strstr (app_id, SHARD_SUFFIX) != NULL;
+}
+
+/**
+ * terminal_broker_new:
+ * @connection: the connection the server owns @app_id on
+ * @app_id: the application ID of the server
+ *
+ * Returns: (transfer full): a new #TerminalBroker
+ */
+TerminalBroker *
+terminal_broker_new (GDBusConnection *connection,
+                     const char *app_id)
+{
+  TerminalBroker *broker;
+
+  broker = g_slice_new0 (TerminalBroker);
+  broker->connection = g_object_ref (connection);
+  broker->cancellable = g_cancellable_new ();
+  broker->app_id = g_strdup (app_id);
+  broker->forwards = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            NULL, (GDestroyNotify) forward_free);
+
+  return broker;
+}
+
+/**
+ * terminal_broker_free:
+ * @broker: (allow-none): a #TerminalBroker
+ *
+ * Unexports all terminals on other shards, and fails pending calls.
+ * The shards keep running.
+ */
+void
+terminal_broker_free (TerminalBroker *broker)
+{
+  guint i;
+
+  if (broker == NULL)
+    return;
+
+  g_cancellable_cancel (broker->cancellable);
+
+  g_hash_table_destroy (broker->forwards);
+  for (i = 0; i < MAX_SHARDS; i++)
+    if (broker->shards[i] != NULL)
+      shard_free (broker->shards[i]);
+
+  g_object_unref (broker->cancellable);
+  g_object_unref (broker->connection);
+  g_free (broker->app_id);
+  g_slice_free (TerminalBroker, broker);
+}
+
+/**
+ * terminal_broker_route_create_instance:
+ * @broker: a #TerminalBroker
+ * @invocation: a CreateInstance call
+ * @options: its options
+ *
+ * Hands @invocation to another shard if the policy says so.
+ *
+ * Returns: %TRUE if @broker took @invocation, %FALSE if the terminal is
+ *   to be created here
+ */
+gboolean
+terminal_broker_route_create_instance (TerminalBroker *broker,
+                                       GDBusMethodInvocation *invocation,
+                                       GVariant *options)
+{
+  PendingCall *call;
+  Shard *shard;
+  guint index;
+
+  index = terminal_broker_pick_shard (broker, options);
+  if (index == 0)
+    return FALSE;
+
+  if (index >= MAX_SHARDS) {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                           "Nonexisting window referenced");
+    return TRUE;
+  }
+
+  shard = terminal_broker_ensure_shard (broker, index);
+
+  call = g_slice_new0 (PendingCall);
+  call->invocation = invocation;
+  call->options = g_variant_ref (options);
+
+  if (shard->owner != NULL) {
+    terminal_broker_forward_create_instance (shard, call);
+  } else {
+    shard->pending = g_list_append (shard->pending, call);
+    shard_start (shard);
+  }
+
+  return TRUE;
+}
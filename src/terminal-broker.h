@@ -0,0 +1,38 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_BROKER_H
+#define TERMINAL_BROKER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalBroker TerminalBroker;
+
+gboolean terminal_broker_is_shard (const char *app_id);
+
+TerminalBroker *terminal_broker_new (GDBusConnection *connection,
+                                     const char *app_id);
+
+void terminal_broker_free (TerminalBroker *broker);
+
+gboolean terminal_broker_route_create_instance (TerminalBroker *broker,
+                                                GDBusMethodInvocation *invocation,
+                                                GVariant *options);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_BROKER_H */
@@ -0,0 +1,566 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-cgroup.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+
+#include <gio/gio.h>
+
+#include "terminal-debug.h"
+
+/* Each terminal's child runs in its own cgroup v2 below the cgroup the
+ * server was started in, if that one is delegated to us. systemd marks
+ * delegated cgroups with a trusted.delegate or user.delegate xattr;
+ * without one, being able to write to the cgroup isn't enough, since
+ * the manager may still reorganize it, unless the user opted in.
+ * Since a cgroup with processes in it can't enable controllers for its
+ * children, the server first moves itself into a "server" leaf.
+ *
+ * A terminal's cgroup is removed once its child exited and whatever
+ * the child left running has exited too. Empty cgroups that a server
+ * left behind are removed when the next one starts using cgroups.
+ *
+ * Everything goes through cgroupfs directly. If anything is missing or
+ * not writable, terminals just run in the server's cgroup as before.
+ */
+
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+#define CGROUP_SERVER_LEAF "server"
+#define CGROUP_CPU_PERIOD (100000) /* µs */
+
+struct _TerminalCgroup
+{
+  char *path;
+};
+
+static gboolean root_checked = FALSE;
+static char *root_path = NULL;
+
+static gboolean
+cgroup_write (const char *dir,
+              const char *file,
+              const char *value,
+              GError **error)
+{
+  char *path;
+  int fd, errsv;
+  gssize len, r;
+
+  path = g_build_filename (dir, file, NULL);
+
+  do {
+    fd = open (path, O_WRONLY | O_CLOEXEC);
+  } while (fd == -1 && errno == EINTR);
+  if (fd == -1)
+    goto fail;
+
+  len = strlen (value);
+  do {
+    r = write (fd, value, len);
+  } while (r == -1 && errno == EINTR);
+  if (r != len) {
+    errsv = errno;
+    close (fd);
+    errno = errsv;
+    goto fail;
+  }
+
+  close (fd);
+  g_free (path);
+  return TRUE;
+
+fail:
+  errsv = errno;
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+               "Failed to write \"%s\" to %s: %s", value, path, g_strerror (errsv));
+  g_free (path);
+  return FALSE;
+}
+
+static char *
+cgroup_read (const char *dir,
+             const char *file)
+{
+  char *path, *contents;
+
+  path = g_build_filename (dir, file, NULL);
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    contents = NULL;
+  g_free (path);
+
+  return contents;
+}
+
+/* Returns the cgroupfs directory of our own cgroup, if this is a pure
+ * cgroup v2 system.
+ */
+static char *
+cgroup_get_own_path (void)
+{
+  char *contents, *path = NULL;
+  char **lines;
+  guint i;
+
+  if (!g_file_test (CGROUP_MOUNT "/cgroup.controllers", G_FILE_TEST_EXISTS))
+    return NULL;
+
+  if (!g_file_get_contents ("/proc/self/cgroup", &contents, NULL, NULL))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++) {
+    if (g_str_has_prefix (lines[i], "0::/")) {
+      path = g_build_filename (CGROUP_MOUNT, lines[i] + 3, NULL);
+      break;
+    }
+  }
+  g_strfreev (lines);
+  g_free (contents);
+
+  return path;
+}
+
+static gboolean
+strv_contains (char **strv,
+               const char *str)
+{
+  for ( ; *strv != NULL; strv++)
+    if (strcmp (*strv, str) == 0)
+      return TRUE;
+
+  return FALSE;
+}
+
+static void
+cgroup_enable_controllers (const char *path)
+{
+  static const char *controllers[] = { "cpu", "memory", "io" };
+  char *available, **names;
+  guint i;
+
+  available = cgroup_read (path, "cgroup.controllers");
+  if (available == NULL)
+    return;
+
+  names = g_strsplit_set (g_strstrip (available), " ", -1);
+  for (i = 0; i < G_N_ELEMENTS (controllers); i++) {
+    char *enable;
+    GError *error = NULL;
+
+    if (!strv_contains (names, controllers[i]))
+      continue;
+
+    enable = g_strconcat ("+", controllers[i], NULL);
+    if (!cgroup_write (path, "cgroup.subtree_control", enable, &error)) {
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "Not using the %s controller: %s\n",
+                             controllers[i], error->message);
+      g_error_free (error);
+    }
+    g_free (enable);
+  }
+
+  g_strfreev (names);
+  g_free (available);
+}
+
+static gboolean
+cgroup_is_delegated (const char *path)
+{
+  return getxattr (path, "trusted.delegate", NULL, 0) >= 0 ||
+         getxattr (path, "user.delegate", NULL, 0) >= 0;
+}
+
+/* Removes the empty cgroups of terminals of servers that are gone */
+static void
+cgroup_remove_stale (const char *root)
+{
+  GDir *dir;
+  const char *name;
+  char *end, *path;
+  long pid;
+
+  dir = g_dir_open (root, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    if (!g_str_has_prefix (name, "terminal-"))
+      continue;
+
+    pid = strtol (name + strlen ("terminal-"), &end, 10);
+    if (*end != '-' || pid <= 0 || pid == (long) getpid ())
+      continue;
+    if (kill ((pid_t) pid, 0) == 0 || errno != ESRCH)
+      continue;
+
+    /* Fails for the ones that still have processes */
+    path = g_build_filename (root, name, NULL);
+    if (rmdir (path) == 0)
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "Removed stale cgroup %s\n", path);
+    g_free (path);
+  }
+
+  g_dir_close (dir);
+}
+
+static const char *
+cgroup_get_root (gboolean assume_delegated)
+{
+  char *own, *base, *leaf;
+  GError *error = NULL;
+
+  if (root_checked)
+    return root_path;
+
+  own = cgroup_get_own_path ();
+  if (own == NULL) {
+    root_checked = TRUE;
+    return NULL;
+  }
+
+  /* Started by a server that already did this */
+  base = g_path_get_basename (own);
+  if (strcmp (base, CGROUP_SERVER_LEAF) == 0) {
+    char *parent = g_path_get_dirname (own);
+
+    g_free (own);
+    own = parent;
+  }
+  g_free (base);
+
+  /* Not settled for good, the user may still opt in */
+  if (!assume_delegated && !cgroup_is_delegated (own)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Not using cgroups: %s isn't delegated\n",
+                           own);
+    g_free (own);
+    return NULL;
+  }
+
+  root_checked = TRUE;
+
+  leaf = g_build_filename (own, CGROUP_SERVER_LEAF, NULL);
+  if ((mkdir (leaf, 0755) == 0 || errno == EEXIST) &&
+      cgroup_write (leaf, "cgroup.procs", "0", &error)) {
+    cgroup_enable_controllers (own);
+    cgroup_remove_stale (own);
+    root_path = own;
+
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Placing terminals in cgroups below %s\n",
+                           root_path);
+  } else {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Not using cgroups: %s\n",
+                           error ? error->message : g_strerror (errno));
+    g_clear_error (&error);
+    g_free (own);
+  }
+
+  g_free (leaf);
+
+  return root_path;
+}
+
+/**
+ * terminal_cgroup_new:
+ * @assume_delegated: whether to use the server's cgroup even if it
+ *   isn't marked as delegated
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Creates a new, empty cgroup for a terminal's child.
+ *
+ * Returns: a new #TerminalCgroup, or %NULL with @error set if there is
+ *   no delegated cgroup v2 hierarchy to create it in
+ */
+TerminalCgroup *
+terminal_cgroup_new (gboolean assume_delegated,
+                     GError **error)
+{
+  static guint serial = 0;
+  TerminalCgroup *cgroup;
+  const char *root;
+  char *name, *path;
+  int errsv;
+
+  root = cgroup_get_root (assume_delegated);
+  if (root == NULL) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         "No delegated cgroup v2 hierarchy");
+    return NULL;
+  }
+
+  name = g_strdup_printf ("terminal-%d-%u", (int) getpid (), ++serial);
+  path = g_build_filename (root, name, NULL);
+  g_free (name);
+
+  if (mkdir (path, 0755) != 0 && errno != EEXIST) {
+    errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to create cgroup %s: %s", path, g_strerror (errsv));
+    g_free (path);
+    return NULL;
+  }
+
+  cgroup = g_slice_new (TerminalCgroup);
+  cgroup->path = path;
+
+  return cgroup;
+}
+
+static gboolean
+cgroup_is_populated (const char *path)
+{
+  char *events;
+  gboolean populated;
+
+  events = cgroup_read (path, "cgroup.events");
+  if (events == NULL)
+    return FALSE;
+
+  populated = strstr (events, "populated 1") != NULL;
+  g_free (events);
+
+  return populated;
+}
+
+static void
+cgroup_events_changed_cb (GFileMonitor *monitor,
+                          GFile *file,
+                          GFile *other_file,
+                          GFileMonitorEvent event,
+                          char *path)
+{
+  if (event != G_FILE_MONITOR_EVENT_CHANGED ||
+      cgroup_is_populated (path))
+    return;
+
+  if (rmdir (path) != 0 && errno == EBUSY)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Removed cgroup %s once it was empty\n",
+                         path);
+
+  g_file_monitor_cancel (monitor);
+  g_object_unref (monitor);
+}
+
+/* The kernel notifies of changes to cgroup.events like of any file */
+static void
+cgroup_remove_when_empty (const char *path)
+{
+  GFile *file;
+  GFileMonitor *monitor;
+  char *events;
+  GError *error = NULL;
+
+  events = g_build_filename (path, "cgroup.events", NULL);
+  file = g_file_new_for_path (events);
+  monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, &error);
+  g_object_unref (file);
+  g_free (events);
+
+  if (monitor == NULL) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Leaving cgroup %s behind: %s\n",
+                           path, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  g_signal_connect_data (monitor, "changed",
+                         G_CALLBACK (cgroup_events_changed_cb),
+                         g_strdup (path), (GClosureNotify) g_free, 0);
+
+  /* In case it emptied meanwhile */
+  if (!cgroup_is_populated (path) && rmdir (path) == 0) {
+    g_file_monitor_cancel (monitor);
+    g_object_unref (monitor);
+  }
+}
+
+/**
+ * terminal_cgroup_free:
+ * @cgroup: a #TerminalCgroup
+ *
+ * Removes the cgroup and frees @cgroup. A cgroup that still has
+ * processes in it is removed once they have exited.
+ */
+void
+terminal_cgroup_free (TerminalCgroup *cgroup)
+{
+  if (cgroup == NULL)
+    return;
+
+  if (rmdir (cgroup->path) != 0) {
+    if (errno == EBUSY)
+      cgroup_remove_when_empty (cgroup->path);
+    else
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "Leaving cgroup %s behind: %s\n",
+                             cgroup->path, g_strerror (errno));
+  }
+
+  g_free (cgroup->path);
+  g_slice_free (TerminalCgroup, cgroup);
+}
+
+/**
+ * terminal_cgroup_get_path:
+ * @cgroup: a #TerminalCgroup
+ *
+ * Returns: the cgroupfs directory of @cgroup
+ */
+const char *
+terminal_cgroup_get_path (TerminalCgroup *cgroup)
+{
+  return cgroup->path;
+}
+
+/**
+ * terminal_cgroup_set_limits:
+ * @cgroup: a #TerminalCgroup
+ * @cpu_quota: the CPU time the cgroup may use, in percent of one CPU, or 0
+ * @memory_max: the memory the cgroup may use, in bytes, or 0
+ * @io_weight: the I/O weight of the cgroup from 1 to 10000, or 0
+ *
+ * Sets the limits of @cgroup; 0 means no limit, or the default weight.
+ * Limits whose controller isn't available are silently ignored.
+ */
+void
+terminal_cgroup_set_limits (TerminalCgroup *cgroup,
+                            guint cpu_quota,
+                            guint64 memory_max,
+                            guint io_weight)
+{
+  char *value;
+  GError *error = NULL;
+
+  if (cpu_quota > 0)
+    value = g_strdup_printf ("%" G_GUINT64_FORMAT " %d",
+                             (guint64) cpu_quota * CGROUP_CPU_PERIOD / 100, CGROUP_CPU_PERIOD);
+  else
+    value = g_strdup_printf ("max %d", CGROUP_CPU_PERIOD);
+  if (!cgroup_write (cgroup->path, "cpu.max", value, &error)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES, "%s\n", error->message);
+    g_clear_error (&error);
+  }
+  g_free (value);
+
+  if (memory_max > 0)
+    value = g_strdup_printf ("%" G_GUINT64_FORMAT, memory_max);
+  else
+    value = g_strdup ("max");
+  if (!cgroup_write (cgroup->path, "memory.max", value, &error)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES, "%s\n", error->message);
+    g_clear_error (&error);
+  }
+  g_free (value);
+
+  value = g_strdup_printf ("default %u", io_weight > 0 ? CLAMP (io_weight, 1, 10000) : 100);
+  if (!cgroup_write (cgroup->path, "io.weight", value, &error)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES, "%s\n", error->message);
+    g_clear_error (&error);
+  }
+  g_free (value);
+}
+
+/**
+ * terminal_cgroup_open_procs:
+ * @cgroup: a #TerminalCgroup
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Opens the cgroup.procs file of @cgroup, so that a forked child can
+ * move itself into @cgroup by writing "0" to it before it execs.
+ *
+ * Returns: a close-on-exec file descriptor, or -1 with @error set
+ */
+int
+terminal_cgroup_open_procs (TerminalCgroup *cgroup,
+                            GError **error)
+{
+  char *path;
+  int fd, errsv;
+
+  path = g_build_filename (cgroup->path, "cgroup.procs", NULL);
+  do {
+    fd = open (path, O_WRONLY | O_CLOEXEC);
+  } while (fd == -1 && errno == EINTR);
+
+  if (fd == -1) {
+    errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to open %s: %s", path, g_strerror (errsv));
+  }
+
+  g_free (path);
+  return fd;
+}
+
+/**
+ * terminal_cgroup_read_usage:
+ * @path: the cgroupfs directory of a cgroup
+ * @cpu_usec: a location to store the CPU time used by the cgroup, in µs
+ * @memory: a location to store the memory used by the cgroup, in bytes
+ *
+ * Reads the resource usage of all processes that ever were in the
+ * cgroup at @path. @memory is 0 if the memory controller isn't enabled.
+ *
+ * This only reads files, and may be called from any thread.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+terminal_cgroup_read_usage (const char *path,
+                            guint64 *cpu_usec,
+                            guint64 *memory)
+{
+  char *contents, *usage;
+  gboolean ok = FALSE;
+
+  contents = cgroup_read (path, "cpu.stat");
+  if (contents == NULL)
+    return FALSE;
+
+  if (g_str_has_prefix (contents, "usage_usec "))
+    usage = contents;
+  else
+    usage = strstr (contents, "\nusage_usec ");
+  if (usage != NULL) {
+    *cpu_usec = g_ascii_strtoull (strchr (usage + 1, ' ') + 1, NULL, 10);
+    ok = TRUE;
+  }
+  g_free (contents);
+
+  contents = cgroup_read (path, "memory.current");
+  *memory = contents ? g_ascii_strtoull (contents, NULL, 10) : 0;
+  g_free (contents);
+
+  return ok;
+}
@@ -0,0 +1,46 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_CGROUP_H
+#define TERMINAL_CGROUP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalCgroup TerminalCgroup;
+
+TerminalCgroup *terminal_cgroup_new (gboolean assume_delegated,
+                                     GError **error);
+
+void terminal_cgroup_free (TerminalCgroup *cgroup);
+
+const char *terminal_cgroup_get_path (TerminalCgroup *cgroup);
+
+void terminal_cgroup_set_limits (TerminalCgroup *cgroup,
+                                 guint cpu_quota,
+                                 guint64 memory_max,
+                                 guint io_weight);
+
+int terminal_cgroup_open_procs (TerminalCgroup *cgroup,
+                                GError **error);
+
+gboolean terminal_cgroup_read_usage (const char *path,
+                                     guint64 *cpu_usec,
+                                     guint64 *memory);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_CGROUP_H */
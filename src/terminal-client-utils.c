@@ -193,3 +193,162 @@ out:
   if (startup_id)
     *startup_id = NULL;
 }
+
+/**
+ * terminal_client_new_trace_id:
+ *
+ * Returns: (transfer full): a random ID for tracing a request through
+ *   the server
+ */
+char *
+terminal_client_new_trace_id (void)
+{
+  return g_strdup_printf ("%08x%08x%08x%08x",
+                          g_random_int (), g_random_int (),
+                          g_random_int (), g_random_int ());
+}
+
+/**
+ * terminal_client_append_trace_id:
+ * @builder: a #GVariantBuilder of #GVariantType "a{sv}"
+ * @trace_id: (allow-none): a trace ID, or %NULL
+ *
+ * Appends @trace_id to @builder, so the server records the stages of
+ * the request under it.
+ */
+void
+terminal_client_append_trace_id (GVariantBuilder *builder,
+                                 const char      *trace_id)
+{
+  if (trace_id)
+    g_variant_builder_add (builder, "{sv}",
+                           "trace-id", g_variant_new_string (trace_id));
+}
+
+typedef struct {
+  GMainLoop *loop;
+  TerminalTrace *trace;
+  guint timeout_id;
+  gboolean finished;
+} TraceWaitData;
+
+static void
+receiver_trace_finished_cb (TerminalReceiver *receiver,
+                            const char *trace_id,
+                            GVariant *spans,
+                            TraceWaitData *data)
+{
+  if (strcmp (trace_id, terminal_trace_get_id (data->trace)) != 0)
+    return;
+
+  terminal_trace_add_spans (data->trace, spans);
+  data->finished = TRUE;
+
+  if (g_main_loop_is_running (data->loop))
+    g_main_loop_quit (data->loop);
+}
+
+static gboolean
+trace_timeout_cb (TraceWaitData *data)
+{
+  data->timeout_id = 0;
+  g_main_loop_quit (data->loop);
+
+  return FALSE; /* don't run again */
+}
+
+/**
+ * terminal_client_wait_for_trace:
+ * @receiver: a #TerminalReceiver proxy that connects to signals
+ * @trace: the #TerminalTrace whose ID was passed to the server
+ * @timeout: how long to wait, in ms
+ *
+ * Waits for the server to finish the trace, which it does once the
+ * terminal has drawn its first frame, and adds its spans to @trace.
+ *
+ * Returns: %TRUE if the server's spans arrived before @timeout
+ */
+gboolean
+terminal_client_wait_for_trace (TerminalReceiver *receiver,
+                                TerminalTrace    *trace,
+                                guint             timeout)
+{
+  TraceWaitData data;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.trace = trace;
+  data.finished = FALSE;
+
+  g_signal_connect (receiver, "trace-finished",
+                    G_CALLBACK (receiver_trace_finished_cb),
+                    &data);
+  data.timeout_id = g_timeout_add (timeout, (GSourceFunc) trace_timeout_cb, &data);
+  g_main_loop_run (data.loop);
+  if (data.timeout_id != 0)
+    g_source_remove (data.timeout_id);
+  g_signal_handlers_disconnect_by_func (receiver,
+                                        G_CALLBACK (receiver_trace_finished_cb),
+                                        &data);
+  g_main_loop_unref (data.loop);
+
+  return data.finished;
+}
+
+/**
+ * terminal_client_print_trace:
+ * @trace: a #TerminalTrace
+ *
+ * Prints the spans of @trace, relative to the first one.
+ */
+void
+terminal_client_print_trace (TerminalTrace *trace)
+{
+  GVariant *spans;
+  GVariantIter iter;
+  const char *name;
+  gint64 start, end, origin = -1;
+  gint32 pid;
+
+  spans = g_variant_ref_sink (terminal_trace_get_spans (trace));
+
+  g_print ("Trace %s:\n", terminal_trace_get_id (trace));
+  g_variant_iter_init (&iter, spans);
+  while (g_variant_iter_next (&iter, "(&sxxi)", &name, &start, &end, &pid)) {
+    if (origin == -1)
+      origin = start;
+
+    if (end == -1)
+      g_print ("  %-20s at %9.3f ms, unfinished\n",
+               name, (start - origin) / 1000.);
+    else
+      g_print ("  %-20s at %9.3f ms, took %9.3f ms\n",
+               name, (start - origin) / 1000., (end - start) / 1000.);
+  }
+
+  g_variant_unref (spans);
+}
+
+/**
+ * terminal_client_write_trace:
+ * @trace: a #TerminalTrace
+ * @filename: the file to write
+ * @error: a #GError to fill in
+ *
+ * Writes @trace to @filename in the Chrome trace event format.
+ *
+ * Returns: %TRUE on success, %FALSE with @error filled in on error
+ */
+gboolean
+terminal_client_write_trace (TerminalTrace *trace,
+                             const char    *filename,
+                             GError       **error)
+{
+  char *json;
+  gboolean retval;
+
+  json = terminal_trace_to_json (trace);
+  retval = g_file_set_contents (filename, json, -1, error);
+  g_free (json);
+
+  return retval;
+}
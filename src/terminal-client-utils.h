@@ -22,6 +22,9 @@
 
 #include <gio/gio.h>
 
+#include "terminal-gdbus-generated.h"
+#include "terminal-trace.h"
+
 G_BEGIN_DECLS
 
 void terminal_client_append_create_instance_options (GVariantBuilder *builder,
@@ -39,6 +42,21 @@ void terminal_client_append_exec_options            (GVariantBuilder *builder,
 
 void terminal_client_get_fallback_startup_id        (char           **startup_id);
 
+char *terminal_client_new_trace_id                  (void);
+
+void terminal_client_append_trace_id                (GVariantBuilder *builder,
+                                                     const char      *trace_id);
+
+gboolean terminal_client_wait_for_trace             (TerminalReceiver *receiver,
+                                                     TerminalTrace    *trace,
+                                                     guint             timeout);
+
+void terminal_client_print_trace                    (TerminalTrace   *trace);
+
+gboolean terminal_client_write_trace                (TerminalTrace   *trace,
+                                                     const char      *filename,
+                                                     GError         **error);
+
 G_END_DECLS
 
 #endif /* TERMINAL_UTIL_UTILS_H */
@@ -18,12 +18,24 @@
 
 #include <config.h>
 
+#include <string.h>
+#include <unistd.h>
+
 #include <glib.h>
 
 #include "terminal-debug.h"
 
 TerminalDebugFlags _terminal_debug_flags;
 
+typedef struct {
+  const char *name;
+  char phase;
+  gint64 time; /* monotonic µs */
+} PerfEvent;
+
+static GArray *perf_events;
+static gboolean perf_finished;
+
 void
 _terminal_debug_init(void)
 {
@@ -35,7 +47,9 @@ _terminal_debug_init(void)
     { "geometry",  TERMINAL_DEBUG_GEOMETRY  },
     { "mdi",       TERMINAL_DEBUG_MDI       },
     { "processes", TERMINAL_DEBUG_PROCESSES },
-    { "profile",   TERMINAL_DEBUG_PROFILE   }
+    { "profile",   TERMINAL_DEBUG_PROFILE   },
+    { "watchdog",  TERMINAL_DEBUG_WATCHDOG  },
+    { "perf",      TERMINAL_DEBUG_PERF      }
   };
 
   _terminal_debug_flags = g_parse_debug_string (g_getenv ("GNOME_TERMINAL_DEBUG"),
@@ -43,3 +57,93 @@ _terminal_debug_init(void)
 #endif /* GNOME_ENABLE_DEBUG */
 }
 
+
+/**
+ * _terminal_debug_perf_record:
+ * @name: a static string naming the event
+ * @phase: 'B' to begin a span, 'E' to end it, or 'i' for an instant
+ *
+ * Records a startup timeline event; use the _terminal_debug_perf_begin(),
+ * _terminal_debug_perf_end() and _terminal_debug_perf_mark() macros
+ * rather than calling this directly. Instant events are only recorded
+ * the first time, so they can mark e.g. the first window map. Nothing
+ * is recorded after _terminal_debug_perf_dump().
+ */
+void
+_terminal_debug_perf_record (const char *name,
+                             char phase)
+{
+  PerfEvent event;
+  guint i;
+
+  if (perf_finished)
+    return;
+
+  if (perf_events == NULL)
+    perf_events = g_array_new (FALSE, FALSE, sizeof (PerfEvent));
+
+  if (phase == 'i') {
+    for (i = 0; i < perf_events->len; i++) {
+      PerfEvent *other = &g_array_index (perf_events, PerfEvent, i);
+
+      if (other->phase == 'i' && strcmp (other->name, name) == 0)
+        return;
+    }
+  }
+
+  event.name = name;
+  event.phase = phase;
+  event.time = g_get_monotonic_time ();
+  g_array_append_val (perf_events, event);
+}
+
+/**
+ * _terminal_debug_perf_dump:
+ *
+ * Writes the recorded timeline as Chrome trace event JSON, to the file
+ * named by GNOME_TERMINAL_PERF_TRACE or else to stderr, and stops
+ * recording. Only the first call does anything.
+ */
+void
+_terminal_debug_perf_dump (void)
+{
+  GString *json;
+  const char *path;
+  GError *error = NULL;
+  pid_t pid;
+  guint i;
+
+  if (perf_finished)
+    return;
+  perf_finished = TRUE;
+
+  if (perf_events == NULL)
+    return;
+
+  pid = getpid ();
+  json = g_string_new ("{\"traceEvents\":[\n");
+  for (i = 0; i < perf_events->len; i++) {
+    PerfEvent *event = &g_array_index (perf_events, PerfEvent, i);
+
+    g_string_append_printf (json,
+                            "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"%c\",%s"
+                            "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%d}%s\n",
+                            event->name, event->phase,
+                            event->phase == 'i' ? "\"s\":\"p\"," : "",
+                            event->time, (int) pid, (int) pid,
+                            i + 1 < perf_events->len ? "," : "");
+  }
+  g_string_append (json, "],\"displayTimeUnit\":\"ms\"}\n");
+
+  path = g_getenv ("GNOME_TERMINAL_PERF_TRACE");
+  if (path == NULL || path[0] == '\0')
+    g_printerr ("%s", json->str);
+  else if (!g_file_set_contents (path, json->str, json->len, &error)) {
+    g_printerr ("Failed to write startup trace to %s: %s\n", path, error->message);
+    g_error_free (error);
+  }
+
+  g_string_free (json, TRUE);
+  g_array_free (perf_events, TRUE);
+  perf_events = NULL;
+}
@@ -32,7 +32,9 @@ typedef enum {
   TERMINAL_DEBUG_GEOMETRY   = 1 << 3,
   TERMINAL_DEBUG_MDI        = 1 << 4,
   TERMINAL_DEBUG_PROCESSES  = 1 << 5,
-  TERMINAL_DEBUG_PROFILE    = 1 << 6
+  TERMINAL_DEBUG_PROFILE    = 1 << 6,
+  TERMINAL_DEBUG_WATCHDOG   = 1 << 7,
+  TERMINAL_DEBUG_PERF       = 1 << 8
 } TerminalDebugFlags;
 
 void _terminal_debug_init(void);
@@ -69,6 +71,21 @@ static void _terminal_debug_print (guint flags, const char *fmt, ...)
 }
 #endif
 
+/* Startup timeline. Names must be static strings. */
+
+void _terminal_debug_perf_record (const char *name,
+                                  char phase);
+void _terminal_debug_perf_dump (void);
+
+#define _terminal_debug_perf_begin(name) \
+  G_STMT_START { _TERMINAL_DEBUG_IF(TERMINAL_DEBUG_PERF) _terminal_debug_perf_record (name, 'B'); } G_STMT_END
+#define _terminal_debug_perf_end(name) \
+  G_STMT_START { _TERMINAL_DEBUG_IF(TERMINAL_DEBUG_PERF) _terminal_debug_perf_record (name, 'E'); } G_STMT_END
+#define _terminal_debug_perf_mark(name) \
+  G_STMT_START { _TERMINAL_DEBUG_IF(TERMINAL_DEBUG_PERF) _terminal_debug_perf_record (name, 'i'); } G_STMT_END
+#define _terminal_debug_perf_finish() \
+  G_STMT_START { _TERMINAL_DEBUG_IF(TERMINAL_DEBUG_PERF) _terminal_debug_perf_dump (); } G_STMT_END
+
 G_END_DECLS
 
 #endif /* !GNOME_ENABLE_DEBUG_H */
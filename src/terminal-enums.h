@@ -41,6 +41,41 @@ typedef enum
   TERMINAL_EXIT_HOLD
 } TerminalExitAction;
 
+typedef enum
+{
+  TERMINAL_ACTIVITY_NONE,
+  TERMINAL_ACTIVITY_OUTPUT,
+  TERMINAL_ACTIVITY_SILENCE
+} TerminalActivity;
+
+typedef enum
+{
+  TERMINAL_SCHEDULING_POLICY_NORMAL,
+  TERMINAL_SCHEDULING_POLICY_BATCH,
+  TERMINAL_SCHEDULING_POLICY_IDLE
+} TerminalSchedulingPolicy;
+
+typedef enum
+{
+  TERMINAL_IO_PRIORITY_CLASS_DEFAULT,
+  TERMINAL_IO_PRIORITY_CLASS_BEST_EFFORT,
+  TERMINAL_IO_PRIORITY_CLASS_IDLE
+} TerminalIOPriorityClass;
+
+typedef enum
+{
+  TERMINAL_SHARD_POLICY_ROUND_ROBIN,
+  TERMINAL_SHARD_POLICY_PROFILE,
+  TERMINAL_SHARD_POLICY_DISPLAY
+} TerminalShardPolicy;
+
+typedef enum
+{
+  TERMINAL_LATENCY_MONITOR_OFF,
+  TERMINAL_LATENCY_MONITOR_COLLECT,
+  TERMINAL_LATENCY_MONITOR_OVERLAY
+} TerminalLatencyMonitor;
+
 G_END_DECLS
 
 #endif /* TERMINAL_ENUMS_H */
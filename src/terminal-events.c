@@ -0,0 +1,376 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-events.h"
+
+#include <string.h>
+
+#include "terminal-debug.h"
+#include "terminal-defines.h"
+
+/* Terminal events
+ *
+ * Clients subscribe to some kinds of events of some or all terminals,
+ * and get them in batches, in an Events signal sent only to them, at
+ * most once per the interval they asked for. Within a batch, events
+ * of the same kind from the same terminal are coalesced: the last one
+ * wins, except for bells, which are counted.
+ */
+
+#define MIN_INTERVAL     (10)    /* ms */
+#define MAX_INTERVAL     (60000) /* ms */
+#define DEFAULT_INTERVAL (250)   /* ms */
+
+static const char *event_names[TERMINAL_N_EVENTS] = {
+  "title",
+  "cwd",
+  "foreground-process",
+  "bell",
+  "activity",
+  "exit"
+};
+
+typedef struct {
+  char *object_path;
+  TerminalEvent event;
+  GVariant *data; /* a{sv} */
+  guint count;
+} PendingEvent;
+
+typedef struct {
+  TerminalEvents *events;
+  guint id;
+  GDBusConnection *connection;
+  char *subscriber; /* unique bus name */
+  guint watch_id;
+  guint mask; /* of 1 << TerminalEvent */
+  GHashTable *object_paths; /* set, or NULL for all terminals */
+  guint interval; /* ms */
+  guint flush_id;
+  GQueue pending; /* of PendingEvent, in the order they first came */
+  GHashTable *pending_index; /* "path event" -> PendingEvent* */
+} Subscription;
+
+struct _TerminalEvents
+{
+  GHashTable *subscriptions; /* id -> Subscription* */
+  guint next_id;
+  guint counts[TERMINAL_N_EVENTS]; /* subscriptions wanting each */
+};
+
+static void
+pending_event_free (PendingEvent *pending)
+{
+  g_free (pending->object_path);
+  g_variant_unref (pending->data);
+  g_slice_free (PendingEvent, pending);
+}
+
+static gboolean
+subscription_flush_cb (Subscription *subscription)
+{
+  GVariantBuilder builder;
+  PendingEvent *pending;
+  GError *error = NULL;
+
+  subscription->flush_id = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(osa{sv})"));
+  while ((pending = g_queue_pop_head (&subscription->pending)) != NULL) {
+    if (pending->event == TERMINAL_EVENT_BELL) {
+      GVariantBuilder data;
+
+      g_variant_builder_init (&data, G_VARIANT_TYPE ("a{sv}"));
+      g_variant_builder_add (&data, "{sv}", "count", g_variant_new_uint32 (pending->count));
+      g_variant_builder_add (&builder, "(os@a{sv})",
+                             pending->object_path, event_names[pending->event],
+                             g_variant_builder_end (&data));
+    } else {
+      g_variant_builder_add (&builder, "(os@a{sv})",
+                             pending->object_path, event_names[pending->event],
+                             pending->data);
+    }
+    pending_event_free (pending);
+  }
+  g_hash_table_remove_all (subscription->pending_index);
+
+  if (!g_dbus_connection_emit_signal (subscription->connection,
+                                      subscription->subscriber,
+                                      TERMINAL_FACTORY_OBJECT_PATH,
+                                      TERMINAL_FACTORY_INTERFACE_NAME,
+                                      "Events",
+                                      g_variant_new ("(u@a(osa{sv}))",
+                                                     subscription->id,
+                                                     g_variant_builder_end (&builder)),
+                                      &error)) {
+    _terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+                           "Failed to send events to %s: %s\n",
+                           subscription->subscriber, error->message);
+    g_error_free (error);
+  }
+
+  return FALSE; /* remove */
+}
+
+static void
+subscription_free (Subscription *subscription)
+{
+  TerminalEvents *events = subscription->events;
+  guint i;
+
+  for (i = 0; i < TERMINAL_N_EVENTS; i++)
+    if (subscription->mask & (1 << i))
+      events->counts[i]--;
+
+  if (subscription->flush_id != 0)
+    g_source_remove (subscription->flush_id);
+  g_queue_foreach (&subscription->pending, (GFunc) pending_event_free, NULL);
+  g_queue_clear (&subscription->pending);
+  g_hash_table_destroy (subscription->pending_index);
+  if (subscription->object_paths != NULL)
+    g_hash_table_destroy (subscription->object_paths);
+
+  g_bus_unwatch_name (subscription->watch_id);
+  g_object_unref (subscription->connection);
+  g_free (subscription->subscriber);
+  g_slice_free (Subscription, subscription);
+}
+
+static void
+subscriber_vanished_cb (GDBusConnection *connection,
+                        const char *name,
+                        Subscription *subscription)
+{
+  _terminal_debug_print (TERMINAL_DEBUG_FACTORY,
+                         "Subscriber %s went away, dropping subscription %u\n",
+                         name, subscription->id);
+
+  g_hash_table_remove (subscription->events->subscriptions,
+                       GUINT_TO_POINTER (subscription->id));
+}
+
+static void
+subscription_add (Subscription *subscription,
+                  const char *object_path,
+                  TerminalEvent event,
+                  GVariant *data)
+{
+  PendingEvent *pending;
+  char *key;
+
+  key = g_strdup_printf ("%s %d", object_path, event);
+  pending = g_hash_table_lookup (subscription->pending_index, key);
+  if (pending != NULL) {
+    g_variant_unref (pending->data);
+    pending->data = g_variant_ref (data);
+    pending->count++;
+    g_free (key);
+  } else {
+    pending = g_slice_new (PendingEvent);
+    pending->object_path = g_strdup (object_path);
+    pending->event = event;
+    pending->data = g_variant_ref (data);
+    pending->count = 1;
+    g_queue_push_tail (&subscription->pending, pending);
+    g_hash_table_insert (subscription->pending_index, key /* adopts */, pending);
+  }
+
+  if (subscription->flush_id == 0)
+    subscription->flush_id = g_timeout_add (subscription->interval,
+                                            (GSourceFunc) subscription_flush_cb,
+                                            subscription);
+}
+
+TerminalEvents *
+terminal_events_new (void)
+{
+  TerminalEvents *events;
+
+  events = g_slice_new0 (TerminalEvents);
+  events->subscriptions = g_hash_table_new_full (NULL, NULL, NULL,
+                                                 (GDestroyNotify) subscription_free);
+  events->next_id = 1;
+
+  return events;
+}
+
+/**
+ * terminal_events_free:
+ * @events: (allow-none): a #TerminalEvents
+ */
+void
+terminal_events_free (TerminalEvents *events)
+{
+  if (events == NULL)
+    return;
+
+  g_hash_table_destroy (events->subscriptions);
+  g_slice_free (TerminalEvents, events);
+}
+
+/**
+ * terminal_events_subscribe:
+ * @events: a #TerminalEvents
+ * @connection: the connection to send the events on
+ * @subscriber: the unique bus name to send the events to
+ * @names: the names of the events wanted, or an empty array for all
+ * @object_paths: the terminals whose events are wanted, or an empty
+ *   array for all terminals
+ * @interval: the minimum time between two batches, in ms, or 0 for
+ *   the default
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Subscribes @subscriber to events, until it unsubscribes or leaves
+ * the bus.
+ *
+ * Returns: the ID of the subscription, or 0 if an event name is unknown
+ */
+guint
+terminal_events_subscribe (TerminalEvents *events,
+                           GDBusConnection *connection,
+                           const char *subscriber,
+                           const char * const *names,
+                           const char * const *object_paths,
+                           guint interval,
+                           GError **error)
+{
+  Subscription *subscription;
+  guint mask = 0, i, event;
+
+  for (i = 0; names[i] != NULL; i++) {
+    for (event = 0; event < TERMINAL_N_EVENTS; event++)
+      if (strcmp (names[i], event_names[event]) == 0)
+        break;
+
+    if (event == TERMINAL_N_EVENTS) {
+      g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                   "Unknown event \"%s\"", names[i]);
+      return 0;
+    }
+
+    mask |= 1 << event;
+  }
+  if (mask == 0)
+    mask = (1 << TERMINAL_N_EVENTS) - 1;
+
+  subscription = g_slice_new0 (Subscription);
+  subscription->events = events;
+  subscription->id = events->next_id++;
+  subscription->connection = g_object_ref (connection);
+  subscription->subscriber = g_strdup (subscriber);
+  subscription->mask = mask;
+  subscription->interval = interval ? CLAMP (interval, MIN_INTERVAL, MAX_INTERVAL)
+                                    : DEFAULT_INTERVAL;
+  g_queue_init (&subscription->pending);
+  subscription->pending_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  if (object_paths[0] != NULL) {
+    subscription->object_paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    for (i = 0; object_paths[i] != NULL; i++)
+      g_hash_table_insert (subscription->object_paths, g_strdup (object_paths[i]), NULL);
+  }
+
+  for (event = 0; event < TERMINAL_N_EVENTS; event++)
+    if (mask & (1 << event))
+      events->counts[event]++;
+
+  subscription->watch_id =
+    g_bus_watch_name_on_connection (connection, subscriber,
+                                    G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                    NULL,
+                                    (GBusNameVanishedCallback) subscriber_vanished_cb,
+                                    subscription, NULL);
+
+  g_hash_table_insert (events->subscriptions,
+                       GUINT_TO_POINTER (subscription->id), subscription);
+
+  return subscription->id;
+}
+
+/**
+ * terminal_events_unsubscribe:
+ * @events: a #TerminalEvents
+ * @subscriber: the unique bus name asking
+ * @id: the ID of the subscription
+ *
+ * Returns: %TRUE if @subscriber had subscription @id
+ */
+gboolean
+terminal_events_unsubscribe (TerminalEvents *events,
+                             const char *subscriber,
+                             guint id)
+{
+  Subscription *subscription;
+
+  subscription = g_hash_table_lookup (events->subscriptions, GUINT_TO_POINTER (id));
+  if (subscription == NULL || strcmp (subscription->subscriber, subscriber) != 0)
+    return FALSE;
+
+  g_hash_table_remove (events->subscriptions, GUINT_TO_POINTER (id));
+  return TRUE;
+}
+
+/**
+ * terminal_events_is_wanted:
+ * @events: a #TerminalEvents
+ * @event: a #TerminalEvent
+ *
+ * Returns: whether any subscription wants @event, so that callers can
+ *   skip building its data
+ */
+gboolean
+terminal_events_is_wanted (TerminalEvents *events,
+                           TerminalEvent event)
+{
+  return events->counts[event] > 0;
+}
+
+/**
+ * terminal_events_post:
+ * @events: a #TerminalEvents
+ * @object_path: the object path of the terminal
+ * @event: a #TerminalEvent
+ * @data: (transfer floating): an a{sv} describing the event
+ *
+ * Queues @event for the subscriptions that want it.
+ */
+void
+terminal_events_post (TerminalEvents *events,
+                      const char *object_path,
+                      TerminalEvent event,
+                      GVariant *data)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_variant_ref_sink (data);
+
+  g_hash_table_iter_init (&iter, events->subscriptions);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    Subscription *subscription = value;
+
+    if (!(subscription->mask & (1 << event)))
+      continue;
+    if (subscription->object_paths != NULL &&
+        !g_hash_table_contains (subscription->object_paths, object_path))
+      continue;
+
+    subscription_add (subscription, object_path, event, data);
+  }
+
+  g_variant_unref (data);
+}
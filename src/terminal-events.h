@@ -0,0 +1,61 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_EVENTS_H
+#define TERMINAL_EVENTS_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  TERMINAL_EVENT_TITLE,
+  TERMINAL_EVENT_CWD,
+  TERMINAL_EVENT_FOREGROUND_PROCESS,
+  TERMINAL_EVENT_BELL,
+  TERMINAL_EVENT_ACTIVITY,
+  TERMINAL_EVENT_EXIT,
+  TERMINAL_N_EVENTS
+} TerminalEvent;
+
+typedef struct _TerminalEvents TerminalEvents;
+
+TerminalEvents *terminal_events_new (void);
+
+void terminal_events_free (TerminalEvents *events);
+
+guint terminal_events_subscribe (TerminalEvents *events,
+                                 GDBusConnection *connection,
+                                 const char *subscriber,
+                                 const char * const *names,
+                                 const char * const *object_paths,
+                                 guint interval,
+                                 GError **error);
+
+gboolean terminal_events_unsubscribe (TerminalEvents *events,
+                                      const char *subscriber,
+                                      guint id);
+
+gboolean terminal_events_is_wanted (TerminalEvents *events,
+                                    TerminalEvent event);
+
+void terminal_events_post (TerminalEvents *events,
+                           const char *object_path,
+                           TerminalEvent event,
+                           GVariant *data);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_EVENTS_H */
@@ -0,0 +1,383 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-feeder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gio/gio.h>
+
+#include "terminal-debug.h"
+
+/* Child input feeder
+ *
+ * Writes input to a terminal's child in chunks, in the order it was
+ * added. The input is written to the PTY directly, and only as much as
+ * the PTY takes, so if the child stops reading, nothing piles up in
+ * VTE's buffer or in our memory; the rest stays in the caller's memfd.
+ *
+ * While the PTY is detached from the terminal, because the terminal is
+ * hibernated or its output is throttled, feeding pauses until it is
+ * attached again. If the terminal gets another PTY, the input fails.
+ */
+
+#define CHUNK_SIZE (16 * 1024)
+
+typedef struct {
+  GBytes *bytes; /* or */
+  int fd;
+  goffset offset;
+  goffset size;
+  TerminalFeederDoneFunc done_func;
+  gpointer user_data;
+} Feed;
+
+struct _TerminalFeeder
+{
+  VteTerminal *terminal; /* unowned */
+  GIOChannel *channel; /* on the PTY master */
+  guint watch_id;
+  GQueue feeds; /* of Feed */
+};
+
+static void
+feed_finish (Feed *feed,
+             const GError *error)
+{
+  feed->done_func (error, feed->user_data);
+
+  if (feed->bytes != NULL)
+    g_bytes_unref (feed->bytes);
+  if (feed->fd != -1)
+    close (feed->fd);
+  g_slice_free (Feed, feed);
+}
+
+static void
+terminal_feeder_fail_all (TerminalFeeder *feeder,
+                          const char *message)
+{
+  GError *error;
+  Feed *feed;
+
+  error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CLOSED, message);
+  while ((feed = g_queue_pop_head (&feeder->feeds)) != NULL)
+    feed_finish (feed, error);
+  g_error_free (error);
+}
+
+/* Whether the terminal is reading from the PTY we write to */
+static gboolean
+terminal_feeder_is_attached (TerminalFeeder *feeder)
+{
+  VtePty *pty;
+
+  pty = vte_terminal_get_pty_object (feeder->terminal);
+  return pty != NULL && vte_pty_get_fd (pty) == g_io_channel_unix_get_fd (feeder->channel);
+}
+
+/* Writes as much of the next chunk of @feed as the PTY takes. Returns
+ * %FALSE once it's done, or failed.
+ */
+static gboolean
+terminal_feeder_write_chunk (TerminalFeeder *feeder,
+                             Feed *feed,
+                             GError **error)
+{
+  char buffer[CHUNK_SIZE];
+  const char *data;
+  gsize length;
+  ssize_t n;
+
+  length = (gsize) MIN (feed->size - feed->offset, CHUNK_SIZE);
+
+  if (feed->bytes != NULL) {
+    data = (const char *) g_bytes_get_data (feed->bytes, NULL) + feed->offset;
+  } else {
+    do
+      n = pread (feed->fd, buffer, length, feed->offset);
+    while (n == -1 && errno == EINTR);
+
+    if (n <= 0) {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (n == 0 ? EIO : errno),
+                   "Failed to read input: %s", n == 0 ? "Unexpected end of file" : g_strerror (errno));
+      return FALSE;
+    }
+
+    data = buffer;
+    length = n;
+  }
+
+  do
+    n = write (g_io_channel_unix_get_fd (feeder->channel), data, length);
+  while (n == -1 && errno == EINTR);
+
+  if (n == -1) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return TRUE;
+
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                 "Failed to write input: %s", g_strerror (errno));
+    return FALSE;
+  }
+
+  feed->offset += n;
+  return feed->offset < feed->size;
+}
+
+static gboolean
+terminal_feeder_writable_cb (GIOChannel *channel,
+                             GIOCondition condition,
+                             TerminalFeeder *feeder)
+{
+  Feed *feed;
+  GError *error = NULL;
+
+  if (condition & (G_IO_HUP | G_IO_ERR)) {
+    feeder->watch_id = 0;
+    terminal_feeder_fail_all (feeder, "The child stopped reading input");
+    return FALSE; /* remove */
+  }
+
+  /* Wait for it to come back; see terminal_feeder_pty_notify_cb() */
+  if (vte_terminal_get_pty_object (feeder->terminal) == NULL) {
+    feeder->watch_id = 0;
+    return FALSE; /* remove */
+  }
+
+  feed = g_queue_peek_head (&feeder->feeds);
+  if (!terminal_feeder_write_chunk (feeder, feed, &error)) {
+    g_queue_pop_head (&feeder->feeds);
+    feed_finish (feed, error);
+    g_clear_error (&error);
+  }
+
+  if (g_queue_is_empty (&feeder->feeds)) {
+    feeder->watch_id = 0;
+    return FALSE; /* remove */
+  }
+
+  return TRUE; /* run again */
+}
+
+static void
+terminal_feeder_start_watch (TerminalFeeder *feeder)
+{
+  if (feeder->watch_id != 0 || g_queue_is_empty (&feeder->feeds))
+    return;
+
+  feeder->watch_id = g_io_add_watch (feeder->channel,
+                                     G_IO_OUT | G_IO_HUP | G_IO_ERR,
+                                     (GIOFunc) terminal_feeder_writable_cb,
+                                     feeder);
+}
+
+static void
+terminal_feeder_stop_watch (TerminalFeeder *feeder)
+{
+  if (feeder->watch_id == 0)
+    return;
+
+  g_source_remove (feeder->watch_id);
+  feeder->watch_id = 0;
+}
+
+static void
+terminal_feeder_pty_notify_cb (VteTerminal *terminal,
+                               GParamSpec *pspec,
+                               TerminalFeeder *feeder)
+{
+  if (vte_terminal_get_pty_object (terminal) == NULL) {
+    terminal_feeder_stop_watch (feeder);
+  } else if (terminal_feeder_is_attached (feeder)) {
+    terminal_feeder_start_watch (feeder);
+  } else {
+    terminal_feeder_stop_watch (feeder);
+    terminal_feeder_fail_all (feeder, "The child went away");
+  }
+}
+
+static void
+terminal_feeder_push (TerminalFeeder *feeder,
+                      Feed *feed)
+{
+  g_queue_push_tail (&feeder->feeds, feed);
+
+  if (terminal_feeder_is_attached (feeder))
+    terminal_feeder_start_watch (feeder);
+}
+
+/**
+ * terminal_feeder_new:
+ * @terminal: the #VteTerminal to feed
+ * @pty_fd: the master of @terminal's PTY, which may be detached from
+ *   @terminal for now
+ *
+ * Returns: (transfer full): a new #TerminalFeeder
+ */
+TerminalFeeder *
+terminal_feeder_new (VteTerminal *terminal,
+                     int pty_fd)
+{
+  TerminalFeeder *feeder;
+
+  feeder = g_slice_new0 (TerminalFeeder);
+  feeder->terminal = terminal;
+  feeder->channel = g_io_channel_unix_new (pty_fd);
+  g_queue_init (&feeder->feeds);
+
+  g_signal_connect (terminal, "notify::pty-object",
+                    G_CALLBACK (terminal_feeder_pty_notify_cb), feeder);
+
+  return feeder;
+}
+
+/**
+ * terminal_feeder_free:
+ * @feeder: (allow-none): a #TerminalFeeder
+ *
+ * Fails the input that hasn't been written yet.
+ */
+void
+terminal_feeder_free (TerminalFeeder *feeder)
+{
+  if (feeder == NULL)
+    return;
+
+  g_signal_handlers_disconnect_by_func (feeder->terminal,
+                                        G_CALLBACK (terminal_feeder_pty_notify_cb),
+                                        feeder);
+  terminal_feeder_stop_watch (feeder);
+  terminal_feeder_fail_all (feeder, "The child went away");
+  g_io_channel_unref (feeder->channel);
+  g_slice_free (TerminalFeeder, feeder);
+}
+
+/**
+ * terminal_feeder_add_bytes:
+ * @feeder: a #TerminalFeeder
+ * @bytes: the input
+ * @done_func: called once @bytes are written, or failed to be
+ * @user_data: data for @done_func
+ *
+ * Queues @bytes for the child. If nothing is queued and the PTY takes
+ * all of @bytes right away, @done_func is called before this returns.
+ */
+void
+terminal_feeder_add_bytes (TerminalFeeder *feeder,
+                           GBytes *bytes,
+                           TerminalFeederDoneFunc done_func,
+                           gpointer user_data)
+{
+  Feed *feed;
+
+  feed = g_slice_new0 (Feed);
+  feed->bytes = g_bytes_ref (bytes);
+  feed->fd = -1;
+  feed->size = g_bytes_get_size (bytes);
+  feed->done_func = done_func;
+  feed->user_data = user_data;
+
+  if (feed->size == 0) {
+    feed_finish (feed, NULL);
+    return;
+  }
+
+  if (g_queue_is_empty (&feeder->feeds) &&
+      feed->size <= CHUNK_SIZE &&
+      terminal_feeder_is_attached (feeder)) {
+    GError *error = NULL;
+
+    if (!terminal_feeder_write_chunk (feeder, feed, &error)) {
+      feed_finish (feed, error);
+      g_clear_error (&error);
+      return;
+    }
+  }
+
+  terminal_feeder_push (feeder, feed);
+}
+
+/**
+ * terminal_feeder_add_fd:
+ * @feeder: a #TerminalFeeder
+ * @fd: (transfer full): a memfd with the input, sealed against writing
+ *   and shrinking
+ * @done_func: called once the contents of @fd are written, or failed to be
+ * @user_data: data for @done_func
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Queues the contents of @fd for the child. @fd is closed once they are
+ * written, or right away if it isn't suitable.
+ *
+ * Returns: %TRUE if @fd was queued, or %FALSE, without calling
+ *   @done_func, if it isn't suitable
+ */
+gboolean
+terminal_feeder_add_fd (TerminalFeeder *feeder,
+                        int fd,
+                        TerminalFeederDoneFunc done_func,
+                        gpointer user_data,
+                        GError **error)
+{
+  struct stat st;
+  Feed *feed;
+
+  if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode)) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                         "Input must be a regular file or memfd");
+    close (fd);
+    return FALSE;
+  }
+
+#ifdef F_GET_SEALS
+  /* The sender mustn't change the contents while we stream them */
+  {
+    int seals = fcntl (fd, F_GET_SEALS);
+
+    if (seals == -1 ||
+        (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK)) {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                           "Input must be a memfd sealed against writing and shrinking");
+      close (fd);
+      return FALSE;
+    }
+  }
+#endif
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Feeding %" G_GOFFSET_FORMAT " bytes from fd %d to the child\n",
+                         (goffset) st.st_size, fd);
+
+  feed = g_slice_new0 (Feed);
+  feed->fd = fd;
+  feed->size = st.st_size;
+  feed->done_func = done_func;
+  feed->user_data = user_data;
+
+  if (feed->size == 0) {
+    feed_finish (feed, NULL);
+    return TRUE;
+  }
+
+  terminal_feeder_push (feeder, feed);
+  return TRUE;
+}
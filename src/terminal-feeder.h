@@ -0,0 +1,51 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_FEEDER_H
+#define TERMINAL_FEEDER_H
+
+#include <vte/vte.h>
+
+G_BEGIN_DECLS
+
+/**
+ * TerminalFeederDoneFunc:
+ * @error: (allow-none): why the input couldn't all be written, or %NULL
+ * @user_data: the data passed with the input
+ */
+typedef void (* TerminalFeederDoneFunc) (const GError *error,
+                                         gpointer user_data);
+
+typedef struct _TerminalFeeder TerminalFeeder;
+
+TerminalFeeder *terminal_feeder_new (VteTerminal *terminal,
+                                     int pty_fd);
+
+void terminal_feeder_free (TerminalFeeder *feeder);
+
+void terminal_feeder_add_bytes (TerminalFeeder *feeder,
+                                GBytes *bytes,
+                                TerminalFeederDoneFunc done_func,
+                                gpointer user_data);
+
+gboolean terminal_feeder_add_fd (TerminalFeeder *feeder,
+                                 int fd,
+                                 TerminalFeederDoneFunc done_func,
+                                 gpointer user_data,
+                                 GError **error);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_FEEDER_H */
@@ -0,0 +1,493 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "terminal-flood-governor.h"
+
+#include "terminal-debug.h"
+
+/* A terminal that keeps changing its contents faster than @threshold
+ * times per second, for @duration seconds in a row, is flooding. Its
+ * PTY is then detached from the terminal for a while, so the terminal
+ * stops reading and the kernel's PTY buffer makes the writer block,
+ * and attached again for a short slice to let some output through.
+ * Once the rate during a slice drops below the threshold, the flood is
+ * over.
+ *
+ * Only reading stops while the PTY is detached: whatever the user types
+ * or pastes is still written to the PTY, and resizes still reach it, so
+ * keystrokes and Ctrl+C work as usual. Input that does not fit into the
+ * PTY right away is handed to the terminal once it is attached again.
+ *
+ * A visible terminal gets most of the time to read, so that the output
+ * still scrolls by; a hidden one only gets a trickle.
+ */
+
+#define PAUSE_VISIBLE (250)  /* ms */
+#define SLICE_VISIBLE (750)  /* ms */
+#define PAUSE_HIDDEN  (1750) /* ms */
+#define SLICE_HIDDEN  (250)  /* ms */
+
+struct _TerminalFloodGovernorPrivate
+{
+  VteTerminal *terminal; /* unowned */
+  TerminalTimerWheel *wheel; /* unowned */
+
+  guint threshold; /* changes per second, 0 when disabled */
+  guint duration; /* s */
+  gboolean visible;
+
+  guint64 window_start; /* tick */
+  guint window_events;
+  guint flooding_seconds;
+
+  gboolean throttled;
+  VtePty *paused_pty; /* while detached */
+  GByteArray *pending_input; /* written to paused_pty on resume */
+  guint64 slice_start; /* tick */
+  guint slice_events;
+  guint timer_id;
+};
+
+enum
+{
+  PROP_0,
+  PROP_THROTTLED
+};
+
+G_DEFINE_TYPE (TerminalFloodGovernor, terminal_flood_governor, G_TYPE_OBJECT)
+
+static void terminal_flood_governor_pause (TerminalFloodGovernor *governor);
+
+static guint
+elapsed_ms (TerminalFloodGovernor *governor,
+            guint64 since)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  return (guint) MIN ((terminal_timer_wheel_get_tick (priv->wheel) - since) *
+                      terminal_timer_wheel_get_resolution (priv->wheel),
+                      G_MAXUINT);
+}
+
+static void
+terminal_flood_governor_stop_timer (TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  if (priv->timer_id == 0)
+    return;
+
+  terminal_timer_wheel_remove (priv->wheel, priv->timer_id);
+  priv->timer_id = 0;
+}
+
+static void
+terminal_flood_governor_resume (TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  if (priv->paused_pty == NULL)
+    return;
+
+  /* Unless somebody else set another one meanwhile */
+  if (vte_terminal_get_pty_object (priv->terminal) == NULL) {
+    vte_terminal_set_pty_object (priv->terminal, priv->paused_pty);
+
+    if (priv->pending_input->len > 0)
+      vte_terminal_feed_child_binary (priv->terminal,
+                                      (const char *) priv->pending_input->data,
+                                      priv->pending_input->len);
+  }
+
+  g_byte_array_set_size (priv->pending_input, 0);
+  g_object_unref (priv->paused_pty);
+  priv->paused_pty = NULL;
+}
+
+static void
+terminal_flood_governor_set_throttled (TerminalFloodGovernor *governor,
+                                       gboolean throttled)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  if (priv->throttled == throttled)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[terminal %p] %s throttling output\n",
+                         priv->terminal, throttled ? "start" : "stop");
+
+  priv->throttled = throttled;
+  priv->flooding_seconds = 0;
+  priv->window_events = 0;
+  priv->window_start = terminal_timer_wheel_get_tick (priv->wheel);
+
+  g_object_notify (G_OBJECT (governor), "throttled");
+}
+
+static void
+slice_end_cb (TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+  guint elapsed;
+
+  priv->timer_id = 0;
+
+  elapsed = MAX (elapsed_ms (governor, priv->slice_start),
+                 terminal_timer_wheel_get_resolution (priv->wheel));
+  if ((guint64) priv->slice_events * 1000 < (guint64) priv->threshold * elapsed)
+    terminal_flood_governor_set_throttled (governor, FALSE);
+  else
+    terminal_flood_governor_pause (governor);
+}
+
+static void
+pause_end_cb (TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  priv->timer_id = 0;
+
+  terminal_flood_governor_resume (governor);
+
+  priv->slice_events = 0;
+  priv->slice_start = terminal_timer_wheel_get_tick (priv->wheel);
+  priv->timer_id = terminal_timer_wheel_add (priv->wheel,
+                                             priv->visible ? SLICE_VISIBLE : SLICE_HIDDEN,
+                                             (TerminalTimerFunc) slice_end_cb,
+                                             governor);
+}
+
+static void
+terminal_flood_governor_pause (TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+  VtePty *pty;
+
+  pty = vte_terminal_get_pty_object (priv->terminal);
+  if (pty == NULL) {
+    /* Nothing to read from */
+    terminal_flood_governor_set_throttled (governor, FALSE);
+    return;
+  }
+
+  priv->paused_pty = g_object_ref (pty);
+  vte_terminal_set_pty_object (priv->terminal, NULL);
+
+  priv->timer_id = terminal_timer_wheel_add (priv->wheel,
+                                             priv->visible ? PAUSE_VISIBLE : PAUSE_HIDDEN,
+                                             (TerminalTimerFunc) pause_end_cb,
+                                             governor);
+}
+
+/* VTE still emits ::commit for typed and pasted text without a PTY,
+ * it just has nowhere to send it; so send it ourselves.
+ */
+static void
+terminal_commit_cb (VteTerminal *terminal,
+                    const char *text,
+                    guint size,
+                    TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+  int fd;
+  gssize n;
+
+  if (priv->paused_pty == NULL || size == 0)
+    return;
+
+  /* Keep the order */
+  if (priv->pending_input->len > 0) {
+    g_byte_array_append (priv->pending_input, (const guint8 *) text, size);
+    return;
+  }
+
+  fd = vte_pty_get_fd (priv->paused_pty);
+  while (size > 0) {
+    n = write (fd, text, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        g_byte_array_append (priv->pending_input, (const guint8 *) text, size);
+      break;
+    }
+
+    text += n;
+    size -= n;
+  }
+}
+
+static void
+terminal_size_allocate_cb (GtkWidget *widget,
+                           GtkAllocation *allocation,
+                           TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  if (priv->paused_pty == NULL)
+    return;
+
+  vte_pty_set_size (priv->paused_pty,
+                    vte_terminal_get_row_count (priv->terminal),
+                    vte_terminal_get_column_count (priv->terminal),
+                    NULL);
+}
+
+static void
+terminal_changed_cb (VteTerminal *terminal,
+                     TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+  guint elapsed;
+
+  if (priv->threshold == 0)
+    return;
+
+  if (priv->throttled) {
+    priv->slice_events++;
+    return;
+  }
+
+  priv->window_events++;
+
+  elapsed = elapsed_ms (governor, priv->window_start);
+  if (elapsed < 1000)
+    return;
+
+  if ((guint64) priv->window_events * 1000 >= (guint64) priv->threshold * elapsed)
+    priv->flooding_seconds += elapsed / 1000;
+  else
+    priv->flooding_seconds = 0;
+
+  priv->window_events = 0;
+  priv->window_start = terminal_timer_wheel_get_tick (priv->wheel);
+
+  if (priv->flooding_seconds < priv->duration)
+    return;
+
+  terminal_flood_governor_set_throttled (governor, TRUE);
+  terminal_flood_governor_pause (governor);
+}
+
+/* Class implementation */
+
+static void
+terminal_flood_governor_init (TerminalFloodGovernor *governor)
+{
+  TerminalFloodGovernorPrivate *priv;
+
+  priv = governor->priv = G_TYPE_INSTANCE_GET_PRIVATE (governor, TERMINAL_TYPE_FLOOD_GOVERNOR, TerminalFloodGovernorPrivate);
+
+  priv->duration = 1;
+  priv->visible = TRUE;
+  priv->pending_input = g_byte_array_new ();
+}
+
+static void
+terminal_flood_governor_dispose (GObject *object)
+{
+  TerminalFloodGovernor *governor = TERMINAL_FLOOD_GOVERNOR (object);
+  TerminalFloodGovernorPrivate *priv = governor->priv;
+
+  terminal_flood_governor_stop_timer (governor);
+
+  if (priv->terminal != NULL) {
+    terminal_flood_governor_resume (governor);
+
+    g_signal_handlers_disconnect_by_func (priv->terminal,
+                                          G_CALLBACK (terminal_changed_cb),
+                                          governor);
+    g_signal_handlers_disconnect_by_func (priv->terminal,
+                                          G_CALLBACK (terminal_commit_cb),
+                                          governor);
+    g_signal_handlers_disconnect_by_func (priv->terminal,
+                                          G_CALLBACK (terminal_size_allocate_cb),
+                                          governor);
+    g_object_remove_weak_pointer (G_OBJECT (priv->terminal), (gpointer *) &priv->terminal);
+    priv->terminal = NULL;
+  }
+
+  g_clear_object (&priv->paused_pty);
+
+  G_OBJECT_CLASS (terminal_flood_governor_parent_class)->dispose (object);
+}
+
+static void
+terminal_flood_governor_finalize (GObject *object)
+{
+  TerminalFloodGovernor *governor = TERMINAL_FLOOD_GOVERNOR (object);
+
+  g_byte_array_unref (governor->priv->pending_input);
+
+  G_OBJECT_CLASS (terminal_flood_governor_parent_class)->finalize (object);
+}
+
+static void
+terminal_flood_governor_get_property (GObject *object,
+                                      guint prop_id,
+                                      GValue *value,
+                                      GParamSpec *pspec)
+{
+  TerminalFloodGovernor *governor = TERMINAL_FLOOD_GOVERNOR (object);
+
+  switch (prop_id) {
+    case PROP_THROTTLED:
+      g_value_set_boolean (value, terminal_flood_governor_get_throttled (governor));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+terminal_flood_governor_class_init (TerminalFloodGovernorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = terminal_flood_governor_dispose;
+  object_class->finalize = terminal_flood_governor_finalize;
+  object_class->get_property = terminal_flood_governor_get_property;
+
+  g_object_class_install_property
+    (object_class,
+     PROP_THROTTLED,
+     g_param_spec_boolean ("throttled", NULL, NULL,
+                           FALSE,
+                           G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_type_class_add_private (object_class, sizeof (TerminalFloodGovernorPrivate));
+}
+
+/* Public API */
+
+/**
+ * terminal_flood_governor_new:
+ * @terminal: the #VteTerminal to govern
+ * @wheel: the #TerminalTimerWheel to schedule on
+ *
+ * Creates a governor for @terminal. It does nothing until limits are
+ * set with terminal_flood_governor_set_limits(). @wheel must outlive
+ * the governor.
+ *
+ * Returns: (transfer full): a new #TerminalFloodGovernor
+ */
+TerminalFloodGovernor *
+terminal_flood_governor_new (VteTerminal *terminal,
+                             TerminalTimerWheel *wheel)
+{
+  TerminalFloodGovernor *governor;
+  TerminalFloodGovernorPrivate *priv;
+
+  g_return_val_if_fail (VTE_IS_TERMINAL (terminal), NULL);
+  g_return_val_if_fail (wheel != NULL, NULL);
+
+  governor = g_object_new (TERMINAL_TYPE_FLOOD_GOVERNOR, NULL);
+  priv = governor->priv;
+
+  priv->terminal = terminal;
+  g_object_add_weak_pointer (G_OBJECT (terminal), (gpointer *) &priv->terminal);
+  priv->wheel = wheel;
+  priv->window_start = terminal_timer_wheel_get_tick (wheel);
+
+  g_signal_connect (terminal, "contents-changed",
+                    G_CALLBACK (terminal_changed_cb), governor);
+  g_signal_connect (terminal, "cursor-moved",
+                    G_CALLBACK (terminal_changed_cb), governor);
+  g_signal_connect (terminal, "commit",
+                    G_CALLBACK (terminal_commit_cb), governor);
+  g_signal_connect_after (terminal, "size-allocate",
+                          G_CALLBACK (terminal_size_allocate_cb), governor);
+
+  return governor;
+}
+
+/**
+ * terminal_flood_governor_set_limits:
+ * @governor: a #TerminalFloodGovernor
+ * @threshold: contents changes and cursor moves per second that count
+ *   as a flood, or 0 to disable the governor
+ * @duration: seconds the rate has to stay above @threshold
+ */
+void
+terminal_flood_governor_set_limits (TerminalFloodGovernor *governor,
+                                    guint threshold,
+                                    guint duration)
+{
+  TerminalFloodGovernorPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_FLOOD_GOVERNOR (governor));
+
+  priv = governor->priv;
+  priv->threshold = threshold;
+  priv->duration = MAX (duration, 1);
+
+  if (threshold == 0)
+    terminal_flood_governor_reset (governor);
+}
+
+/**
+ * terminal_flood_governor_set_visible:
+ * @governor: a #TerminalFloodGovernor
+ * @visible: whether the terminal can be seen
+ *
+ * A visible terminal gets more time to read while throttled. This takes
+ * effect from the next pause or slice.
+ */
+void
+terminal_flood_governor_set_visible (TerminalFloodGovernor *governor,
+                                     gboolean visible)
+{
+  g_return_if_fail (TERMINAL_IS_FLOOD_GOVERNOR (governor));
+
+  governor->priv->visible = visible != FALSE;
+}
+
+/**
+ * terminal_flood_governor_reset:
+ * @governor: a #TerminalFloodGovernor
+ *
+ * Stops throttling, and attaches the PTY again if it is detached. Call
+ * this when the terminal's child exits or is replaced.
+ */
+void
+terminal_flood_governor_reset (TerminalFloodGovernor *governor)
+{
+  g_return_if_fail (TERMINAL_IS_FLOOD_GOVERNOR (governor));
+
+  terminal_flood_governor_stop_timer (governor);
+  terminal_flood_governor_resume (governor);
+  terminal_flood_governor_set_throttled (governor, FALSE);
+}
+
+/**
+ * terminal_flood_governor_get_throttled:
+ * @governor: a #TerminalFloodGovernor
+ *
+ * Returns: whether the terminal's output is being throttled
+ */
+gboolean
+terminal_flood_governor_get_throttled (TerminalFloodGovernor *governor)
+{
+  g_return_val_if_fail (TERMINAL_IS_FLOOD_GOVERNOR (governor), FALSE);
+
+  return governor->priv->throttled;
+}
@@ -0,0 +1,68 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_FLOOD_GOVERNOR_H
+#define TERMINAL_FLOOD_GOVERNOR_H
+
+#include <glib-object.h>
+#include <vte/vte.h>
+
+#include "terminal-timer-wheel.h"
+
+G_BEGIN_DECLS
+
+#define TERMINAL_TYPE_FLOOD_GOVERNOR         (terminal_flood_governor_get_type ())
+#define TERMINAL_FLOOD_GOVERNOR(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), TERMINAL_TYPE_FLOOD_GOVERNOR, TerminalFloodGovernor))
+#define TERMINAL_FLOOD_GOVERNOR_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST((k), TERMINAL_TYPE_FLOOD_GOVERNOR, TerminalFloodGovernorClass))
+#define TERMINAL_IS_FLOOD_GOVERNOR(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), TERMINAL_TYPE_FLOOD_GOVERNOR))
+#define TERMINAL_IS_FLOOD_GOVERNOR_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), TERMINAL_TYPE_FLOOD_GOVERNOR))
+#define TERMINAL_FLOOD_GOVERNOR_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), TERMINAL_TYPE_FLOOD_GOVERNOR, TerminalFloodGovernorClass))
+
+typedef struct _TerminalFloodGovernor        TerminalFloodGovernor;
+typedef struct _TerminalFloodGovernorClass   TerminalFloodGovernorClass;
+typedef struct _TerminalFloodGovernorPrivate TerminalFloodGovernorPrivate;
+
+struct _TerminalFloodGovernor
+{
+  GObject parent_instance;
+
+  /*< private >*/
+  TerminalFloodGovernorPrivate *priv;
+};
+
+struct _TerminalFloodGovernorClass
+{
+  GObjectClass parent_class;
+};
+
+GType terminal_flood_governor_get_type (void);
+
+TerminalFloodGovernor *terminal_flood_governor_new (VteTerminal *terminal,
+                                                    TerminalTimerWheel *wheel);
+
+void terminal_flood_governor_set_limits (TerminalFloodGovernor *governor,
+                                         guint threshold,
+                                         guint duration);
+
+void terminal_flood_governor_set_visible (TerminalFloodGovernor *governor,
+                                          gboolean visible);
+
+void terminal_flood_governor_reset (TerminalFloodGovernor *governor);
+
+gboolean terminal_flood_governor_get_throttled (TerminalFloodGovernor *governor);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_FLOOD_GOVERNOR_H */
@@ -0,0 +1,333 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-frame-stats.h"
+
+#include <string.h>
+
+#include <gdk/gdk.h>
+
+/* Frame timings
+ *
+ * A frame is one update cycle of a window: everything painted in it
+ * from when GDK processes updates until the main loop gets to lower
+ * priority sources. Terminals have their own GdkWindow, so new output
+ * usually only repaints them without the toplevel's ::draw running;
+ * their paints count too. For each frame, the window records how
+ * long painting took and how much of that was VTE drawing terminals,
+ * how long size allocation and gnome-terminal's own handlers took since
+ * the previous frame and how much of the latter ran during layout or
+ * paint, and how many frame intervals new output waited to be painted.
+ * The last frames are kept in a ring buffer.
+ */
+
+#define FRAME_INTERVAL (G_USEC_PER_SEC / 60)
+
+typedef struct {
+  gint64 time; /* monotonic µs at the end of the paint */
+  guint paint; /* µs */
+  guint vte_paint; /* µs */
+  guint layout; /* µs */
+  guint handlers; /* µs */
+  guint handlers_in_frame; /* µs */
+  guint skipped; /* frame intervals */
+} Frame;
+
+struct _TerminalFrameStats
+{
+  Frame *frames;
+  guint capacity;
+  guint n_frames; /* ever recorded */
+
+  /* The frame in progress */
+  Frame current;
+  gint64 frame_start; /* first paint in the cycle, or 0 */
+  gint64 frame_end;
+  guint close_id;
+  gint64 paint_start; /* of the toplevel */
+  gint64 layout_start;
+  guint depth; /* of nested layouts and paints */
+  gint64 output_pending; /* since when, or 0 */
+};
+
+/**
+ * terminal_frame_stats_new:
+ * @capacity: the number of frames to keep
+ *
+ * Returns: (transfer full): a new #TerminalFrameStats
+ */
+TerminalFrameStats *
+terminal_frame_stats_new (guint capacity)
+{
+  TerminalFrameStats *stats;
+
+  stats = g_slice_new0 (TerminalFrameStats);
+  stats->capacity = MAX (capacity, 1);
+  stats->frames = g_new0 (Frame, stats->capacity);
+
+  return stats;
+}
+
+/**
+ * terminal_frame_stats_free:
+ * @stats: (allow-none): a #TerminalFrameStats
+ */
+void
+terminal_frame_stats_free (TerminalFrameStats *stats)
+{
+  if (stats == NULL)
+    return;
+
+  if (stats->close_id != 0)
+    g_source_remove (stats->close_id);
+  g_free (stats->frames);
+  g_slice_free (TerminalFrameStats, stats);
+}
+
+/* Completes the frame in progress and adds it to the ring buffer */
+static gboolean
+terminal_frame_stats_close_cb (TerminalFrameStats *stats)
+{
+  stats->close_id = 0;
+
+  stats->current.time = stats->frame_end;
+  if (stats->output_pending != 0) {
+    if (stats->frame_start > stats->output_pending)
+      stats->current.skipped = (stats->frame_start - stats->output_pending) / FRAME_INTERVAL;
+    stats->output_pending = 0;
+  }
+
+  stats->frames[stats->n_frames % stats->capacity] = stats->current;
+  stats->n_frames++;
+
+  memset (&stats->current, 0, sizeof (Frame));
+  stats->frame_start = 0;
+
+  return FALSE;
+}
+
+static void
+terminal_frame_stats_add_paint (TerminalFrameStats *stats,
+                                gint64 start,
+                                gint64 end)
+{
+  stats->current.paint += end - start;
+
+  if (stats->frame_start == 0)
+    stats->frame_start = start;
+  stats->frame_end = end;
+
+  /* After all paints of this cycle */
+  if (stats->close_id == 0)
+    stats->close_id = g_idle_add_full (GDK_PRIORITY_REDRAW + 1,
+                                       (GSourceFunc) terminal_frame_stats_close_cb,
+                                       stats, NULL);
+}
+
+/* All of these accept a %NULL @stats, so callers don't need to check
+ * whether recording is on.
+ */
+
+void
+terminal_frame_stats_begin_paint (TerminalFrameStats *stats)
+{
+  if (stats == NULL)
+    return;
+
+  stats->paint_start = g_get_monotonic_time ();
+  stats->depth++;
+}
+
+void
+terminal_frame_stats_end_paint (TerminalFrameStats *stats)
+{
+  if (stats == NULL || stats->paint_start == 0)
+    return;
+
+  stats->depth--;
+  terminal_frame_stats_add_paint (stats, stats->paint_start, g_get_monotonic_time ());
+  stats->paint_start = 0;
+}
+
+void
+terminal_frame_stats_begin_layout (TerminalFrameStats *stats)
+{
+  if (stats == NULL)
+    return;
+
+  stats->layout_start = g_get_monotonic_time ();
+  stats->depth++;
+}
+
+void
+terminal_frame_stats_end_layout (TerminalFrameStats *stats)
+{
+  if (stats == NULL || stats->layout_start == 0)
+    return;
+
+  stats->current.layout += g_get_monotonic_time () - stats->layout_start;
+  stats->layout_start = 0;
+  stats->depth--;
+}
+
+/**
+ * terminal_frame_stats_add_vte_paint:
+ * @stats: (allow-none): a #TerminalFrameStats
+ * @start: monotonic time the terminal started painting
+ * @end: monotonic time it was done
+ *
+ * Records a terminal's paint. Unless the toplevel is being painted
+ * around it, it is part of the frame's paint time as well.
+ */
+void
+terminal_frame_stats_add_vte_paint (TerminalFrameStats *stats,
+                                    gint64 start,
+                                    gint64 end)
+{
+  if (stats == NULL)
+    return;
+
+  stats->current.vte_paint += end - start;
+
+  if (stats->paint_start == 0)
+    terminal_frame_stats_add_paint (stats, start, end);
+}
+
+/**
+ * terminal_frame_stats_begin_handler:
+ * @stats: (allow-none): a #TerminalFrameStats
+ *
+ * Returns: the start time to pass to terminal_frame_stats_end_handler()
+ */
+gint64
+terminal_frame_stats_begin_handler (TerminalFrameStats *stats)
+{
+  if (stats == NULL)
+    return 0;
+
+  return g_get_monotonic_time ();
+}
+
+void
+terminal_frame_stats_end_handler (TerminalFrameStats *stats,
+                                  gint64 start)
+{
+  gint64 duration;
+
+  if (stats == NULL || start == 0)
+    return;
+
+  duration = g_get_monotonic_time () - start;
+  stats->current.handlers += duration;
+  if (stats->depth > 0)
+    stats->current.handlers_in_frame += duration;
+}
+
+/**
+ * terminal_frame_stats_output_pending:
+ * @stats: (allow-none): a #TerminalFrameStats
+ *
+ * Notes that a terminal in the window has new output to paint.
+ */
+void
+terminal_frame_stats_output_pending (TerminalFrameStats *stats)
+{
+  if (stats == NULL || stats->output_pending != 0)
+    return;
+
+  stats->output_pending = g_get_monotonic_time ();
+}
+
+/**
+ * terminal_frame_stats_get_frames:
+ * @stats: a #TerminalFrameStats
+ *
+ * Returns: (transfer floating): an a(xuuuuuu) of the recorded frames,
+ *   oldest first: the monotonic time the frame was done, the paint,
+ *   VTE paint, layout, handler and in-frame handler durations in µs,
+ *   and the number of skipped frames
+ */
+GVariant *
+terminal_frame_stats_get_frames (TerminalFrameStats *stats)
+{
+  GVariantBuilder builder;
+  guint i, n;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xuuuuuu)"));
+
+  n = MIN (stats->n_frames, stats->capacity);
+  for (i = stats->n_frames - n; i < stats->n_frames; i++) {
+    Frame *frame = &stats->frames[i % stats->capacity];
+
+    g_variant_builder_add (&builder, "(xuuuuuu)",
+                           frame->time,
+                           frame->paint,
+                           frame->vte_paint,
+                           frame->layout,
+                           frame->handlers,
+                           frame->handlers_in_frame,
+                           frame->skipped);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * terminal_frame_stats_format:
+ * @stats: a #TerminalFrameStats
+ *
+ * Returns: (transfer full): the recorded frames as a table, with
+ *   totals, for logging
+ */
+char *
+terminal_frame_stats_format (TerminalFrameStats *stats)
+{
+  GString *string;
+  guint64 paint = 0, vte_paint = 0, layout = 0, handlers = 0, handlers_in_frame = 0, skipped = 0;
+  guint i, n;
+
+  string = g_string_new ("    time (ms)   paint     vte  layout handler (in frame) skipped\n");
+
+  n = MIN (stats->n_frames, stats->capacity);
+  for (i = stats->n_frames - n; i < stats->n_frames; i++) {
+    Frame *frame = &stats->frames[i % stats->capacity];
+
+    g_string_append_printf (string, "%13.3f %7.3f %7.3f %7.3f %7.3f   %7.3f %7u\n",
+                            frame->time / 1000.,
+                            frame->paint / 1000.,
+                            frame->vte_paint / 1000.,
+                            frame->layout / 1000.,
+                            frame->handlers / 1000.,
+                            frame->handlers_in_frame / 1000.,
+                            frame->skipped);
+
+    paint += frame->paint;
+    vte_paint += frame->vte_paint;
+    layout += frame->layout;
+    handlers += frame->handlers;
+    handlers_in_frame += frame->handlers_in_frame;
+    skipped += frame->skipped;
+  }
+
+  g_string_append_printf (string, "%u frames, total %.3f ms painting (%.3f ms VTE), "
+                          "%.3f ms layout, %.3f ms handlers (%.3f ms in frames), "
+                          "%" G_GUINT64_FORMAT " frames skipped\n",
+                          n, paint / 1000., vte_paint / 1000., layout / 1000.,
+                          handlers / 1000., handlers_in_frame / 1000., skipped);
+
+  return g_string_free (string, FALSE);
+}
@@ -0,0 +1,54 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_FRAME_STATS_H
+#define TERMINAL_FRAME_STATS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalFrameStats TerminalFrameStats;
+
+TerminalFrameStats *terminal_frame_stats_new (guint capacity);
+
+void terminal_frame_stats_free (TerminalFrameStats *stats);
+
+void terminal_frame_stats_begin_paint (TerminalFrameStats *stats);
+
+void terminal_frame_stats_end_paint (TerminalFrameStats *stats);
+
+void terminal_frame_stats_begin_layout (TerminalFrameStats *stats);
+
+void terminal_frame_stats_end_layout (TerminalFrameStats *stats);
+
+void terminal_frame_stats_add_vte_paint (TerminalFrameStats *stats,
+                                         gint64 start,
+                                         gint64 end);
+
+gint64 terminal_frame_stats_begin_handler (TerminalFrameStats *stats);
+
+void terminal_frame_stats_end_handler (TerminalFrameStats *stats,
+                                       gint64 start);
+
+void terminal_frame_stats_output_pending (TerminalFrameStats *stats);
+
+GVariant *terminal_frame_stats_get_frames (TerminalFrameStats *stats);
+
+char *terminal_frame_stats_format (TerminalFrameStats *stats);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_FRAME_STATS_H */
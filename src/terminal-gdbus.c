@@ -20,14 +20,22 @@
 
 #include "terminal-gdbus.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
 
 #include "terminal-app.h"
 #include "terminal-debug.h"
 #include "terminal-defines.h"
+#include "terminal-histogram.h"
 #include "terminal-mdi-container.h"
+#include "terminal-trace.h"
 #include "terminal-util.h"
+#include "terminal-watchdog.h"
 #include "terminal-window.h"
 
 /* ------------------------------------------------------------------------- */
@@ -43,8 +51,161 @@ enum {
   PROP_SCREEN
 };
 
+/* How long the methods that create terminals take, for GetStats */
+enum {
+  METHOD_CREATE_INSTANCE,
+  METHOD_EXEC,
+  N_METHODS
+};
+
+static const char *method_names[N_METHODS] = {
+  "CreateInstance",
+  "Exec"
+};
+
+static TerminalHistogram method_latencies[N_METHODS];
+
 /* helper functions */
 
+static GVariant *
+build_resource_usage (TerminalScreen *screen)
+{
+  GVariantBuilder builder;
+  const TerminalProcessInfo *info;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+  g_variant_builder_add (&builder, "{sv}", "restart-count",
+                         g_variant_new_uint32 (terminal_screen_get_restart_count (screen)));
+  if (terminal_screen_get_cgroup (screen) != NULL)
+    g_variant_builder_add (&builder, "{sv}", "cgroup",
+                           g_variant_new_string (terminal_cgroup_get_path (terminal_screen_get_cgroup (screen))));
+
+  info = terminal_process_tracker_lookup (terminal_app_get_process_tracker (terminal_app_get ()),
+                                          screen);
+  if (info != NULL) {
+    g_variant_builder_add (&builder, "{sv}", "child-pid",
+                           g_variant_new_int32 (terminal_screen_get_child_pid (screen)));
+    if (info->name != NULL)
+      g_variant_builder_add (&builder, "{sv}", "foreground-process",
+                             g_variant_new_string (info->name));
+    g_variant_builder_add (&builder, "{sv}", "processes", g_variant_new_uint32 (info->n_processes));
+    g_variant_builder_add (&builder, "{sv}", "cpu-percent", g_variant_new_double (info->cpu_percent));
+    g_variant_builder_add (&builder, "{sv}", "rss", g_variant_new_uint64 (info->rss));
+    g_variant_builder_add (&builder, "{sv}", "read-bytes", g_variant_new_uint64 (info->read_bytes));
+    g_variant_builder_add (&builder, "{sv}", "write-bytes", g_variant_new_uint64 (info->write_bytes));
+    if (info->cgroup_memory > 0)
+      g_variant_builder_add (&builder, "{sv}", "cgroup-memory", g_variant_new_uint64 (info->cgroup_memory));
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/* Looks up the window from the "window-id" option, or creates a new one.
+ * Returns %NULL after returning an error to @invocation.
+ */
+static TerminalWindow *
+get_window_for_options (GDBusMethodInvocation *invocation,
+                        GVariant *options,
+                        gboolean *have_new_window)
+{
+  TerminalApp *app = terminal_app_get ();
+  TerminalWindow *window;
+  guint window_id;
+
+  if (g_variant_lookup (options, "window-id", "u", &window_id)) {
+    GtkWindow *win;
+
+    win = gtk_application_get_window_by_id (GTK_APPLICATION (app), window_id);
+
+    if (!TERMINAL_IS_WINDOW (win)) {
+      g_dbus_method_invocation_return_error (invocation,
+                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                             "Nonexisting window %u referenced",
+                                             window_id);
+      return NULL;
+    }
+
+    window = TERMINAL_WINDOW (win);
+    *have_new_window = FALSE;
+  } else {
+    const char *startup_id, *display_name, *role;
+    gboolean start_maximized, start_fullscreen;
+    int screen_number;
+    GdkScreen *gdk_screen;
+
+    /* Create a new window */
+
+    if (!g_variant_lookup (options, "display", "^&ay", &display_name)) {
+      g_dbus_method_invocation_return_error (invocation, 
+                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                             "No display specified");
+      return NULL;
+    }
+
+    screen_number = 0;
+    gdk_screen = terminal_util_get_screen_by_display_name (display_name, screen_number);
+    if (gdk_screen == NULL) {
+      g_dbus_method_invocation_return_error (invocation, 
+                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                             "No screen %d on display \"%s\"",
+                                             screen_number, display_name);
+      return NULL;
+    }
+
+    window = terminal_app_new_window (app, gdk_screen);
+
+    if (g_variant_lookup (options, "desktop-startup-id", "^&ay", &startup_id))
+      gtk_window_set_startup_id (GTK_WINDOW (window), startup_id);
+
+    /* Overwrite the default, unique window role set in terminal_window_init */
+    if (g_variant_lookup (options, "role", "&s", &role))
+      gtk_window_set_role (GTK_WINDOW (window), role);
+
+    if (g_variant_lookup (options, "fullscreen-window", "b", &start_fullscreen) &&
+        start_fullscreen) {
+      gtk_window_fullscreen (GTK_WINDOW (window));
+    }
+    if (g_variant_lookup (options, "maximize-window", "b", &start_maximized) &&
+        start_maximized) {
+      gtk_window_maximize (GTK_WINDOW (window));
+    }
+
+    *have_new_window = TRUE;
+  }
+
+  return window;
+}
+
+static void
+present_window_for_options (TerminalWindow *window,
+                            GVariant *options,
+                            gboolean have_new_window)
+{
+  gboolean present_window, present_window_set;
+
+  if (g_variant_lookup (options, "present-window", "b", &present_window))
+    present_window_set = TRUE;
+  else
+    present_window_set = FALSE;
+
+  if (have_new_window) {
+    const char *geometry;
+
+    if (g_variant_lookup (options, "geometry", "&s", &geometry) &&
+        !terminal_window_parse_geometry (window, geometry))
+      _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+                             "Invalid geometry string \"%s\"", geometry);
+
+    /* Restored windows shouldn't demand attention; see bug #586308. */
+    if (present_window_set && !present_window)
+      terminal_window_set_is_restored (window);
+  }
+
+  if (have_new_window || (present_window_set && present_window))
+    gtk_window_present (GTK_WINDOW (window));
+}
+
 static void
 child_exited_cb (VteTerminal *terminal,
                  TerminalReceiver *receiver)
@@ -56,6 +217,18 @@ child_exited_cb (VteTerminal *terminal,
   terminal_receiver_emit_child_exited (receiver, exit_code);
 }
 
+static void
+trace_finished_cb (TerminalScreen *screen,
+                   TerminalReceiver *receiver)
+{
+  TerminalTrace *trace;
+
+  trace = terminal_screen_get_trace (screen);
+  terminal_receiver_emit_trace_finished (receiver,
+                                         terminal_trace_get_id (trace),
+                                         terminal_trace_get_spans (trace));
+}
+
 static void
 terminal_receiver_impl_set_screen (TerminalReceiverImpl *impl,
                                 TerminalScreen *screen)
@@ -80,6 +253,9 @@ terminal_receiver_impl_set_screen (TerminalReceiverImpl *impl,
     g_signal_connect (screen, "child-exited",
                       G_CALLBACK (child_exited_cb), 
                       impl);
+    g_signal_connect (screen, "trace-finished",
+                      G_CALLBACK (trace_finished_cb),
+                      impl);
     g_signal_connect_swapped (screen, "destroy",
                               G_CALLBACK (_terminal_receiver_impl_unset_screen), 
                               impl);
@@ -99,11 +275,18 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
 {
   TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
   TerminalReceiverImplPrivate *priv = impl->priv;
-  const char *working_directory;
+  const char *working_directory, *view_path;
   char **exec_argv, **envv;
   gsize exec_argc;
-  GVariant *fd_array;
+  GVariant *fd_array, *resources;
+  gint32 view_fd;
   GError *error;
+  const char *phase;
+  TerminalTrace *trace;
+  gint64 start;
+
+  phase = terminal_watchdog_enter ("terminal_receiver_impl_exec");
+  start = g_get_monotonic_time ();
 
   if (priv->screen == NULL) {
     g_dbus_method_invocation_return_error_literal (invocation,
@@ -113,6 +296,46 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
     goto out;
   }
 
+  /* Show a file or a passed FD instead of running a command */
+  if (!g_variant_lookup (options, "view-path", "^&ay", &view_path))
+    view_path = NULL;
+  if (!g_variant_lookup (options, "view-fd", "h", &view_fd))
+    view_fd = -1;
+  if (view_path != NULL || view_fd != -1) {
+    int fd = -1;
+
+    error = NULL;
+    if (view_path == NULL) {
+      if (fd_list == NULL || view_fd < 0 || view_fd >= g_unix_fd_list_get_length (fd_list)) {
+        g_dbus_method_invocation_return_error_literal (invocation,
+                                                       G_DBUS_ERROR,
+                                                       G_DBUS_ERROR_INVALID_ARGS,
+                                                       "Handle out of range");
+        goto out;
+      }
+      fd = g_unix_fd_list_get (fd_list, view_fd, &error);
+    }
+
+    if ((view_path == NULL && fd == -1) ||
+        !terminal_screen_view (priv->screen, view_path, fd, &error))
+      g_dbus_method_invocation_take_error (invocation, error);
+    else
+      terminal_receiver_complete_exec (receiver, invocation, NULL /* outfdlist */);
+    goto out;
+  }
+
+  /* Continue the trace from CreateInstance, unless this is a new request */
+  trace = terminal_trace_new_for_options (options);
+  if (trace != NULL) {
+    TerminalTrace *current = terminal_screen_get_trace (priv->screen);
+
+    if (current != NULL &&
+        strcmp (terminal_trace_get_id (current), terminal_trace_get_id (trace)) == 0)
+      terminal_trace_free (trace);
+    else
+      terminal_screen_set_trace (priv->screen, trace);
+  }
+
   if (!g_variant_lookup (options, "cwd", "^&ay", &working_directory))
     working_directory = NULL;
   if (!g_variant_lookup (options, "environ", "^a&ay", &envv))
@@ -120,6 +343,8 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
 
   if (!g_variant_lookup (options, "fd-set", "@a(ih)", &fd_array))
     fd_array = NULL;
+  if (!g_variant_lookup (options, "resources", "@a{sv}", &resources))
+    resources = NULL;
 
   /* Check FD passing */
   if ((fd_list != NULL) ^ (fd_array != NULL)) {
@@ -172,6 +397,7 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
                              envv,
                              working_directory,
                              fd_list, fd_array,
+                             resources,
                              &error)) {
     g_dbus_method_invocation_take_error (invocation, error);
   } else {
@@ -182,8 +408,247 @@ terminal_receiver_impl_exec (TerminalReceiver *receiver,
   g_free (envv);
   if (fd_array)
     g_variant_unref (fd_array);
+  if (resources)
+    g_variant_unref (resources);
 
 out:
+  terminal_histogram_add (&method_latencies[METHOD_EXEC], g_get_monotonic_time () - start);
+  terminal_watchdog_leave (phase);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_receiver_impl_get_resource_usage (TerminalReceiver *receiver,
+                                           GDBusMethodInvocation *invocation)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    return TRUE;
+  }
+
+  terminal_receiver_complete_get_resource_usage (receiver, invocation,
+                                                 build_resource_usage (priv->screen));
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_receiver_impl_attach (TerminalReceiver *receiver,
+                               GDBusMethodInvocation *invocation,
+                               GVariant *options)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+  TerminalApp *app = terminal_app_get ();
+  TerminalWindow *window;
+  TerminalScreen *screen;
+  gboolean have_new_window;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    return TRUE;
+  }
+  if (gtk_widget_get_parent (GTK_WIDGET (priv->screen)) != NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal is already attached to a window");
+    return TRUE;
+  }
+
+  window = get_window_for_options (invocation, options, &have_new_window);
+  if (window == NULL)
+    return TRUE;
+
+  screen = g_object_ref (priv->screen);
+  terminal_app_remove_headless_screen (app, screen);
+  terminal_window_add_screen (window, screen, -1);
+  terminal_window_switch_screen (window, screen);
+  gtk_widget_grab_focus (GTK_WIDGET (screen));
+  g_object_unref (screen);
+
+  present_window_for_options (window, options, have_new_window);
+
+  terminal_receiver_complete_attach (receiver, invocation);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_receiver_impl_detach (TerminalReceiver *receiver,
+                               GDBusMethodInvocation *invocation)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+  GtkWidget *toplevel;
+  TerminalScreen *screen;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    return TRUE;
+  }
+
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (priv->screen));
+  if (!gtk_widget_is_toplevel (toplevel) || !TERMINAL_IS_WINDOW (toplevel)) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal is not attached to a window");
+    return TRUE;
+  }
+
+  /* The window closes itself if this was its last terminal */
+  screen = terminal_window_detach_screen (TERMINAL_WINDOW (toplevel), priv->screen);
+  terminal_app_add_headless_screen (terminal_app_get (), screen);
+  g_object_unref (screen);
+
+  terminal_receiver_complete_detach (receiver, invocation);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_receiver_impl_get_latency (TerminalReceiver *receiver,
+                                    GDBusMethodInvocation *invocation)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    return TRUE; /* handled */
+  }
+
+  terminal_receiver_complete_get_latency (receiver, invocation,
+                                          terminal_screen_get_latency_report (priv->screen));
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_receiver_impl_get_frame_timings (TerminalReceiver *receiver,
+                                          GDBusMethodInvocation *invocation)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+  GtkWidget *toplevel;
+  TerminalFrameStats *stats = NULL;
+  GVariant *frames;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    return TRUE; /* handled */
+  }
+
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (priv->screen));
+  if (TERMINAL_IS_WINDOW (toplevel))
+    stats = terminal_window_get_frame_stats (TERMINAL_WINDOW (toplevel));
+
+  if (stats != NULL)
+    frames = terminal_frame_stats_get_frames (stats);
+  else
+    frames = g_variant_new_array (G_VARIANT_TYPE ("(xuuuuuu)"), NULL, 0);
+
+  terminal_receiver_complete_get_frame_timings (receiver, invocation, frames);
+
+  return TRUE; /* handled */
+}
+
+static void
+feed_child_done_cb (const GError *error,
+                    GDBusMethodInvocation *invocation)
+{
+  if (error != NULL)
+    g_dbus_method_invocation_return_gerror (invocation, error);
+  else
+    g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static gboolean
+terminal_receiver_impl_feed_child (TerminalReceiver *receiver,
+                                   GDBusMethodInvocation *invocation,
+                                   GUnixFDList *fd_list,
+                                   GVariant *options,
+                                   GVariant *data)
+{
+  TerminalReceiverImpl *impl = TERMINAL_RECEIVER_IMPL (receiver);
+  TerminalReceiverImplPrivate *priv = impl->priv;
+  TerminalFeeder *feeder;
+  GBytes *bytes;
+  gint32 input_fd;
+  GError *error = NULL;
+
+  if (priv->screen == NULL) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_FAILED,
+                                                   "Terminal already closed");
+    return TRUE; /* handled */
+  }
+
+  /* Large input comes in a sealed memfd rather than in the message */
+  if (!g_variant_lookup (options, "input-fd", "h", &input_fd))
+    input_fd = -1;
+  if (input_fd != -1 &&
+      (fd_list == NULL || input_fd < 0 || input_fd >= g_unix_fd_list_get_length (fd_list))) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_INVALID_ARGS,
+                                                   "Handle out of range");
+    return TRUE; /* handled */
+  }
+  if (input_fd != -1 && g_variant_get_size (data) > 0) {
+    g_dbus_method_invocation_return_error_literal (invocation,
+                                                   G_DBUS_ERROR,
+                                                   G_DBUS_ERROR_INVALID_ARGS,
+                                                   "Must pass either data or an input-fd, not both");
+    return TRUE; /* handled */
+  }
+
+  feeder = terminal_screen_get_feeder (priv->screen, &error);
+  if (feeder == NULL) {
+    g_dbus_method_invocation_take_error (invocation, error);
+    return TRUE; /* handled */
+  }
+
+  /* The reply is sent once the child has been given all of the input */
+  if (input_fd != -1) {
+    int fd;
+
+    fd = g_unix_fd_list_get (fd_list, input_fd, &error);
+    if (fd == -1 ||
+        !terminal_feeder_add_fd (feeder, fd,
+                                 (TerminalFeederDoneFunc) feed_child_done_cb, invocation,
+                                 &error))
+      g_dbus_method_invocation_take_error (invocation, error);
+  } else {
+    bytes = g_bytes_new_with_free_func (g_variant_get_data (data),
+                                        g_variant_get_size (data),
+                                        (GDestroyNotify) g_variant_unref,
+                                        g_variant_ref (data));
+    terminal_feeder_add_bytes (feeder, bytes,
+                               (TerminalFeederDoneFunc) feed_child_done_cb, invocation);
+    g_bytes_unref (bytes);
+  }
 
   return TRUE; /* handled */
 }
@@ -192,6 +657,12 @@ static void
 terminal_receiver_impl_iface_init (TerminalReceiverIface *iface)
 {
   iface->handle_exec = terminal_receiver_impl_exec;
+  iface->handle_get_resource_usage = terminal_receiver_impl_get_resource_usage;
+  iface->handle_attach = terminal_receiver_impl_attach;
+  iface->handle_detach = terminal_receiver_impl_detach;
+  iface->handle_get_latency = terminal_receiver_impl_get_latency;
+  iface->handle_get_frame_timings = terminal_receiver_impl_get_frame_timings;
+  iface->handle_feed_child = terminal_receiver_impl_feed_child;
 }
 
 G_DEFINE_TYPE_WITH_CODE (TerminalReceiverImpl, terminal_receiver_impl, TERMINAL_TYPE_RECEIVER_SKELETON,
@@ -337,157 +808,318 @@ screen_destroy_cb (GObject *screen,
   if (skeleton == NULL)
     return;
 
+  terminal_registry_remove (terminal_app_get_registry (terminal_app_get ()),
+                            TERMINAL_SCREEN (screen));
+
   object_manager = terminal_app_get_object_manager (terminal_app_get ());
   object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (skeleton));
   g_dbus_object_manager_server_unexport (object_manager, object_path);
   g_object_set_data (screen, RECEIVER_IMPL_SKELETON_DATA_KEY, NULL);
 }
 
+/**
+ * terminal_factory_impl_export_screen:
+ * @screen: a #TerminalScreen
+ * @window: (allow-none): the #TerminalWindow @screen is in, or %NULL if
+ *   it is headless
+ *
+ * Exports a #TerminalReceiver for @screen on the app's object manager,
+ * for as long as @screen exists. This is done for every screen, however
+ * it was created, so that ListTerminals and Subscribe see them all.
+ *
+ * Returns: (transfer full): the object path of the receiver
+ */
+char *
+terminal_factory_impl_export_screen (TerminalScreen *screen,
+                                     TerminalWindow *window)
+{
+  TerminalApp *app = terminal_app_get ();
+  GDBusObjectManagerServer *object_manager;
+  TerminalReceiverImpl *impl;
+  TerminalObjectSkeleton *skeleton;
+  char *object_path;
+
+  if (window != NULL) {
+    object_path = g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX "/window/%u/terminal/%u", 
+                                   gtk_application_window_get_id (GTK_APPLICATION_WINDOW (window)),
+                                   terminal_mdi_container_get_n_screens (TERMINAL_MDI_CONTAINER (terminal_window_get_mdi_container (window))));
+  } else {
+    static guint n_headless = 0;
+
+    object_path = g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX "/headless/terminal/%u",
+                                   ++n_headless);
+  }
+
+  skeleton = terminal_object_skeleton_new (object_path);
+  impl = terminal_receiver_impl_new (screen);
+  terminal_object_skeleton_set_receiver (skeleton, TERMINAL_RECEIVER (impl));
+  g_object_unref (impl);
+
+  /* The tab count is reused once a tab is closed */
+  object_manager = terminal_app_get_object_manager (app);
+  g_dbus_object_manager_server_export_uniquely (object_manager, G_DBUS_OBJECT_SKELETON (skeleton));
+  g_free (object_path);
+  object_path = g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (skeleton)));
+
+  terminal_registry_add (terminal_app_get_registry (app), screen, object_path);
+  g_object_set_data_full (G_OBJECT (screen), RECEIVER_IMPL_SKELETON_DATA_KEY,
+                          skeleton, (GDestroyNotify) g_object_unref);
+  g_signal_connect (screen, "destroy",
+                    G_CALLBACK (screen_destroy_cb), app);
+
+  return object_path;
+}
+
 static gboolean
 terminal_factory_impl_create_instance (TerminalFactory *factory,
                                        GDBusMethodInvocation *invocation,
                                        GVariant *options)
 {
   TerminalApp *app = terminal_app_get ();
-  GDBusObjectManagerServer *object_manager;
+  TerminalBroker *broker;
   TerminalWindow *window;
   TerminalScreen *screen;
-  TerminalReceiverImpl *impl;
-  TerminalObjectSkeleton *skeleton;
   char *object_path;
   GSettings *profile = NULL;
   const char *profile_name, *title;
   gboolean zoom_set = FALSE;
   gdouble zoom = 1.0;
-  guint window_id;
   gboolean active = TRUE;
-  gboolean have_new_window, present_window, present_window_set;
+  gboolean have_new_window = FALSE;
+  gboolean headless;
+  const char *phase;
+  TerminalTrace *trace = NULL;
+  gint64 start;
+
+  phase = terminal_watchdog_enter ("terminal_factory_impl_create_instance");
+  start = g_get_monotonic_time ();
+  _terminal_debug_perf_begin ("CreateInstance");
+
+  /* The terminal may belong in another server */
+  broker = terminal_app_get_broker (app);
+  if (broker != NULL &&
+      terminal_broker_route_create_instance (broker, invocation, options))
+    goto out;
 
-  if (g_variant_lookup (options, "window-id", "u", &window_id)) {
-    GtkWindow *win;
+  trace = terminal_trace_new_for_options (options);
+  terminal_trace_begin (trace, "parse-options");
 
-    win = gtk_application_get_window_by_id (GTK_APPLICATION (app), window_id);
+  /* A headless terminal runs its child without any window */
+  if (!g_variant_lookup (options, "headless", "b", &headless))
+    headless = FALSE;
 
-    if (!TERMINAL_IS_WINDOW (win)) {
-      g_dbus_method_invocation_return_error (invocation,
-                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                             "Nonexisting window %u referenced",
-                                             window_id);
+  if (!g_variant_lookup (options, "profile", "&s", &profile_name))
+    profile_name = NULL;
+  if (!g_variant_lookup (options, "title", "&s", &title))
+    title = NULL;
+  if (g_variant_lookup (options, "zoom", "d", &zoom))
+    zoom_set = TRUE;
+
+  terminal_trace_end (trace, "parse-options");
+
+  if (headless) {
+    window = NULL;
+  } else {
+    terminal_trace_begin (trace, "create-window");
+    window = get_window_for_options (invocation, options, &have_new_window);
+    terminal_trace_end (trace, "create-window");
+    if (window == NULL)
       goto out;
-    }
+  }
 
-    window = TERMINAL_WINDOW (win);
-    have_new_window = FALSE;
+  terminal_trace_begin (trace, "create-screen");
+
+  profile = terminal_app_get_profile (app, profile_name);
+  g_assert (profile);
+
+  screen = terminal_screen_new (profile, NULL, title, NULL, NULL, 
+                                zoom_set ? zoom : 1.0);
+  if (window != NULL) {
+    terminal_window_add_screen (window, screen, -1);
+    terminal_window_switch_screen (window, screen);
+    gtk_widget_grab_focus (GTK_WIDGET (screen));
   } else {
-    const char *startup_id, *display_name, *role;
-    gboolean start_maximized, start_fullscreen;
-    int screen_number;
-    GdkScreen *gdk_screen;
+    terminal_app_add_headless_screen (app, screen);
+  }
 
-    /* Create a new window */
+  object_path = terminal_factory_impl_export_screen (screen, window);
 
-    if (!g_variant_lookup (options, "display", "^&ay", &display_name)) {
-      g_dbus_method_invocation_return_error (invocation, 
-                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                             "No display specified");
-      goto out;
-    }
+  if (window != NULL) {
+    if (active)
+      terminal_window_switch_screen (window, screen);
 
-    screen_number = 0;
-    gdk_screen = terminal_util_get_screen_by_display_name (display_name, screen_number);
-    if (gdk_screen == NULL) {
-      g_dbus_method_invocation_return_error (invocation, 
-                                             G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-                                             "No screen %d on display \"%s\"",
-                                             screen_number, display_name);
-      goto out;
-    }
+    present_window_for_options (window, options, have_new_window);
+  }
 
-    window = terminal_app_new_window (app, gdk_screen);
+  terminal_trace_end (trace, "create-screen");
+  terminal_screen_set_trace (screen, trace);
+  trace = NULL;
 
-    if (g_variant_lookup (options, "desktop-startup-id", "^&ay", &startup_id))
-      gtk_window_set_startup_id (GTK_WINDOW (window), startup_id);
+  terminal_factory_complete_create_instance (factory, invocation, object_path);
 
-    /* Overwrite the default, unique window role set in terminal_window_init */
-    if (g_variant_lookup (options, "role", "&s", &role))
-      gtk_window_set_role (GTK_WINDOW (window), role);
+  g_free (object_path);
+  g_object_unref (profile);
 
-    if (g_variant_lookup (options, "fullscreen-window", "b", &start_fullscreen) &&
-        start_fullscreen) {
-      gtk_window_fullscreen (GTK_WINDOW (window));
-    }
-    if (g_variant_lookup (options, "maximize-window", "b", &start_maximized) &&
-        start_maximized) {
-      gtk_window_maximize (GTK_WINDOW (window));
-    }
+out:
+  terminal_trace_free (trace);
+  _terminal_debug_perf_end ("CreateInstance");
+  terminal_histogram_add (&method_latencies[METHOD_CREATE_INSTANCE], g_get_monotonic_time () - start);
+  terminal_watchdog_leave (phase);
 
-    have_new_window = TRUE;
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_factory_impl_get_resource_usage (TerminalFactory *factory,
+                                          GDBusMethodInvocation *invocation)
+{
+  TerminalApp *app = terminal_app_get ();
+  GDBusObjectManager *object_manager;
+  GVariantBuilder builder, terminals;
+  GList *objects, *l;
+  gint64 cost;
+  guint interval, n_scanned;
+
+  terminal_process_tracker_get_accounting_cost (terminal_app_get_process_tracker (app),
+                                                &cost, &interval, &n_scanned);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "sample-cost", g_variant_new_int64 (cost));
+  g_variant_builder_add (&builder, "{sv}", "sample-interval", g_variant_new_uint32 (interval));
+  g_variant_builder_add (&builder, "{sv}", "processes-scanned", g_variant_new_uint32 (n_scanned));
+
+  g_variant_builder_init (&terminals, G_VARIANT_TYPE ("a{oa{sv}}"));
+
+  object_manager = G_DBUS_OBJECT_MANAGER (terminal_app_get_object_manager (app));
+  objects = g_dbus_object_manager_get_objects (object_manager);
+  for (l = objects; l != NULL; l = l->next) {
+    TerminalReceiver *receiver;
+    TerminalScreen *screen;
+
+    receiver = terminal_object_get_receiver (TERMINAL_OBJECT (l->data));
+    if (receiver == NULL)
+      continue;
+
+    if (TERMINAL_IS_RECEIVER_IMPL (receiver) &&
+        (screen = terminal_receiver_impl_get_screen (TERMINAL_RECEIVER_IMPL (receiver))) != NULL)
+      g_variant_builder_add (&terminals, "{o@a{sv}}",
+                             g_dbus_object_get_object_path (G_DBUS_OBJECT (l->data)),
+                             build_resource_usage (screen));
+
+    g_object_unref (receiver);
   }
+  g_list_free_full (objects, g_object_unref);
 
-  g_assert (window != NULL);
+  g_variant_builder_add (&builder, "{sv}", "terminals", g_variant_builder_end (&terminals));
 
-  if (!g_variant_lookup (options, "profile", "&s", &profile_name))
-    profile_name = NULL;
-  if (!g_variant_lookup (options, "title", "&s", &title))
-    title = NULL;
-  if (g_variant_lookup (options, "zoom", "d", &zoom))
-    zoom_set = TRUE;
+  terminal_factory_complete_get_resource_usage (factory, invocation,
+                                                g_variant_builder_end (&builder));
 
-  profile = terminal_app_get_profile (app, profile_name);
-  g_assert (profile);
+  return TRUE; /* handled */
+}
 
-  screen = terminal_screen_new (profile, NULL, title, NULL, NULL, 
-                                zoom_set ? zoom : 1.0);
-  terminal_window_add_screen (window, screen, -1);
-  terminal_window_switch_screen (window, screen);
-  gtk_widget_grab_focus (GTK_WIDGET (screen));
+static gboolean
+terminal_factory_impl_exit_cb (GDBusConnection *connection)
+{
+  /* Leave without closing the terminals; the fd holder's new server
+   * takes them over once this one is gone.
+   */
+  g_dbus_connection_flush_sync (connection, NULL, NULL);
+  _exit (EXIT_SUCCESS);
 
-  object_path = g_strdup_printf (TERMINAL_RECEIVER_OBJECT_PATH_PREFIX "/window/%u/terminal/%u", 
-                                 gtk_application_window_get_id (GTK_APPLICATION_WINDOW (window)),
-                                 terminal_mdi_container_get_n_screens (TERMINAL_MDI_CONTAINER (terminal_window_get_mdi_container (window))));
+  return FALSE;
+}
 
-  skeleton = terminal_object_skeleton_new (object_path);
-  impl = terminal_receiver_impl_new (screen);
-  terminal_object_skeleton_set_receiver (skeleton, TERMINAL_RECEIVER (impl));
-  g_object_unref (impl);
+static gboolean
+terminal_factory_impl_upgrade (TerminalFactory *factory,
+                               GDBusMethodInvocation *invocation)
+{
+  GError *error = NULL;
+  const char *phase;
+  gboolean ok;
 
-  object_manager = terminal_app_get_object_manager (app);
-  g_dbus_object_manager_server_export (object_manager, G_DBUS_OBJECT_SKELETON (skeleton));
-  g_object_set_data_full (G_OBJECT (screen), RECEIVER_IMPL_SKELETON_DATA_KEY,
-                          skeleton, (GDestroyNotify) g_object_unref);
-  g_signal_connect (screen, "destroy",
-                    G_CALLBACK (screen_destroy_cb), app);
+  phase = terminal_watchdog_enter ("terminal_factory_impl_upgrade");
+  ok = terminal_app_upgrade (terminal_app_get (), &error);
+  terminal_watchdog_leave (phase);
 
-  if (active)
-    terminal_window_switch_screen (window, screen);
+  if (!ok) {
+    g_dbus_method_invocation_take_error (invocation, error);
+    return TRUE; /* handled */
+  }
 
-  if (g_variant_lookup (options, "present-window", "b", &present_window))
-    present_window_set = TRUE;
-  else
-    present_window_set = FALSE;
+  terminal_factory_complete_upgrade (factory, invocation);
 
-  if (have_new_window) {
-    const char *geometry;
+  g_idle_add ((GSourceFunc) terminal_factory_impl_exit_cb,
+              g_dbus_method_invocation_get_connection (invocation));
 
-    if (g_variant_lookup (options, "geometry", "&s", &geometry) &&
-        !terminal_window_parse_geometry (window, geometry))
-      _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
-                             "Invalid geometry string \"%s\"", geometry);
+  return TRUE; /* handled */
+}
 
-    /* Restored windows shouldn't demand attention; see bug #586308. */
-    if (present_window_set && !present_window)
-      terminal_window_set_is_restored (window);
-  }
+static gboolean
+terminal_factory_impl_get_stalls (TerminalFactory *factory,
+                                  GDBusMethodInvocation *invocation)
+{
+  TerminalWatchdog *watchdog;
 
-  if (have_new_window || (present_window_set && present_window))
-    gtk_window_present (GTK_WINDOW (window));
+  watchdog = terminal_app_get_watchdog (terminal_app_get ());
+  terminal_factory_complete_get_stalls (factory, invocation,
+                                        watchdog ? terminal_watchdog_get_reports (watchdog)
+                                                 : g_variant_new_array (G_VARIANT_TYPE ("a{sv}"), NULL, 0));
 
-  terminal_factory_complete_create_instance (factory, invocation, object_path);
+  return TRUE; /* handled */
+}
 
-  g_free (object_path);
-  g_object_unref (profile);
+static gboolean
+terminal_factory_impl_list_terminals (TerminalFactory *factory,
+                                      GDBusMethodInvocation *invocation)
+{
+  GVariant *terminals;
 
-out:
+  terminals = terminal_registry_list (terminal_app_get_registry (terminal_app_get ()));
+  terminal_factory_complete_list_terminals (factory, invocation, terminals);
+  g_variant_unref (terminals);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_factory_impl_subscribe (TerminalFactory *factory,
+                                 GDBusMethodInvocation *invocation,
+                                 const char * const *events,
+                                 const char * const *terminals,
+                                 guint interval)
+{
+  GError *error = NULL;
+  guint id;
+
+  id = terminal_events_subscribe (terminal_app_get_events (terminal_app_get ()),
+                                  g_dbus_method_invocation_get_connection (invocation),
+                                  g_dbus_method_invocation_get_sender (invocation),
+                                  events, terminals, interval, &error);
+  if (id == 0)
+    g_dbus_method_invocation_take_error (invocation, error);
+  else
+    terminal_factory_complete_subscribe (factory, invocation, id);
+
+  return TRUE; /* handled */
+}
+
+static gboolean
+terminal_factory_impl_unsubscribe (TerminalFactory *factory,
+                                   GDBusMethodInvocation *invocation,
+                                   guint id)
+{
+  if (!terminal_events_unsubscribe (terminal_app_get_events (terminal_app_get ()),
+                                    g_dbus_method_invocation_get_sender (invocation),
+                                    id)) {
+    g_dbus_method_invocation_return_error (invocation,
+                                           G_DBUS_ERROR,
+                                           G_DBUS_ERROR_INVALID_ARGS,
+                                           "No subscription %u", id);
+    return TRUE; /* handled */
+  }
+
+  terminal_factory_complete_unsubscribe (factory, invocation);
 
   return TRUE; /* handled */
 }
@@ -496,6 +1128,12 @@ static void
 terminal_factory_impl_iface_init (TerminalFactoryIface *iface)
 {
   iface->handle_create_instance = terminal_factory_impl_create_instance;
+  iface->handle_get_resource_usage = terminal_factory_impl_get_resource_usage;
+  iface->handle_upgrade = terminal_factory_impl_upgrade;
+  iface->handle_get_stalls = terminal_factory_impl_get_stalls;
+  iface->handle_list_terminals = terminal_factory_impl_list_terminals;
+  iface->handle_subscribe = terminal_factory_impl_subscribe;
+  iface->handle_unsubscribe = terminal_factory_impl_unsubscribe;
 }
 
 G_DEFINE_TYPE_WITH_CODE (TerminalFactoryImpl, terminal_factory_impl, TERMINAL_TYPE_FACTORY_SKELETON,
@@ -523,3 +1161,111 @@ terminal_factory_impl_new (void)
 {
   return g_object_new (TERMINAL_TYPE_FACTORY_IMPL, NULL);
 }
+
+/* ------------------------------------------------------------------------- */
+
+/* Returns the resident set size of this process in bytes, or 0 */
+static guint64
+get_server_rss (void)
+{
+  char *contents;
+  unsigned long size, resident;
+  guint64 rss = 0;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return 0;
+
+  if (sscanf (contents, "%lu %lu", &size, &resident) == 2)
+    rss = (guint64) resident * sysconf (_SC_PAGESIZE);
+  g_free (contents);
+
+  return rss;
+}
+
+static gboolean
+terminal_stats_impl_get_stats (TerminalStats *stats,
+                               GDBusMethodInvocation *invocation)
+{
+  TerminalApp *app = terminal_app_get ();
+  TerminalWatchdog *watchdog;
+  GVariantBuilder builder, terminals, methods;
+  GList *windows, *screens, *l;
+  guint n_windows = 0, n_screens = 0, i;
+
+  windows = gtk_application_get_windows (GTK_APPLICATION (app));
+  for (l = windows; l != NULL; l = l->next)
+    if (TERMINAL_IS_WINDOW (l->data))
+      n_windows++;
+
+  g_variant_builder_init (&terminals, G_VARIANT_TYPE ("a{oa{sv}}"));
+
+  /* Count the screens themselves; not every one may have a receiver */
+  screens = terminal_app_list_screens (app);
+  for (l = screens; l != NULL; l = l->next) {
+    GDBusObject *skeleton;
+
+    n_screens++;
+
+    skeleton = g_object_get_data (G_OBJECT (l->data), RECEIVER_IMPL_SKELETON_DATA_KEY);
+    if (skeleton != NULL)
+      g_variant_builder_add (&terminals, "{o@a{sv}}",
+                             g_dbus_object_get_object_path (skeleton),
+                             terminal_screen_get_stats (TERMINAL_SCREEN (l->data)));
+  }
+  g_list_free (screens);
+
+  g_variant_builder_init (&methods, G_VARIANT_TYPE ("a{sv}"));
+  for (i = 0; i < N_METHODS; i++)
+    g_variant_builder_add (&methods, "{sv}", method_names[i],
+                           terminal_histogram_to_variant (&method_latencies[i]));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "windows", g_variant_new_uint32 (n_windows));
+  g_variant_builder_add (&builder, "{sv}", "screens", g_variant_new_uint32 (n_screens));
+  g_variant_builder_add (&builder, "{sv}", "rss", g_variant_new_uint64 (get_server_rss ()));
+  g_variant_builder_add (&builder, "{sv}", "settings-changes",
+                         g_variant_new_uint64 (terminal_app_get_n_settings_changes (app)));
+  g_variant_builder_add (&builder, "{sv}", "method-latencies", g_variant_builder_end (&methods));
+
+  /* Left out rather than 0 when nobody is watching */
+  watchdog = terminal_app_get_watchdog (app);
+  if (watchdog != NULL)
+    g_variant_builder_add (&builder, "{sv}", "stalls",
+                           g_variant_new_uint32 (terminal_watchdog_get_n_stalls (watchdog)));
+
+  g_variant_builder_add (&builder, "{sv}", "terminals", g_variant_builder_end (&terminals));
+
+  terminal_stats_complete_get_stats (stats, invocation, g_variant_builder_end (&builder));
+
+  return TRUE; /* handled */
+}
+
+static void
+terminal_stats_impl_iface_init (TerminalStatsIface *iface)
+{
+  iface->handle_get_stats = terminal_stats_impl_get_stats;
+}
+
+G_DEFINE_TYPE_WITH_CODE (TerminalStatsImpl, terminal_stats_impl, TERMINAL_TYPE_STATS_SKELETON,
+                         G_IMPLEMENT_INTERFACE (TERMINAL_TYPE_STATS, terminal_stats_impl_iface_init))
+
+static void
+terminal_stats_impl_init (TerminalStatsImpl *impl)
+{
+}
+
+static void
+terminal_stats_impl_class_init (TerminalStatsImplClass *klass)
+{
+}
+
+/**
+ * terminal_stats_impl_new:
+ *
+ * Returns: (transfer full): a new #TerminalStatsImpl
+ */
+TerminalStats *
+terminal_stats_impl_new (void)
+{
+  return g_object_new (TERMINAL_TYPE_STATS_IMPL, NULL);
+}
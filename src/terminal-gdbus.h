@@ -23,6 +23,7 @@
 
 #include "terminal-gdbus-generated.h"
 #include "terminal-screen.h"
+#include "terminal-window.h"
 
 G_BEGIN_DECLS
 
@@ -86,6 +87,34 @@ GType terminal_factory_impl_get_type (void);
 
 TerminalFactory *terminal_factory_impl_new (void);
 
+char *terminal_factory_impl_export_screen (TerminalScreen *screen,
+                                           TerminalWindow *window);
+
+/* ------------------------------------------------------------------------- */
+
+#define TERMINAL_TYPE_STATS_IMPL              (terminal_stats_impl_get_type ())
+#define TERMINAL_STATS_IMPL(object)           (G_TYPE_CHECK_INSTANCE_CAST ((object), TERMINAL_TYPE_STATS_IMPL, TerminalStatsImpl))
+#define TERMINAL_STATS_IMPL_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), TERMINAL_TYPE_STATS_IMPL, TerminalStatsImplClass))
+#define TERMINAL_IS_STATS_IMPL(object)        (G_TYPE_CHECK_INSTANCE_TYPE ((object), TERMINAL_TYPE_STATS_IMPL))
+#define TERMINAL_IS_STATS_IMPL_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), TERMINAL_TYPE_STATS_IMPL))
+#define TERMINAL_STATS_IMPL_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), TERMINAL_TYPE_STATS_IMPL, TerminalStatsImplClass))
+
+typedef struct _TerminalStatsImpl        TerminalStatsImpl;
+typedef struct _TerminalStatsImplClass   TerminalStatsImplClass;
+
+struct _TerminalStatsImplClass {
+  TerminalStatsSkeletonClass parent_class;
+};
+
+struct _TerminalStatsImpl
+{
+  TerminalStatsSkeleton parent_instance;
+};
+
+GType terminal_stats_impl_get_type (void);
+
+TerminalStats *terminal_stats_impl_new (void);
+
 G_END_DECLS
 
 #endif /* !TERMINAL_RECEIVER_IMPL_H */
@@ -0,0 +1,486 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-handover.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gio/gunixfdmessage.h>
+#include <gio/gunixsocketaddress.h>
+#include <glib/gstdio.h>
+
+#include "terminal-debug.h"
+
+/* Handing terminals over to another server
+ *
+ * gnome-terminal-fdholder is a small helper that keeps a copy of each
+ * terminal's PTY master, together with a description of the terminal.
+ * As long as it holds them, the children don't get a hangup when the
+ * server goes away. When the server disconnects while the helper still
+ * holds terminals, because it crashed or because it is being upgraded,
+ * the helper starts a new server, which retrieves the PTYs and rebuilds
+ * its terminals around the running children.
+ *
+ * Messages are (sua{sv}) tuples on a SOCK_SEQPACKET socket in the user's
+ * runtime directory, with the FDs attached as SCM_RIGHTS. Large data,
+ * like the contents of a terminal, is passed as a file descriptor too.
+ */
+
+#define MAX_MESSAGE_SIZE (64 * 1024)
+#define RETRIEVE_TIMEOUT (10) /* s */
+
+struct _TerminalHandover
+{
+  GSocket *socket;
+  guint next_key;
+};
+
+/**
+ * terminal_handover_get_socket_path:
+ * @app_id: the application ID of the server
+ *
+ * Returns: (transfer full): the path of the fd holder's socket for @app_id
+ */
+char *
+terminal_handover_get_socket_path (const char *app_id)
+{
+  char *name, *path;
+
+  name = g_strdup_printf ("%s.fdholder", app_id);
+  path = g_build_filename (g_get_user_runtime_dir (), "gnome-terminal", name, NULL);
+  g_free (name);
+
+  return path;
+}
+
+/**
+ * terminal_handover_send_message:
+ * @socket: a connected #GSocket
+ * @command: the command
+ * @key: the key of the terminal, or 0
+ * @state: (allow-none): an a{sv}, or %NULL
+ * @fd_list: (allow-none): FDs to pass along, or %NULL
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Sends one message. A floating @state is consumed.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+terminal_handover_send_message (GSocket *socket,
+                                const char *command,
+                                guint key,
+                                GVariant *state,
+                                GUnixFDList *fd_list,
+                                GError **error)
+{
+  GVariant *message;
+  GOutputVector vector;
+  GSocketControlMessage *fd_message = NULL;
+  gssize len;
+
+  if (state == NULL)
+    state = g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0);
+
+  message = g_variant_ref_sink (g_variant_new ("(su@a{sv})", command, key, state));
+  vector.buffer = g_variant_get_data (message);
+  vector.size = g_variant_get_size (message);
+
+  if (fd_list != NULL && g_unix_fd_list_get_length (fd_list) > 0)
+    fd_message = g_unix_fd_message_new_with_fd_list (fd_list);
+
+  len = g_socket_send_message (socket, NULL, &vector, 1,
+                               fd_message != NULL ? &fd_message : NULL,
+                               fd_message != NULL ? 1 : 0,
+                               0, NULL, error);
+
+  if (fd_message != NULL)
+    g_object_unref (fd_message);
+  g_variant_unref (message);
+
+  return len >= 0;
+}
+
+/**
+ * terminal_handover_receive_message:
+ * @socket: a connected #GSocket
+ * @command: (out): the command
+ * @key: (out): the key
+ * @state: (out): the a{sv} state
+ * @fd_list: (out): the FDs passed along; may be empty
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Receives one message. When the peer closed the connection, fails with
+ * %G_IO_ERROR_CLOSED.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+terminal_handover_receive_message (GSocket *socket,
+                                   char **command,
+                                   guint *key,
+                                   GVariant **state,
+                                   GUnixFDList **fd_list,
+                                   GError **error)
+{
+  GSocketControlMessage **messages = NULL;
+  GUnixFDList *fds = NULL;
+  GInputVector vector;
+  GVariant *message;
+  char *buffer;
+  gssize len;
+  int n_messages = 0, flags = 0, i;
+
+  buffer = g_malloc (MAX_MESSAGE_SIZE);
+  vector.buffer = buffer;
+  vector.size = MAX_MESSAGE_SIZE;
+
+  len = g_socket_receive_message (socket, NULL, &vector, 1,
+                                  &messages, &n_messages,
+                                  &flags, NULL, error);
+
+  for (i = 0; i < n_messages; i++) {
+    if (fds == NULL && G_IS_UNIX_FD_MESSAGE (messages[i]))
+      fds = g_object_ref (g_unix_fd_message_get_fd_list (G_UNIX_FD_MESSAGE (messages[i])));
+    g_object_unref (messages[i]);
+  }
+  g_free (messages);
+
+  if (len < 0)
+    goto fail;
+  if (len == 0) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                         "Connection closed");
+    goto fail;
+  }
+  if (flags & MSG_TRUNC) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "Message too long");
+    goto fail;
+  }
+
+  message = g_variant_new_from_data (G_VARIANT_TYPE ("(sua{sv})"),
+                                     buffer, len, FALSE,
+                                     g_free, buffer);
+  g_variant_ref_sink (message);
+  if (!g_variant_is_normal_form (message)) {
+    g_variant_unref (message);
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                         "Malformed message");
+    g_clear_object (&fds);
+    return FALSE;
+  }
+
+  g_variant_get (message, "(su@a{sv})", command, key, state);
+  g_variant_unref (message);
+
+  *fd_list = fds != NULL ? fds : g_unix_fd_list_new ();
+
+  return TRUE;
+
+fail:
+  g_clear_object (&fds);
+  g_free (buffer);
+  return FALSE;
+}
+
+static void
+holder_child_setup (gpointer data)
+{
+  int fd = GPOINTER_TO_INT (data);
+
+  /* Let the listening socket survive the exec */
+  fcntl (fd, F_SETFD, fcntl (fd, F_GETFD) & ~FD_CLOEXEC);
+}
+
+static void
+holder_exited_cb (GPid pid,
+                  int status,
+                  gpointer data)
+{
+  g_spawn_close_pid (pid);
+}
+
+static gboolean
+terminal_handover_spawn_holder (const char *app_id,
+                                GSocketAddress *address,
+                                GError **error)
+{
+  GSocket *listener;
+  GPid pid;
+  char *fd_string;
+  gboolean ok;
+
+  listener = g_socket_new (G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_SEQPACKET,
+                           G_SOCKET_PROTOCOL_DEFAULT, error);
+  if (listener == NULL)
+    return FALSE;
+
+  /* A stale socket from a holder that went away */
+  g_unlink (g_unix_socket_address_get_path (G_UNIX_SOCKET_ADDRESS (address)));
+
+  if (!g_socket_bind (listener, address, FALSE, error) ||
+      !g_socket_listen (listener, error)) {
+    g_object_unref (listener);
+    return FALSE;
+  }
+
+  fd_string = g_strdup_printf ("%d", g_socket_get_fd (listener));
+  {
+    char *argv[] = {
+      (char *) TERM_LIBEXECDIR "/gnome-terminal-fdholder",
+      (char *) "--listen-fd", fd_string,
+      (char *) "--",
+      (char *) TERM_LIBEXECDIR "/gnome-terminal-server",
+      (char *) "--app-id", (char *) app_id,
+      (char *) "--recover",
+      NULL
+    };
+
+    ok = g_spawn_async (NULL, argv, NULL,
+                        G_SPAWN_DO_NOT_REAP_CHILD,
+                        holder_child_setup, GINT_TO_POINTER (g_socket_get_fd (listener)),
+                        &pid, error);
+  }
+  g_free (fd_string);
+
+  /* The holder has its own copy now */
+  g_socket_close (listener, NULL);
+  g_object_unref (listener);
+
+  if (!ok)
+    return FALSE;
+
+  g_child_watch_add (pid, holder_exited_cb, NULL);
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Started fd holder %d\n", (int) pid);
+
+  return TRUE;
+}
+
+/**
+ * terminal_handover_new:
+ * @app_id: the application ID of the server
+ * @spawn: whether to start a holder if none is running
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Connects to the fd holder for @app_id.
+ *
+ * Returns: (transfer full): a new #TerminalHandover, or %NULL
+ */
+TerminalHandover *
+terminal_handover_new (const char *app_id,
+                       gboolean spawn,
+                       GError **error)
+{
+  TerminalHandover *handover;
+  GSocketAddress *address;
+  GSocket *socket;
+  GError *err = NULL;
+  char *path, *dir;
+
+  path = terminal_handover_get_socket_path (app_id);
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  address = g_unix_socket_address_new (path);
+  g_free (path);
+
+  socket = g_socket_new (G_SOCKET_FAMILY_UNIX, G_SOCKET_TYPE_SEQPACKET,
+                         G_SOCKET_PROTOCOL_DEFAULT, error);
+  if (socket == NULL) {
+    g_object_unref (address);
+    return NULL;
+  }
+
+  if (!g_socket_connect (socket, address, NULL, &err)) {
+    if (!spawn ||
+        !(g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) ||
+          g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_REFUSED))) {
+      g_propagate_error (error, err);
+      g_object_unref (socket);
+      g_object_unref (address);
+      return NULL;
+    }
+    g_clear_error (&err);
+
+    /* The listen backlog takes the connection even before the holder runs */
+    if (!terminal_handover_spawn_holder (app_id, address, error) ||
+        !g_socket_connect (socket, address, NULL, error)) {
+      g_object_unref (socket);
+      g_object_unref (address);
+      return NULL;
+    }
+  }
+  g_object_unref (address);
+
+  handover = g_slice_new0 (TerminalHandover);
+  handover->socket = socket;
+  handover->next_key = 1;
+
+  return handover;
+}
+
+/**
+ * terminal_handover_free:
+ * @handover: (allow-none): a #TerminalHandover
+ *
+ * Tells the holder to let go of everything, and disconnects. Only to
+ * be used when the terminals aren't to be recovered.
+ */
+void
+terminal_handover_free (TerminalHandover *handover)
+{
+  if (handover == NULL)
+    return;
+
+  terminal_handover_send_message (handover->socket, TERMINAL_HANDOVER_RELEASE,
+                                  0, NULL, NULL, NULL);
+  g_socket_close (handover->socket, NULL);
+  g_object_unref (handover->socket);
+  g_slice_free (TerminalHandover, handover);
+}
+
+/**
+ * terminal_handover_deposit:
+ * @handover: a #TerminalHandover
+ * @key: the key of a previous deposit to replace, or 0
+ * @state: an a{sv} describing the terminal
+ * @fd_list: the FDs @state refers to
+ *
+ * Hands a copy of the terminal's FDs to the holder. A floating @state
+ * is consumed.
+ *
+ * Returns: the key to replace or forget the deposit with, or 0 on failure
+ */
+guint
+terminal_handover_deposit (TerminalHandover *handover,
+                           guint key,
+                           GVariant *state,
+                           GUnixFDList *fd_list)
+{
+  GError *error = NULL;
+
+  if (key == 0)
+    key = handover->next_key++;
+
+  if (!terminal_handover_send_message (handover->socket, TERMINAL_HANDOVER_DEPOSIT,
+                                       key, state, fd_list, &error)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "Failed to deposit terminal %u: %s\n",
+                           key, error->message);
+    g_error_free (error);
+    return 0;
+  }
+
+  return key;
+}
+
+/**
+ * terminal_handover_forget:
+ * @handover: a #TerminalHandover
+ * @key: the key of a deposit
+ *
+ * Makes the holder close its copies of the terminal's FDs.
+ */
+void
+terminal_handover_forget (TerminalHandover *handover,
+                          guint key)
+{
+  if (key == 0)
+    return;
+
+  terminal_handover_send_message (handover->socket, TERMINAL_HANDOVER_FORGET,
+                                  key, NULL, NULL, NULL);
+}
+
+/**
+ * terminal_handover_retrieve:
+ * @handover: a #TerminalHandover
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Fetches everything the holder holds. The holder keeps its copies;
+ * forget the keys of terminals that can't be recovered.
+ *
+ * Returns: (transfer full) (element-type TerminalHandoverEntry): the
+ *   deposits, or %NULL on error or when there are none
+ */
+GList *
+terminal_handover_retrieve (TerminalHandover *handover,
+                            GError **error)
+{
+  GList *entries = NULL;
+  char *command;
+
+  if (!terminal_handover_send_message (handover->socket, TERMINAL_HANDOVER_RETRIEVE,
+                                       0, NULL, NULL, error))
+    return NULL;
+
+  /* Don't hang the new server on a wedged holder */
+  g_socket_set_timeout (handover->socket, RETRIEVE_TIMEOUT);
+
+  for (;;) {
+    TerminalHandoverEntry *entry;
+
+    entry = g_slice_new0 (TerminalHandoverEntry);
+    if (!terminal_handover_receive_message (handover->socket, &command,
+                                            &entry->key, &entry->state,
+                                            &entry->fd_list, error)) {
+      g_slice_free (TerminalHandoverEntry, entry);
+      g_list_free_full (entries, (GDestroyNotify) terminal_handover_entry_free);
+      entries = NULL;
+      break;
+    }
+
+    if (strcmp (command, TERMINAL_HANDOVER_END) == 0) {
+      g_free (command);
+      terminal_handover_entry_free (entry);
+      break;
+    }
+    if (strcmp (command, TERMINAL_HANDOVER_ENTRY) != 0) {
+      g_free (command);
+      terminal_handover_entry_free (entry);
+      continue;
+    }
+    g_free (command);
+
+    handover->next_key = MAX (handover->next_key, entry->key + 1);
+    entries = g_list_prepend (entries, entry);
+  }
+
+  g_socket_set_timeout (handover->socket, 0);
+
+  return g_list_reverse (entries);
+}
+
+/**
+ * terminal_handover_entry_free:
+ * @entry: a #TerminalHandoverEntry
+ */
+void
+terminal_handover_entry_free (TerminalHandoverEntry *entry)
+{
+  g_variant_unref (entry->state);
+  g_object_unref (entry->fd_list);
+  g_slice_free (TerminalHandoverEntry, entry);
+}
@@ -0,0 +1,83 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_HANDOVER_H
+#define TERMINAL_HANDOVER_H
+
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+G_BEGIN_DECLS
+
+/* Commands understood by gnome-terminal-fdholder */
+#define TERMINAL_HANDOVER_DEPOSIT  "deposit"
+#define TERMINAL_HANDOVER_FORGET   "forget"
+#define TERMINAL_HANDOVER_RETRIEVE "retrieve"
+#define TERMINAL_HANDOVER_RELEASE  "release"
+#define TERMINAL_HANDOVER_ENTRY    "entry"
+#define TERMINAL_HANDOVER_END      "end"
+
+typedef struct _TerminalHandover TerminalHandover;
+
+/**
+ * TerminalHandoverEntry:
+ * @key: the key the state was deposited under
+ * @state: an a{sv} as returned by terminal_screen_save_state()
+ * @fd_list: the FDs @state refers to
+ */
+typedef struct {
+  guint key;
+  GVariant *state;
+  GUnixFDList *fd_list;
+} TerminalHandoverEntry;
+
+char *terminal_handover_get_socket_path (const char *app_id);
+
+gboolean terminal_handover_send_message (GSocket *socket,
+                                         const char *command,
+                                         guint key,
+                                         GVariant *state,
+                                         GUnixFDList *fd_list,
+                                         GError **error);
+
+gboolean terminal_handover_receive_message (GSocket *socket,
+                                            char **command,
+                                            guint *key,
+                                            GVariant **state,
+                                            GUnixFDList **fd_list,
+                                            GError **error);
+
+TerminalHandover *terminal_handover_new (const char *app_id,
+                                         gboolean spawn,
+                                         GError **error);
+
+void terminal_handover_free (TerminalHandover *handover);
+
+guint terminal_handover_deposit (TerminalHandover *handover,
+                                 guint key,
+                                 GVariant *state,
+                                 GUnixFDList *fd_list);
+
+void terminal_handover_forget (TerminalHandover *handover,
+                               guint key);
+
+GList *terminal_handover_retrieve (TerminalHandover *handover,
+                                   GError **error);
+
+void terminal_handover_entry_free (TerminalHandoverEntry *entry);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_HANDOVER_H */
@@ -0,0 +1,117 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-histogram.h"
+
+static guint
+bucket_for_duration (gint64 duration)
+{
+  guint64 value = MAX (duration, 1);
+  guint msb, bucket;
+
+  if (value < 4)
+    return (guint) value;
+
+  msb = g_bit_storage (value) - 1;
+  bucket = 4 * msb + ((value >> (msb - 2)) & 3);
+
+  return MIN (bucket, TERMINAL_HISTOGRAM_N_BUCKETS - 1);
+}
+
+static gint64
+bucket_upper_bound (guint bucket)
+{
+  guint msb = bucket / 4;
+
+  if (bucket < 4)
+    return bucket;
+
+  return (gint64) (4 + (bucket & 3) + 1) << (msb - 2);
+}
+
+void
+terminal_histogram_add (TerminalHistogram *histogram,
+                        gint64 duration)
+{
+  histogram->counts[bucket_for_duration (duration)]++;
+  histogram->n++;
+  histogram->sum += MAX (duration, 0);
+}
+
+/**
+ * terminal_histogram_get_percentile:
+ * @histogram: a #TerminalHistogram
+ * @percent: the percentile, e.g. 95
+ *
+ * Returns: the upper bound in µs of the duration that @percent percent
+ *   of the samples are within, or 0 if there are no samples
+ */
+gint64
+terminal_histogram_get_percentile (const TerminalHistogram *histogram,
+                                   guint percent)
+{
+  guint64 wanted, seen = 0;
+  guint i;
+
+  if (histogram->n == 0)
+    return 0;
+
+  wanted = ((guint64) histogram->n * MIN (percent, 100) + 99) / 100;
+  wanted = MAX (wanted, 1);
+  for (i = 0; i < TERMINAL_HISTOGRAM_N_BUCKETS; i++) {
+    seen += histogram->counts[i];
+    if (seen >= wanted)
+      return bucket_upper_bound (i);
+  }
+
+  return bucket_upper_bound (TERMINAL_HISTOGRAM_N_BUCKETS - 1);
+}
+
+/**
+ * terminal_histogram_to_variant:
+ * @histogram: a #TerminalHistogram
+ *
+ * Returns: (transfer floating): an a{sv} with the "count" and "sum" of
+ *   the samples, their "p50", "p95" and "p99" percentiles, and the
+ *   "buckets" as an a(xu) of upper bound and count, leaving out
+ *   empty ones
+ */
+GVariant *
+terminal_histogram_to_variant (const TerminalHistogram *histogram)
+{
+  GVariantBuilder builder, buckets;
+  guint i;
+
+  g_variant_builder_init (&buckets, G_VARIANT_TYPE ("a(xu)"));
+  for (i = 0; i < TERMINAL_HISTOGRAM_N_BUCKETS; i++)
+    if (histogram->counts[i] != 0)
+      g_variant_builder_add (&buckets, "(xu)",
+                             bucket_upper_bound (i), histogram->counts[i]);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "count", g_variant_new_uint32 (histogram->n));
+  g_variant_builder_add (&builder, "{sv}", "sum", g_variant_new_uint64 (histogram->sum));
+  g_variant_builder_add (&builder, "{sv}", "p50",
+                         g_variant_new_int64 (terminal_histogram_get_percentile (histogram, 50)));
+  g_variant_builder_add (&builder, "{sv}", "p95",
+                         g_variant_new_int64 (terminal_histogram_get_percentile (histogram, 95)));
+  g_variant_builder_add (&builder, "{sv}", "p99",
+                         g_variant_new_int64 (terminal_histogram_get_percentile (histogram, 99)));
+  g_variant_builder_add (&builder, "{sv}", "buckets", g_variant_builder_end (&buckets));
+
+  return g_variant_builder_end (&builder);
+}
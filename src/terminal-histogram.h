@@ -0,0 +1,44 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_HISTOGRAM_H
+#define TERMINAL_HISTOGRAM_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define TERMINAL_HISTOGRAM_N_BUCKETS (4 * 32)
+
+/* Durations in µs, with four buckets per power of two, so that
+ * percentiles are accurate to within 25%. Zero-initialise to use.
+ */
+typedef struct {
+  guint counts[TERMINAL_HISTOGRAM_N_BUCKETS];
+  guint n;
+  guint64 sum;
+} TerminalHistogram;
+
+void terminal_histogram_add (TerminalHistogram *histogram,
+                             gint64 duration);
+
+gint64 terminal_histogram_get_percentile (const TerminalHistogram *histogram,
+                                          guint percent);
+
+GVariant *terminal_histogram_to_variant (const TerminalHistogram *histogram);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_HISTOGRAM_H */
@@ -89,7 +89,16 @@ terminal_info_bar_new (GtkMessageType type,
   return info_bar;
 }
 
-void
+/**
+ * terminal_info_bar_format_text:
+ * @bar: a #TerminalInfoBar
+ * @format: a printf() format string
+ *
+ * Adds a line of text to @bar.
+ *
+ * Returns: (transfer none): the #GtkLabel showing the text
+ */
+GtkWidget *
 terminal_info_bar_format_text (TerminalInfoBar *bar,
                                const char *format,
                                ...)
@@ -99,7 +108,7 @@ terminal_info_bar_format_text (TerminalInfoBar *bar,
   GtkWidget *label;
   va_list args;
 
-  g_return_if_fail (TERMINAL_IS_INFO_BAR (bar));
+  g_return_val_if_fail (TERMINAL_IS_INFO_BAR (bar), NULL);
 
   priv = bar->priv;
 
@@ -116,4 +125,6 @@ terminal_info_bar_format_text (TerminalInfoBar *bar,
 
   gtk_box_pack_start (GTK_BOX (priv->content_box), label, FALSE, FALSE, 0);
   gtk_widget_show_all (priv->content_box);
+
+  return label;
 }
@@ -53,9 +53,9 @@ GtkWidget *terminal_info_bar_new (GtkMessageType type,
                                   const char *first_button_text,
                                   ...) G_GNUC_NULL_TERMINATED;
 
-void terminal_info_bar_format_text (TerminalInfoBar *bar,
-                                    const char *format,
-                                    ...) G_GNUC_PRINTF (2, 3);
+GtkWidget *terminal_info_bar_format_text (TerminalInfoBar *bar,
+                                          const char *format,
+                                          ...) G_GNUC_PRINTF (2, 3);
 
 G_END_DECLS
 
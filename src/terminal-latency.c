@@ -0,0 +1,214 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-latency.h"
+
+#include "terminal-histogram.h"
+
+/* Keystroke latency
+ *
+ * A sample starts at a key press, and follows it through the write of
+ * the resulting input to the PTY, the next output read from the child,
+ * and the next frame drawn after that. Keys that don't write anything
+ * (modifiers, scrolling) are superseded by the next key press, and a
+ * sample whose next step doesn't come within SAMPLE_TIMEOUT, e.g.
+ * because the child doesn't echo, is dropped rather than attributed to
+ * unrelated output.
+ */
+
+#define SAMPLE_TIMEOUT   (G_USEC_PER_SEC)
+
+struct _TerminalLatency
+{
+  /* The pending sample, monotonic µs; 0 if not reached */
+  gint64 key;
+  gint64 written;
+  gint64 output;
+
+  guint n_samples;
+  TerminalHistogram histograms[TERMINAL_LATENCY_N_STAGES];
+};
+
+static const char *stage_names[TERMINAL_LATENCY_N_STAGES] = {
+  "input",
+  "child",
+  "render",
+  "total"
+};
+
+static void
+terminal_latency_reset (TerminalLatency *latency)
+{
+  latency->key = latency->written = latency->output = 0;
+}
+
+/* Drops the pending sample if its last step was too long ago */
+static void
+terminal_latency_expire (TerminalLatency *latency,
+                         gint64 time)
+{
+  gint64 last;
+
+  last = latency->output ? latency->output
+       : latency->written ? latency->written
+       : latency->key;
+  if (last != 0 && time - last > SAMPLE_TIMEOUT)
+    terminal_latency_reset (latency);
+}
+
+TerminalLatency *
+terminal_latency_new (void)
+{
+  return g_slice_new0 (TerminalLatency);
+}
+
+/**
+ * terminal_latency_free:
+ * @latency: (allow-none): a #TerminalLatency
+ */
+void
+terminal_latency_free (TerminalLatency *latency)
+{
+  if (latency == NULL)
+    return;
+
+  g_slice_free (TerminalLatency, latency);
+}
+
+/**
+ * terminal_latency_key_pressed:
+ * @latency: a #TerminalLatency
+ * @time: the monotonic time of the key press
+ *
+ * Starts a sample, unless one is already waiting for its output: while
+ * typing fast, the first key of a burst is the one that waits longest.
+ */
+void
+terminal_latency_key_pressed (TerminalLatency *latency,
+                              gint64 time)
+{
+  terminal_latency_expire (latency, time);
+
+  if (latency->written != 0)
+    return;
+
+  latency->key = time;
+}
+
+void
+terminal_latency_input_written (TerminalLatency *latency,
+                                gint64 time)
+{
+  terminal_latency_expire (latency, time);
+
+  if (latency->key == 0 || latency->written != 0)
+    return;
+
+  latency->written = time;
+}
+
+void
+terminal_latency_output_read (TerminalLatency *latency,
+                              gint64 time)
+{
+  terminal_latency_expire (latency, time);
+
+  if (latency->written == 0 || latency->output != 0)
+    return;
+
+  latency->output = time;
+}
+
+/**
+ * terminal_latency_frame_drawn:
+ * @latency: a #TerminalLatency
+ * @time: the monotonic time the frame was drawn
+ *
+ * Completes the pending sample if its output has been read.
+ */
+void
+terminal_latency_frame_drawn (TerminalLatency *latency,
+                              gint64 time)
+{
+  if (latency->output == 0)
+    return;
+
+  terminal_histogram_add (&latency->histograms[TERMINAL_LATENCY_STAGE_INPUT],
+                          latency->written - latency->key);
+  terminal_histogram_add (&latency->histograms[TERMINAL_LATENCY_STAGE_CHILD],
+                          latency->output - latency->written);
+  terminal_histogram_add (&latency->histograms[TERMINAL_LATENCY_STAGE_RENDER],
+                          time - latency->output);
+  terminal_histogram_add (&latency->histograms[TERMINAL_LATENCY_STAGE_TOTAL],
+                          time - latency->key);
+  latency->n_samples++;
+
+  terminal_latency_reset (latency);
+}
+
+guint
+terminal_latency_get_n_samples (TerminalLatency *latency)
+{
+  return latency->n_samples;
+}
+
+/**
+ * terminal_latency_get_percentile:
+ * @latency: a #TerminalLatency
+ * @stage: a #TerminalLatencyStage
+ * @percent: the percentile, e.g. 95
+ *
+ * Returns: the upper bound in µs of the latency that @percent percent
+ *   of the samples of @stage are within, or 0 if there are no samples
+ */
+gint64
+terminal_latency_get_percentile (TerminalLatency *latency,
+                                 TerminalLatencyStage stage,
+                                 guint percent)
+{
+  g_return_val_if_fail (stage < TERMINAL_LATENCY_N_STAGES, 0);
+
+  return terminal_histogram_get_percentile (&latency->histograms[stage], percent);
+}
+
+/**
+ * terminal_latency_get_report:
+ * @latency: a #TerminalLatency
+ *
+ * Returns: (transfer floating): an a{sv} with the number of "samples",
+ *   and for each of the stages "input", "child", "render" and "total",
+ *   a (xxx) of its 50th, 95th and 99th percentiles in µs
+ */
+GVariant *
+terminal_latency_get_report (TerminalLatency *latency)
+{
+  GVariantBuilder builder;
+  guint stage;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "samples",
+                         g_variant_new_uint32 (latency->n_samples));
+
+  for (stage = 0; stage < TERMINAL_LATENCY_N_STAGES; stage++)
+    g_variant_builder_add (&builder, "{sv}", stage_names[stage],
+                           g_variant_new ("(xxx)",
+                                          terminal_latency_get_percentile (latency, stage, 50),
+                                          terminal_latency_get_percentile (latency, stage, 95),
+                                          terminal_latency_get_percentile (latency, stage, 99)));
+
+  return g_variant_builder_end (&builder);
+}
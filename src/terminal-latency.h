@@ -0,0 +1,59 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_LATENCY_H
+#define TERMINAL_LATENCY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  TERMINAL_LATENCY_STAGE_INPUT,  /* key press to write to the PTY */
+  TERMINAL_LATENCY_STAGE_CHILD,  /* write to the next output */
+  TERMINAL_LATENCY_STAGE_RENDER, /* output to the frame showing it */
+  TERMINAL_LATENCY_STAGE_TOTAL,  /* key press to frame */
+  TERMINAL_LATENCY_N_STAGES
+} TerminalLatencyStage;
+
+typedef struct _TerminalLatency TerminalLatency;
+
+TerminalLatency *terminal_latency_new (void);
+
+void terminal_latency_free (TerminalLatency *latency);
+
+void terminal_latency_key_pressed (TerminalLatency *latency,
+                                   gint64 time);
+
+void terminal_latency_input_written (TerminalLatency *latency,
+                                     gint64 time);
+
+void terminal_latency_output_read (TerminalLatency *latency,
+                                   gint64 time);
+
+void terminal_latency_frame_drawn (TerminalLatency *latency,
+                                   gint64 time);
+
+guint terminal_latency_get_n_samples (TerminalLatency *latency);
+
+gint64 terminal_latency_get_percentile (TerminalLatency *latency,
+                                        TerminalLatencyStage stage,
+                                        guint percent);
+
+GVariant *terminal_latency_get_report (TerminalLatency *latency);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_LATENCY_H */
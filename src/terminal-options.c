@@ -898,6 +898,8 @@ terminal_options_free (TerminalOptions *options)
   g_free (options->sm_client_id);
   g_free (options->sm_config_prefix);
 
+  g_free (options->trace_file);
+
   g_slice_free (TerminalOptions, options);
 }
 
@@ -940,6 +942,24 @@ get_goption_context (TerminalOptions *options)
       unsupported_option_callback,
       NULL, NULL
     },
+    {
+      "timing",
+      0,
+      0,
+      G_OPTION_ARG_NONE,
+      &options->timing,
+      N_("Print how long each stage of opening the terminals took"),
+      NULL
+    },
+    {
+      "trace-file",
+      0,
+      0,
+      G_OPTION_ARG_FILENAME,
+      &options->trace_file,
+      N_("Write the stages of opening the terminals to a Chrome trace file"),
+      N_("FILE")
+    },
     { "version", 0, G_OPTION_FLAG_NO_ARG | G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_CALLBACK, option_version_cb, NULL, NULL },
     { NULL, 0, 0, 0, NULL, NULL, NULL }
   };
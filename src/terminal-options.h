@@ -77,6 +77,9 @@ typedef struct
   gboolean  use_factory;
   double    zoom;
 
+  gboolean timing;
+  char    *trace_file;
+
   gboolean sm_client_disable;
   char *sm_client_id;
   char *sm_config_prefix;
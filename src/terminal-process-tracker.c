@@ -0,0 +1,1032 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#define _GNU_SOURCE /* for RUSAGE_THREAD */
+
+#include "terminal-process-tracker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "terminal-debug.h"
+#include "terminal-intl.h"
+
+/* The sampling interval starts out at MIN_INTERVAL and doubles on every
+ * tick that finds nothing changed, up to MAX_INTERVAL. Any change drops
+ * it back down to MIN_INTERVAL.
+ */
+#define MIN_INTERVAL (250)  /* ms */
+#define MAX_INTERVAL (4000) /* ms */
+
+/* Don't refresh a screen on contents-changed more often than this */
+#define MIN_REFRESH_DELAY (50 * 1000) /* µs */
+
+/* Resource accounting walks all of /proc, so it runs in a worker thread and
+ * much less often than the foreground process sampling. The interval is
+ * stretched so that a pass never costs more than 1% of one CPU, and a pass
+ * never looks at more than ACCOUNTING_MAX_PROCESSES processes.
+ */
+#define ACCOUNTING_INTERVAL_IDLE   (5000) /* ms */
+#define ACCOUNTING_INTERVAL_ACTIVE (1000) /* ms, while somebody is watching */
+#define ACCOUNTING_MAX_PROCESSES   (65536)
+#define ACCOUNTING_MAX_DEPTH       (256)
+
+typedef struct {
+  TerminalScreen *screen; /* unowned */
+  TerminalProcessInfo info;
+  gint64 last_refresh;
+  guint64 cpu_ticks;
+  guint64 cgroup_cpu_usec;
+  gint64 cpu_timestamp;
+  guint dirty : 1;
+} TrackedScreen;
+
+typedef struct {
+  TerminalScreen *screen; /* only used as a key; never dereferenced by the thread */
+  GPid root;
+  char *cgroup; /* cgroupfs path, or NULL */
+  guint n_processes;
+  guint64 cpu_ticks;
+  guint64 rss;
+  guint64 read_bytes;
+  guint64 write_bytes;
+  guint64 cgroup_cpu_usec;
+  guint64 cgroup_memory;
+  gboolean cgroup_valid;
+} AccountingSample;
+
+typedef struct {
+  GPid pid;
+  GPid ppid;
+  guint64 cpu_ticks;
+  guint64 rss_pages;
+  int owner; /* index into the samples, -1 for none, -2 for not yet known */
+} ProcEntry;
+
+typedef struct {
+  TerminalProcessTracker *tracker;
+  GArray *samples; /* AccountingSample */
+  gint64 timestamp;
+  gint64 cost; /* µs of CPU time */
+  guint n_scanned;
+} AccountingPass;
+
+struct _TerminalProcessTrackerPrivate
+{
+  GHashTable *screens; /* TerminalScreen* -> TrackedScreen* */
+  guint interval;
+  guint timeout_id;
+  guint idle_id;
+
+  guint accounting_users;
+  guint accounting_interval;
+  guint accounting_timeout_id;
+  gint64 accounting_cost;
+  guint accounting_n_scanned;
+  guint accounting_in_flight : 1;
+
+  guint disposed : 1;
+};
+
+enum
+{
+  PROCESS_CHANGED,
+  ACCOUNTING_UPDATED,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL];
+
+static void terminal_process_tracker_schedule (TerminalProcessTracker *tracker,
+                                               guint interval);
+static void terminal_process_tracker_schedule_accounting (TerminalProcessTracker *tracker);
+
+G_DEFINE_TYPE (TerminalProcessTracker, terminal_process_tracker, G_TYPE_OBJECT)
+
+/* helper functions */
+
+static char *
+read_process_name (GPid pid)
+{
+  char filename[64];
+  char *cmdline, *basename, *name;
+  gsize len;
+
+  g_snprintf (filename, sizeof (filename), "/proc/%d/cmdline", pid);
+  if (!g_file_get_contents (filename, &cmdline, &len, NULL))
+    return NULL;
+
+  /* Zombies have an empty command line, use the kernel's idea of the name */
+  if (len == 0) {
+    g_free (cmdline);
+
+    g_snprintf (filename, sizeof (filename), "/proc/%d/comm", pid);
+    if (!g_file_get_contents (filename, &cmdline, &len, NULL))
+      return NULL;
+
+    g_strchomp (cmdline);
+  }
+
+  basename = g_path_get_basename (cmdline);
+  g_free (cmdline);
+  if (!basename)
+    return NULL;
+
+  name = g_filename_to_utf8 (basename, -1, NULL, NULL, NULL);
+  g_free (basename);
+
+  return name;
+}
+
+static char *
+read_process_cwd (GPid pid)
+{
+  char filename[64];
+
+  g_snprintf (filename, sizeof (filename), "/proc/%d/cwd", pid);
+  return g_file_read_link (filename, NULL);
+}
+
+static char
+read_process_state (GPid pid)
+{
+  char filename[64];
+  char *contents, *p;
+  char state = '\0';
+
+  g_snprintf (filename, sizeof (filename), "/proc/%d/stat", pid);
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return '\0';
+
+  /* The process name may contain spaces and parentheses, so look for the last ')' */
+  p = strrchr (contents, ')');
+  if (p != NULL && p[1] == ' ' && p[2] != '\0')
+    state = p[2];
+
+  g_free (contents);
+  return state;
+}
+
+static void
+tracked_screen_free (TrackedScreen *tracked)
+{
+  g_free (tracked->info.name);
+  g_free (tracked->info.cwd);
+  g_slice_free (TrackedScreen, tracked);
+}
+
+/* Returns: %TRUE iff the foreground process or its working directory changed */
+static gboolean
+tracked_screen_refresh (TrackedScreen *tracked,
+                        gboolean with_state)
+{
+  TerminalProcessInfo *info = &tracked->info;
+  GPid child_pid, pgrp, pid;
+  char *cwd;
+  int fd;
+  gboolean changed = FALSE;
+
+  tracked->dirty = FALSE;
+  tracked->last_refresh = g_get_monotonic_time ();
+
+  fd = terminal_screen_get_pty_fd (tracked->screen);
+  child_pid = terminal_screen_get_child_pid (tracked->screen);
+
+  pgrp = fd != -1 ? tcgetpgrp (fd) : -1;
+  if (pgrp <= 0)
+    pgrp = -1;
+
+  pid = pgrp != -1 ? pgrp : child_pid;
+
+  if (pgrp != info->pgrp) {
+    info->pgrp = pgrp;
+    g_free (info->name);
+    info->name = pid != -1 ? read_process_name (pid) : NULL;
+    with_state = TRUE;
+    changed = TRUE;
+
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] foreground process now %d (%s)\n",
+                           tracked->screen, pgrp, info->name ? info->name : "(unknown)");
+  }
+
+  cwd = pid != -1 ? read_process_cwd (pid) : NULL;
+  if (cwd == NULL && child_pid != -1 && pid != child_pid)
+    cwd = read_process_cwd (child_pid);
+  if (g_strcmp0 (cwd, info->cwd) != 0) {
+    g_free (info->cwd);
+    info->cwd = cwd;
+    changed = TRUE;
+  } else {
+    g_free (cwd);
+  }
+
+  /* The state flips all the time for busy processes, so it's only
+   * sampled on ticks and doesn't count as a change.
+   */
+  if (with_state)
+    info->state = pid != -1 ? read_process_state (pid) : '\0';
+
+  return changed;
+}
+
+static void
+emit_process_changed (TerminalProcessTracker *tracker,
+                      GSList *screens)
+{
+  GSList *l;
+
+  for (l = screens; l != NULL; l = l->next)
+    g_signal_emit (tracker, signals[PROCESS_CHANGED], 0, l->data);
+
+  g_slist_foreach (screens, (GFunc) g_object_unref, NULL);
+  g_slist_free (screens);
+}
+
+static gboolean
+terminal_process_tracker_tick_cb (TerminalProcessTracker *tracker)
+{
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+  GHashTableIter iter;
+  TrackedScreen *tracked;
+  GSList *changed = NULL;
+
+  priv->timeout_id = 0;
+
+  g_hash_table_iter_init (&iter, priv->screens);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &tracked)) {
+    if (tracked_screen_refresh (tracked, TRUE))
+      changed = g_slist_prepend (changed, g_object_ref (tracked->screen));
+  }
+
+  terminal_process_tracker_schedule (tracker,
+                                     changed ? MIN_INTERVAL : MIN (priv->interval * 2, MAX_INTERVAL));
+
+  emit_process_changed (tracker, changed);
+
+  return FALSE; /* rescheduled above */
+}
+
+static gboolean
+terminal_process_tracker_idle_cb (TerminalProcessTracker *tracker)
+{
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+  GHashTableIter iter;
+  TrackedScreen *tracked;
+  GSList *changed = NULL;
+  gint64 now;
+
+  priv->idle_id = 0;
+
+  now = g_get_monotonic_time ();
+
+  /* Screens that were refreshed very recently stay dirty; the next tick picks them up */
+  g_hash_table_iter_init (&iter, priv->screens);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &tracked)) {
+    if (!tracked->dirty ||
+        now - tracked->last_refresh < MIN_REFRESH_DELAY)
+      continue;
+
+    if (tracked_screen_refresh (tracked, FALSE))
+      changed = g_slist_prepend (changed, g_object_ref (tracked->screen));
+  }
+
+  if (changed != NULL && priv->interval > MIN_INTERVAL)
+    terminal_process_tracker_schedule (tracker, MIN_INTERVAL);
+
+  emit_process_changed (tracker, changed);
+
+  return FALSE;
+}
+
+static void
+terminal_process_tracker_schedule (TerminalProcessTracker *tracker,
+                                   guint interval)
+{
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+
+  priv->interval = interval;
+
+  if (priv->timeout_id != 0) {
+    g_source_remove (priv->timeout_id);
+    priv->timeout_id = 0;
+  }
+
+  /* Nothing to track, no need to wake up */
+  if (g_hash_table_size (priv->screens) == 0)
+    return;
+
+  priv->timeout_id = g_timeout_add (interval,
+                                    (GSourceFunc) terminal_process_tracker_tick_cb,
+                                    tracker);
+}
+
+static void
+screen_contents_changed_cb (TerminalScreen *screen,
+                            TerminalProcessTracker *tracker)
+{
+  /* Nobody's looking; the periodic tick will catch up */
+  if (terminal_screen_get_low_power (screen))
+    return;
+
+  terminal_process_tracker_queue_refresh (tracker, screen);
+}
+
+/* Resource accounting */
+
+static gboolean
+read_proc_stat (GPid pid,
+                GPid *ppid,
+                guint64 *cpu_ticks,
+                guint64 *rss_pages)
+{
+  char filename[64];
+  char *contents, *p;
+  unsigned long utime, stime;
+  long rss;
+  int parent;
+  gboolean retval = FALSE;
+
+  g_snprintf (filename, sizeof (filename), "/proc/%d/stat", pid);
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return FALSE;
+
+  /* Skip over the name, then pick ppid (4), utime (14), stime (15) and rss (24) */
+  p = strrchr (contents, ')');
+  if (p != NULL && p[1] == ' ' &&
+      sscanf (p + 2,
+              "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu "
+              "%*d %*d %*d %*d %*d %*d %*u %*u %ld",
+              &parent, &utime, &stime, &rss) == 4) {
+    *ppid = parent;
+    *cpu_ticks = (guint64) utime + (guint64) stime;
+    *rss_pages = rss > 0 ? (guint64) rss : 0;
+    retval = TRUE;
+  }
+
+  g_free (contents);
+  return retval;
+}
+
+static void
+read_proc_io (GPid pid,
+              guint64 *read_bytes,
+              guint64 *write_bytes)
+{
+  char filename[64];
+  char *contents, *p;
+
+  g_snprintf (filename, sizeof (filename), "/proc/%d/io", pid);
+  if (!g_file_get_contents (filename, &contents, NULL, NULL))
+    return;
+
+  /* Note the leading newline, so we don't match cancelled_write_bytes */
+  if ((p = strstr (contents, "\nread_bytes: ")) != NULL)
+    *read_bytes += g_ascii_strtoull (p + strlen ("\nread_bytes: "), NULL, 10);
+  if ((p = strstr (contents, "\nwrite_bytes: ")) != NULL)
+    *write_bytes += g_ascii_strtoull (p + strlen ("\nwrite_bytes: "), NULL, 10);
+
+  g_free (contents);
+}
+
+#define LOOKUP_INDEX(table, pid) (GPOINTER_TO_UINT (g_hash_table_lookup ((table), GINT_TO_POINTER (pid))))
+
+static int
+resolve_owner (GArray *entries,
+               GHashTable *pids,
+               GHashTable *roots,
+               guint index)
+{
+  ProcEntry *entry;
+  guint i, last, depth, parent, root;
+  int owner = -1;
+
+  /* Walk up the tree until we hit one of the screens' children, a process
+   * whose owner we already know, or the top...
+   */
+  last = i = index;
+  for (depth = 0; depth < ACCOUNTING_MAX_DEPTH; depth++) {
+    entry = &g_array_index (entries, ProcEntry, i);
+    last = i;
+
+    if (entry->owner != -2) {
+      owner = entry->owner;
+      break;
+    }
+    if ((root = LOOKUP_INDEX (roots, entry->pid)) != 0) {
+      owner = root - 1;
+      break;
+    }
+    if (entry->ppid <= 1 ||
+        (parent = LOOKUP_INDEX (pids, entry->ppid)) == 0)
+      break;
+
+    i = parent - 1;
+  }
+
+  /* ... then remember the answer along the way, so that the
+   * siblings and descendants resolve immediately.
+   */
+  i = index;
+  for (depth = 0; depth < ACCOUNTING_MAX_DEPTH; depth++) {
+    entry = &g_array_index (entries, ProcEntry, i);
+    if (entry->owner == -2)
+      entry->owner = owner;
+
+    if (i == last ||
+        (parent = LOOKUP_INDEX (pids, entry->ppid)) == 0)
+      break;
+
+    i = parent - 1;
+  }
+
+  return owner;
+}
+
+static void
+accounting_pass_free (AccountingPass *pass)
+{
+  guint i;
+
+  for (i = 0; i < pass->samples->len; i++)
+    g_free (g_array_index (pass->samples, AccountingSample, i).cgroup);
+  g_array_free (pass->samples, TRUE);
+  g_object_unref (pass->tracker);
+  g_slice_free (AccountingPass, pass);
+}
+
+static gboolean
+accounting_pass_done_cb (AccountingPass *pass)
+{
+  TerminalProcessTracker *tracker = pass->tracker;
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+  long clock_ticks;
+  guint i;
+
+  priv->accounting_in_flight = FALSE;
+  if (priv->disposed)
+    goto out;
+
+  priv->accounting_cost = pass->cost;
+  priv->accounting_n_scanned = pass->n_scanned;
+
+  clock_ticks = sysconf (_SC_CLK_TCK);
+
+  for (i = 0; i < pass->samples->len; i++) {
+    AccountingSample *sample = &g_array_index (pass->samples, AccountingSample, i);
+    TrackedScreen *tracked;
+    TerminalProcessInfo *info;
+
+    /* The screen may have gone away, or restarted its child, meanwhile */
+    tracked = g_hash_table_lookup (priv->screens, sample->screen);
+    if (tracked == NULL ||
+        terminal_screen_get_child_pid (tracked->screen) != sample->root)
+      continue;
+
+    info = &tracked->info;
+
+    /* The cgroup counts everything that ran in it, exactly */
+    if (sample->cgroup_valid) {
+      if (tracked->cpu_timestamp != 0 &&
+          pass->timestamp > tracked->cpu_timestamp &&
+          sample->cgroup_cpu_usec >= tracked->cgroup_cpu_usec)
+        info->cpu_percent = 100.0 * (double) (sample->cgroup_cpu_usec - tracked->cgroup_cpu_usec) /
+                            (double) (pass->timestamp - tracked->cpu_timestamp);
+      else
+        info->cpu_percent = 0.0;
+    } else if (tracked->cpu_timestamp != 0 &&
+        pass->timestamp > tracked->cpu_timestamp &&
+        sample->cpu_ticks >= tracked->cpu_ticks &&
+        clock_ticks > 0)
+      info->cpu_percent = 100.0 * (double) (sample->cpu_ticks - tracked->cpu_ticks) / (double) clock_ticks /
+                          ((double) (pass->timestamp - tracked->cpu_timestamp) / G_USEC_PER_SEC);
+    else
+      info->cpu_percent = 0.0;
+
+    tracked->cpu_ticks = sample->cpu_ticks;
+    tracked->cgroup_cpu_usec = sample->cgroup_cpu_usec;
+    tracked->cpu_timestamp = pass->timestamp;
+
+    info->n_processes = sample->n_processes;
+    info->rss = sample->rss;
+    info->read_bytes = sample->read_bytes;
+    info->write_bytes = sample->write_bytes;
+    info->cgroup_memory = sample->cgroup_valid ? sample->cgroup_memory : 0;
+  }
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "Accounting pass over %u processes took %" G_GINT64_FORMAT "µs of CPU\n",
+                         pass->n_scanned, pass->cost);
+
+  terminal_process_tracker_schedule_accounting (tracker);
+
+  g_signal_emit (tracker, signals[ACCOUNTING_UPDATED], 0);
+
+out:
+  accounting_pass_free (pass);
+  return FALSE;
+}
+
+static gint64
+thread_cpu_time (void)
+{
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_THREAD, &usage) != 0)
+    return 0;
+
+  return (gint64) usage.ru_utime.tv_sec * G_USEC_PER_SEC + usage.ru_utime.tv_usec +
+         (gint64) usage.ru_stime.tv_sec * G_USEC_PER_SEC + usage.ru_stime.tv_usec;
+}
+
+static gpointer
+accounting_pass_thread (AccountingPass *pass)
+{
+  GArray *entries;
+  GHashTable *pids, *roots; /* pid -> index + 1 */
+  GDir *dir;
+  const char *name;
+  gint64 start;
+  long page_size;
+  guint i;
+
+  start = thread_cpu_time ();
+  page_size = sysconf (_SC_PAGESIZE);
+
+  entries = g_array_new (FALSE, FALSE, sizeof (ProcEntry));
+  pids = g_hash_table_new (NULL, NULL);
+  roots = g_hash_table_new (NULL, NULL);
+
+  for (i = 0; i < pass->samples->len; i++) {
+    AccountingSample *sample = &g_array_index (pass->samples, AccountingSample, i);
+
+    g_hash_table_insert (roots, GINT_TO_POINTER (sample->root), GUINT_TO_POINTER (i + 1));
+  }
+
+  /* One pass over /proc for all screens */
+  dir = g_dir_open ("/proc", 0, NULL);
+  while (dir != NULL &&
+         entries->len < ACCOUNTING_MAX_PROCESSES &&
+         (name = g_dir_read_name (dir)) != NULL) {
+    ProcEntry entry;
+    char *end;
+    long pid;
+
+    pid = strtol (name, &end, 10);
+    if (*end != '\0' || pid <= 0)
+      continue;
+
+    entry.pid = pid;
+    entry.owner = -2;
+    if (!read_proc_stat (entry.pid, &entry.ppid, &entry.cpu_ticks, &entry.rss_pages))
+      continue;
+
+    g_hash_table_insert (pids, GINT_TO_POINTER (entry.pid), GUINT_TO_POINTER (entries->len + 1));
+    g_array_append_val (entries, entry);
+  }
+  if (dir != NULL)
+    g_dir_close (dir);
+
+  for (i = 0; i < entries->len; i++) {
+    ProcEntry *entry = &g_array_index (entries, ProcEntry, i);
+    AccountingSample *sample;
+    int owner;
+
+    owner = resolve_owner (entries, pids, roots, i);
+    if (owner < 0)
+      continue;
+
+    sample = &g_array_index (pass->samples, AccountingSample, owner);
+    sample->n_processes++;
+    sample->cpu_ticks += entry->cpu_ticks;
+    sample->rss += entry->rss_pages * page_size;
+    read_proc_io (entry->pid, &sample->read_bytes, &sample->write_bytes);
+  }
+
+  for (i = 0; i < pass->samples->len; i++) {
+    AccountingSample *sample = &g_array_index (pass->samples, AccountingSample, i);
+
+    if (sample->cgroup != NULL)
+      sample->cgroup_valid = terminal_cgroup_read_usage (sample->cgroup,
+                                                         &sample->cgroup_cpu_usec,
+                                                         &sample->cgroup_memory);
+  }
+
+  pass->n_scanned = entries->len;
+
+  g_hash_table_destroy (roots);
+  g_hash_table_destroy (pids);
+  g_array_free (entries, TRUE);
+
+  pass->cost = thread_cpu_time () - start;
+
+  g_idle_add ((GSourceFunc) accounting_pass_done_cb, pass);
+
+  return NULL;
+}
+
+static void
+terminal_process_tracker_start_accounting (TerminalProcessTracker *tracker)
+{
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+  AccountingPass *pass;
+  GHashTableIter iter;
+  TrackedScreen *tracked;
+  GThread *thread;
+
+  if (priv->accounting_in_flight)
+    return;
+
+  pass = g_slice_new0 (AccountingPass);
+  pass->tracker = g_object_ref (tracker);
+  pass->samples = g_array_new (FALSE, TRUE, sizeof (AccountingSample));
+
+  g_hash_table_iter_init (&iter, priv->screens);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &tracked)) {
+    AccountingSample sample;
+    TerminalCgroup *cgroup;
+    GPid pid;
+
+    pid = terminal_screen_get_child_pid (tracked->screen);
+    if (pid == -1)
+      continue;
+
+    memset (&sample, 0, sizeof (sample));
+    sample.screen = tracked->screen;
+    sample.root = pid;
+    cgroup = terminal_screen_get_cgroup (tracked->screen);
+    if (cgroup != NULL)
+      sample.cgroup = g_strdup (terminal_cgroup_get_path (cgroup));
+    g_array_append_val (pass->samples, sample);
+  }
+
+  if (pass->samples->len == 0) {
+    accounting_pass_free (pass);
+    return;
+  }
+
+  pass->timestamp = g_get_monotonic_time ();
+
+  thread = g_thread_try_new ("accounting", (GThreadFunc) accounting_pass_thread, pass, NULL);
+  if (thread == NULL) {
+    accounting_pass_free (pass);
+    terminal_process_tracker_schedule_accounting (tracker);
+    return;
+  }
+
+  priv->accounting_in_flight = TRUE;
+  g_thread_unref (thread);
+}
+
+static gboolean
+accounting_timeout_cb (TerminalProcessTracker *tracker)
+{
+  tracker->priv->accounting_timeout_id = 0;
+  terminal_process_tracker_start_accounting (tracker);
+  return FALSE;
+}
+
+static void
+terminal_process_tracker_schedule_accounting (TerminalProcessTracker *tracker)
+{
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+  guint interval;
+
+  if (priv->accounting_timeout_id != 0 ||
+      priv->accounting_in_flight ||
+      g_hash_table_size (priv->screens) == 0)
+    return;
+
+  interval = priv->accounting_users > 0 ? ACCOUNTING_INTERVAL_ACTIVE : ACCOUNTING_INTERVAL_IDLE;
+
+  /* A pass costing c µs stays below 1% of a CPU if it runs at most every c/10 ms */
+  interval = MAX (interval, (guint) MIN (priv->accounting_cost / 10, G_MAXUINT));
+
+  priv->accounting_interval = interval;
+  priv->accounting_timeout_id = g_timeout_add (interval,
+                                               (GSourceFunc) accounting_timeout_cb,
+                                               tracker);
+}
+
+/* Class implementation */
+
+static void
+terminal_process_tracker_init (TerminalProcessTracker *tracker)
+{
+  TerminalProcessTrackerPrivate *priv;
+
+  priv = tracker->priv = G_TYPE_INSTANCE_GET_PRIVATE (tracker, TERMINAL_TYPE_PROCESS_TRACKER, TerminalProcessTrackerPrivate);
+
+  priv->screens = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) tracked_screen_free);
+  priv->interval = MIN_INTERVAL;
+  priv->accounting_interval = ACCOUNTING_INTERVAL_IDLE;
+}
+
+static void
+terminal_process_tracker_dispose (GObject *object)
+{
+  TerminalProcessTracker *tracker = TERMINAL_PROCESS_TRACKER (object);
+  TerminalProcessTrackerPrivate *priv = tracker->priv;
+  GHashTableIter iter;
+  TerminalScreen *screen;
+
+  priv->disposed = TRUE;
+
+  g_hash_table_iter_init (&iter, priv->screens);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &screen, NULL))
+    g_signal_handlers_disconnect_by_func (screen,
+                                          G_CALLBACK (screen_contents_changed_cb),
+                                          tracker);
+  g_hash_table_remove_all (priv->screens);
+
+  if (priv->timeout_id != 0) {
+    g_source_remove (priv->timeout_id);
+    priv->timeout_id = 0;
+  }
+  if (priv->idle_id != 0) {
+    g_source_remove (priv->idle_id);
+    priv->idle_id = 0;
+  }
+  if (priv->accounting_timeout_id != 0) {
+    g_source_remove (priv->accounting_timeout_id);
+    priv->accounting_timeout_id = 0;
+  }
+
+  G_OBJECT_CLASS (terminal_process_tracker_parent_class)->dispose (object);
+}
+
+static void
+terminal_process_tracker_finalize (GObject *object)
+{
+  TerminalProcessTracker *tracker = TERMINAL_PROCESS_TRACKER (object);
+
+  g_hash_table_destroy (tracker->priv->screens);
+
+  G_OBJECT_CLASS (terminal_process_tracker_parent_class)->finalize (object);
+}
+
+static void
+terminal_process_tracker_class_init (TerminalProcessTrackerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = terminal_process_tracker_dispose;
+  object_class->finalize = terminal_process_tracker_finalize;
+
+  signals[PROCESS_CHANGED] =
+    g_signal_new (I_("process-changed"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalProcessTrackerClass, process_changed),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1, TERMINAL_TYPE_SCREEN);
+
+  signals[ACCOUNTING_UPDATED] =
+    g_signal_new (I_("accounting-updated"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalProcessTrackerClass, accounting_updated),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE,
+                  0);
+
+  g_type_class_add_private (object_class, sizeof (TerminalProcessTrackerPrivate));
+}
+
+/* Public API */
+
+/**
+ * terminal_process_tracker_new:
+ *
+ * Returns: (transfer full): a new #TerminalProcessTracker
+ */
+TerminalProcessTracker *
+terminal_process_tracker_new (void)
+{
+  return g_object_new (TERMINAL_TYPE_PROCESS_TRACKER, NULL);
+}
+
+/**
+ * terminal_process_tracker_add_screen:
+ * @tracker: a #TerminalProcessTracker
+ * @screen: a #TerminalScreen with a running child process
+ *
+ * Starts tracking the foreground process of @screen's PTY.
+ */
+void
+terminal_process_tracker_add_screen (TerminalProcessTracker *tracker,
+                                     TerminalScreen *screen)
+{
+  TerminalProcessTrackerPrivate *priv;
+  TrackedScreen *tracked;
+
+  g_return_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker));
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = tracker->priv;
+  if (g_hash_table_lookup (priv->screens, screen) != NULL)
+    return;
+
+  tracked = g_slice_new0 (TrackedScreen);
+  tracked->screen = screen;
+  tracked->info.pgrp = -1;
+  g_hash_table_insert (priv->screens, screen, tracked);
+
+  g_signal_connect (screen, "contents-changed",
+                    G_CALLBACK (screen_contents_changed_cb), tracker);
+
+  terminal_process_tracker_queue_refresh (tracker, screen);
+  terminal_process_tracker_schedule (tracker, MIN_INTERVAL);
+  terminal_process_tracker_schedule_accounting (tracker);
+}
+
+/**
+ * terminal_process_tracker_remove_screen:
+ * @tracker: a #TerminalProcessTracker
+ * @screen: a #TerminalScreen
+ *
+ * Stops tracking @screen, and drops its cached process information.
+ */
+void
+terminal_process_tracker_remove_screen (TerminalProcessTracker *tracker,
+                                        TerminalScreen *screen)
+{
+  TerminalProcessTrackerPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker));
+
+  priv = tracker->priv;
+  if (!g_hash_table_remove (priv->screens, screen))
+    return;
+
+  g_signal_handlers_disconnect_by_func (screen,
+                                        G_CALLBACK (screen_contents_changed_cb),
+                                        tracker);
+
+  if (g_hash_table_size (priv->screens) == 0) {
+    terminal_process_tracker_schedule (tracker, MIN_INTERVAL);
+
+    if (priv->accounting_timeout_id != 0) {
+      g_source_remove (priv->accounting_timeout_id);
+      priv->accounting_timeout_id = 0;
+    }
+  }
+}
+
+/**
+ * terminal_process_tracker_queue_refresh:
+ * @tracker: a #TerminalProcessTracker
+ * @screen: a #TerminalScreen
+ *
+ * Schedules a refresh of @screen's cached process information
+ * as soon as the main loop is idle.
+ */
+void
+terminal_process_tracker_queue_refresh (TerminalProcessTracker *tracker,
+                                        TerminalScreen *screen)
+{
+  TerminalProcessTrackerPrivate *priv;
+  TrackedScreen *tracked;
+
+  g_return_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker));
+
+  priv = tracker->priv;
+  tracked = g_hash_table_lookup (priv->screens, screen);
+  if (tracked == NULL)
+    return;
+
+  tracked->dirty = TRUE;
+
+  if (priv->idle_id == 0)
+    priv->idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                     (GSourceFunc) terminal_process_tracker_idle_cb,
+                                     tracker, NULL);
+}
+
+/**
+ * terminal_process_tracker_lookup:
+ * @tracker: a #TerminalProcessTracker
+ * @screen: a #TerminalScreen
+ *
+ * Returns the cached information about the foreground process
+ * of @screen. This never touches /proc.
+ *
+ * Returns: (transfer none): the cached #TerminalProcessInfo, or %NULL
+ *   if @screen isn't tracked
+ */
+const TerminalProcessInfo *
+terminal_process_tracker_lookup (TerminalProcessTracker *tracker,
+                                 TerminalScreen *screen)
+{
+  TrackedScreen *tracked;
+
+  g_return_val_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker), NULL);
+
+  tracked = g_hash_table_lookup (tracker->priv->screens, screen);
+  if (tracked == NULL)
+    return NULL;
+
+  return &tracked->info;
+}
+
+/**
+ * terminal_process_tracker_list_screens:
+ * @tracker: a #TerminalProcessTracker
+ *
+ * Returns: (transfer container): a #GList of all tracked #TerminalScreen<!-- -->s;
+ *   free with g_list_free()
+ */
+GList *
+terminal_process_tracker_list_screens (TerminalProcessTracker *tracker)
+{
+  g_return_val_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker), NULL);
+
+  return g_hash_table_get_keys (tracker->priv->screens);
+}
+
+/**
+ * terminal_process_tracker_hold_accounting:
+ * @tracker: a #TerminalProcessTracker
+ *
+ * Tells @tracker that somebody is watching the resource usage, so it
+ * should be sampled more often. Starts a new sample right away.
+ * Call terminal_process_tracker_release_accounting() when done.
+ */
+void
+terminal_process_tracker_hold_accounting (TerminalProcessTracker *tracker)
+{
+  TerminalProcessTrackerPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker));
+
+  priv = tracker->priv;
+  if (priv->accounting_users++ > 0)
+    return;
+
+  if (priv->accounting_timeout_id != 0) {
+    g_source_remove (priv->accounting_timeout_id);
+    priv->accounting_timeout_id = 0;
+  }
+
+  terminal_process_tracker_start_accounting (tracker);
+}
+
+/**
+ * terminal_process_tracker_release_accounting:
+ * @tracker: a #TerminalProcessTracker
+ *
+ * Undoes one terminal_process_tracker_hold_accounting() call.
+ */
+void
+terminal_process_tracker_release_accounting (TerminalProcessTracker *tracker)
+{
+  g_return_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker));
+  g_return_if_fail (tracker->priv->accounting_users > 0);
+
+  tracker->priv->accounting_users--;
+}
+
+/**
+ * terminal_process_tracker_get_accounting_cost:
+ * @tracker: a #TerminalProcessTracker
+ * @cost: (out) (allow-none): the CPU time of the last accounting pass, in µs
+ * @interval: (out) (allow-none): the current accounting interval, in ms
+ * @n_scanned: (out) (allow-none): the number of processes looked at in the last pass
+ */
+void
+terminal_process_tracker_get_accounting_cost (TerminalProcessTracker *tracker,
+                                              gint64 *cost,
+                                              guint *interval,
+                                              guint *n_scanned)
+{
+  TerminalProcessTrackerPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_PROCESS_TRACKER (tracker));
+
+  priv = tracker->priv;
+  if (cost)
+    *cost = priv->accounting_cost;
+  if (interval)
+    *interval = priv->accounting_interval;
+  if (n_scanned)
+    *n_scanned = priv->accounting_n_scanned;
+}
@@ -0,0 +1,113 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_PROCESS_TRACKER_H
+#define TERMINAL_PROCESS_TRACKER_H
+
+#include <glib-object.h>
+
+#include "terminal-screen.h"
+
+G_BEGIN_DECLS
+
+#define TERMINAL_TYPE_PROCESS_TRACKER         (terminal_process_tracker_get_type ())
+#define TERMINAL_PROCESS_TRACKER(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o), TERMINAL_TYPE_PROCESS_TRACKER, TerminalProcessTracker))
+#define TERMINAL_PROCESS_TRACKER_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST((k), TERMINAL_TYPE_PROCESS_TRACKER, TerminalProcessTrackerClass))
+#define TERMINAL_IS_PROCESS_TRACKER(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o), TERMINAL_TYPE_PROCESS_TRACKER))
+#define TERMINAL_IS_PROCESS_TRACKER_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k), TERMINAL_TYPE_PROCESS_TRACKER))
+#define TERMINAL_PROCESS_TRACKER_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o), TERMINAL_TYPE_PROCESS_TRACKER, TerminalProcessTrackerClass))
+
+typedef struct _TerminalProcessTracker        TerminalProcessTracker;
+typedef struct _TerminalProcessTrackerClass   TerminalProcessTrackerClass;
+typedef struct _TerminalProcessTrackerPrivate TerminalProcessTrackerPrivate;
+
+struct _TerminalProcessTracker
+{
+  GObject parent_instance;
+
+  /*< private >*/
+  TerminalProcessTrackerPrivate *priv;
+};
+
+struct _TerminalProcessTrackerClass
+{
+  GObjectClass parent_class;
+
+  void (* process_changed)    (TerminalProcessTracker *tracker,
+                               TerminalScreen *screen);
+  void (* accounting_updated) (TerminalProcessTracker *tracker);
+};
+
+/**
+ * TerminalProcessInfo:
+ * @pgrp: the foreground process group of the screen's PTY, or -1
+ * @name: the name of the foreground process, or %NULL
+ * @cwd: the working directory of the foreground process, or %NULL
+ * @state: the process state from /proc/<pid>/stat, or '\0'
+ * @n_processes: the number of processes in the child's process tree
+ * @cpu_percent: the CPU usage of the process tree, in percent of one CPU
+ * @rss: the resident set size of the process tree, in bytes
+ * @read_bytes: the bytes read from storage by the process tree
+ * @write_bytes: the bytes written to storage by the process tree
+ * @cgroup_memory: the memory charged to the child's cgroup, in bytes,
+ *   or 0 if it doesn't run in a cgroup of its own
+ *
+ * Cached information about the foreground process of a #TerminalScreen,
+ * and the resource usage of all processes below its child. If the child
+ * runs in a cgroup of its own, @cpu_percent comes from the cgroup.
+ */
+typedef struct {
+  GPid  pgrp;
+  char *name;
+  char *cwd;
+  char  state;
+
+  guint   n_processes;
+  double  cpu_percent;
+  guint64 rss;
+  guint64 read_bytes;
+  guint64 write_bytes;
+  guint64 cgroup_memory;
+} TerminalProcessInfo;
+
+GType terminal_process_tracker_get_type (void);
+
+TerminalProcessTracker *terminal_process_tracker_new (void);
+
+void terminal_process_tracker_add_screen (TerminalProcessTracker *tracker,
+                                          TerminalScreen *screen);
+
+void terminal_process_tracker_remove_screen (TerminalProcessTracker *tracker,
+                                             TerminalScreen *screen);
+
+void terminal_process_tracker_queue_refresh (TerminalProcessTracker *tracker,
+                                             TerminalScreen *screen);
+
+const TerminalProcessInfo *terminal_process_tracker_lookup (TerminalProcessTracker *tracker,
+                                                            TerminalScreen *screen);
+
+GList *terminal_process_tracker_list_screens (TerminalProcessTracker *tracker);
+
+void terminal_process_tracker_hold_accounting    (TerminalProcessTracker *tracker);
+void terminal_process_tracker_release_accounting (TerminalProcessTracker *tracker);
+
+void terminal_process_tracker_get_accounting_cost (TerminalProcessTracker *tracker,
+                                                   gint64 *cost,
+                                                   guint *interval,
+                                                   guint *n_scanned);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_PROCESS_TRACKER_H */
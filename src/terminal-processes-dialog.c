@@ -0,0 +1,309 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-processes-dialog.h"
+
+#include "terminal-app.h"
+#include "terminal-intl.h"
+#include "terminal-process-tracker.h"
+#include "terminal-window.h"
+
+enum
+{
+  COLUMN_SCREEN,
+  COLUMN_TITLE,
+  COLUMN_PROCESS,
+  COLUMN_PID,
+  COLUMN_N_PROCESSES,
+  COLUMN_CPU,
+  COLUMN_RSS,
+  COLUMN_READ,
+  COLUMN_WRITE,
+  N_COLUMNS
+};
+
+typedef struct
+{
+  GtkWidget *dialog;
+  GtkListStore *store;
+  GtkTreeView *tree_view;
+  GtkWidget *cost_label;
+} ProcessesDialogData;
+
+static GtkWidget *processes_dialog = NULL;
+
+static void
+cpu_cell_data_func (GtkTreeViewColumn *column,
+                    GtkCellRenderer *cell,
+                    GtkTreeModel *model,
+                    GtkTreeIter *iter,
+                    gpointer user_data)
+{
+  double cpu;
+  char *text;
+
+  gtk_tree_model_get (model, iter, COLUMN_CPU, &cpu, -1);
+  text = g_strdup_printf ("%.1f%%", cpu);
+  g_object_set (cell, "text", text, NULL);
+  g_free (text);
+}
+
+static void
+size_cell_data_func (GtkTreeViewColumn *column,
+                     GtkCellRenderer *cell,
+                     GtkTreeModel *model,
+                     GtkTreeIter *iter,
+                     gpointer user_data)
+{
+  guint64 size;
+  char *text;
+
+  gtk_tree_model_get (model, iter, GPOINTER_TO_INT (user_data), &size, -1);
+  text = g_format_size (size);
+  g_object_set (cell, "text", text, NULL);
+  g_free (text);
+}
+
+static void
+add_column (GtkTreeView *tree_view,
+            const char *title,
+            int column_id,
+            gboolean numeric,
+            GtkTreeCellDataFunc func)
+{
+  GtkCellRenderer *cell;
+  GtkTreeViewColumn *column;
+
+  cell = gtk_cell_renderer_text_new ();
+  if (numeric)
+    g_object_set (cell, "xalign", 1.0, NULL);
+  else
+    g_object_set (cell, "ellipsize", PANGO_ELLIPSIZE_END, NULL);
+
+  column = gtk_tree_view_column_new ();
+  gtk_tree_view_column_set_title (column, title);
+  gtk_tree_view_column_pack_start (column, cell, TRUE);
+  if (func)
+    gtk_tree_view_column_set_cell_data_func (column, cell, func, GINT_TO_POINTER (column_id), NULL);
+  else
+    gtk_tree_view_column_add_attribute (column, cell, "text", column_id);
+  gtk_tree_view_column_set_sort_column_id (column, column_id);
+  gtk_tree_view_column_set_resizable (column, TRUE);
+  gtk_tree_view_column_set_expand (column, !numeric);
+
+  gtk_tree_view_append_column (tree_view, column);
+}
+
+static void
+processes_dialog_refill (TerminalProcessTracker *tracker,
+                         ProcessesDialogData *data)
+{
+  GtkTreeSelection *selection;
+  GtkTreeIter iter;
+  TerminalScreen *selected = NULL;
+  GList *screens, *l;
+  gint64 cost;
+  guint interval, n_scanned;
+  char *text;
+
+  selection = gtk_tree_view_get_selection (data->tree_view);
+  if (gtk_tree_selection_get_selected (selection, NULL, &iter))
+    gtk_tree_model_get (GTK_TREE_MODEL (data->store), &iter, COLUMN_SCREEN, &selected, -1);
+
+  gtk_list_store_clear (data->store);
+
+  screens = terminal_process_tracker_list_screens (tracker);
+  for (l = screens; l != NULL; l = l->next) {
+    TerminalScreen *screen = l->data;
+    const TerminalProcessInfo *info;
+
+    info = terminal_process_tracker_lookup (tracker, screen);
+    if (info == NULL)
+      continue;
+
+    gtk_list_store_insert_with_values (data->store, &iter, -1,
+                                       COLUMN_SCREEN, screen,
+                                       COLUMN_TITLE, terminal_screen_get_title (screen),
+                                       COLUMN_PROCESS, info->name ? info->name : "",
+                                       COLUMN_PID, (int) terminal_screen_get_child_pid (screen),
+                                       COLUMN_N_PROCESSES, info->n_processes,
+                                       COLUMN_CPU, info->cpu_percent,
+                                       /* The cgroup's figure includes shared and cached pages */
+                                       COLUMN_RSS, info->cgroup_memory > 0 ? info->cgroup_memory : info->rss,
+                                       COLUMN_READ, info->read_bytes,
+                                       COLUMN_WRITE, info->write_bytes,
+                                       -1);
+
+    if (screen == selected)
+      gtk_tree_selection_select_iter (selection, &iter);
+  }
+  g_list_free (screens);
+
+  if (selected)
+    g_object_unref (selected);
+
+  terminal_process_tracker_get_accounting_cost (tracker, &cost, &interval, &n_scanned);
+  text = g_strdup_printf (ngettext ("Sampled %u process in %.1f ms of CPU time, every %.1f s",
+                                    "Sampled %u processes in %.1f ms of CPU time, every %.1f s",
+                                    n_scanned),
+                          n_scanned, cost / 1000.0, interval / 1000.0);
+  gtk_label_set_text (GTK_LABEL (data->cost_label), text);
+  g_free (text);
+}
+
+static void
+row_activated_cb (GtkTreeView *tree_view,
+                  GtkTreePath *path,
+                  GtkTreeViewColumn *column,
+                  ProcessesDialogData *data)
+{
+  GtkTreeIter iter;
+  TerminalScreen *screen;
+  GtkWidget *toplevel;
+
+  if (!gtk_tree_model_get_iter (GTK_TREE_MODEL (data->store), &iter, path))
+    return;
+
+  gtk_tree_model_get (GTK_TREE_MODEL (data->store), &iter, COLUMN_SCREEN, &screen, -1);
+  if (screen == NULL)
+    return;
+
+  /* The screen may have been closed since the list was filled */
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (screen));
+  if (TERMINAL_IS_WINDOW (toplevel)) {
+    terminal_window_switch_screen (TERMINAL_WINDOW (toplevel), screen);
+    gtk_window_present (GTK_WINDOW (toplevel));
+  }
+
+  g_object_unref (screen);
+}
+
+static void
+response_callback (GtkWidget *dialog,
+                   int response,
+                   ProcessesDialogData *data)
+{
+  gtk_widget_destroy (dialog);
+}
+
+static void
+processes_dialog_data_free (ProcessesDialogData *data)
+{
+  TerminalProcessTracker *tracker;
+
+  tracker = terminal_app_get_process_tracker (terminal_app_get ());
+  g_signal_handlers_disconnect_by_func (tracker,
+                                        G_CALLBACK (processes_dialog_refill),
+                                        data);
+  terminal_process_tracker_release_accounting (tracker);
+
+  g_object_unref (data->store);
+  g_free (data);
+}
+
+/**
+ * terminal_processes_dialog_show:
+ * @transient_parent: a #GtkWindow, or %NULL
+ *
+ * Shows the dialog listing the resource usage of all terminals.
+ * While the dialog is open, the resource usage is sampled more often.
+ */
+void
+terminal_processes_dialog_show (GtkWindow *transient_parent)
+{
+  TerminalProcessTracker *tracker;
+  ProcessesDialogData *data;
+  GtkWidget *content_area, *scrolled_window, *tree_view;
+
+  if (processes_dialog) {
+    gtk_window_set_transient_for (GTK_WINDOW (processes_dialog), transient_parent);
+    gtk_window_present (GTK_WINDOW (processes_dialog));
+    return;
+  }
+
+  data = g_new0 (ProcessesDialogData, 1);
+
+  data->dialog = gtk_dialog_new_with_buttons (_("Terminal Processes"),
+                                              transient_parent,
+                                              GTK_DIALOG_DESTROY_WITH_PARENT,
+                                              GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                              NULL);
+  gtk_window_set_role (GTK_WINDOW (data->dialog), "gnome-terminal-processes");
+  gtk_window_set_default_size (GTK_WINDOW (data->dialog), 640, 320);
+  gtk_container_set_border_width (GTK_CONTAINER (data->dialog), 6);
+
+  g_object_set_data_full (G_OBJECT (data->dialog), "GT::Data", data, (GDestroyNotify) processes_dialog_data_free);
+  g_signal_connect (data->dialog, "response",
+                    G_CALLBACK (response_callback), data);
+
+  data->store = gtk_list_store_new (N_COLUMNS,
+                                    TERMINAL_TYPE_SCREEN,
+                                    G_TYPE_STRING,
+                                    G_TYPE_STRING,
+                                    G_TYPE_INT,
+                                    G_TYPE_UINT,
+                                    G_TYPE_DOUBLE,
+                                    G_TYPE_UINT64,
+                                    G_TYPE_UINT64,
+                                    G_TYPE_UINT64);
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (data->store),
+                                        COLUMN_CPU,
+                                        GTK_SORT_DESCENDING);
+
+  tree_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (data->store));
+  data->tree_view = GTK_TREE_VIEW (tree_view);
+  gtk_tree_view_set_rules_hint (data->tree_view, TRUE);
+
+  add_column (data->tree_view, _("Title"), COLUMN_TITLE, FALSE, NULL);
+  add_column (data->tree_view, _("Process"), COLUMN_PROCESS, FALSE, NULL);
+  add_column (data->tree_view, _("PID"), COLUMN_PID, TRUE, NULL);
+  add_column (data->tree_view, _("Processes"), COLUMN_N_PROCESSES, TRUE, NULL);
+  add_column (data->tree_view, _("CPU"), COLUMN_CPU, TRUE, cpu_cell_data_func);
+  add_column (data->tree_view, _("Memory"), COLUMN_RSS, TRUE, size_cell_data_func);
+  add_column (data->tree_view, _("Read"), COLUMN_READ, TRUE, size_cell_data_func);
+  add_column (data->tree_view, _("Written"), COLUMN_WRITE, TRUE, size_cell_data_func);
+
+  g_signal_connect (tree_view, "row-activated",
+                    G_CALLBACK (row_activated_cb), data);
+
+  scrolled_window = gtk_scrolled_window_new (NULL, NULL);
+  gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (scrolled_window),
+                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (scrolled_window), GTK_SHADOW_IN);
+  gtk_container_add (GTK_CONTAINER (scrolled_window), tree_view);
+
+  data->cost_label = gtk_label_new (NULL);
+  gtk_misc_set_alignment (GTK_MISC (data->cost_label), 0.0, 0.5);
+
+  content_area = gtk_dialog_get_content_area (GTK_DIALOG (data->dialog));
+  gtk_box_set_spacing (GTK_BOX (content_area), 6);
+  gtk_box_pack_start (GTK_BOX (content_area), scrolled_window, TRUE, TRUE, 0);
+  gtk_box_pack_start (GTK_BOX (content_area), data->cost_label, FALSE, FALSE, 0);
+
+  tracker = terminal_app_get_process_tracker (terminal_app_get ());
+  processes_dialog_refill (tracker, data);
+  g_signal_connect (tracker, "accounting-updated",
+                    G_CALLBACK (processes_dialog_refill), data);
+  terminal_process_tracker_hold_accounting (tracker);
+
+  gtk_widget_show_all (content_area);
+  gtk_window_present (GTK_WINDOW (data->dialog));
+
+  processes_dialog = data->dialog;
+  g_signal_connect (data->dialog, "destroy",
+                    G_CALLBACK (gtk_widget_destroyed), &processes_dialog);
+}
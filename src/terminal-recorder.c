@@ -0,0 +1,739 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-recorder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+
+#include "terminal-debug.h"
+
+/* The recorder sits between the child's PTY and the one VTE reads. A
+ * relay thread copies keyboard input to the child and the child's output
+ * to VTE, forwarding each chunk of output before queueing a copy of it,
+ * so recording never delays what the user sees. A writer thread
+ * compresses the queued output into files of at most @max_size bytes
+ * before compression, optionally in asciicast v2 format.
+ *
+ * If the writer falls too far behind, output is dropped from the
+ * recording rather than held up, so the child never waits for the disk.
+ *
+ * Stopping never blocks: both threads keep a reference on the recorder
+ * and finish on their own. The relay hands the output it still had for
+ * the terminal to the main thread, so that nothing the child wrote last
+ * gets lost when the child exits.
+ */
+
+#define BUFFER_SIZE (16 * 1024)
+#define MAX_QUEUED  (8 * 1024 * 1024) /* bytes */
+
+typedef struct {
+  gint64 time; /* monotonic µs */
+  char type; /* 'o' for output, 'r' for resize */
+  gsize len;
+  char data[1];
+} RecordChunk;
+
+typedef struct {
+  TerminalRecorderDrainedFunc func;
+  gpointer user_data;
+  GBytes *tail;
+} Drained;
+
+struct _TerminalRecorder
+{
+  volatile gint ref_count;
+  int child_fd;
+  int terminal_fd;
+  int wakeup_pipe[2];
+
+  char *directory;
+  char *name;
+  guint64 max_size;
+  gboolean timing;
+
+  GMutex lock;
+  GCond cond;
+  GQueue chunks; /* of RecordChunk */
+  gsize queued; /* bytes */
+  gsize dropped; /* bytes, since the writer last noticed */
+  gboolean relaying; /* the threads were started */
+  gboolean stopping;
+  guint columns, rows;
+  GByteArray *tail; /* once the relay is done */
+  TerminalRecorderDrainedFunc drained_func;
+  gpointer drained_data;
+
+  /* Only used by the writer thread */
+  GOutputStream *stream;
+  guint64 file_size; /* uncompressed */
+  gint64 file_start; /* monotonic µs */
+  guint serial;
+  char carry[4]; /* incomplete UTF-8 sequence */
+  gsize carry_len;
+  gboolean failed;
+};
+
+static void
+set_nonblocking (int fd)
+{
+  int flags;
+
+  flags = fcntl (fd, F_GETFL);
+  if (flags != -1)
+    fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static RecordChunk *
+record_chunk_new (char type,
+                  const char *data,
+                  gsize len)
+{
+  RecordChunk *chunk;
+
+  chunk = g_malloc (offsetof (RecordChunk, data) + MAX (len, 1));
+  chunk->time = g_get_monotonic_time ();
+  chunk->type = type;
+  chunk->len = len;
+  memcpy (chunk->data, data, len);
+
+  return chunk;
+}
+
+static void
+recorder_queue (TerminalRecorder *recorder,
+                RecordChunk *chunk)
+{
+  g_mutex_lock (&recorder->lock);
+  if (recorder->queued > MAX_QUEUED && chunk->type == 'o') {
+    recorder->dropped += chunk->len;
+    g_free (chunk);
+  } else {
+    g_queue_push_tail (&recorder->chunks, chunk);
+    recorder->queued += chunk->len;
+    g_cond_broadcast (&recorder->cond);
+  }
+  g_mutex_unlock (&recorder->lock);
+}
+
+/* Output files */
+
+static gboolean
+recorder_write (TerminalRecorder *recorder,
+                const char *data,
+                gsize len,
+                GError **error)
+{
+  gsize written;
+
+  if (!g_output_stream_write_all (recorder->stream, data, len, &written, NULL, error))
+    return FALSE;
+
+  recorder->file_size += written;
+  return TRUE;
+}
+
+static gboolean
+recorder_close_file (TerminalRecorder *recorder,
+                     GError **error)
+{
+  gboolean ok;
+
+  if (recorder->stream == NULL)
+    return TRUE;
+
+  ok = g_output_stream_close (recorder->stream, NULL, error);
+  g_object_unref (recorder->stream);
+  recorder->stream = NULL;
+
+  return ok;
+}
+
+static gboolean
+recorder_open_file (TerminalRecorder *recorder,
+                    GError **error)
+{
+  GDateTime *now;
+  GFile *file;
+  GFileOutputStream *file_stream;
+  GConverter *compressor;
+  char *stamp, *basename, *path;
+  guint columns, rows;
+
+  now = g_date_time_new_now_local ();
+  stamp = g_date_time_format (now, "%Y%m%d-%H%M%S");
+  basename = g_strdup_printf ("%s-%s-%u.%s.gz",
+                              recorder->name, stamp, recorder->serial++,
+                              recorder->timing ? "cast" : "log");
+  path = g_build_filename (recorder->directory, basename, NULL);
+  g_free (basename);
+  g_free (stamp);
+
+  file = g_file_new_for_path (path);
+  file_stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, error);
+  g_object_unref (file);
+  if (file_stream == NULL) {
+    g_date_time_unref (now);
+    g_free (path);
+    return FALSE;
+  }
+
+  compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+  recorder->stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream), compressor);
+  g_object_unref (compressor);
+  g_object_unref (file_stream);
+
+  recorder->file_size = 0;
+  recorder->file_start = g_get_monotonic_time ();
+  recorder->carry_len = 0;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[recorder %p] recording to %s\n",
+                         recorder, path);
+  g_free (path);
+
+  g_mutex_lock (&recorder->lock);
+  columns = recorder->columns;
+  rows = recorder->rows;
+  g_mutex_unlock (&recorder->lock);
+
+  if (recorder->timing) {
+    char *header;
+    gboolean ok;
+
+    header = g_strdup_printf ("{\"version\": 2, \"width\": %u, \"height\": %u, \"timestamp\": %" G_GINT64_FORMAT "}\n",
+                              columns, rows, g_date_time_to_unix (now));
+    ok = recorder_write (recorder, header, strlen (header), error);
+    g_free (header);
+    g_date_time_unref (now);
+    return ok;
+  }
+
+  g_date_time_unref (now);
+  return TRUE;
+}
+
+/* Appends @data as the contents of a JSON string. Incomplete UTF-8 at the
+ * end is kept for the next chunk, invalid bytes become U+FFFD.
+ */
+static void
+append_json_escaped (TerminalRecorder *recorder,
+                     GString *string,
+                     const char *data,
+                     gsize len)
+{
+  char *buffer;
+  const char *p, *end;
+
+  buffer = g_malloc (recorder->carry_len + len);
+  memcpy (buffer, recorder->carry, recorder->carry_len);
+  memcpy (buffer + recorder->carry_len, data, len);
+  p = buffer;
+  end = buffer + recorder->carry_len + len;
+  recorder->carry_len = 0;
+
+  while (p < end) {
+    gunichar c;
+    const char *next;
+
+    c = g_utf8_get_char_validated (p, end - p);
+    if (c == (gunichar) -2 && end - p < (gssize) sizeof (recorder->carry)) {
+      memcpy (recorder->carry, p, end - p);
+      recorder->carry_len = end - p;
+      break;
+    }
+    if (c == (gunichar) -1 || c == (gunichar) -2) {
+      g_string_append (string, "\\ufffd");
+      p++;
+      continue;
+    }
+
+    next = g_utf8_next_char (p);
+    switch (c) {
+      case '"':
+        g_string_append (string, "\\\"");
+        break;
+      case '\\':
+        g_string_append (string, "\\\\");
+        break;
+      case '\n':
+        g_string_append (string, "\\n");
+        break;
+      case '\r':
+        g_string_append (string, "\\r");
+        break;
+      default:
+        if (c < 0x20 || c == 0x7f)
+          g_string_append_printf (string, "\\u%04x", c);
+        else
+          g_string_append_len (string, p, next - p);
+        break;
+    }
+    p = next;
+  }
+
+  g_free (buffer);
+}
+
+static gboolean
+recorder_write_chunk (TerminalRecorder *recorder,
+                      RecordChunk *chunk,
+                      GError **error)
+{
+  GString *line;
+  gboolean ok;
+
+  if (recorder->max_size > 0 && recorder->file_size >= recorder->max_size) {
+    if (!recorder_close_file (recorder, error))
+      return FALSE;
+  }
+  if (recorder->stream == NULL &&
+      !recorder_open_file (recorder, error))
+    return FALSE;
+
+  if (!recorder->timing) {
+    if (chunk->type != 'o')
+      return TRUE;
+
+    return recorder_write (recorder, chunk->data, chunk->len, error);
+  }
+
+  line = g_string_sized_new (chunk->len + 32);
+  g_string_append_printf (line, "[%.6f, \"%c\", \"",
+                          MAX (chunk->time - recorder->file_start, 0) / (double) G_USEC_PER_SEC,
+                          chunk->type);
+  if (chunk->type == 'o')
+    append_json_escaped (recorder, line, chunk->data, chunk->len);
+  else
+    g_string_append_len (line, chunk->data, chunk->len);
+  g_string_append (line, "\"]\n");
+
+  ok = recorder_write (recorder, line->str, line->len, error);
+  g_string_free (line, TRUE);
+
+  return ok;
+}
+
+static void
+recorder_unref (TerminalRecorder *recorder)
+{
+  if (!g_atomic_int_dec_and_test (&recorder->ref_count))
+    return;
+
+  /* Only if the writer never ran */
+  recorder_close_file (recorder, NULL);
+
+  g_queue_foreach (&recorder->chunks, (GFunc) g_free, NULL);
+  g_queue_clear (&recorder->chunks);
+  if (recorder->tail != NULL)
+    g_byte_array_unref (recorder->tail);
+
+  if (recorder->wakeup_pipe[0] != -1) {
+    close (recorder->wakeup_pipe[0]);
+    close (recorder->wakeup_pipe[1]);
+  }
+  if (recorder->child_fd != -1)
+    close (recorder->child_fd);
+  close (recorder->terminal_fd);
+
+  g_mutex_clear (&recorder->lock);
+  g_cond_clear (&recorder->cond);
+  g_free (recorder->directory);
+  g_free (recorder->name);
+  g_slice_free (TerminalRecorder, recorder);
+}
+
+static gboolean
+drained_cb (Drained *drained)
+{
+  drained->func (drained->tail, drained->user_data);
+
+  g_bytes_unref (drained->tail);
+  g_slice_free (Drained, drained);
+
+  return FALSE;
+}
+
+/* Called with the lock held, once the relay is done and the main
+ * thread asked for what it had left
+ */
+static void
+recorder_schedule_drained (TerminalRecorder *recorder)
+{
+  Drained *drained;
+
+  if (recorder->tail == NULL || recorder->drained_func == NULL)
+    return;
+
+  drained = g_slice_new (Drained);
+  drained->func = recorder->drained_func;
+  drained->user_data = recorder->drained_data;
+  drained->tail = g_byte_array_free_to_bytes (recorder->tail);
+  recorder->tail = NULL;
+  recorder->drained_func = NULL;
+
+  g_idle_add ((GSourceFunc) drained_cb, drained);
+}
+
+static gpointer
+writer_thread (TerminalRecorder *recorder)
+{
+  RecordChunk *chunk;
+  GError *error = NULL;
+  gsize dropped;
+
+  for (;;) {
+    g_mutex_lock (&recorder->lock);
+    while (g_queue_is_empty (&recorder->chunks) && !recorder->stopping)
+      g_cond_wait (&recorder->cond, &recorder->lock);
+    chunk = g_queue_pop_head (&recorder->chunks);
+    if (chunk != NULL)
+      recorder->queued -= chunk->len;
+    dropped = recorder->dropped;
+    recorder->dropped = 0;
+    g_mutex_unlock (&recorder->lock);
+
+    if (dropped > 0 && !recorder->failed)
+      g_warning ("Recording fell behind the terminal output; "
+                 "%" G_GSIZE_FORMAT " bytes were not recorded", dropped);
+
+    if (chunk == NULL)
+      break;
+
+    if (!recorder->failed &&
+        !recorder_write_chunk (recorder, chunk, &error)) {
+      /* Keep relaying; the session just isn't recorded any more */
+      g_warning ("Failed to record terminal output: %s", error->message);
+      g_clear_error (&error);
+      recorder->failed = TRUE;
+    }
+
+    g_free (chunk);
+  }
+
+  if (!recorder_close_file (recorder, &error)) {
+    g_warning ("Failed to record terminal output: %s", error->message);
+    g_error_free (error);
+  }
+
+  recorder_unref (recorder);
+  return NULL;
+}
+
+/* Relay */
+
+/* Writes as much of @buffer as @fd takes without blocking. Returns
+ * FALSE if @fd is gone.
+ */
+static gboolean
+relay_write (int fd,
+             const char *buffer,
+             gsize *pos,
+             gsize len)
+{
+  ssize_t n;
+
+  while (*pos < len) {
+    n = write (fd, buffer + *pos, len - *pos);
+    if (n > 0)
+      *pos += n;
+    else if (n == -1 && errno == EINTR)
+      continue;
+    else
+      return n == -1 && errno == EAGAIN;
+  }
+
+  return TRUE;
+}
+
+static gpointer
+relay_thread (TerminalRecorder *recorder)
+{
+  char output[BUFFER_SIZE]; /* child → terminal */
+  char input[BUFFER_SIZE]; /* terminal → child */
+  gsize output_pos = 0, output_len = 0;
+  gsize input_pos = 0, input_len = 0;
+  gboolean child_open = TRUE, terminal_open = TRUE;
+  struct pollfd fds[3];
+  GByteArray *tail;
+  ssize_t n;
+
+  for (;;) {
+    fds[0].fd = recorder->wakeup_pipe[0];
+    fds[0].events = POLLIN;
+
+    fds[1].fd = child_open ? recorder->child_fd : -1;
+    fds[1].events = (output_len == 0 ? POLLIN : 0) | (input_len > 0 ? POLLOUT : 0);
+
+    fds[2].fd = terminal_open ? recorder->terminal_fd : -1;
+    fds[2].events = (input_len == 0 ? POLLIN : 0) | (output_len > 0 ? POLLOUT : 0);
+
+    if (poll (fds, G_N_ELEMENTS (fds), -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[0].revents != 0)
+      break;
+
+    /* Output first, so typing gets echoed without delay */
+    if (output_len == 0 && fds[1].revents != 0) {
+      n = read (recorder->child_fd, output, sizeof (output));
+      if (n > 0) {
+        output_pos = 0;
+        output_len = n;
+        if (!relay_write (recorder->terminal_fd, output, &output_pos, output_len))
+          terminal_open = FALSE;
+        recorder_queue (recorder, record_chunk_new ('o', output, n));
+      } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        /* EIO once the child side is closed */
+        child_open = FALSE;
+      }
+    }
+    if (output_len > 0 && terminal_open &&
+        !relay_write (recorder->terminal_fd, output, &output_pos, output_len))
+      terminal_open = FALSE;
+    if (output_pos == output_len || !terminal_open)
+      output_pos = output_len = 0;
+
+    if (input_len == 0 && fds[2].revents != 0) {
+      n = read (recorder->terminal_fd, input, sizeof (input));
+      if (n > 0) {
+        input_pos = 0;
+        input_len = n;
+      } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        terminal_open = FALSE;
+      }
+    }
+    if (input_len > 0 && child_open &&
+        !relay_write (recorder->child_fd, input, &input_pos, input_len))
+      child_open = FALSE;
+    if (input_pos == input_len || !child_open)
+      input_pos = input_len = 0;
+
+    if (!child_open && !terminal_open)
+      break;
+  }
+
+  /* The terminal may not read any more once the child exited, so what
+   * it didn't take yet, and whatever the child wrote last, goes to the
+   * main thread instead
+   */
+  tail = g_byte_array_new ();
+  if (terminal_open && output_pos < output_len)
+    g_byte_array_append (tail, (const guint8 *) output + output_pos, output_len - output_pos);
+  while (child_open &&
+         (n = read (recorder->child_fd, output, sizeof (output))) > 0) {
+    g_byte_array_append (tail, (const guint8 *) output, n);
+    recorder_queue (recorder, record_chunk_new ('o', output, n));
+  }
+
+  g_mutex_lock (&recorder->lock);
+  recorder->tail = tail;
+  recorder->stopping = TRUE;
+  g_cond_broadcast (&recorder->cond);
+  recorder_schedule_drained (recorder);
+  g_mutex_unlock (&recorder->lock);
+
+  recorder_unref (recorder);
+  return NULL;
+}
+
+/* Public API */
+
+/**
+ * terminal_recorder_new:
+ * @child_fd: the master side of the child's PTY
+ * @terminal_fd: the slave side of the terminal's PTY, in raw mode
+ * @directory: the directory to store the recordings in
+ * @name: the prefix of the file names
+ * @max_size: the size at which to start a new file, in bytes before
+ *   compression, or 0 for no limit
+ * @timing: whether to write asciicast v2 files instead of the plain
+ *   byte stream
+ * @error: return location for a #GError
+ *
+ * Starts relaying between @child_fd and @terminal_fd and recording the
+ * output. The recorder takes ownership of @terminal_fd, even if it
+ * fails, and keeps a duplicate of @child_fd. Both are made non-blocking.
+ *
+ * Returns: a new #TerminalRecorder, or %NULL if the first file couldn't
+ *   be created
+ */
+TerminalRecorder *
+terminal_recorder_new (int child_fd,
+                       int terminal_fd,
+                       const char *directory,
+                       const char *name,
+                       guint64 max_size,
+                       gboolean timing,
+                       GError **error)
+{
+  TerminalRecorder *recorder;
+  int errsv;
+
+  g_return_val_if_fail (child_fd != -1, NULL);
+  g_return_val_if_fail (terminal_fd != -1, NULL);
+  g_return_val_if_fail (directory != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  if (g_mkdir_with_parents (directory, 0700) != 0) {
+    errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to create %s: %s", directory, g_strerror (errsv));
+    close (terminal_fd);
+    return NULL;
+  }
+
+  recorder = g_slice_new0 (TerminalRecorder);
+  recorder->ref_count = 1;
+  recorder->child_fd = -1;
+  recorder->terminal_fd = terminal_fd;
+  recorder->directory = g_strdup (directory);
+  recorder->name = g_strdup (name);
+  recorder->max_size = max_size;
+  recorder->timing = timing;
+  recorder->columns = 80;
+  recorder->rows = 24;
+  g_mutex_init (&recorder->lock);
+  g_cond_init (&recorder->cond);
+  g_queue_init (&recorder->chunks);
+
+  if (!g_unix_open_pipe (recorder->wakeup_pipe, FD_CLOEXEC, error)) {
+    recorder->wakeup_pipe[0] = recorder->wakeup_pipe[1] = -1;
+    terminal_recorder_free (recorder);
+    return NULL;
+  }
+
+  /* The threads may outlive the caller's PTY */
+  recorder->child_fd = fcntl (child_fd, F_DUPFD_CLOEXEC, 3);
+  if (recorder->child_fd == -1) {
+    errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to duplicate the child's PTY: %s", g_strerror (errsv));
+    terminal_recorder_free (recorder);
+    return NULL;
+  }
+
+  /* Create the first file now, so that errors show up on launch */
+  if (!recorder_open_file (recorder, error)) {
+    terminal_recorder_free (recorder);
+    return NULL;
+  }
+
+  set_nonblocking (recorder->child_fd);
+  set_nonblocking (terminal_fd);
+
+  g_atomic_int_add (&recorder->ref_count, 2);
+  recorder->relaying = TRUE;
+  g_thread_unref (g_thread_new ("recorder-writer", (GThreadFunc) writer_thread, recorder));
+  g_thread_unref (g_thread_new ("recorder-relay", (GThreadFunc) relay_thread, recorder));
+
+  return recorder;
+}
+
+/**
+ * terminal_recorder_stop:
+ * @recorder: a #TerminalRecorder
+ * @func: (allow-none): called on the main thread with the output that
+ *   hadn't reached the terminal yet, once there won't be any more
+ * @user_data: data for @func
+ *
+ * Stops relaying and frees @recorder. The remaining output is written
+ * out and the recording closed in the background.
+ */
+void
+terminal_recorder_stop (TerminalRecorder *recorder,
+                        TerminalRecorderDrainedFunc func,
+                        gpointer user_data)
+{
+  int r;
+
+  if (recorder == NULL)
+    return;
+
+  g_mutex_lock (&recorder->lock);
+  if (!recorder->relaying && recorder->tail == NULL)
+    recorder->tail = g_byte_array_new ();
+  recorder->drained_func = func;
+  recorder->drained_data = user_data;
+  recorder_schedule_drained (recorder);
+  g_mutex_unlock (&recorder->lock);
+
+  if (recorder->relaying) {
+    do {
+      r = write (recorder->wakeup_pipe[1], "x", 1);
+    } while (r == -1 && errno == EINTR);
+  }
+
+  recorder_unref (recorder);
+}
+
+/**
+ * terminal_recorder_free:
+ * @recorder: (allow-none): a #TerminalRecorder
+ *
+ * Like terminal_recorder_stop(), for when the remaining output doesn't
+ * matter to the terminal.
+ */
+void
+terminal_recorder_free (TerminalRecorder *recorder)
+{
+  terminal_recorder_stop (recorder, NULL, NULL);
+}
+
+/**
+ * terminal_recorder_set_size:
+ * @recorder: a #TerminalRecorder
+ * @columns: the terminal's width
+ * @rows: the terminal's height
+ *
+ * Records a change of the terminal size. The size also goes into the
+ * header of each new asciicast file.
+ */
+void
+terminal_recorder_set_size (TerminalRecorder *recorder,
+                            guint columns,
+                            guint rows)
+{
+  char *size;
+  gboolean changed;
+
+  g_return_if_fail (recorder != NULL);
+
+  g_mutex_lock (&recorder->lock);
+  changed = columns != recorder->columns || rows != recorder->rows;
+  recorder->columns = columns;
+  recorder->rows = rows;
+  g_mutex_unlock (&recorder->lock);
+
+  if (!changed || !recorder->timing)
+    return;
+
+  size = g_strdup_printf ("%ux%u", columns, rows);
+  recorder_queue (recorder, record_chunk_new ('r', size, strlen (size)));
+  g_free (size);
+}
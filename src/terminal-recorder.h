@@ -0,0 +1,53 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_RECORDER_H
+#define TERMINAL_RECORDER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalRecorder TerminalRecorder;
+
+/**
+ * TerminalRecorderDrainedFunc:
+ * @tail: output from the child that the terminal hasn't read yet
+ * @user_data: the data passed to terminal_recorder_stop()
+ */
+typedef void (* TerminalRecorderDrainedFunc) (GBytes *tail,
+                                              gpointer user_data);
+
+TerminalRecorder *terminal_recorder_new (int child_fd,
+                                         int terminal_fd,
+                                         const char *directory,
+                                         const char *name,
+                                         guint64 max_size,
+                                         gboolean timing,
+                                         GError **error);
+
+void terminal_recorder_stop (TerminalRecorder *recorder,
+                             TerminalRecorderDrainedFunc func,
+                             gpointer user_data);
+
+void terminal_recorder_free (TerminalRecorder *recorder);
+
+void terminal_recorder_set_size (TerminalRecorder *recorder,
+                                 guint columns,
+                                 guint rows);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_RECORDER_H */
@@ -0,0 +1,451 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-registry.h"
+
+#include <gtk/gtk.h>
+
+#include "terminal-schemas.h"
+#include "terminal-window.h"
+
+/* Terminal registry
+ *
+ * Keeps a snapshot of every exported terminal for ListTerminals. Each
+ * entry caches its a{sv}, and the signals that change what's in it
+ * drop the cache, so a call only rebuilds the terminals that changed
+ * since the last one, and returns the previous list as is if none did.
+ * The same signals are turned into events for subscribers.
+ */
+
+typedef struct {
+  TerminalRegistry *registry;
+  TerminalScreen *screen; /* unowned */
+  char *object_path;
+  GList *link; /* in registry->entries */
+  GVariant *snapshot; /* NULL when stale */
+  glong columns, rows; /* in the snapshot */
+  gboolean child_exited;
+  char *cwd; /* last seen, for events */
+  char *process_name; /* last seen, for events */
+  GSettings *profile; /* whose name is watched */
+  gulong profile_name_changed_id;
+} Entry;
+
+struct _TerminalRegistry
+{
+  TerminalProcessTracker *tracker;
+  TerminalEvents *events;
+  GHashTable *screens; /* TerminalScreen* -> Entry* */
+  GQueue entries; /* in the order they were added */
+  GVariant *list; /* NULL when stale */
+};
+
+static void
+entry_invalidate (Entry *entry)
+{
+  if (entry->snapshot != NULL) {
+    g_variant_unref (entry->snapshot);
+    entry->snapshot = NULL;
+  }
+
+  if (entry->registry->list != NULL) {
+    g_variant_unref (entry->registry->list);
+    entry->registry->list = NULL;
+  }
+}
+
+static const char *activity_names[] = {
+  "none",
+  "output",
+  "silence"
+};
+
+static void
+entry_title_changed_cb (TerminalScreen *screen,
+                        GParamSpec *pspec,
+                        Entry *entry)
+{
+  const char *title;
+
+  entry_invalidate (entry);
+
+  if (!terminal_events_is_wanted (entry->registry->events, TERMINAL_EVENT_TITLE))
+    return;
+
+  title = terminal_screen_get_title (screen);
+  terminal_events_post (entry->registry->events, entry->object_path, TERMINAL_EVENT_TITLE,
+                        g_variant_new_parsed ("{'title': <%s>}", title ? title : ""));
+}
+
+static void
+entry_activity_changed_cb (TerminalScreen *screen,
+                           GParamSpec *pspec,
+                           Entry *entry)
+{
+  TerminalActivity activity;
+
+  if (!terminal_events_is_wanted (entry->registry->events, TERMINAL_EVENT_ACTIVITY))
+    return;
+
+  activity = terminal_screen_get_activity (screen);
+  g_return_if_fail (activity < G_N_ELEMENTS (activity_names));
+
+  terminal_events_post (entry->registry->events, entry->object_path, TERMINAL_EVENT_ACTIVITY,
+                        g_variant_new_parsed ("{'activity': <%s>}", activity_names[activity]));
+}
+
+static void
+entry_beep_cb (TerminalScreen *screen,
+               Entry *entry)
+{
+  if (!terminal_events_is_wanted (entry->registry->events, TERMINAL_EVENT_BELL))
+    return;
+
+  terminal_events_post (entry->registry->events, entry->object_path, TERMINAL_EVENT_BELL,
+                        g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0));
+}
+
+/* Posts events for whatever changed about the cwd and foreground process */
+static void
+entry_process_changed (Entry *entry)
+{
+  TerminalEvents *events = entry->registry->events;
+  const TerminalProcessInfo *info;
+  const char *name;
+  char *cwd;
+
+  entry_invalidate (entry);
+
+  cwd = terminal_screen_get_current_dir (entry->screen);
+  if (g_strcmp0 (cwd, entry->cwd) != 0) {
+    g_free (entry->cwd);
+    entry->cwd = cwd;
+
+    if (cwd != NULL && terminal_events_is_wanted (events, TERMINAL_EVENT_CWD))
+      terminal_events_post (events, entry->object_path, TERMINAL_EVENT_CWD,
+                            g_variant_new_parsed ("{'cwd': <%^ay>}", cwd));
+  } else {
+    g_free (cwd);
+  }
+
+  info = terminal_process_tracker_lookup (entry->registry->tracker, entry->screen);
+  name = info != NULL ? info->name : NULL;
+  if (g_strcmp0 (name, entry->process_name) != 0) {
+    g_free (entry->process_name);
+    entry->process_name = g_strdup (name);
+
+    if (name != NULL && terminal_events_is_wanted (events, TERMINAL_EVENT_FOREGROUND_PROCESS))
+      terminal_events_post (events, entry->object_path, TERMINAL_EVENT_FOREGROUND_PROCESS,
+                            g_variant_new_parsed ("{'name': <%s>}", name));
+  }
+}
+
+static void
+entry_profile_name_changed_cb (GSettings *profile,
+                               const char *key,
+                               Entry *entry)
+{
+  entry_invalidate (entry);
+}
+
+static void
+entry_watch_profile (Entry *entry)
+{
+  if (entry->profile != NULL) {
+    g_signal_handler_disconnect (entry->profile, entry->profile_name_changed_id);
+    g_object_unref (entry->profile);
+  }
+
+  entry->profile = g_object_ref (terminal_screen_get_profile (entry->screen));
+  entry->profile_name_changed_id =
+    g_signal_connect (entry->profile, "changed::" TERMINAL_PROFILE_VISIBLE_NAME_KEY,
+                      G_CALLBACK (entry_profile_name_changed_cb), entry);
+}
+
+static void
+entry_profile_set_cb (TerminalScreen *screen,
+                      GSettings *old_profile,
+                      Entry *entry)
+{
+  entry_watch_profile (entry);
+  entry_invalidate (entry);
+}
+
+static void
+entry_size_allocate_cb (GtkWidget *widget,
+                        GtkAllocation *allocation,
+                        Entry *entry)
+{
+  /* Only the grid size depends on the allocation */
+  if (entry->snapshot != NULL &&
+      (vte_terminal_get_column_count (VTE_TERMINAL (widget)) != entry->columns ||
+       vte_terminal_get_row_count (VTE_TERMINAL (widget)) != entry->rows))
+    entry_invalidate (entry);
+}
+
+static void
+entry_child_exited_cb (TerminalScreen *screen,
+                       Entry *entry)
+{
+  entry->child_exited = TRUE;
+  entry_invalidate (entry);
+
+  if (terminal_events_is_wanted (entry->registry->events, TERMINAL_EVENT_EXIT))
+    terminal_events_post (entry->registry->events, entry->object_path, TERMINAL_EVENT_EXIT,
+                          g_variant_new_parsed ("{'exit-status': <%i>}",
+                                                vte_terminal_get_child_exit_status (VTE_TERMINAL (screen))));
+}
+
+static void
+entry_free (Entry *entry)
+{
+  g_signal_handlers_disconnect_matched (entry->screen, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL, entry);
+  if (entry->profile != NULL) {
+    g_signal_handler_disconnect (entry->profile, entry->profile_name_changed_id);
+    g_object_unref (entry->profile);
+  }
+  if (entry->snapshot != NULL)
+    g_variant_unref (entry->snapshot);
+  g_free (entry->cwd);
+  g_free (entry->process_name);
+  g_free (entry->object_path);
+  g_slice_free (Entry, entry);
+}
+
+static GVariant *
+entry_build_snapshot (Entry *entry)
+{
+  TerminalScreen *screen = entry->screen;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  const TerminalProcessInfo *info;
+  GVariantBuilder builder;
+  GtkWidget *toplevel;
+  const char *title, *state;
+  char *cwd, *profile_name;
+  GPid pid;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+  toplevel = gtk_widget_get_toplevel (GTK_WIDGET (screen));
+  if (TERMINAL_IS_WINDOW (toplevel))
+    g_variant_builder_add (&builder, "{sv}", "window-id",
+                           g_variant_new_uint32 (gtk_application_window_get_id (GTK_APPLICATION_WINDOW (toplevel))));
+
+  title = terminal_screen_get_title (screen);
+  g_variant_builder_add (&builder, "{sv}", "title", g_variant_new_string (title ? title : ""));
+
+  cwd = terminal_screen_get_current_dir (screen);
+  if (cwd != NULL)
+    g_variant_builder_add (&builder, "{sv}", "cwd", g_variant_new_bytestring (cwd));
+  g_free (cwd);
+
+  info = terminal_process_tracker_lookup (entry->registry->tracker, screen);
+  if (info != NULL && info->name != NULL)
+    g_variant_builder_add (&builder, "{sv}", "foreground-process",
+                           g_variant_new_string (info->name));
+
+  entry->columns = vte_terminal_get_column_count (terminal);
+  entry->rows = vte_terminal_get_row_count (terminal);
+  g_variant_builder_add (&builder, "{sv}", "columns", g_variant_new_int64 (entry->columns));
+  g_variant_builder_add (&builder, "{sv}", "rows", g_variant_new_int64 (entry->rows));
+
+  profile_name = g_settings_get_string (terminal_screen_get_profile (screen),
+                                        TERMINAL_PROFILE_VISIBLE_NAME_KEY);
+  g_variant_builder_add (&builder, "{sv}", "profile", g_variant_new_string (profile_name));
+  g_free (profile_name);
+
+  pid = terminal_screen_get_child_pid (screen);
+  if (pid != -1) {
+    state = "running";
+    g_variant_builder_add (&builder, "{sv}", "child-pid", g_variant_new_int32 (pid));
+  } else if (entry->child_exited) {
+    state = "exited";
+  } else {
+    state = "none";
+  }
+  g_variant_builder_add (&builder, "{sv}", "child-state", g_variant_new_string (state));
+
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
+}
+
+static void
+terminal_registry_process_changed_cb (TerminalProcessTracker *tracker,
+                                      TerminalScreen *screen,
+                                      TerminalRegistry *registry)
+{
+  Entry *entry;
+
+  entry = g_hash_table_lookup (registry->screens, screen);
+  if (entry != NULL)
+    entry_process_changed (entry);
+}
+
+/**
+ * terminal_registry_new:
+ * @tracker: the #TerminalProcessTracker to get foreground processes from
+ * @events: the #TerminalEvents to post changes to
+ *
+ * Returns: (transfer full): a new #TerminalRegistry
+ */
+TerminalRegistry *
+terminal_registry_new (TerminalProcessTracker *tracker,
+                       TerminalEvents *events)
+{
+  TerminalRegistry *registry;
+
+  registry = g_slice_new0 (TerminalRegistry);
+  registry->tracker = g_object_ref (tracker);
+  registry->events = events;
+  registry->screens = g_hash_table_new (NULL, NULL);
+  g_queue_init (&registry->entries);
+
+  g_signal_connect (tracker, "process-changed",
+                    G_CALLBACK (terminal_registry_process_changed_cb), registry);
+
+  return registry;
+}
+
+/**
+ * terminal_registry_free:
+ * @registry: (allow-none): a #TerminalRegistry
+ */
+void
+terminal_registry_free (TerminalRegistry *registry)
+{
+  if (registry == NULL)
+    return;
+
+  g_signal_handlers_disconnect_by_func (registry->tracker,
+                                        G_CALLBACK (terminal_registry_process_changed_cb),
+                                        registry);
+  g_object_unref (registry->tracker);
+
+  g_queue_foreach (&registry->entries, (GFunc) entry_free, NULL);
+  g_queue_clear (&registry->entries);
+  g_hash_table_destroy (registry->screens);
+  if (registry->list != NULL)
+    g_variant_unref (registry->list);
+  g_slice_free (TerminalRegistry, registry);
+}
+
+/**
+ * terminal_registry_add:
+ * @registry: a #TerminalRegistry
+ * @screen: a #TerminalScreen
+ * @object_path: the object path @screen is exported on
+ *
+ * Adds @screen to @registry until terminal_registry_remove() is called.
+ */
+void
+terminal_registry_add (TerminalRegistry *registry,
+                       TerminalScreen *screen,
+                       const char *object_path)
+{
+  Entry *entry;
+
+  g_return_if_fail (g_hash_table_lookup (registry->screens, screen) == NULL);
+
+  entry = g_slice_new0 (Entry);
+  entry->registry = registry;
+  entry->screen = screen;
+  entry->object_path = g_strdup (object_path);
+
+  g_queue_push_tail (&registry->entries, entry);
+  entry->link = registry->entries.tail;
+  g_hash_table_insert (registry->screens, screen, entry);
+
+  entry_watch_profile (entry);
+  g_signal_connect (screen, "notify::title",
+                    G_CALLBACK (entry_title_changed_cb), entry);
+  g_signal_connect (screen, "notify::activity",
+                    G_CALLBACK (entry_activity_changed_cb), entry);
+  g_signal_connect (screen, "beep",
+                    G_CALLBACK (entry_beep_cb), entry);
+  g_signal_connect_swapped (screen, "notify::restart-count",
+                            G_CALLBACK (entry_invalidate), entry);
+  g_signal_connect (screen, "profile-set",
+                    G_CALLBACK (entry_profile_set_cb), entry);
+  g_signal_connect (screen, "child-exited",
+                    G_CALLBACK (entry_child_exited_cb), entry);
+  g_signal_connect_swapped (screen, "current-directory-uri-changed",
+                            G_CALLBACK (entry_process_changed), entry);
+  g_signal_connect_swapped (screen, "hierarchy-changed",
+                            G_CALLBACK (entry_invalidate), entry);
+  g_signal_connect (screen, "size-allocate",
+                    G_CALLBACK (entry_size_allocate_cb), entry);
+
+  if (registry->list != NULL) {
+    g_variant_unref (registry->list);
+    registry->list = NULL;
+  }
+}
+
+/**
+ * terminal_registry_remove:
+ * @registry: a #TerminalRegistry
+ * @screen: a #TerminalScreen
+ */
+void
+terminal_registry_remove (TerminalRegistry *registry,
+                          TerminalScreen *screen)
+{
+  Entry *entry;
+
+  entry = g_hash_table_lookup (registry->screens, screen);
+  if (entry == NULL)
+    return;
+
+  entry_invalidate (entry);
+  g_hash_table_remove (registry->screens, screen);
+  g_queue_delete_link (&registry->entries, entry->link);
+  entry_free (entry);
+}
+
+/**
+ * terminal_registry_list:
+ * @registry: a #TerminalRegistry
+ *
+ * Returns: (transfer full): an a{oa{sv}} with, for the object path of
+ *   every terminal, its "window-id" unless it's headless, "title",
+ *   "cwd" if known, "foreground-process" if known, "columns", "rows",
+ *   "profile" name, "child-state" ("none", "running" or "exited") and
+ *   "child-pid" while it's running
+ */
+GVariant *
+terminal_registry_list (TerminalRegistry *registry)
+{
+  GVariantBuilder builder;
+  GList *l;
+
+  if (registry->list != NULL)
+    return g_variant_ref (registry->list);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sv}}"));
+  for (l = registry->entries.head; l != NULL; l = l->next) {
+    Entry *entry = l->data;
+
+    if (entry->snapshot == NULL)
+      entry->snapshot = entry_build_snapshot (entry);
+
+    g_variant_builder_add (&builder, "{o@a{sv}}", entry->object_path, entry->snapshot);
+  }
+
+  registry->list = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  return g_variant_ref (registry->list);
+}
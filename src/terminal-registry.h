@@ -0,0 +1,45 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_REGISTRY_H
+#define TERMINAL_REGISTRY_H
+
+#include <glib.h>
+
+#include "terminal-events.h"
+#include "terminal-process-tracker.h"
+#include "terminal-screen.h"
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalRegistry TerminalRegistry;
+
+TerminalRegistry *terminal_registry_new (TerminalProcessTracker *tracker,
+                                         TerminalEvents *events);
+
+void terminal_registry_free (TerminalRegistry *registry);
+
+void terminal_registry_add (TerminalRegistry *registry,
+                            TerminalScreen *screen,
+                            const char *object_path);
+
+void terminal_registry_remove (TerminalRegistry *registry,
+                               TerminalScreen *screen);
+
+GVariant *terminal_registry_list (TerminalRegistry *registry);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_REGISTRY_H */
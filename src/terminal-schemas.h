@@ -34,6 +34,10 @@ G_BEGIN_DECLS
 #define TERMINAL_PROFILE_BOLD_COLOR_KEY                 "bold-color"
 #define TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY      "bold-color-same-as-fg"
 #define TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY          "cursor-blink-mode"
+#define TERMINAL_PROFILE_CGROUP_CPU_QUOTA_KEY           "cgroup-cpu-quota"
+#define TERMINAL_PROFILE_CGROUP_IO_WEIGHT_KEY           "cgroup-io-weight"
+#define TERMINAL_PROFILE_CGROUP_MEMORY_MAX_KEY          "cgroup-memory-max"
+#define TERMINAL_PROFILE_CPU_AFFINITY_KEY               "cpu-affinity"
 #define TERMINAL_PROFILE_CURSOR_SHAPE_KEY               "cursor-shape"
 #define TERMINAL_PROFILE_CUSTOM_COMMAND_KEY             "custom-command"
 #define TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY       "default-size-columns"
@@ -41,16 +45,33 @@ G_BEGIN_DECLS
 #define TERMINAL_PROFILE_DELETE_BINDING_KEY             "delete-binding"
 #define TERMINAL_PROFILE_ENCODING                       "encoding"
 #define TERMINAL_PROFILE_EXIT_ACTION_KEY                "exit-action"
+#define TERMINAL_PROFILE_FLOOD_DURATION_KEY             "flood-duration"
+#define TERMINAL_PROFILE_FLOOD_THRESHOLD_KEY            "flood-threshold"
 #define TERMINAL_PROFILE_FONT_KEY                       "font"
 #define TERMINAL_PROFILE_FOREGROUND_COLOR_KEY           "foreground-color"
+#define TERMINAL_PROFILE_IO_PRIORITY_CLASS_KEY          "io-priority-class"
 #define TERMINAL_PROFILE_LOGIN_SHELL_KEY                "login-shell"
+#define TERMINAL_PROFILE_MONITOR_ACTIVITY_KEY           "monitor-activity"
+#define TERMINAL_PROFILE_MONITOR_SILENCE_KEY            "monitor-silence"
 #define TERMINAL_PROFILE_NAME_KEY                       "name"
+#define TERMINAL_PROFILE_NICE_KEY                       "nice"
 #define TERMINAL_PROFILE_PALETTE_KEY                    "palette"
+#define TERMINAL_PROFILE_RECORD_DIRECTORY_KEY           "record-directory"
+#define TERMINAL_PROFILE_RECORD_MAX_SIZE_KEY            "record-max-size"
+#define TERMINAL_PROFILE_RECORD_OUTPUT_KEY              "record-output"
+#define TERMINAL_PROFILE_RECORD_TIMING_KEY              "record-timing"
+#define TERMINAL_PROFILE_RESOURCE_LIMITS_KEY            "resource-limits"
+#define TERMINAL_PROFILE_RESTART_DELAY_KEY              "restart-delay"
+#define TERMINAL_PROFILE_RESTART_DELAY_MAX_KEY          "restart-delay-max"
+#define TERMINAL_PROFILE_RESTART_LIMIT_KEY              "restart-limit"
+#define TERMINAL_PROFILE_RESTART_LIMIT_INTERVAL_KEY     "restart-limit-interval"
+#define TERMINAL_PROFILE_SCHEDULING_POLICY_KEY          "scheduling-policy"
 #define TERMINAL_PROFILE_SCROLLBACK_LINES_KEY           "scrollback-lines"
 #define TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY       "scrollback-unlimited"
 #define TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY           "scrollbar-policy"
 #define TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY        "scroll-on-keystroke"
 #define TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY           "scroll-on-output"
+#define TERMINAL_PROFILE_SILENCE_TIMEOUT_KEY            "silence-timeout"
 #define TERMINAL_PROFILE_TITLE_MODE_KEY                 "title-mode"
 #define TERMINAL_PROFILE_TITLE_KEY                      "title"
 #define TERMINAL_PROFILE_UPDATE_RECORDS_KEY             "update-records"
@@ -62,12 +83,21 @@ G_BEGIN_DECLS
 #define TERMINAL_PROFILE_VISIBLE_NAME_KEY               "visible-name"
 #define TERMINAL_PROFILE_WORD_CHARS_KEY                 "word-chars"
 
+#define TERMINAL_SETTING_CGROUP_ASSUME_DELEGATED_KEY    "cgroup-assume-delegated"
 #define TERMINAL_SETTING_CONFIRM_CLOSE_KEY              "confirm-close"
+#define TERMINAL_SETTING_CRASH_RECOVERY_KEY             "crash-recovery"
 #define TERMINAL_SETTING_DEFAULT_PROFILE_KEY            "default-profile"
 #define TERMINAL_SETTING_DEFAULT_SHOW_MENUBAR_KEY       "default-show-menubar"
 #define TERMINAL_SETTING_ENABLE_MENU_BAR_ACCEL_KEY      "menu-accelerator-enabled"
 #define TERMINAL_SETTING_ENABLE_MNEMONICS_KEY           "mnemonics-enabled"
 #define TERMINAL_SETTING_ENCODINGS_KEY                  "encodings"
+#define TERMINAL_SETTING_HIBERNATE_TIMEOUT_KEY          "hibernate-timeout"
+#define TERMINAL_SETTING_SCROLLBACK_BUDGET_KEY          "scrollback-budget"
+#define TERMINAL_SETTING_SHARD_COUNT_KEY                "shard-count"
+#define TERMINAL_SETTING_SHARD_POLICY_KEY               "shard-policy"
+#define TERMINAL_SETTING_STALL_THRESHOLD_KEY            "stall-threshold"
+#define TERMINAL_SETTING_LATENCY_MONITOR_KEY            "latency-monitor"
+#define TERMINAL_SETTING_FRAME_TIMINGS_KEY              "frame-timings"
 
 #define TERMINAL_PROFILES_PATH_PREFIX   "/org/gnome/terminal/profiles:/"
 #define TERMINAL_DEFAULT_PROFILE_ID     ":profile0"
@@ -26,11 +26,19 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <termios.h>
 
 #include <glib.h>
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
+#include <gio/gunixinputstream.h>
+#include <gio/gunixoutputstream.h>
+#include <glib/gstdio.h>
 
 #include <gtk/gtk.h>
 
@@ -42,11 +50,20 @@
 #include "terminal-app.h"
 #include "terminal-debug.h"
 #include "terminal-enums.h"
+#include "terminal-feeder.h"
+#include "terminal-flood-governor.h"
+#include "terminal-handover.h"
 #include "terminal-intl.h"
+#include "terminal-latency.h"
 #include "terminal-marshal.h"
+#include "terminal-process-tracker.h"
+#include "terminal-recorder.h"
 #include "terminal-schemas.h"
 #include "terminal-screen-container.h"
+#include "terminal-trace.h"
+#include "terminal-type-builtins.h"
 #include "terminal-util.h"
+#include "terminal-viewer.h"
 #include "terminal-window.h"
 #include "terminal-info-bar.h"
 
@@ -54,12 +71,49 @@
 
 #define URL_MATCH_CURSOR  (GDK_HAND2)
 
+#define DEFERRED_TITLE_DELAY (1000) /* ms */
+
+static const struct {
+  const char *name;
+  int resource;
+} rlimit_names[] = {
+  { "as",      RLIMIT_AS      },
+  { "core",    RLIMIT_CORE    },
+  { "cpu",     RLIMIT_CPU     },
+  { "data",    RLIMIT_DATA    },
+  { "fsize",   RLIMIT_FSIZE   },
+  { "memlock", RLIMIT_MEMLOCK },
+  { "nofile",  RLIMIT_NOFILE  },
+  { "nproc",   RLIMIT_NPROC   },
+  { "stack",   RLIMIT_STACK   }
+};
+
+/* From linux/ioprio.h */
+#define IOPRIO_CLASS_SHIFT (13)
+#define IOPRIO_CLASS_BE    (2)
+#define IOPRIO_CLASS_IDLE  (3)
+#define IOPRIO_WHO_PROCESS (1)
+
 typedef struct {
   int *fd_list;
   int fd_list_len;
   const int *fd_array;
   gsize fd_array_len;
-} FDSetupData;
+
+  VtePty *pty; /* when not spawned by VTE, unowned */
+
+  /* Resolved in the parent, applied in the child */
+  int cgroup_procs_fd; /* -1 to stay in the server's cgroup */
+  int nice;
+  int sched_policy; /* -1 to leave unchanged */
+  int ioprio;       /* -1 to leave unchanged */
+  gboolean set_affinity;
+  cpu_set_t affinity;
+  struct {
+    gboolean set;
+    rlim_t value;
+  } rlimits[G_N_ELEMENTS (rlimit_names)];
+} ChildSetupData;
 
 typedef struct
 {
@@ -67,6 +121,17 @@ typedef struct
   TerminalURLFlavour flavor;
 } TagData;
 
+/* Counts events, and their rate over the last complete window */
+typedef struct
+{
+  guint64 total;
+  guint64 window_total; /* total at window_start */
+  gint64 window_start;
+  double rate; /* per second */
+} RateCounter;
+
+#define RATE_WINDOW (10 * G_USEC_PER_SEC)
+
 struct _TerminalScreenPrivate
 {
   GSettings *profile; /* never NULL */
@@ -85,6 +150,66 @@ struct _TerminalScreenPrivate
   gboolean user_title; /* title was manually set */
   GSList *match_tags;
   guint launch_child_source_id;
+
+  TerminalActivity activity;
+  gboolean monitor_activity;
+  guint silence_timeout; /* s, 0 when not monitoring silence */
+  guint silence_timer_id;
+  guint64 last_output_tick;
+
+  gboolean window_minimized;
+  gboolean low_power; /* unmapped, or in a minimized window */
+  gboolean title_notify_pending;
+  gboolean icon_title_notify_pending;
+  guint title_flush_timer_id;
+  gint64 last_shown; /* when it last entered or left low-power mode */
+
+  glong scrollback_lines; /* from the profile, -1 for unlimited */
+  glong scrollback_limit; /* from the app's scrollback budget, -1 for none */
+  glong scrollback_applied;
+
+  guint hibernate_timer_id;
+  VtePty *hibernated_pty; /* only while hibernated */
+  guint hibernated_watch_id;
+  GByteArray *hibernated_input;
+  GBytes *snapshot_contents; /* until the snapshot is written */
+  char *snapshot_path;
+  gpointer snapshot_job;
+
+  gint64 child_start_time;
+  guint restart_count;
+  guint restart_backoff; /* quick exits in a row */
+  GArray *restart_times; /* gint64 monotonic times of recent restarts */
+  guint restart_timer_id;
+  gint64 restart_deadline; /* monotonic */
+  GtkWidget *restart_info_bar;
+  GtkWidget *restart_label; /* in restart_info_bar */
+
+  GVariant *resource_overrides; /* a{sv} from Exec, or NULL */
+
+  TerminalCgroup *cgroup;
+
+  TerminalFloodGovernor *flood_governor;
+
+  VtePty *child_pty; /* only while recording */
+  VtePty *recorded_pty; /* VTE's end, only while recording */
+  TerminalRecorder *recorder;
+  gboolean draining_recorder; /* exit action waits for the child's last output */
+
+  TerminalViewer *viewer; /* instead of a child */
+
+  guint handover_key; /* of the deposit with the fd holder, or 0 */
+  gboolean adopted; /* the child was started by another server */
+
+  TerminalTrace *trace; /* until the first frame is drawn */
+
+  TerminalLatency *latency; /* once measured */
+
+  TerminalFeeder *feeder; /* while input is being fed */
+
+  RateCounter contents_changes;
+  RateCounter title_changes;
+  gint64 spawn_latency; /* µs, of the last child */
 };
 
 enum
@@ -93,6 +218,7 @@ enum
   SHOW_POPUP_MENU,
   MATCH_CLICKED,
   CLOSE_SCREEN,
+  TRACE_FINISHED,
   LAST_SIGNAL
 };
 
@@ -103,7 +229,10 @@ enum {
   PROP_ICON_TITLE_SET,
   PROP_OVERRIDE_COMMAND,
   PROP_TITLE,
-  PROP_INITIAL_ENVIRONMENT
+  PROP_INITIAL_ENVIRONMENT,
+  PROP_ACTIVITY,
+  PROP_RESTART_COUNT,
+  PROP_THROTTLED
 };
 
 enum
@@ -133,9 +262,19 @@ static gboolean terminal_screen_popup_menu (GtkWidget *widget);
 static gboolean terminal_screen_button_press (GtkWidget *widget,
                                               GdkEventButton *event);
 static gboolean terminal_screen_do_exec (TerminalScreen *screen,
-                                         FDSetupData    *data,
+                                         ChildSetupData *data,
                                          GError **error);
 static void terminal_screen_child_exited  (VteTerminal *terminal);
+static void terminal_screen_eof (VteTerminal *terminal);
+static void terminal_screen_sync_child_size (TerminalScreen *screen);
+static void terminal_screen_stop_recording (TerminalScreen *screen);
+static void terminal_screen_contents_changed (VteTerminal *terminal);
+static void terminal_screen_stop_restart (TerminalScreen *screen);
+static gboolean terminal_screen_draw (GtkWidget *widget,
+                                      cairo_t *cr);
+static gboolean terminal_screen_key_press (GtkWidget *widget,
+                                           GdkEventKey *event);
+static void terminal_screen_finish_trace (TerminalScreen *screen);
 
 static void terminal_screen_window_title_changed      (VteTerminal *vte_terminal,
                                                        TerminalScreen *screen);
@@ -242,1971 +381,4685 @@ terminal_screen_realize (GtkWidget *widget)
 }
 
 static void
-terminal_screen_style_updated (GtkWidget *widget)
+terminal_screen_update_cursor_blink (TerminalScreen *screen)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (widget);
-
-  GTK_WIDGET_CLASS (terminal_screen_parent_class)->style_updated (widget);
-
-  update_color_scheme (screen);
+  TerminalScreenPrivate *priv = screen->priv;
 
-  if (gtk_widget_get_realized (widget))
-    terminal_screen_change_font (screen);
+  /* A blinking cursor nobody can see is just wakeups */
+  vte_terminal_set_cursor_blink_mode (VTE_TERMINAL (screen),
+                                      priv->low_power ? VTE_CURSOR_BLINK_OFF
+                                                      : g_settings_get_enum (priv->profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY));
 }
 
-#ifdef GNOME_ENABLE_DEBUG
 static void
-size_request (GtkWidget *widget,
-              GtkRequisition *req)
+terminal_screen_flush_title_notify (TerminalScreen *screen)
 {
-  _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
-                         "[screen %p] size-request %d : %d\n",
-                         widget, req->width, req->height);
+  TerminalScreenPrivate *priv = screen->priv;
+  GObject *object = G_OBJECT (screen);
+
+  g_object_freeze_notify (object);
+
+  if (priv->title_notify_pending)
+    {
+      priv->title_notify_pending = FALSE;
+      g_object_notify (object, "title");
+    }
+  if (priv->icon_title_notify_pending)
+    {
+      priv->icon_title_notify_pending = FALSE;
+      g_object_notify (object, "icon-title");
+    }
+
+  g_object_thaw_notify (object);
 }
 
 static void
-size_allocate (GtkWidget *widget,
-               GtkAllocation *allocation)
+terminal_screen_title_flush_timeout_cb (TerminalScreen *screen)
 {
-  _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
-                         "[screen %p] size-alloc   %d : %d at (%d, %d)\n",
-                         widget, allocation->width, allocation->height, allocation->x, allocation->y);
+  screen->priv->title_flush_timer_id = 0;
+  terminal_screen_flush_title_notify (screen);
 }
-#endif
 
 static void
-terminal_screen_init (TerminalScreen *screen)
+terminal_screen_stop_title_flush_timer (TerminalScreen *screen)
 {
-  const GtkTargetEntry target_table[] = {
-    { (char *) "GTK_NOTEBOOK_TAB", GTK_TARGET_SAME_APP, TARGET_TAB },
-    { (char *) "application/x-color", 0, TARGET_COLOR },
-    { (char *) "x-special/gnome-reset-background", 0, TARGET_RESET_BG },
-    { (char *) "text/x-moz-url",  0, TARGET_MOZ_URL },
-    { (char *) "_NETSCAPE_URL", 0, TARGET_NETSCAPE_URL }
-  };
-  VteTerminal *terminal = VTE_TERMINAL (screen);
-  TerminalScreenPrivate *priv;
-  TerminalApp *app;
-  GtkTargetList *target_list;
-  GtkTargetEntry *targets;
-  int n_targets;
-  guint i;
-
-  priv = screen->priv = G_TYPE_INSTANCE_GET_PRIVATE (screen, TERMINAL_TYPE_SCREEN, TerminalScreenPrivate);
+  TerminalScreenPrivate *priv = screen->priv;
 
-  vte_terminal_set_mouse_autohide (terminal, TRUE);
-  vte_terminal_set_background_image (terminal, NULL);
-  vte_terminal_set_scroll_background (terminal, FALSE);
-  vte_terminal_set_background_transparent (terminal, FALSE);
+  if (priv->title_flush_timer_id == 0)
+    return;
 
-  priv->child_pid = -1;
-  priv->pty_fd = -1;
+  terminal_timer_wheel_remove (terminal_app_get_timer_wheel (terminal_app_get ()),
+                               priv->title_flush_timer_id);
+  priv->title_flush_timer_id = 0;
+}
 
-  priv->font_scale = PANGO_SCALE_MEDIUM;
+/* In low-power mode, title changes are only collected. In a minimized
+ * window nothing shows them, so they wait until the screen is shown;
+ * a background tab's label is still visible, so they're coalesced
+ * into at most one notification per DEFERRED_TITLE_DELAY instead.
+ */
+static void
+terminal_screen_notify_title (TerminalScreen *screen,
+                              gboolean icon_title)
+{
+  TerminalScreenPrivate *priv = screen->priv;
 
-  for (i = 0; i < n_url_regexes; ++i)
+  if (!priv->low_power)
     {
-      TagData *tag_data;
+      g_object_notify (G_OBJECT (screen), icon_title ? "icon-title" : "title");
+      return;
+    }
 
-      tag_data = g_slice_new (TagData);
-      tag_data->flavor = url_regex_flavors[i];
-      tag_data->tag = vte_terminal_match_add_gregex (terminal, url_regexes[i], 0);
-      vte_terminal_match_set_cursor_type (terminal, tag_data->tag, URL_MATCH_CURSOR);
+  if (icon_title)
+    priv->icon_title_notify_pending = TRUE;
+  else
+    priv->title_notify_pending = TRUE;
 
-      priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
-    }
+  if (!priv->window_minimized && priv->title_flush_timer_id == 0)
+    priv->title_flush_timer_id = terminal_timer_wheel_add (terminal_app_get_timer_wheel (terminal_app_get ()),
+                                                           DEFERRED_TITLE_DELAY,
+                                                           (TerminalTimerFunc) terminal_screen_title_flush_timeout_cb,
+                                                           screen);
+}
 
-  /* Setup DND */
-  target_list = gtk_target_list_new (NULL, 0);
-  gtk_target_list_add_uri_targets (target_list, 0);
-  gtk_target_list_add_text_targets (target_list, 0);
-  gtk_target_list_add_table (target_list, target_table, G_N_ELEMENTS (target_table));
+/* Hibernation
+ *
+ * A terminal that has been hidden, without output, for hibernate-timeout
+ * seconds writes its contents to a compressed snapshot in the cache
+ * directory and clears itself, which frees the scrollback. The PTY is
+ * detached from the terminal but kept open, so the child keeps running;
+ * it only blocks once the PTY buffer is full. Showing the terminal, input,
+ * or output from the child, feeds the snapshot back and reattaches the PTY.
+ *
+ * Only the contents are copied out on the main thread; compressing and
+ * writing the snapshot, and reading it back, happen in a worker thread.
+ * Until the snapshot is written, the contents stay in memory.
+ */
 
-  targets = gtk_target_table_new_from_list (target_list, &n_targets);
+typedef struct {
+  TerminalScreen *screen; /* unowned, NULL once the screen lost interest */
+  char *path;
+  GBytes *contents; /* to write */
+  char *text; /* as read */
+  gboolean writing;
+  gboolean ok;
+} SnapshotJob;
+
+static void terminal_screen_finish_thaw (TerminalScreen *screen,
+                                         char *text);
+
+static char *
+terminal_screen_new_snapshot_path (void)
+{
+  static guint serial = 0;
+  char *name, *path;
 
-  gtk_drag_dest_set (GTK_WIDGET (screen),
-                     GTK_DEST_DEFAULT_MOTION |
-                     GTK_DEST_DEFAULT_HIGHLIGHT |
-                     GTK_DEST_DEFAULT_DROP,
-                     targets, n_targets,
-                     GDK_ACTION_COPY | GDK_ACTION_MOVE);
+  name = g_strdup_printf ("%d-%u.txt.gz", (int) getpid (), ++serial);
+  path = g_build_filename (g_get_user_cache_dir (), "gnome-terminal", "snapshots", name, NULL);
+  g_free (name);
 
-  gtk_target_table_free (targets, n_targets);
-  gtk_target_list_unref (target_list);
+  return path;
+}
 
-  priv->override_title = NULL;
-  priv->user_title = FALSE;
-  
-  g_signal_connect (screen, "window-title-changed",
-                    G_CALLBACK (terminal_screen_window_title_changed),
-                    screen);
-  g_signal_connect (screen, "icon-title-changed",
-                    G_CALLBACK (terminal_screen_icon_title_changed),
-                    screen);
+/* Snapshots of a server that went away without cleaning up */
+static void
+snapshot_remove_stale (const char *dir)
+{
+  GDir *gdir;
+  const char *name;
+  char *end, *path;
+  long pid;
 
-  app = terminal_app_get ();
-  g_signal_connect (terminal_app_get_desktop_interface_settings (app), "changed::" MONOSPACE_FONT_KEY_NAME,
-                    G_CALLBACK (terminal_screen_system_font_changed_cb), screen);
+  gdir = g_dir_open (dir, 0, NULL);
+  if (gdir == NULL)
+    return;
 
-#ifdef GNOME_ENABLE_DEBUG
-  _TERMINAL_DEBUG_IF (TERMINAL_DEBUG_GEOMETRY)
+  while ((name = g_dir_read_name (gdir)) != NULL)
     {
-      g_signal_connect_after (screen, "size-request", G_CALLBACK (size_request), NULL);
-      g_signal_connect_after (screen, "size-allocate", G_CALLBACK (size_allocate), NULL);
+      pid = strtol (name, &end, 10);
+      if (end == name || *end != '-' || pid <= 0 || pid == (long) getpid ())
+        continue;
+      if (kill ((pid_t) pid, 0) == 0 || errno != ESRCH)
+        continue;
+
+      path = g_build_filename (dir, name, NULL);
+      g_unlink (path);
+      g_free (path);
     }
-#endif
+
+  g_dir_close (gdir);
 }
 
 static void
-terminal_screen_get_property (GObject *object,
-                              guint prop_id,
-                              GValue *value,
-                              GParamSpec *pspec)
+snapshot_job_free (SnapshotJob *job)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (object);
+  g_free (job->path);
+  if (job->contents != NULL)
+    g_bytes_unref (job->contents);
+  g_free (job->text);
+  g_slice_free (SnapshotJob, job);
+}
 
-  switch (prop_id)
+static void
+terminal_screen_snapshot_written (TerminalScreen *screen,
+                                  SnapshotJob *job)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (!job->ok)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] hibernated to %s\n",
+                         screen, job->path);
+
+  priv->snapshot_path = job->path;
+  job->path = NULL;
+  g_bytes_unref (priv->snapshot_contents);
+  priv->snapshot_contents = NULL;
+}
+
+static gboolean
+snapshot_job_done_cb (SnapshotJob *job)
+{
+  TerminalScreen *screen = job->screen;
+
+  if (screen != NULL)
     {
-      case PROP_PROFILE:
-        g_value_set_object (value, terminal_screen_get_profile (screen));
-        break;
-      case PROP_ICON_TITLE:
-        g_value_set_string (value, terminal_screen_get_icon_title (screen));
-        break;
-      case PROP_ICON_TITLE_SET:
-        g_value_set_boolean (value, terminal_screen_get_icon_title_set (screen));
-        break;
-      case PROP_OVERRIDE_COMMAND:
-        g_value_set_boxed (value, terminal_screen_get_override_command (screen));
-        break;
-      case PROP_INITIAL_ENVIRONMENT:
-        g_value_set_boxed (value, terminal_screen_get_initial_environment (screen));
-        break;
-      case PROP_TITLE:
-        g_value_set_string (value, terminal_screen_get_title (screen));
-        break;
-      default:
-        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-        break;
+      screen->priv->snapshot_job = NULL;
+
+      if (job->writing)
+        terminal_screen_snapshot_written (screen, job);
+      else
+        {
+          g_free (screen->priv->snapshot_path);
+          screen->priv->snapshot_path = NULL;
+          terminal_screen_finish_thaw (screen, job->text);
+        }
     }
+
+  /* Unless the screen took it, nobody needs the file anymore */
+  if (job->path != NULL)
+    g_unlink (job->path);
+
+  snapshot_job_free (job);
+  return FALSE;
 }
 
-static void
-terminal_screen_set_property (GObject *object,
-                              guint prop_id,
-                              const GValue *value,
-                              GParamSpec *pspec)
+static gboolean
+terminal_screen_write_snapshot_stream (TerminalScreen *screen,
+                                       GOutputStream *file_stream,
+                                       GError **error)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (object);
+  GOutputStream *stream;
+  GConverter *compressor;
+  gboolean ok;
 
-  switch (prop_id)
+  compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+  stream = g_converter_output_stream_new (file_stream, compressor);
+
+  ok = vte_terminal_write_contents (VTE_TERMINAL (screen), stream,
+                                    VTE_TERMINAL_WRITE_DEFAULT,
+                                    NULL, error) &&
+       g_output_stream_close (stream, NULL, error);
+
+  g_object_unref (stream);
+  g_object_unref (compressor);
+
+  return ok;
+}
+
+static gpointer
+snapshot_write_thread (SnapshotJob *job)
+{
+  static gsize stale_removed = 0;
+  GFile *file;
+  GFileOutputStream *file_stream;
+  GOutputStream *stream;
+  GConverter *compressor;
+  GError *error = NULL;
+  char *dir;
+
+  dir = g_path_get_dirname (job->path);
+  if (g_mkdir_with_parents (dir, 0700) != 0)
     {
-      case PROP_PROFILE:
-        terminal_screen_set_profile (screen, g_value_get_object (value));
-        break;
-      case PROP_OVERRIDE_COMMAND:
-        terminal_screen_set_override_command (screen, g_value_get_boxed (value));
-        break;
-      case PROP_INITIAL_ENVIRONMENT:
-        terminal_screen_set_initial_environment (screen, g_value_get_boxed (value));
-        break;
-      case PROP_ICON_TITLE:
-      case PROP_ICON_TITLE_SET:
-      case PROP_TITLE:
-        /* not writable */
-      default:
-        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-        break;
+      g_free (dir);
+      g_idle_add ((GSourceFunc) snapshot_job_done_cb, job);
+      return NULL;
+    }
+
+  if (g_once_init_enter (&stale_removed))
+    {
+      snapshot_remove_stale (dir);
+      g_once_init_leave (&stale_removed, 1);
+    }
+  g_free (dir);
+
+  file = g_file_new_for_path (job->path);
+  file_stream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_PRIVATE, NULL, &error);
+  if (file_stream != NULL)
+    {
+      compressor = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+      stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream), compressor);
+
+      job->ok = g_output_stream_write_all (stream,
+                                           g_bytes_get_data (job->contents, NULL),
+                                           g_bytes_get_size (job->contents),
+                                           NULL, NULL, &error) &&
+                g_output_stream_close (stream, NULL, &error);
+
+      g_object_unref (stream);
+      g_object_unref (compressor);
+      g_object_unref (file_stream);
+    }
+
+  if (!job->ok)
+    {
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "failed to write snapshot %s: %s\n",
+                             job->path, error->message);
+      g_error_free (error);
+      g_file_delete (file, NULL, NULL);
     }
+
+  g_object_unref (file);
+
+  g_idle_add ((GSourceFunc) snapshot_job_done_cb, job);
+  return NULL;
 }
 
-static void
-terminal_screen_class_init (TerminalScreenClass *klass)
+static char *
+terminal_screen_read_snapshot_stream (GInputStream *file_stream)
 {
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
-  VteTerminalClass *terminal_class = VTE_TERMINAL_CLASS (klass);
-  GSettings *settings;
-  guint i;
+  GInputStream *stream;
+  GConverter *decompressor;
+  GString *text;
+  char buffer[8192];
+  gssize len;
 
-  object_class->dispose = terminal_screen_dispose;
-  object_class->finalize = terminal_screen_finalize;
-  object_class->get_property = terminal_screen_get_property;
-  object_class->set_property = terminal_screen_set_property;
+  decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+  stream = g_converter_input_stream_new (file_stream, decompressor);
 
-  widget_class->realize = terminal_screen_realize;
-  widget_class->style_updated = terminal_screen_style_updated;
-  widget_class->drag_data_received = terminal_screen_drag_data_received;
-  widget_class->button_press_event = terminal_screen_button_press;
-  widget_class->popup_menu = terminal_screen_popup_menu;
+  text = g_string_new (NULL);
+  while ((len = g_input_stream_read (stream, buffer, sizeof (buffer), NULL, NULL)) > 0)
+    g_string_append_len (text, buffer, len);
 
-  terminal_class->child_exited = terminal_screen_child_exited;
+  g_object_unref (stream);
+  g_object_unref (decompressor);
 
-  signals[PROFILE_SET] =
-    g_signal_new (I_("profile-set"),
-                  G_OBJECT_CLASS_TYPE (object_class),
-                  G_SIGNAL_RUN_LAST,
-                  G_STRUCT_OFFSET (TerminalScreenClass, profile_set),
-                  NULL, NULL,
-                  g_cclosure_marshal_VOID__OBJECT,
-                  G_TYPE_NONE,
-                  1, G_TYPE_SETTINGS);
-  
-  signals[SHOW_POPUP_MENU] =
-    g_signal_new (I_("show-popup-menu"),
-                  G_OBJECT_CLASS_TYPE (object_class),
-                  G_SIGNAL_RUN_LAST,
-                  G_STRUCT_OFFSET (TerminalScreenClass, show_popup_menu),
-                  NULL, NULL,
-                  g_cclosure_marshal_VOID__POINTER,
-                  G_TYPE_NONE,
-                  1,
-                  G_TYPE_POINTER);
-
-  signals[MATCH_CLICKED] =
-    g_signal_new (I_("match-clicked"),
-                  G_OBJECT_CLASS_TYPE (object_class),
-                  G_SIGNAL_RUN_LAST,
-                  G_STRUCT_OFFSET (TerminalScreenClass, match_clicked),
-                  g_signal_accumulator_true_handled, NULL,
-                  _terminal_marshal_BOOLEAN__STRING_INT_UINT,
-                  G_TYPE_BOOLEAN,
-                  3, G_TYPE_STRING, G_TYPE_INT, G_TYPE_UINT);
-  
-  signals[CLOSE_SCREEN] =
-    g_signal_new (I_("close-screen"),
-                  G_OBJECT_CLASS_TYPE (object_class),
-                  G_SIGNAL_RUN_LAST,
-                  G_STRUCT_OFFSET (TerminalScreenClass, close_screen),
-                  NULL, NULL,
-                  g_cclosure_marshal_VOID__VOID,
-                  G_TYPE_NONE,
-                  0);
-
-  g_object_class_install_property
-    (object_class,
-     PROP_PROFILE,
-     g_param_spec_object ("profile", NULL, NULL,
-                          G_TYPE_SETTINGS,
-                          G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
-
-  g_object_class_install_property
-    (object_class,
-     PROP_ICON_TITLE,
-     g_param_spec_string ("icon-title", NULL, NULL,
-                          NULL,
-                          G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
-
-  g_object_class_install_property
-    (object_class,
-     PROP_ICON_TITLE_SET,
-     g_param_spec_boolean ("icon-title-set", NULL, NULL,
-                           FALSE,
-                           G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
-
-  g_object_class_install_property
-    (object_class,
-     PROP_OVERRIDE_COMMAND,
-     g_param_spec_boxed ("override-command", NULL, NULL,
-                         G_TYPE_STRV,
-                         G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
-
-  g_object_class_install_property
-    (object_class,
-     PROP_TITLE,
-     g_param_spec_string ("title", NULL, NULL,
-                          NULL,
-                          G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
-
-  g_object_class_install_property
-    (object_class,
-     PROP_INITIAL_ENVIRONMENT,
-     g_param_spec_boxed ("initial-environment", NULL, NULL,
-                         G_TYPE_STRV,
-                         G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+  return g_string_free (text, FALSE);
+}
 
-  g_type_class_add_private (object_class, sizeof (TerminalScreenPrivate));
+static char *
+terminal_screen_read_snapshot (const char *path)
+{
+  GFile *file;
+  GInputStream *file_stream;
+  char *text;
+
+  file = g_file_new_for_path (path);
+  file_stream = G_INPUT_STREAM (g_file_read (file, NULL, NULL));
+  g_object_unref (file);
+  if (file_stream == NULL)
+    return NULL;
 
-  /* Precompile the regexes */
-  n_url_regexes = G_N_ELEMENTS (url_regex_patterns);
-  url_regexes = g_new0 (GRegex*, n_url_regexes);
-  url_regex_flavors = g_new0 (TerminalURLFlavour, n_url_regexes);
+  text = terminal_screen_read_snapshot_stream (file_stream);
+  g_object_unref (file_stream);
 
-  for (i = 0; i < n_url_regexes; ++i)
-    {
-      GError *error = NULL;
+  return text;
+}
 
-      url_regexes[i] = g_regex_new (url_regex_patterns[i].pattern,
-                                    url_regex_patterns[i].flags | G_REGEX_OPTIMIZE,
-                                    0, &error);
-      if (error)
-        {
-          g_message ("%s", error->message);
-          g_error_free (error);
-        }
+static gpointer
+snapshot_read_thread (SnapshotJob *job)
+{
+  job->text = terminal_screen_read_snapshot (job->path);
+  job->ok = job->text != NULL;
 
-      url_regex_flavors[i] = url_regex_patterns[i].flavor;
-    }
+  g_idle_add ((GSourceFunc) snapshot_job_done_cb, job);
+  return NULL;
+}
 
-  /* This fixes bug #329827 */
-  settings = terminal_app_get_global_settings (terminal_app_get ());
-  terminal_screen_class_enable_menu_bar_accel_notify_cb (settings, TERMINAL_SETTING_ENABLE_MENU_BAR_ACCEL_KEY, klass);
-  g_signal_connect (settings, "changed::" TERMINAL_SETTING_ENABLE_MENU_BAR_ACCEL_KEY,
-                    G_CALLBACK (terminal_screen_class_enable_menu_bar_accel_notify_cb), klass);
+static void
+terminal_screen_start_snapshot_job (TerminalScreen *screen,
+                                    char *path,
+                                    GBytes *contents)
+{
+  SnapshotJob *job;
+
+  job = g_slice_new0 (SnapshotJob);
+  job->screen = screen;
+  job->path = path;
+  job->contents = contents != NULL ? g_bytes_ref (contents) : NULL;
+  job->writing = contents != NULL;
+  screen->priv->snapshot_job = job;
+
+  g_thread_unref (g_thread_new (job->writing ? "snapshot-writer" : "snapshot-reader",
+                                job->writing ? (GThreadFunc) snapshot_write_thread
+                                             : (GThreadFunc) snapshot_read_thread,
+                                job));
 }
 
 static void
-terminal_screen_dispose (GObject *object)
+terminal_screen_forget_snapshot_job (TerminalScreen *screen)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (object);
   TerminalScreenPrivate *priv = screen->priv;
-  GtkSettings *settings;
-
-  settings = gtk_widget_get_settings (GTK_WIDGET (screen));
-  g_signal_handlers_disconnect_matched (settings, G_SIGNAL_MATCH_DATA,
-                                        0, 0, NULL, NULL,
-                                        screen);
 
-  if (priv->launch_child_source_id != 0)
-    {
-      g_source_remove (priv->launch_child_source_id);
-      priv->launch_child_source_id = 0;
-    }
+  if (priv->snapshot_job == NULL)
+    return;
 
-  G_OBJECT_CLASS (terminal_screen_parent_class)->dispose (object);
+  ((SnapshotJob *) priv->snapshot_job)->screen = NULL;
+  priv->snapshot_job = NULL;
 }
 
 static void
-terminal_screen_finalize (GObject *object)
+terminal_screen_stop_hibernated_watch (TerminalScreen *screen)
 {
-  TerminalScreen *screen = TERMINAL_SCREEN (object);
   TerminalScreenPrivate *priv = screen->priv;
 
-  g_signal_handlers_disconnect_by_func (terminal_app_get_desktop_interface_settings (terminal_app_get ()),
-                                        G_CALLBACK (terminal_screen_system_font_changed_cb),
-                                        screen);
+  if (priv->hibernated_watch_id == 0)
+    return;
 
-  terminal_screen_set_profile (screen, NULL);
+  g_source_remove (priv->hibernated_watch_id);
+  priv->hibernated_watch_id = 0;
+}
 
-  g_free (priv->raw_title);
-  g_free (priv->cooked_title);
-  g_free (priv->override_title);
-  g_free (priv->raw_icon_title);
-  g_free (priv->cooked_icon_title);
-  g_free (priv->initial_working_directory);
-  g_strfreev (priv->override_command);
-  g_strfreev (priv->initial_env);
+static void terminal_screen_thaw_async (TerminalScreen *screen);
 
-  g_slist_foreach (priv->match_tags, (GFunc) free_tag_data, NULL);
-  g_slist_free (priv->match_tags);
+static gboolean
+terminal_screen_hibernated_pty_cb (GIOChannel *channel,
+                                   GIOCondition condition,
+                                   TerminalScreen *screen)
+{
+  screen->priv->hibernated_watch_id = 0;
 
-  G_OBJECT_CLASS (terminal_screen_parent_class)->finalize (object);
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] output while hibernated\n",
+                         screen);
+
+  terminal_screen_thaw_async (screen);
+
+  return FALSE;
 }
 
-TerminalScreen *
-terminal_screen_new (GSettings       *profile,
-                     char           **override_command,
-                     const char      *title,
-                     const char      *working_dir,
-                     char           **child_env,
-                     double           zoom)
+static gboolean
+terminal_screen_hibernate (TerminalScreen *screen)
 {
-  TerminalScreen *screen;
-  TerminalScreenPrivate *priv;
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  VtePty *pty;
+  GOutputStream *stream;
+  GIOChannel *channel;
+  GError *error = NULL;
+  gsize size;
+  gboolean ok;
+
+  if (priv->hibernated_pty != NULL || priv->child_pid == -1)
+    return FALSE;
 
-  g_return_val_if_fail (G_IS_SETTINGS (profile), NULL);
+  pty = vte_terminal_get_pty_object (terminal);
+  if (pty == NULL)
+    return FALSE;
 
-  screen = g_object_new (TERMINAL_TYPE_SCREEN, NULL);
-  priv = screen->priv;
+  /* A plain text snapshot can't bring back the alternate screen or the
+   * terminal modes that full-screen programs like vim, less or tmux
+   * use, and VTE doesn't tell whether they are in effect. They only are
+   * while such a program runs in the foreground, so only hibernate
+   * while the shell itself does.
+   */
+  if (tcgetpgrp (vte_pty_get_fd (pty)) != priv->child_pid)
+    return FALSE;
 
-  terminal_screen_set_profile (screen, profile);
+  /* Take the PTY back in case output was throttled */
+  terminal_flood_governor_reset (priv->flood_governor);
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_DEFAULT_SIZE_KEY)) {
-    vte_terminal_set_size (VTE_TERMINAL (screen),
-			   g_settings_get_int (profile, TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY),
-			   g_settings_get_int (profile, TERMINAL_PROFILE_DEFAULT_SIZE_ROWS_KEY));
-  }
+  stream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  ok = vte_terminal_write_contents (terminal, stream,
+                                    VTE_TERMINAL_WRITE_DEFAULT,
+                                    NULL, &error) &&
+       g_output_stream_write_all (stream, "", 1, NULL, NULL, &error) &&
+       g_output_stream_close (stream, NULL, &error);
+  if (!ok)
+    {
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "[screen %p] failed to copy the contents: %s\n",
+                             screen, error->message);
+      g_error_free (error);
+      g_object_unref (stream);
+      return FALSE;
+    }
 
-  if (title)
-    terminal_screen_set_override_title (screen, title);
+  size = g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (stream));
+  priv->snapshot_contents = g_bytes_new_take (g_memory_output_stream_steal_data (G_MEMORY_OUTPUT_STREAM (stream)),
+                                              size);
+  g_object_unref (stream);
 
-  priv->initial_working_directory = g_strdup (working_dir);
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] hibernating\n",
+                         screen);
 
-  if (override_command)
-    terminal_screen_set_override_command (screen, override_command);
+  terminal_screen_start_snapshot_job (screen, terminal_screen_new_snapshot_path (),
+                                      priv->snapshot_contents);
 
-  if (child_env)
-    terminal_screen_set_initial_environment (screen, child_env);
+  priv->hibernated_pty = g_object_ref (pty);
+  vte_terminal_set_pty_object (terminal, NULL);
+  vte_terminal_reset (terminal, TRUE, TRUE);
 
-  terminal_screen_set_font_scale (screen, zoom);
-  terminal_screen_set_font (screen);
+  channel = g_io_channel_unix_new (vte_pty_get_fd (priv->hibernated_pty));
+  priv->hibernated_watch_id = g_io_add_watch (channel,
+                                              G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                              (GIOFunc) terminal_screen_hibernated_pty_cb,
+                                              screen);
+  g_io_channel_unref (channel);
 
-  return screen;
+  return TRUE;
 }
 
-gboolean 
-terminal_screen_exec (TerminalScreen *screen,
-                      char          **argv,
-                      char          **envv,
-                      const char     *cwd,
-                      GUnixFDList    *fd_list,
-                      GVariant       *fd_array,
-                      GError        **error)
+static void
+terminal_screen_feed_snapshot (TerminalScreen *screen,
+                               char *text)
 {
-  TerminalScreenPrivate *priv;
-  FDSetupData *data;
-
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  char **lines;
+  guint i;
 
-  priv = screen->priv;
+  /* The snapshot includes the empty rows below the cursor */
+  g_strchomp (text);
 
-  terminal_screen_set_initial_environment (screen, envv);
+  /* Fed text needs explicit carriage returns */
+  lines = g_strsplit (text, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++)
+    {
+      if (i > 0)
+        vte_terminal_feed (VTE_TERMINAL (screen), "\r\n", 2);
+      vte_terminal_feed (VTE_TERMINAL (screen), lines[i], -1);
+    }
 
-  if (argv)
-    terminal_screen_set_override_command (screen, argv);
+  g_strfreev (lines);
+}
 
-  g_free (priv->initial_working_directory);
-  priv->initial_working_directory = g_strdup (cwd);
+static void
+terminal_screen_finish_thaw (TerminalScreen *screen,
+                             char *text)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
 
-  if (fd_list) {
-    const int *fds;
+  if (text != NULL)
+    terminal_screen_feed_snapshot (screen, text);
 
-    data = g_new (FDSetupData, 1);
-    fds = g_unix_fd_list_peek_fds (fd_list, &data->fd_list_len);
-    data->fd_list = g_memdup (fds, (data->fd_list_len + 1) * sizeof (int));
-    data->fd_array = g_variant_get_fixed_array (fd_array, &data->fd_array_len, 2 * sizeof (int));
-  } else
-    data = NULL;
+  /* Now resume live output */
+  vte_terminal_set_pty_object (terminal, priv->hibernated_pty);
+  g_object_unref (priv->hibernated_pty);
+  priv->hibernated_pty = NULL;
 
-  return terminal_screen_do_exec (screen, data, error);
+  /* And pass on what was typed meanwhile */
+  if (priv->hibernated_input != NULL)
+    {
+      vte_terminal_feed_child_binary (terminal,
+                                      (const char *) priv->hibernated_input->data,
+                                      priv->hibernated_input->len);
+      g_byte_array_unref (priv->hibernated_input);
+      priv->hibernated_input = NULL;
+    }
 }
 
-const char*
-terminal_screen_get_raw_title (TerminalScreen *screen)
+/* For when the contents are needed right away */
+static void
+terminal_screen_thaw (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  
-  if (priv->raw_title)
-    return priv->raw_title;
+  char *text = NULL;
 
-  return "";
+  if (priv->hibernated_pty == NULL)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] thawing\n",
+                         screen);
+
+  terminal_screen_stop_hibernated_watch (screen);
+  terminal_screen_forget_snapshot_job (screen);
+
+  if (priv->snapshot_contents != NULL)
+    {
+      text = g_strdup (g_bytes_get_data (priv->snapshot_contents, NULL));
+      g_bytes_unref (priv->snapshot_contents);
+      priv->snapshot_contents = NULL;
+    }
+  else if (priv->snapshot_path != NULL)
+    {
+      text = terminal_screen_read_snapshot (priv->snapshot_path);
+      g_unlink (priv->snapshot_path);
+      g_free (priv->snapshot_path);
+      priv->snapshot_path = NULL;
+    }
+
+  terminal_screen_finish_thaw (screen, text);
+  g_free (text);
 }
 
-const char*
-terminal_screen_get_title (TerminalScreen *screen)
+static void
+terminal_screen_thaw_async (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  
-  if (priv->cooked_title == NULL)
-    terminal_screen_cook_title (screen);
 
-  /* cooked_title may still be NULL */
-  if (priv->cooked_title != NULL)
-    return priv->cooked_title;
-  else
-    return "";
-}
+  if (priv->hibernated_pty == NULL)
+    return;
 
-const char*
-terminal_screen_get_icon_title (TerminalScreen *screen)
-{
-  TerminalScreenPrivate *priv = screen->priv;
-  
-  if (priv->cooked_icon_title == NULL)
-    terminal_screen_cook_icon_title (screen);
+  terminal_screen_stop_hibernated_watch (screen);
 
-  /* cooked_icon_title may still be NULL */
-  if (priv->cooked_icon_title != NULL)
-    return priv->cooked_icon_title;
-  else
-    return "";
+  /* Still in memory */
+  if (priv->snapshot_path == NULL)
+    {
+      terminal_screen_thaw (screen);
+      return;
+    }
+
+  /* Already being read */
+  if (priv->snapshot_job != NULL)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] thawing from %s\n",
+                         screen, priv->snapshot_path);
+
+  terminal_screen_start_snapshot_job (screen, g_strdup (priv->snapshot_path), NULL);
 }
 
-gboolean
-terminal_screen_get_icon_title_set (TerminalScreen *screen)
+static void
+terminal_screen_stop_hibernate_timer (TerminalScreen *screen)
 {
-  return screen->priv->icon_title_set;
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (priv->hibernate_timer_id == 0)
+    return;
+
+  terminal_timer_wheel_remove (terminal_app_get_timer_wheel (terminal_app_get ()),
+                               priv->hibernate_timer_id);
+  priv->hibernate_timer_id = 0;
 }
 
-/* Supported format specifiers:
- * %S = static title
- * %D = dynamic title
- * %A = dynamic title, falling back to static title if empty
- * %- = separator, if not at start or end of string (excluding whitespace)
- */
-static const char *
-terminal_screen_get_title_format (TerminalScreen *screen)
+static void
+terminal_screen_hibernate_timeout_cb (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  static const char *formats[] = {
-    "%A"      /* TERMINAL_TITLE_REPLACE */,
-    "%D%-%S"  /* TERMINAL_TITLE_BEFORE  */,
-    "%S%-%D"  /* TERMINAL_TITLE_AFTER   */,
-    "%S"      /* TERMINAL_TITLE_IGNORE  */
-  };
+  TerminalTimerWheel *wheel;
+  guint timeout;
+  guint64 idle;
 
-  return formats[g_settings_get_enum (priv->profile, TERMINAL_PROFILE_TITLE_MODE_KEY)];
+  priv->hibernate_timer_id = 0;
+
+  timeout = g_settings_get_uint (terminal_app_get_global_settings (terminal_app_get ()),
+                                 TERMINAL_SETTING_HIBERNATE_TIMEOUT_KEY);
+  if (!priv->low_power || timeout == 0)
+    return;
+
+  wheel = terminal_app_get_timer_wheel (terminal_app_get ());
+  idle = (terminal_timer_wheel_get_tick (wheel) - priv->last_output_tick) *
+         terminal_timer_wheel_get_resolution (wheel);
+  if (idle < (guint64) timeout * 1000)
+    {
+      priv->hibernate_timer_id = terminal_timer_wheel_add (wheel,
+                                                           (guint) MIN ((guint64) timeout * 1000 - idle, G_MAXUINT),
+                                                           (TerminalTimerFunc) terminal_screen_hibernate_timeout_cb,
+                                                           screen);
+      return;
+    }
+
+  /* Try again later if the shell wasn't in the foreground */
+  if (!terminal_screen_hibernate (screen) && priv->hibernated_pty == NULL)
+    priv->hibernate_timer_id = terminal_timer_wheel_add (wheel,
+                                                         (guint) MIN ((guint64) timeout * 1000, G_MAXUINT),
+                                                         (TerminalTimerFunc) terminal_screen_hibernate_timeout_cb,
+                                                         screen);
 }
 
-/**
- * terminal_screen_format_title::
- * @screen:
- * @raw_title: main ingredient
- * @titleptr <inout>: pointer of the current title string
- * 
- * Format title according @format, and stores it in <literal>*titleptr</literal>.
- * Always ensures that *titleptr will be non-NULL.
- *
- * Returns: %TRUE iff the title changed
- */
-static gboolean
-terminal_screen_format_title (TerminalScreen *screen,
-                              const char *raw_title,
-                              char **titleptr)
+static void
+terminal_screen_start_hibernate_timer (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  const char *format, *arg;
-  const char *static_title = NULL;
-  GString *title;
-  gboolean add_sep = FALSE;
+  TerminalTimerWheel *wheel;
+  guint timeout;
 
-  g_assert (titleptr);
+  if (priv->hibernate_timer_id != 0 || priv->hibernated_pty != NULL)
+    return;
 
-  /* use --title argument if one was supplied, otherwise ask the profile */
-  if (priv->override_title)
-    static_title = priv->override_title;
-  else
-    g_settings_get (priv->profile, TERMINAL_PROFILE_TITLE_KEY, "&s", &static_title);
+  timeout = g_settings_get_uint (terminal_app_get_global_settings (terminal_app_get ()),
+                                 TERMINAL_SETTING_HIBERNATE_TIMEOUT_KEY);
+  if (timeout == 0)
+    return;
 
-  title = g_string_sized_new (128);
+  wheel = terminal_app_get_timer_wheel (terminal_app_get ());
+  priv->last_output_tick = terminal_timer_wheel_get_tick (wheel);
+  priv->hibernate_timer_id = terminal_timer_wheel_add (wheel,
+                                                       (guint) MIN ((guint64) timeout * 1000, G_MAXUINT),
+                                                       (TerminalTimerFunc) terminal_screen_hibernate_timeout_cb,
+                                                       screen);
+}
 
-  format = terminal_screen_get_title_format (screen);
-  for (arg = format; *arg; arg += 2)
-    {
-      const char *text_to_append = NULL;
+static void
+terminal_screen_update_power_state (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  gboolean low_power;
 
-      g_assert (arg[0] == '%');
+  low_power = priv->window_minimized || !gtk_widget_get_mapped (GTK_WIDGET (screen));
+  if (low_power == priv->low_power)
+    return;
 
-      switch (arg[1])
-        {
-          case 'A':
-            text_to_append = raw_title ? raw_title : static_title;
-            break;
-          case 'D':
-            text_to_append = raw_title;
-            break;
-          case 'S':
-            text_to_append = static_title;
-            break;
-          case '-':
-            text_to_append = NULL;
-            add_sep = TRUE;
-            break;
-          default:
-            g_assert_not_reached ();
-        }
+  priv->low_power = low_power;
+  priv->last_shown = g_get_monotonic_time ();
 
-      if (!text_to_append || !text_to_append[0])
-        continue;
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] %s low-power mode\n",
+                         screen, low_power ? "entering" : "leaving");
 
-      if (add_sep && title->len > 0)
-        g_string_append (title, " - ");
+  terminal_app_queue_scrollback_rebalance (terminal_app_get ());
 
-      g_string_append (title, text_to_append);
-      add_sep = FALSE;
-    }
+  terminal_screen_update_cursor_blink (screen);
 
-  if (*titleptr == NULL || strcmp (title->str, *titleptr) != 0)
+  terminal_flood_governor_set_visible (priv->flood_governor, !low_power);
+
+  if (low_power)
     {
-      g_free (*titleptr);
-      *titleptr = g_string_free (title, FALSE);
-      return TRUE;
+      terminal_screen_start_hibernate_timer (screen);
     }
+  else
+    {
+      terminal_screen_stop_hibernate_timer (screen);
+      terminal_screen_thaw_async (screen);
 
-  g_string_free (title, TRUE);
-  return FALSE;
+      terminal_screen_stop_title_flush_timer (screen);
+      terminal_screen_flush_title_notify (screen);
+    }
 }
 
-static void 
-terminal_screen_cook_title (TerminalScreen *screen)
+static void
+terminal_screen_update_scrollback (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  
-  if (terminal_screen_format_title (screen, priv->raw_title, &priv->cooked_title))
-    g_object_notify (G_OBJECT (screen), "title");
+  glong lines;
+
+  lines = priv->scrollback_lines;
+  if (priv->scrollback_limit >= 0 &&
+      (lines < 0 || lines > priv->scrollback_limit))
+    lines = priv->scrollback_limit;
+
+  /* Resizing the scrollback isn't free, even to the same size */
+  if (lines == priv->scrollback_applied)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] scrollback now %ld lines\n",
+                         screen, lines);
+
+  priv->scrollback_applied = lines;
+  vte_terminal_set_scrollback_lines (VTE_TERMINAL (screen), lines);
 }
 
-static void 
-terminal_screen_cook_icon_title (TerminalScreen *screen)
+static void
+terminal_screen_stop_silence_timer (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
 
-  if (terminal_screen_format_title (screen, priv->raw_icon_title, &priv->cooked_icon_title))
-    g_object_notify (G_OBJECT (screen), "icon-title");
+  if (priv->silence_timer_id == 0)
+    return;
+
+  terminal_timer_wheel_remove (terminal_app_get_timer_wheel (terminal_app_get ()),
+                               priv->silence_timer_id);
+  priv->silence_timer_id = 0;
 }
 
 static void
-terminal_screen_profile_changed_cb (GSettings     *profile,
-                                    const char    *prop_name,
-                                   TerminalScreen *screen)
+terminal_screen_set_activity (TerminalScreen *screen,
+                              TerminalActivity activity)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  GObject *object = G_OBJECT (screen);
-  VteTerminal *vte_terminal = VTE_TERMINAL (screen);
-  TerminalWindow *window;
-  const char *string;
 
-  g_object_freeze_notify (object);
+  if (priv->activity == activity)
+    return;
 
-  if ((window = terminal_screen_get_window (screen)))
-    {
-      /* We need these in line for the set_size in
-       * update_on_realize
-       */
-      terminal_window_update_geometry (window);
-    }
+  priv->activity = activity;
+  g_object_notify (G_OBJECT (screen), "activity");
+}
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY))
-    _terminal_screen_update_scrollbar (screen);
+static void
+terminal_screen_silence_timeout_cb (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  TerminalTimerWheel *wheel;
+  guint64 idle;
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ENCODING))
-    {
-      TerminalEncoding *encoding;
+  priv->silence_timer_id = 0;
 
-      encoding = terminal_app_ensure_encoding (terminal_app_get (),
-                                               g_settings_get_string (profile, TERMINAL_PROFILE_ENCODING));
-      vte_terminal_set_encoding (vte_terminal, terminal_encoding_get_charset (encoding));
-    }
+  /* Output while the timer was pending only moved last_output_tick
+   * forward, so check whether the deadline has to be pushed back.
+   */
+  wheel = terminal_app_get_timer_wheel (terminal_app_get ());
+  idle = (terminal_timer_wheel_get_tick (wheel) - priv->last_output_tick) *
+         terminal_timer_wheel_get_resolution (wheel);
+  if (idle < priv->silence_timeout * 1000) {
+    priv->silence_timer_id = terminal_timer_wheel_add (wheel,
+                                                       priv->silence_timeout * 1000 - idle,
+                                                       (TerminalTimerFunc) terminal_screen_silence_timeout_cb,
+                                                       screen);
+    return;
+  }
 
-  if (!prop_name ||
-      prop_name == I_(TERMINAL_PROFILE_TITLE_MODE_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_TITLE_KEY))
-    {
-      terminal_screen_cook_title (screen);
-      terminal_screen_cook_icon_title (screen);
-    }
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] silent for %us\n",
+                         screen, priv->silence_timeout);
 
-  if (gtk_widget_get_realized (GTK_WIDGET (screen)) &&
-      (!prop_name ||
-       prop_name == I_(TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY) ||
-       prop_name == I_(TERMINAL_PROFILE_FONT_KEY)))
-    terminal_screen_change_font (screen);
+  terminal_screen_set_activity (screen, TERMINAL_ACTIVITY_SILENCE);
+}
 
-  if (!prop_name ||
-      prop_name == I_(TERMINAL_PROFILE_USE_THEME_COLORS_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_FOREGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_BACKGROUND_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_PALETTE_KEY))
-    update_color_scheme (screen);
+static void
+terminal_screen_map (GtkWidget *widget)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_AUDIBLE_BELL_KEY))
-      vte_terminal_set_audible_bell (vte_terminal, g_settings_get_boolean (profile, TERMINAL_PROFILE_AUDIBLE_BELL_KEY));
+  GTK_WIDGET_CLASS (terminal_screen_parent_class)->map (widget);
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_WORD_CHARS_KEY))
-    {
-      g_settings_get (profile, TERMINAL_PROFILE_WORD_CHARS_KEY, "&s", &string);
-      vte_terminal_set_word_chars (vte_terminal, string);
-    }
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY))
-    vte_terminal_set_scroll_on_keystroke (vte_terminal,
-                                          g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY));
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY))
-    vte_terminal_set_scroll_on_output (vte_terminal,
-                                       g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY));
-  if (!prop_name ||
-      prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_LINES_KEY) ||
-      prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY))
-    {
-      glong lines = g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY) ?
-		    -1 : g_settings_get_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY);
-      vte_terminal_set_scrollback_lines (vte_terminal, lines);
-    }
+  /* The user can see it now */
+  terminal_screen_stop_silence_timer (screen);
+  terminal_screen_set_activity (screen, TERMINAL_ACTIVITY_NONE);
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_BACKSPACE_BINDING_KEY))
-  vte_terminal_set_backspace_binding (vte_terminal,
-                                      g_settings_get_enum (profile, TERMINAL_PROFILE_BACKSPACE_BINDING_KEY));
-  
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_DELETE_BINDING_KEY))
-  vte_terminal_set_delete_binding (vte_terminal,
-                                   g_settings_get_enum (profile, TERMINAL_PROFILE_DELETE_BINDING_KEY));
+  terminal_screen_update_power_state (screen);
+}
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ALLOW_BOLD_KEY))
-    vte_terminal_set_allow_bold (vte_terminal,
-                                 g_settings_get_boolean (profile, TERMINAL_PROFILE_ALLOW_BOLD_KEY));
+/* Keystroke latency
+ *
+ * With the latency monitor on, key presses, the input they write to the
+ * child, its next output and the next frame are timestamped, and kept
+ * in per-screen histograms. Frames are timed when drawing finishes.
+ */
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY))
-    vte_terminal_set_cursor_blink_mode (vte_terminal,
-                                        g_settings_get_enum (priv->profile, TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY));
+static TerminalLatency *
+terminal_screen_get_latency (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
 
-  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_SHAPE_KEY))
-    vte_terminal_set_cursor_shape (vte_terminal,
-                                   g_settings_get_enum (priv->profile, TERMINAL_PROFILE_CURSOR_SHAPE_KEY));
+  if (terminal_app_get_latency_monitor (terminal_app_get ()) == TERMINAL_LATENCY_MONITOR_OFF)
+    return NULL;
 
-  g_object_thaw_notify (object);
+  if (priv->latency == NULL)
+    priv->latency = terminal_latency_new ();
+
+  return priv->latency;
+}
+
+static gboolean
+terminal_screen_key_press (GtkWidget *widget,
+                           GdkEventKey *event)
+{
+  TerminalLatency *latency;
+
+  /* The event's time is on the X server's clock */
+  latency = terminal_screen_get_latency (TERMINAL_SCREEN (widget));
+  if (latency != NULL)
+    terminal_latency_key_pressed (latency, g_get_monotonic_time ());
+
+  return GTK_WIDGET_CLASS (terminal_screen_parent_class)->key_press_event (widget, event);
 }
 
 static void
-update_color_scheme (TerminalScreen *screen)
+terminal_screen_commit_cb (VteTerminal *terminal,
+                           const char *text,
+                           guint size,
+                           gpointer user_data)
 {
-  GtkWidget *widget = GTK_WIDGET (screen);
+  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
   TerminalScreenPrivate *priv = screen->priv;
-  GSettings *profile = priv->profile;
-  GdkRGBA *colors;
-  gsize n_colors;
-  GdkRGBA fg, bg, bold, theme_fg, theme_bg;
-  GtkStyleContext *context;
-
-  context = gtk_widget_get_style_context (widget);
-  gtk_style_context_get_color (context, GTK_STATE_FLAG_NORMAL, &theme_fg);
-  gtk_style_context_get_background_color (context, GTK_STATE_FLAG_NORMAL, &theme_bg);
+  TerminalLatency *latency;
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY) ||
-      (!terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY, &fg) ||
-       !terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY, &bg)))
+  /* There's no PTY to write to until the contents are back */
+  if (priv->hibernated_pty != NULL)
     {
-      fg = theme_fg;
-      bg = theme_bg;
+      if (priv->hibernated_input == NULL)
+        priv->hibernated_input = g_byte_array_new ();
+      g_byte_array_append (priv->hibernated_input, (const guint8 *) text, size);
+      terminal_screen_thaw_async (screen);
+      return;
     }
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) ||
-      !terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BOLD_COLOR_KEY, &bold))
-    bold = fg;
+  latency = terminal_screen_get_latency (screen);
+  if (latency != NULL)
+    terminal_latency_input_written (latency, g_get_monotonic_time ());
+}
 
-  colors = terminal_g_settings_get_rgba_palette (priv->profile, TERMINAL_PROFILE_PALETTE_KEY, &n_colors);
-  vte_terminal_set_colors_rgba (VTE_TERMINAL (screen), &fg, &bg,
-                                colors, n_colors);
-  vte_terminal_set_color_bold_rgba (VTE_TERMINAL (screen), &bold);
-  g_free (colors);
+static void
+terminal_screen_draw_latency_overlay (TerminalScreen *screen,
+                                      cairo_t *cr)
+{
+  TerminalLatency *latency = screen->priv->latency;
+  PangoLayout *layout;
+  char *text;
+  int width, text_width, text_height;
+
+  if (latency == NULL || terminal_latency_get_n_samples (latency) == 0)
+    text = g_strdup (_("Latency: no samples yet"));
+  else
+    text = g_strdup_printf (_("Latency: p50 %.1f ms, p95 %.1f ms, p99 %.1f ms (%u samples)"),
+                            terminal_latency_get_percentile (latency, TERMINAL_LATENCY_STAGE_TOTAL, 50) / 1000.,
+                            terminal_latency_get_percentile (latency, TERMINAL_LATENCY_STAGE_TOTAL, 95) / 1000.,
+                            terminal_latency_get_percentile (latency, TERMINAL_LATENCY_STAGE_TOTAL, 99) / 1000.,
+                            terminal_latency_get_n_samples (latency));
+
+  layout = gtk_widget_create_pango_layout (GTK_WIDGET (screen), text);
+  pango_layout_get_pixel_size (layout, &text_width, &text_height);
+  width = gtk_widget_get_allocated_width (GTK_WIDGET (screen));
+
+  cairo_save (cr);
+  cairo_set_source_rgba (cr, 0., 0., 0., .7);
+  cairo_rectangle (cr, width - text_width - 8, 0, text_width + 8, text_height + 4);
+  cairo_fill (cr);
+  cairo_set_source_rgb (cr, 1., 1., 1.);
+  cairo_move_to (cr, width - text_width - 4, 2);
+  pango_cairo_show_layout (cr, layout);
+  cairo_restore (cr);
+
+  g_object_unref (layout);
+  g_free (text);
 }
 
-void
-terminal_screen_set_font (TerminalScreen *screen)
+static gboolean
+terminal_screen_draw (GtkWidget *widget,
+                      cairo_t *cr)
 {
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
   TerminalScreenPrivate *priv = screen->priv;
-  GSettings *profile = priv->profile;
-  const char *font;
-  PangoFontDescription *desc;
-  int size;
+  TerminalWindow *window;
+  TerminalLatency *latency;
+  gboolean result;
+  gint64 output, start;
 
-  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY))
-    {
-      desc = terminal_app_get_system_font (terminal_app_get ());
-    }
-  else
-    {
-      g_settings_get (profile, TERMINAL_PROFILE_FONT_KEY, "&s", &font);
-      desc = pango_font_description_from_string (font);
-    }
+  start = g_get_monotonic_time ();
+  result = GTK_WIDGET_CLASS (terminal_screen_parent_class)->draw (widget, cr);
 
-  size = pango_font_description_get_size (desc);
-  if (size == 0)
-    size = 10;
+  window = terminal_screen_get_window (screen);
+  if (window != NULL)
+    terminal_frame_stats_add_vte_paint (terminal_window_get_frame_stats (window),
+                                        start, g_get_monotonic_time ());
 
-  if (pango_font_description_get_size_is_absolute (desc))
-    pango_font_description_set_absolute_size (desc, priv->font_scale * size);
-  else
-    pango_font_description_set_size (desc, priv->font_scale * size);
+  latency = terminal_screen_get_latency (screen);
+  if (latency != NULL) {
+    terminal_latency_frame_drawn (latency, g_get_monotonic_time ());
 
-  vte_terminal_set_font (VTE_TERMINAL (screen), desc);
+    if (terminal_app_get_latency_monitor (terminal_app_get ()) == TERMINAL_LATENCY_MONITOR_OVERLAY)
+      terminal_screen_draw_latency_overlay (screen, cr);
+  }
 
-  pango_font_description_free (desc);
+  if (priv->trace != NULL &&
+      (output = terminal_trace_get_end (priv->trace, "first-output")) != 0) {
+    terminal_trace_add_span (priv->trace, "first-frame", output, g_get_monotonic_time ());
+    terminal_screen_finish_trace (screen);
+  }
+
+  return result;
 }
 
 static void
-terminal_screen_system_font_changed_cb (GSettings      *settings,
-                                        const char     *key,
-                                        TerminalScreen *screen)
+terminal_screen_unmap (GtkWidget *widget)
 {
-  if (!gtk_widget_get_realized (GTK_WIDGET (screen)))
-    return;
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
 
-  if (!g_settings_get_boolean (settings, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY))
-    return;
+  GTK_WIDGET_CLASS (terminal_screen_parent_class)->unmap (widget);
 
-  terminal_screen_change_font (screen);
+  terminal_screen_update_power_state (screen);
 }
 
 static void
-terminal_screen_change_font (TerminalScreen *screen)
+rate_counter_update (RateCounter *counter,
+                     gint64 now)
 {
-  TerminalWindow *window;
-
-  terminal_screen_set_font (screen);
+  if (now - counter->window_start < RATE_WINDOW)
+    return;
 
-  window = terminal_screen_get_window (screen);
-  terminal_window_set_size (window, screen);
+  if (counter->window_start != 0)
+    counter->rate = (double) (counter->total - counter->window_total) * G_USEC_PER_SEC /
+                    (now - counter->window_start);
+  counter->window_total = counter->total;
+  counter->window_start = now;
 }
 
-#if 0
 static void
-profile_forgotten_callback (GSettings *profile,
-                            TerminalScreen  *screen)
+rate_counter_add (RateCounter *counter)
 {
-  TerminalProfile *new_profile;
-
-  new_profile = terminal_app_get_profile_for_new_term (terminal_app_get ());
-  g_assert (new_profile != NULL);
-  terminal_screen_set_profile (screen, new_profile);
+  counter->total++;
+  rate_counter_update (counter, g_get_monotonic_time ());
 }
-#endif
 
-void
-terminal_screen_set_profile (TerminalScreen *screen,
-                             GSettings *profile)
+/* This runs for every batch of output, so it must stay cheap: at most
+ * one state change per batch, and re-arming the silence timer is just
+ * recording the wheel's current tick.
+ */
+static void
+terminal_screen_contents_changed (VteTerminal *terminal)
 {
+  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
   TerminalScreenPrivate *priv = screen->priv;
-  GSettings*old_profile;
+  TerminalTimerWheel *wheel;
+  TerminalLatency *latency;
+  TerminalWindow *window;
 
-  old_profile = priv->profile;
-  if (profile == old_profile)
-    return;
+  rate_counter_add (&priv->contents_changes);
 
-  if (priv->profile_changed_id)
-    {
-      g_signal_handler_disconnect (G_OBJECT (priv->profile),
-                                   priv->profile_changed_id);
-      priv->profile_changed_id = 0;
-    }
+  latency = terminal_screen_get_latency (screen);
+  if (latency != NULL)
+    terminal_latency_output_read (latency, g_get_monotonic_time ());
 
-/*  if (priv->profile_forgotten_id)
-    {
-      g_signal_handler_disconnect (G_OBJECT (priv->profile),
-                                   priv->profile_forgotten_id);
-      priv->profile_forgotten_id = 0;
-    }*/
+  /* Output in other tabs isn't going to be painted */
+  window = terminal_screen_get_window (screen);
+  if (window != NULL && terminal_window_get_active (window) == screen)
+    terminal_frame_stats_output_pending (terminal_window_get_frame_stats (window));
 
-  priv->profile = profile;
-  if (profile)
-    {
-      g_object_ref (profile);
-      priv->profile_changed_id =
-        g_signal_connect (profile, "changed",
-                          G_CALLBACK (terminal_screen_profile_changed_cb),
-                          screen);
-//       priv->profile_forgotten_id =
-//         g_signal_connect (G_OBJECT (profile),
-//                           "forgotten",
-//                           G_CALLBACK (profile_forgotten_callback),
-//                           screen);
+  /* Startup is done once a terminal shows something */
+  _terminal_debug_perf_mark ("first child output");
+  _terminal_debug_perf_finish ();
 
-      terminal_screen_profile_changed_cb (profile, NULL, screen);
+  if (priv->trace != NULL &&
+      terminal_trace_get_end (priv->trace, "first-output") == 0) {
+    gint64 spawned;
 
-      g_signal_emit (G_OBJECT (screen), signals[PROFILE_SET], 0, old_profile);
+    spawned = terminal_trace_get_end (priv->trace, "fork-exec");
+    if (spawned != 0) {
+      terminal_trace_add_span (priv->trace, "first-output", spawned, g_get_monotonic_time ());
+
+      /* There won't be a frame to wait for */
+      if (!gtk_widget_get_mapped (GTK_WIDGET (screen)))
+        terminal_screen_finish_trace (screen);
     }
+  }
 
-  if (old_profile)
-    g_object_unref (old_profile);
+  if (VTE_TERMINAL_CLASS (terminal_screen_parent_class)->contents_changed)
+    VTE_TERMINAL_CLASS (terminal_screen_parent_class)->contents_changed (terminal);
 
-  g_object_notify (G_OBJECT (screen), "profile");
-}
+  /* Only monitor terminals that aren't visible. Hibernating clears
+   * the terminal, which isn't output either.
+   */
+  if (!priv->low_power || priv->hibernated_pty != NULL)
+    return;
 
-GSettings*
-terminal_screen_get_profile (TerminalScreen *screen)
-{
-  TerminalScreenPrivate *priv = screen->priv;
+  wheel = terminal_app_get_timer_wheel (terminal_app_get ());
+  priv->last_output_tick = terminal_timer_wheel_get_tick (wheel);
 
-  g_assert (priv->profile != NULL);
-  return priv->profile;
+  /* In a minimized window; there's no tab to mark */
+  if (gtk_widget_get_mapped (GTK_WIDGET (screen)))
+    return;
+
+  terminal_screen_set_activity (screen, priv->monitor_activity ? TERMINAL_ACTIVITY_OUTPUT
+                                                               : TERMINAL_ACTIVITY_NONE);
+
+  if (priv->silence_timeout != 0 && priv->silence_timer_id == 0)
+    priv->silence_timer_id = terminal_timer_wheel_add (wheel,
+                                                       priv->silence_timeout * 1000,
+                                                       (TerminalTimerFunc) terminal_screen_silence_timeout_cb,
+                                                       screen);
 }
 
-void
-terminal_screen_set_override_command (TerminalScreen *screen,
-                                      char          **argv)
+static void
+terminal_screen_style_updated (GtkWidget *widget)
 {
-  TerminalScreenPrivate *priv;
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
 
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  GTK_WIDGET_CLASS (terminal_screen_parent_class)->style_updated (widget);
 
-  priv = screen->priv;
-  g_strfreev (priv->override_command);
-  priv->override_command = g_strdupv (argv);
+  update_color_scheme (screen);
+
+  if (gtk_widget_get_realized (widget))
+    terminal_screen_change_font (screen);
 }
 
-const char**
-terminal_screen_get_override_command (TerminalScreen *screen)
+static void
+terminal_screen_throttled_notify_cb (TerminalFloodGovernor *governor,
+                                     GParamSpec *pspec,
+                                     TerminalScreen *screen)
 {
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
-
-  return (const char**) screen->priv->override_command;
+  g_object_notify (G_OBJECT (screen), "throttled");
 }
 
-void
-terminal_screen_set_initial_environment (TerminalScreen *screen,
-                                         char          **argv)
+static void
+terminal_screen_size_allocate_cb (TerminalScreen *screen,
+                                  GtkAllocation *allocation,
+                                  gpointer user_data)
 {
-  TerminalScreenPrivate *priv;
-
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
-
-  priv = screen->priv;
-  g_assert (priv->initial_env == NULL);
-  priv->initial_env = g_strdupv (argv);
+  /* VTE only resizes its own PTY */
+  terminal_screen_sync_child_size (screen);
 }
 
-char**
-terminal_screen_get_initial_environment (TerminalScreen *screen)
+#ifdef GNOME_ENABLE_DEBUG
+static void
+size_request (GtkWidget *widget,
+              GtkRequisition *req)
 {
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+  _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+                         "[screen %p] size-request %d : %d\n",
+                         widget, req->width, req->height);
+}
 
-  return screen->priv->initial_env;
+static void
+size_allocate (GtkWidget *widget,
+               GtkAllocation *allocation)
+{
+  _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
+                         "[screen %p] size-alloc   %d : %d at (%d, %d)\n",
+                         widget, allocation->width, allocation->height, allocation->x, allocation->y);
 }
+#endif
 
-static gboolean
-get_child_command (TerminalScreen *screen,
-                   const char     *shell_env,
-                   GSpawnFlags    *spawn_flags_p,
-                   char         ***argv_p,
-                   GError        **err)
+static void
+terminal_screen_init (TerminalScreen *screen)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GSettings *profile = priv->profile;
-  char **argv;
+  const GtkTargetEntry target_table[] = {
+    { (char *) "GTK_NOTEBOOK_TAB", GTK_TARGET_SAME_APP, TARGET_TAB },
+    { (char *) "application/x-color", 0, TARGET_COLOR },
+    { (char *) "x-special/gnome-reset-background", 0, TARGET_RESET_BG },
+    { (char *) "text/x-moz-url",  0, TARGET_MOZ_URL },
+    { (char *) "_NETSCAPE_URL", 0, TARGET_NETSCAPE_URL }
+  };
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  TerminalScreenPrivate *priv;
+  TerminalApp *app;
+  GtkTargetList *target_list;
+  GtkTargetEntry *targets;
+  int n_targets;
+  guint i;
 
-  g_assert (spawn_flags_p != NULL && argv_p != NULL);
+  priv = screen->priv = G_TYPE_INSTANCE_GET_PRIVATE (screen, TERMINAL_TYPE_SCREEN, TerminalScreenPrivate);
 
-  *argv_p = argv = NULL;
+  vte_terminal_set_mouse_autohide (terminal, TRUE);
+  vte_terminal_set_background_image (terminal, NULL);
+  vte_terminal_set_scroll_background (terminal, FALSE);
+  vte_terminal_set_background_transparent (terminal, FALSE);
 
-  if (priv->override_command)
-    {
-      argv = g_strdupv (priv->override_command);
+  priv->child_pid = -1;
+  priv->pty_fd = -1;
 
-      *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
-    }
-  else if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY))
-    {
-      const char *argv_str;
+  priv->font_scale = PANGO_SCALE_MEDIUM;
 
-      g_settings_get (profile, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY, "&s", &argv_str);
-      if (!g_shell_parse_argv (argv_str, NULL, &argv, err))
-        return FALSE;
+  /* Not mapped yet */
+  priv->low_power = TRUE;
+  priv->last_shown = g_get_monotonic_time ();
 
-      *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
-    }
-  else
-    {
-      const char *only_name;
-      char *shell;
-      int argc = 0;
+  priv->scrollback_lines = -1;
+  priv->scrollback_limit = -1;
+  priv->scrollback_applied = -2; /* never applied */
 
-      shell = egg_shell (shell_env);
+  priv->restart_times = g_array_new (FALSE, FALSE, sizeof (gint64));
 
-      only_name = strrchr (shell, '/');
-      if (only_name != NULL)
-        only_name++;
-      else
-        only_name = shell;
+  priv->flood_governor = terminal_flood_governor_new (terminal,
+                                                      terminal_app_get_timer_wheel (terminal_app_get ()));
+  terminal_flood_governor_set_visible (priv->flood_governor, FALSE);
+  g_signal_connect (priv->flood_governor, "notify::throttled",
+                    G_CALLBACK (terminal_screen_throttled_notify_cb), screen);
 
-      argv = g_new (char*, 3);
+  g_signal_connect (screen, "commit",
+                    G_CALLBACK (terminal_screen_commit_cb), NULL);
 
-      argv[argc++] = shell;
+  for (i = 0; i < n_url_regexes; ++i)
+    {
+      TagData *tag_data;
 
-      if (g_settings_get_boolean (profile, TERMINAL_PROFILE_LOGIN_SHELL_KEY))
-        argv[argc++] = g_strconcat ("-", only_name, NULL);
-      else
-        argv[argc++] = g_strdup (only_name);
+      tag_data = g_slice_new (TagData);
+      tag_data->flavor = url_regex_flavors[i];
+      tag_data->tag = vte_terminal_match_add_gregex (terminal, url_regexes[i], 0);
+      vte_terminal_match_set_cursor_type (terminal, tag_data->tag, URL_MATCH_CURSOR);
+
+      priv->match_tags = g_slist_prepend (priv->match_tags, tag_data);
+    }
+
+  /* Setup DND */
+  target_list = gtk_target_list_new (NULL, 0);
+  gtk_target_list_add_uri_targets (target_list, 0);
+  gtk_target_list_add_text_targets (target_list, 0);
+  gtk_target_list_add_table (target_list, target_table, G_N_ELEMENTS (target_table));
+
+  targets = gtk_target_table_new_from_list (target_list, &n_targets);
+
+  gtk_drag_dest_set (GTK_WIDGET (screen),
+                     GTK_DEST_DEFAULT_MOTION |
+                     GTK_DEST_DEFAULT_HIGHLIGHT |
+                     GTK_DEST_DEFAULT_DROP,
+                     targets, n_targets,
+                     GDK_ACTION_COPY | GDK_ACTION_MOVE);
+
+  gtk_target_table_free (targets, n_targets);
+  gtk_target_list_unref (target_list);
+
+  priv->override_title = NULL;
+  priv->user_title = FALSE;
+  
+  g_signal_connect (screen, "window-title-changed",
+                    G_CALLBACK (terminal_screen_window_title_changed),
+                    screen);
+  g_signal_connect (screen, "icon-title-changed",
+                    G_CALLBACK (terminal_screen_icon_title_changed),
+                    screen);
+  g_signal_connect_after (screen, "size-allocate",
+                          G_CALLBACK (terminal_screen_size_allocate_cb), NULL);
+
+  app = terminal_app_get ();
+  g_signal_connect (terminal_app_get_desktop_interface_settings (app), "changed::" MONOSPACE_FONT_KEY_NAME,
+                    G_CALLBACK (terminal_screen_system_font_changed_cb), screen);
+
+#ifdef GNOME_ENABLE_DEBUG
+  _TERMINAL_DEBUG_IF (TERMINAL_DEBUG_GEOMETRY)
+    {
+      g_signal_connect_after (screen, "size-request", G_CALLBACK (size_request), NULL);
+      g_signal_connect_after (screen, "size-allocate", G_CALLBACK (size_allocate), NULL);
+    }
+#endif
+}
+
+static void
+terminal_screen_get_property (GObject *object,
+                              guint prop_id,
+                              GValue *value,
+                              GParamSpec *pspec)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (object);
+
+  switch (prop_id)
+    {
+      case PROP_PROFILE:
+        g_value_set_object (value, terminal_screen_get_profile (screen));
+        break;
+      case PROP_ICON_TITLE:
+        g_value_set_string (value, terminal_screen_get_icon_title (screen));
+        break;
+      case PROP_ICON_TITLE_SET:
+        g_value_set_boolean (value, terminal_screen_get_icon_title_set (screen));
+        break;
+      case PROP_OVERRIDE_COMMAND:
+        g_value_set_boxed (value, terminal_screen_get_override_command (screen));
+        break;
+      case PROP_INITIAL_ENVIRONMENT:
+        g_value_set_boxed (value, terminal_screen_get_initial_environment (screen));
+        break;
+      case PROP_TITLE:
+        g_value_set_string (value, terminal_screen_get_title (screen));
+        break;
+      case PROP_ACTIVITY:
+        g_value_set_enum (value, terminal_screen_get_activity (screen));
+        break;
+      case PROP_RESTART_COUNT:
+        g_value_set_uint (value, terminal_screen_get_restart_count (screen));
+        break;
+      case PROP_THROTTLED:
+        g_value_set_boolean (value, terminal_screen_get_throttled (screen));
+        break;
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+terminal_screen_set_property (GObject *object,
+                              guint prop_id,
+                              const GValue *value,
+                              GParamSpec *pspec)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (object);
+
+  switch (prop_id)
+    {
+      case PROP_PROFILE:
+        terminal_screen_set_profile (screen, g_value_get_object (value));
+        break;
+      case PROP_OVERRIDE_COMMAND:
+        terminal_screen_set_override_command (screen, g_value_get_boxed (value));
+        break;
+      case PROP_INITIAL_ENVIRONMENT:
+        terminal_screen_set_initial_environment (screen, g_value_get_boxed (value));
+        break;
+      case PROP_ICON_TITLE:
+      case PROP_ICON_TITLE_SET:
+      case PROP_TITLE:
+      case PROP_ACTIVITY:
+      case PROP_RESTART_COUNT:
+      case PROP_THROTTLED:
+        /* not writable */
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+        break;
+    }
+}
+
+static void
+terminal_screen_class_init (TerminalScreenClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
+  VteTerminalClass *terminal_class = VTE_TERMINAL_CLASS (klass);
+  GSettings *settings;
+  guint i;
+
+  object_class->dispose = terminal_screen_dispose;
+  object_class->finalize = terminal_screen_finalize;
+  object_class->get_property = terminal_screen_get_property;
+  object_class->set_property = terminal_screen_set_property;
+
+  widget_class->realize = terminal_screen_realize;
+  widget_class->map = terminal_screen_map;
+  widget_class->unmap = terminal_screen_unmap;
+  widget_class->style_updated = terminal_screen_style_updated;
+  widget_class->drag_data_received = terminal_screen_drag_data_received;
+  widget_class->button_press_event = terminal_screen_button_press;
+  widget_class->popup_menu = terminal_screen_popup_menu;
+  widget_class->draw = terminal_screen_draw;
+  widget_class->key_press_event = terminal_screen_key_press;
+
+  terminal_class->child_exited = terminal_screen_child_exited;
+  terminal_class->eof = terminal_screen_eof;
+  terminal_class->contents_changed = terminal_screen_contents_changed;
+
+  signals[PROFILE_SET] =
+    g_signal_new (I_("profile-set"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalScreenClass, profile_set),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1, G_TYPE_SETTINGS);
+  
+  signals[SHOW_POPUP_MENU] =
+    g_signal_new (I_("show-popup-menu"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalScreenClass, show_popup_menu),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__POINTER,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_POINTER);
+
+  signals[MATCH_CLICKED] =
+    g_signal_new (I_("match-clicked"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalScreenClass, match_clicked),
+                  g_signal_accumulator_true_handled, NULL,
+                  _terminal_marshal_BOOLEAN__STRING_INT_UINT,
+                  G_TYPE_BOOLEAN,
+                  3, G_TYPE_STRING, G_TYPE_INT, G_TYPE_UINT);
+  
+  signals[CLOSE_SCREEN] =
+    g_signal_new (I_("close-screen"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalScreenClass, close_screen),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE,
+                  0);
+
+  signals[TRACE_FINISHED] =
+    g_signal_new (I_("trace-finished"),
+                  G_OBJECT_CLASS_TYPE (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  G_STRUCT_OFFSET (TerminalScreenClass, trace_finished),
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE,
+                  0);
+
+  g_object_class_install_property
+    (object_class,
+     PROP_PROFILE,
+     g_param_spec_object ("profile", NULL, NULL,
+                          G_TYPE_SETTINGS,
+                          G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_ICON_TITLE,
+     g_param_spec_string ("icon-title", NULL, NULL,
+                          NULL,
+                          G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_ICON_TITLE_SET,
+     g_param_spec_boolean ("icon-title-set", NULL, NULL,
+                           FALSE,
+                           G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_OVERRIDE_COMMAND,
+     g_param_spec_boxed ("override-command", NULL, NULL,
+                         G_TYPE_STRV,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_TITLE,
+     g_param_spec_string ("title", NULL, NULL,
+                          NULL,
+                          G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_INITIAL_ENVIRONMENT,
+     g_param_spec_boxed ("initial-environment", NULL, NULL,
+                         G_TYPE_STRV,
+                         G_PARAM_READWRITE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_ACTIVITY,
+     g_param_spec_enum ("activity", NULL, NULL,
+                        TERMINAL_TYPE_ACTIVITY,
+                        TERMINAL_ACTIVITY_NONE,
+                        G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_RESTART_COUNT,
+     g_param_spec_uint ("restart-count", NULL, NULL,
+                        0, G_MAXUINT, 0,
+                        G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_object_class_install_property
+    (object_class,
+     PROP_THROTTLED,
+     g_param_spec_boolean ("throttled", NULL, NULL,
+                           FALSE,
+                           G_PARAM_READABLE | G_PARAM_STATIC_NAME | G_PARAM_STATIC_NICK | G_PARAM_STATIC_BLURB));
+
+  g_type_class_add_private (object_class, sizeof (TerminalScreenPrivate));
+
+  /* Precompile the regexes */
+  n_url_regexes = G_N_ELEMENTS (url_regex_patterns);
+  url_regexes = g_new0 (GRegex*, n_url_regexes);
+  url_regex_flavors = g_new0 (TerminalURLFlavour, n_url_regexes);
+
+  for (i = 0; i < n_url_regexes; ++i)
+    {
+      GError *error = NULL;
+
+      url_regexes[i] = g_regex_new (url_regex_patterns[i].pattern,
+                                    url_regex_patterns[i].flags | G_REGEX_OPTIMIZE,
+                                    0, &error);
+      if (error)
+        {
+          g_message ("%s", error->message);
+          g_error_free (error);
+        }
+
+      url_regex_flavors[i] = url_regex_patterns[i].flavor;
+    }
+
+  /* This fixes bug #329827 */
+  settings = terminal_app_get_global_settings (terminal_app_get ());
+  terminal_screen_class_enable_menu_bar_accel_notify_cb (settings, TERMINAL_SETTING_ENABLE_MENU_BAR_ACCEL_KEY, klass);
+  g_signal_connect (settings, "changed::" TERMINAL_SETTING_ENABLE_MENU_BAR_ACCEL_KEY,
+                    G_CALLBACK (terminal_screen_class_enable_menu_bar_accel_notify_cb), klass);
+}
+
+static void
+terminal_screen_dispose (GObject *object)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (object);
+  TerminalScreenPrivate *priv = screen->priv;
+  GtkSettings *settings;
+
+  settings = gtk_widget_get_settings (GTK_WIDGET (screen));
+  g_signal_handlers_disconnect_matched (settings, G_SIGNAL_MATCH_DATA,
+                                        0, 0, NULL, NULL,
+                                        screen);
+
+  if (priv->launch_child_source_id != 0)
+    {
+      g_source_remove (priv->launch_child_source_id);
+      priv->launch_child_source_id = 0;
+    }
+
+  terminal_process_tracker_remove_screen (terminal_app_get_process_tracker (terminal_app_get ()),
+                                          screen);
+
+  terminal_screen_stop_silence_timer (screen);
+  terminal_screen_stop_title_flush_timer (screen);
+  terminal_screen_stop_hibernate_timer (screen);
+  terminal_screen_stop_restart (screen);
+  terminal_screen_stop_recording (screen);
+  terminal_screen_forget_deposit (screen);
+
+  terminal_viewer_free (priv->viewer);
+  priv->viewer = NULL;
+
+  if (priv->flood_governor != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (priv->flood_governor,
+                                            G_CALLBACK (terminal_screen_throttled_notify_cb),
+                                            screen);
+      g_object_unref (priv->flood_governor);
+      priv->flood_governor = NULL;
+    }
+
+  terminal_screen_forget_snapshot_job (screen);
+  if (priv->hibernated_pty != NULL)
+    {
+      terminal_screen_stop_hibernated_watch (screen);
+      g_clear_object (&priv->hibernated_pty);
+      if (priv->snapshot_path != NULL)
+        g_unlink (priv->snapshot_path);
+      g_free (priv->snapshot_path);
+      priv->snapshot_path = NULL;
+      if (priv->snapshot_contents != NULL)
+        {
+          g_bytes_unref (priv->snapshot_contents);
+          priv->snapshot_contents = NULL;
+        }
+    }
+  if (priv->hibernated_input != NULL)
+    {
+      g_byte_array_unref (priv->hibernated_input);
+      priv->hibernated_input = NULL;
+    }
+
+  /* Let the others have our share */
+  terminal_app_queue_scrollback_rebalance (terminal_app_get ());
+
+  G_OBJECT_CLASS (terminal_screen_parent_class)->dispose (object);
+}
+
+static void
+terminal_screen_finalize (GObject *object)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (object);
+  TerminalScreenPrivate *priv = screen->priv;
+
+  g_signal_handlers_disconnect_by_func (terminal_app_get_desktop_interface_settings (terminal_app_get ()),
+                                        G_CALLBACK (terminal_screen_system_font_changed_cb),
+                                        screen);
+
+  terminal_screen_set_profile (screen, NULL);
+
+  g_free (priv->raw_title);
+  g_free (priv->cooked_title);
+  g_free (priv->override_title);
+  g_free (priv->raw_icon_title);
+  g_free (priv->cooked_icon_title);
+  g_free (priv->initial_working_directory);
+  g_strfreev (priv->override_command);
+  g_strfreev (priv->initial_env);
+
+  g_slist_foreach (priv->match_tags, (GFunc) free_tag_data, NULL);
+  g_slist_free (priv->match_tags);
+
+  g_array_free (priv->restart_times, TRUE);
+
+  if (priv->resource_overrides)
+    g_variant_unref (priv->resource_overrides);
+
+  terminal_cgroup_free (priv->cgroup);
+  terminal_trace_free (priv->trace);
+  terminal_latency_free (priv->latency);
+  terminal_feeder_free (priv->feeder);
+
+  G_OBJECT_CLASS (terminal_screen_parent_class)->finalize (object);
+}
+
+TerminalScreen *
+terminal_screen_new (GSettings       *profile,
+                     char           **override_command,
+                     const char      *title,
+                     const char      *working_dir,
+                     char           **child_env,
+                     double           zoom)
+{
+  TerminalScreen *screen;
+  TerminalScreenPrivate *priv;
+
+  g_return_val_if_fail (G_IS_SETTINGS (profile), NULL);
+
+  screen = g_object_new (TERMINAL_TYPE_SCREEN, NULL);
+  priv = screen->priv;
+
+  terminal_screen_set_profile (screen, profile);
+
+  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_DEFAULT_SIZE_KEY)) {
+    vte_terminal_set_size (VTE_TERMINAL (screen),
+			   g_settings_get_int (profile, TERMINAL_PROFILE_DEFAULT_SIZE_COLUMNS_KEY),
+			   g_settings_get_int (profile, TERMINAL_PROFILE_DEFAULT_SIZE_ROWS_KEY));
+  }
+
+  if (title)
+    terminal_screen_set_override_title (screen, title);
+
+  priv->initial_working_directory = g_strdup (working_dir);
+
+  if (override_command)
+    terminal_screen_set_override_command (screen, override_command);
+
+  if (child_env)
+    terminal_screen_set_initial_environment (screen, child_env);
+
+  terminal_screen_set_font_scale (screen, zoom);
+  terminal_screen_set_font (screen);
+
+  return screen;
+}
+
+gboolean 
+terminal_screen_exec (TerminalScreen *screen,
+                      char          **argv,
+                      char          **envv,
+                      const char     *cwd,
+                      GUnixFDList    *fd_list,
+                      GVariant       *fd_array,
+                      GVariant       *resources,
+                      GError        **error)
+{
+  TerminalScreenPrivate *priv;
+  ChildSetupData *data;
+
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  priv = screen->priv;
+
+  terminal_screen_set_initial_environment (screen, envv);
+
+  if (argv)
+    terminal_screen_set_override_command (screen, argv);
+
+  g_free (priv->initial_working_directory);
+  priv->initial_working_directory = g_strdup (cwd);
+
+  /* Kept for restarts */
+  if (priv->resource_overrides)
+    g_variant_unref (priv->resource_overrides);
+  priv->resource_overrides = resources ? g_variant_ref (resources) : NULL;
+
+  if (fd_list) {
+    const int *fds;
+
+    data = g_new0 (ChildSetupData, 1);
+    fds = g_unix_fd_list_peek_fds (fd_list, &data->fd_list_len);
+    data->fd_list = g_memdup (fds, (data->fd_list_len + 1) * sizeof (int));
+    data->fd_array = g_variant_get_fixed_array (fd_array, &data->fd_array_len, 2 * sizeof (int));
+  } else
+    data = NULL;
+
+  return terminal_screen_do_exec (screen, data, error);
+}
+
+/**
+ * terminal_screen_view:
+ * @screen: a #TerminalScreen
+ * @path: a file to follow, or %NULL
+ * @fd: if @path is %NULL, a file descriptor to read until the end, which
+ *   @screen takes ownership of
+ * @error: return location for a #GError
+ *
+ * Shows the contents of @path or @fd in @screen instead of running a
+ * child process in it.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+terminal_screen_view (TerminalScreen *screen,
+                      const char     *path,
+                      int             fd,
+                      GError        **error)
+{
+  TerminalScreenPrivate *priv;
+
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+  g_return_val_if_fail (path != NULL || fd != -1, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  priv = screen->priv;
+
+  if (priv->child_pid != -1 || priv->viewer != NULL) {
+    g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                         "Cannot view a file while the terminal is already in use");
+    if (path == NULL)
+      close (fd);
+    return FALSE;
+  }
+
+  if (priv->launch_child_source_id != 0)
+    {
+      g_source_remove (priv->launch_child_source_id);
+      priv->launch_child_source_id = 0;
+    }
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] viewing %s\n",
+                         screen, path ? path : "a file descriptor");
+
+  if (path != NULL)
+    priv->viewer = terminal_viewer_new_for_path (VTE_TERMINAL (screen), path, error);
+  else
+    priv->viewer = terminal_viewer_new_for_fd (VTE_TERMINAL (screen), fd);
+
+  return priv->viewer != NULL;
+}
+
+const char*
+terminal_screen_get_raw_title (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  
+  if (priv->raw_title)
+    return priv->raw_title;
+
+  return "";
+}
+
+const char*
+terminal_screen_get_title (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  
+  if (priv->cooked_title == NULL)
+    terminal_screen_cook_title (screen);
+
+  /* cooked_title may still be NULL */
+  if (priv->cooked_title != NULL)
+    return priv->cooked_title;
+  else
+    return "";
+}
+
+const char*
+terminal_screen_get_icon_title (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  
+  if (priv->cooked_icon_title == NULL)
+    terminal_screen_cook_icon_title (screen);
+
+  /* cooked_icon_title may still be NULL */
+  if (priv->cooked_icon_title != NULL)
+    return priv->cooked_icon_title;
+  else
+    return "";
+}
+
+gboolean
+terminal_screen_get_icon_title_set (TerminalScreen *screen)
+{
+  return screen->priv->icon_title_set;
+}
+
+/* Supported format specifiers:
+ * %S = static title
+ * %D = dynamic title
+ * %A = dynamic title, falling back to static title if empty
+ * %- = separator, if not at start or end of string (excluding whitespace)
+ */
+static const char *
+terminal_screen_get_title_format (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  static const char *formats[] = {
+    "%A"      /* TERMINAL_TITLE_REPLACE */,
+    "%D%-%S"  /* TERMINAL_TITLE_BEFORE  */,
+    "%S%-%D"  /* TERMINAL_TITLE_AFTER   */,
+    "%S"      /* TERMINAL_TITLE_IGNORE  */
+  };
+
+  return formats[g_settings_get_enum (priv->profile, TERMINAL_PROFILE_TITLE_MODE_KEY)];
+}
+
+/**
+ * terminal_screen_format_title::
+ * @screen:
+ * @raw_title: main ingredient
+ * @titleptr <inout>: pointer of the current title string
+ * 
+ * Format title according @format, and stores it in <literal>*titleptr</literal>.
+ * Always ensures that *titleptr will be non-NULL.
+ *
+ * Returns: %TRUE iff the title changed
+ */
+static gboolean
+terminal_screen_format_title (TerminalScreen *screen,
+                              const char *raw_title,
+                              char **titleptr)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  const char *format, *arg;
+  const char *static_title = NULL;
+  GString *title;
+  gboolean add_sep = FALSE;
+
+  g_assert (titleptr);
+
+  /* use --title argument if one was supplied, otherwise ask the profile */
+  if (priv->override_title)
+    static_title = priv->override_title;
+  else
+    g_settings_get (priv->profile, TERMINAL_PROFILE_TITLE_KEY, "&s", &static_title);
+
+  title = g_string_sized_new (128);
+
+  format = terminal_screen_get_title_format (screen);
+  for (arg = format; *arg; arg += 2)
+    {
+      const char *text_to_append = NULL;
+
+      g_assert (arg[0] == '%');
+
+      switch (arg[1])
+        {
+          case 'A':
+            text_to_append = raw_title ? raw_title : static_title;
+            break;
+          case 'D':
+            text_to_append = raw_title;
+            break;
+          case 'S':
+            text_to_append = static_title;
+            break;
+          case '-':
+            text_to_append = NULL;
+            add_sep = TRUE;
+            break;
+          default:
+            g_assert_not_reached ();
+        }
+
+      if (!text_to_append || !text_to_append[0])
+        continue;
+
+      if (add_sep && title->len > 0)
+        g_string_append (title, " - ");
+
+      g_string_append (title, text_to_append);
+      add_sep = FALSE;
+    }
+
+  if (*titleptr == NULL || strcmp (title->str, *titleptr) != 0)
+    {
+      g_free (*titleptr);
+      *titleptr = g_string_free (title, FALSE);
+      return TRUE;
+    }
+
+  g_string_free (title, TRUE);
+  return FALSE;
+}
+
+static void 
+terminal_screen_cook_title (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  
+  if (terminal_screen_format_title (screen, priv->raw_title, &priv->cooked_title))
+    terminal_screen_notify_title (screen, FALSE);
+}
+
+static void 
+terminal_screen_cook_icon_title (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (terminal_screen_format_title (screen, priv->raw_icon_title, &priv->cooked_icon_title))
+    terminal_screen_notify_title (screen, TRUE);
+}
+
+static void
+terminal_screen_profile_changed_cb (GSettings     *profile,
+                                    const char    *prop_name,
+                                   TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GObject *object = G_OBJECT (screen);
+  VteTerminal *vte_terminal = VTE_TERMINAL (screen);
+  TerminalWindow *window;
+  const char *string;
+  const char *phase;
+
+  phase = terminal_watchdog_enter ("terminal_screen_profile_changed_cb");
+  g_object_freeze_notify (object);
+
+  if (prop_name != NULL)
+    terminal_app_count_settings_change (terminal_app_get ());
+
+  if ((window = terminal_screen_get_window (screen)))
+    {
+      /* We need these in line for the set_size in
+       * update_on_realize
+       */
+      terminal_window_update_geometry (window);
+    }
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY))
+    _terminal_screen_update_scrollbar (screen);
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_MONITOR_ACTIVITY_KEY))
+    priv->monitor_activity = g_settings_get_boolean (profile, TERMINAL_PROFILE_MONITOR_ACTIVITY_KEY);
+
+  if (!prop_name ||
+      prop_name == I_(TERMINAL_PROFILE_MONITOR_SILENCE_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_SILENCE_TIMEOUT_KEY))
+    {
+      if (g_settings_get_boolean (profile, TERMINAL_PROFILE_MONITOR_SILENCE_KEY))
+        priv->silence_timeout = g_settings_get_uint (profile, TERMINAL_PROFILE_SILENCE_TIMEOUT_KEY);
+      else
+        priv->silence_timeout = 0;
+
+      if (priv->silence_timeout == 0)
+        terminal_screen_stop_silence_timer (screen);
+    }
+
+  if (!prop_name ||
+      prop_name == I_(TERMINAL_PROFILE_FLOOD_THRESHOLD_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_FLOOD_DURATION_KEY))
+    terminal_flood_governor_set_limits (priv->flood_governor,
+                                        g_settings_get_uint (profile, TERMINAL_PROFILE_FLOOD_THRESHOLD_KEY),
+                                        g_settings_get_uint (profile, TERMINAL_PROFILE_FLOOD_DURATION_KEY));
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ENCODING))
+    {
+      TerminalEncoding *encoding;
+
+      encoding = terminal_app_ensure_encoding (terminal_app_get (),
+                                               g_settings_get_string (profile, TERMINAL_PROFILE_ENCODING));
+      vte_terminal_set_encoding (vte_terminal, terminal_encoding_get_charset (encoding));
+    }
+
+  if (!prop_name ||
+      prop_name == I_(TERMINAL_PROFILE_TITLE_MODE_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_TITLE_KEY))
+    {
+      terminal_screen_cook_title (screen);
+      terminal_screen_cook_icon_title (screen);
+    }
+
+  if (gtk_widget_get_realized (GTK_WIDGET (screen)) &&
+      (!prop_name ||
+       prop_name == I_(TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY) ||
+       prop_name == I_(TERMINAL_PROFILE_FONT_KEY)))
+    terminal_screen_change_font (screen);
+
+  if (!prop_name ||
+      prop_name == I_(TERMINAL_PROFILE_USE_THEME_COLORS_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_FOREGROUND_COLOR_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_BACKGROUND_COLOR_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_BOLD_COLOR_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_PALETTE_KEY))
+    update_color_scheme (screen);
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_AUDIBLE_BELL_KEY))
+      vte_terminal_set_audible_bell (vte_terminal, g_settings_get_boolean (profile, TERMINAL_PROFILE_AUDIBLE_BELL_KEY));
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_WORD_CHARS_KEY))
+    {
+      g_settings_get (profile, TERMINAL_PROFILE_WORD_CHARS_KEY, "&s", &string);
+      vte_terminal_set_word_chars (vte_terminal, string);
+    }
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY))
+    vte_terminal_set_scroll_on_keystroke (vte_terminal,
+                                          g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_KEYSTROKE_KEY));
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY))
+    vte_terminal_set_scroll_on_output (vte_terminal,
+                                       g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLL_ON_OUTPUT_KEY));
+  if (!prop_name ||
+      prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_LINES_KEY) ||
+      prop_name == I_(TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY))
+    {
+      priv->scrollback_lines = g_settings_get_boolean (profile, TERMINAL_PROFILE_SCROLLBACK_UNLIMITED_KEY) ?
+                               -1 : g_settings_get_int (profile, TERMINAL_PROFILE_SCROLLBACK_LINES_KEY);
+      terminal_screen_update_scrollback (screen);
+      terminal_app_queue_scrollback_rebalance (terminal_app_get ());
+    }
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_BACKSPACE_BINDING_KEY))
+  vte_terminal_set_backspace_binding (vte_terminal,
+                                      g_settings_get_enum (profile, TERMINAL_PROFILE_BACKSPACE_BINDING_KEY));
+  
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_DELETE_BINDING_KEY))
+  vte_terminal_set_delete_binding (vte_terminal,
+                                   g_settings_get_enum (profile, TERMINAL_PROFILE_DELETE_BINDING_KEY));
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_ALLOW_BOLD_KEY))
+    vte_terminal_set_allow_bold (vte_terminal,
+                                 g_settings_get_boolean (profile, TERMINAL_PROFILE_ALLOW_BOLD_KEY));
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_BLINK_MODE_KEY))
+    terminal_screen_update_cursor_blink (screen);
+
+  if (!prop_name || prop_name == I_(TERMINAL_PROFILE_CURSOR_SHAPE_KEY))
+    vte_terminal_set_cursor_shape (vte_terminal,
+                                   g_settings_get_enum (priv->profile, TERMINAL_PROFILE_CURSOR_SHAPE_KEY));
+
+  g_object_thaw_notify (object);
+  terminal_watchdog_leave (phase);
+}
+
+static void
+update_color_scheme (TerminalScreen *screen)
+{
+  GtkWidget *widget = GTK_WIDGET (screen);
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  GdkRGBA *colors;
+  gsize n_colors;
+  GdkRGBA fg, bg, bold, theme_fg, theme_bg;
+  GtkStyleContext *context;
+
+  context = gtk_widget_get_style_context (widget);
+  gtk_style_context_get_color (context, GTK_STATE_FLAG_NORMAL, &theme_fg);
+  gtk_style_context_get_background_color (context, GTK_STATE_FLAG_NORMAL, &theme_bg);
+
+  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY) ||
+      (!terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_FOREGROUND_COLOR_KEY, &fg) ||
+       !terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY, &bg)))
+    {
+      fg = theme_fg;
+      bg = theme_bg;
+    }
+
+  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_BOLD_COLOR_SAME_AS_FG_KEY) ||
+      !terminal_g_settings_get_rgba (profile, TERMINAL_PROFILE_BOLD_COLOR_KEY, &bold))
+    bold = fg;
+
+  colors = terminal_g_settings_get_rgba_palette (priv->profile, TERMINAL_PROFILE_PALETTE_KEY, &n_colors);
+  vte_terminal_set_colors_rgba (VTE_TERMINAL (screen), &fg, &bg,
+                                colors, n_colors);
+  vte_terminal_set_color_bold_rgba (VTE_TERMINAL (screen), &bold);
+  g_free (colors);
+}
+
+void
+terminal_screen_set_font (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  const char *font;
+  PangoFontDescription *desc;
+  int size;
+
+  if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY))
+    {
+      desc = terminal_app_get_system_font (terminal_app_get ());
+    }
+  else
+    {
+      g_settings_get (profile, TERMINAL_PROFILE_FONT_KEY, "&s", &font);
+      desc = pango_font_description_from_string (font);
+    }
+
+  size = pango_font_description_get_size (desc);
+  if (size == 0)
+    size = 10;
+
+  if (pango_font_description_get_size_is_absolute (desc))
+    pango_font_description_set_absolute_size (desc, priv->font_scale * size);
+  else
+    pango_font_description_set_size (desc, priv->font_scale * size);
+
+  vte_terminal_set_font (VTE_TERMINAL (screen), desc);
+
+  pango_font_description_free (desc);
+}
+
+static void
+terminal_screen_system_font_changed_cb (GSettings      *settings,
+                                        const char     *key,
+                                        TerminalScreen *screen)
+{
+  if (!gtk_widget_get_realized (GTK_WIDGET (screen)))
+    return;
+
+  if (!g_settings_get_boolean (settings, TERMINAL_PROFILE_USE_SYSTEM_FONT_KEY))
+    return;
+
+  terminal_screen_change_font (screen);
+}
+
+static void
+terminal_screen_change_font (TerminalScreen *screen)
+{
+  TerminalWindow *window;
+
+  terminal_screen_set_font (screen);
+
+  window = terminal_screen_get_window (screen);
+  terminal_window_set_size (window, screen);
+}
+
+#if 0
+static void
+profile_forgotten_callback (GSettings *profile,
+                            TerminalScreen  *screen)
+{
+  TerminalProfile *new_profile;
+
+  new_profile = terminal_app_get_profile_for_new_term (terminal_app_get ());
+  g_assert (new_profile != NULL);
+  terminal_screen_set_profile (screen, new_profile);
+}
+#endif
+
+void
+terminal_screen_set_profile (TerminalScreen *screen,
+                             GSettings *profile)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings*old_profile;
+
+  old_profile = priv->profile;
+  if (profile == old_profile)
+    return;
+
+  if (priv->profile_changed_id)
+    {
+      g_signal_handler_disconnect (G_OBJECT (priv->profile),
+                                   priv->profile_changed_id);
+      priv->profile_changed_id = 0;
+    }
+
+/*  if (priv->profile_forgotten_id)
+    {
+      g_signal_handler_disconnect (G_OBJECT (priv->profile),
+                                   priv->profile_forgotten_id);
+      priv->profile_forgotten_id = 0;
+    }*/
+
+  priv->profile = profile;
+  if (profile)
+    {
+      g_object_ref (profile);
+      priv->profile_changed_id =
+        g_signal_connect (profile, "changed",
+                          G_CALLBACK (terminal_screen_profile_changed_cb),
+                          screen);
+//       priv->profile_forgotten_id =
+//         g_signal_connect (G_OBJECT (profile),
+//                           "forgotten",
+//                           G_CALLBACK (profile_forgotten_callback),
+//                           screen);
+
+      terminal_screen_profile_changed_cb (profile, NULL, screen);
+
+      g_signal_emit (G_OBJECT (screen), signals[PROFILE_SET], 0, old_profile);
+    }
+
+  if (old_profile)
+    g_object_unref (old_profile);
+
+  g_object_notify (G_OBJECT (screen), "profile");
+}
+
+GSettings*
+terminal_screen_get_profile (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  g_assert (priv->profile != NULL);
+  return priv->profile;
+}
+
+void
+terminal_screen_set_override_command (TerminalScreen *screen,
+                                      char          **argv)
+{
+  TerminalScreenPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  g_strfreev (priv->override_command);
+  priv->override_command = g_strdupv (argv);
+}
+
+const char**
+terminal_screen_get_override_command (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+
+  return (const char**) screen->priv->override_command;
+}
+
+void
+terminal_screen_set_initial_environment (TerminalScreen *screen,
+                                         char          **argv)
+{
+  TerminalScreenPrivate *priv;
+
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  priv = screen->priv;
+  g_assert (priv->initial_env == NULL);
+  priv->initial_env = g_strdupv (argv);
+}
+
+char**
+terminal_screen_get_initial_environment (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+
+  return screen->priv->initial_env;
+}
+
+static gboolean
+get_child_command (TerminalScreen *screen,
+                   const char     *shell_env,
+                   GSpawnFlags    *spawn_flags_p,
+                   char         ***argv_p,
+                   GError        **err)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  char **argv;
+
+  g_assert (spawn_flags_p != NULL && argv_p != NULL);
+
+  *argv_p = argv = NULL;
+
+  if (priv->override_command)
+    {
+      argv = g_strdupv (priv->override_command);
+
+      *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
+    }
+  else if (g_settings_get_boolean (profile, TERMINAL_PROFILE_USE_CUSTOM_COMMAND_KEY))
+    {
+      const char *argv_str;
+
+      g_settings_get (profile, TERMINAL_PROFILE_CUSTOM_COMMAND_KEY, "&s", &argv_str);
+      if (!g_shell_parse_argv (argv_str, NULL, &argv, err))
+        return FALSE;
+
+      *spawn_flags_p |= G_SPAWN_SEARCH_PATH;
+    }
+  else
+    {
+      const char *only_name;
+      char *shell;
+      int argc = 0;
+
+      shell = egg_shell (shell_env);
+
+      only_name = strrchr (shell, '/');
+      if (only_name != NULL)
+        only_name++;
+      else
+        only_name = shell;
+
+      argv = g_new (char*, 3);
+
+      argv[argc++] = shell;
+
+      if (g_settings_get_boolean (profile, TERMINAL_PROFILE_LOGIN_SHELL_KEY))
+        argv[argc++] = g_strconcat ("-", only_name, NULL);
+      else
+        argv[argc++] = g_strdup (only_name);
 
       argv[argc++] = NULL;
 
-      *spawn_flags_p |= G_SPAWN_FILE_AND_ARGV_ZERO;
-    }
+      *spawn_flags_p |= G_SPAWN_FILE_AND_ARGV_ZERO;
+    }
+
+  *argv_p = argv;
+
+  return TRUE;
+}
+
+static char**
+get_child_environment (TerminalScreen *screen,
+                       const char *cwd,
+                       char **shell)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  TerminalWindow *window;
+#ifdef GDK_WINDOWING_X11
+  GdkDisplay *display;
+#endif
+  char **env;
+  char *e, *v;
+  GHashTable *env_table;
+  GHashTableIter iter;
+  GPtrArray *retval;
+  guint i;
+
+  /* NULL for a headless screen */
+  window = terminal_screen_get_window (screen);
+
+  env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  /* First take the factory's environment */
+  env = g_listenv ();
+  for (i = 0; env[i]; ++i)
+    g_hash_table_insert (env_table, env[i], g_strdup (g_getenv (env[i])));
+  g_free (env); /* the strings themselves are now owned by the hash table */
+
+  /* and then merge the child environment, if any */
+  env = priv->initial_env;
+  if (env)
+    {
+      for (i = 0; env[i]; ++i)
+        {
+          v = strchr (env[i], '=');
+          if (v)
+             g_hash_table_replace (env_table, g_strndup (env[i], v - env[i]), g_strdup (v + 1));
+           else
+             g_hash_table_replace (env_table, g_strdup (env[i]), NULL);
+        }
+    }
+
+  g_hash_table_remove (env_table, "COLUMNS");
+  g_hash_table_remove (env_table, "LINES");
+  g_hash_table_remove (env_table, "GNOME_DESKTOP_ICON");
+  
+  g_hash_table_replace (env_table, g_strdup ("COLORTERM"), g_strdup (EXECUTABLE_NAME));
+  
+#ifdef GDK_WINDOWING_X11
+  display = window != NULL ? gtk_widget_get_display (GTK_WIDGET (window)) : gdk_display_get_default ();
+  if (display != NULL && GDK_IS_X11_DISPLAY (display))
+    {
+      /* FIXME: moving the tab between windows, or the window between displays will make the next two invalid... */
+      if (window != NULL && gtk_widget_get_realized (GTK_WIDGET (window)))
+        g_hash_table_replace (env_table, g_strdup ("WINDOWID"),
+                              g_strdup_printf ("%ld",
+                                               GDK_WINDOW_XID (gtk_widget_get_window (GTK_WIDGET (window)))));
+      else
+        g_hash_table_remove (env_table, "WINDOWID");
+      g_hash_table_replace (env_table, g_strdup ("DISPLAY"), g_strdup (gdk_display_get_name (display)));
+    }
+#endif
+
+  /* We need to put the working directory also in PWD, so that
+   * e.g. bash starts in the right directory if @cwd is a symlink.
+   * See bug #502146.
+   */
+  g_hash_table_replace (env_table, g_strdup ("PWD"), g_strdup (cwd));
+
+  terminal_util_add_proxy_env (env_table);
+
+  retval = g_ptr_array_sized_new (g_hash_table_size (env_table));
+  g_hash_table_iter_init (&iter, env_table);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &e, (gpointer *) &v))
+    g_ptr_array_add (retval, g_strdup_printf ("%s=%s", e, v ? v : ""));
+  g_ptr_array_add (retval, NULL);
+
+  *shell = g_strdup (g_hash_table_lookup (env_table, "SHELL"));
+
+  g_hash_table_destroy (env_table);
+  return (char **) g_ptr_array_free (retval, FALSE);
+}
+
+enum {
+  RESPONSE_RELAUNCH,
+  RESPONSE_EDIT_PROFILE
+};
+
+static void
+terminal_screen_show_info_bar (TerminalScreen *screen,
+                               GtkWidget *info_bar,
+                               int default_response)
+{
+  TerminalScreenContainer *container;
+
+  /* A headless screen has nowhere to show it */
+  container = terminal_screen_container_get_from_screen (screen);
+  if (container == NULL) {
+    g_object_ref_sink (info_bar);
+    gtk_widget_destroy (info_bar);
+    g_object_unref (info_bar);
+    return;
+  }
+
+  gtk_box_pack_start (GTK_BOX (container), info_bar, FALSE, FALSE, 0);
+  gtk_info_bar_set_default_response (GTK_INFO_BAR (info_bar), default_response);
+  gtk_widget_show (info_bar);
+}
+
+static void
+info_bar_response_cb (GtkWidget *info_bar,
+                      int response,
+                      TerminalScreen *screen)
+{
+  gtk_widget_grab_focus (GTK_WIDGET (screen));
+
+  switch (response) {
+    case GTK_RESPONSE_CANCEL:
+      gtk_widget_destroy (info_bar);
+      g_signal_emit (screen, signals[CLOSE_SCREEN], 0);
+      break;
+    case RESPONSE_RELAUNCH:
+      gtk_widget_destroy (info_bar);
+      /* The user is watching; start the restart policy over */
+      screen->priv->restart_backoff = 0;
+      g_array_set_size (screen->priv->restart_times, 0);
+      _terminal_screen_launch_child_on_idle (screen);
+      break;
+    case RESPONSE_EDIT_PROFILE:
+      terminal_app_edit_profile (terminal_app_get (),
+                                 terminal_screen_get_profile (screen),
+                                 GTK_WINDOW (terminal_screen_get_window (screen)),
+                                 "custom-command-entry");
+      break;
+    default:
+      gtk_widget_destroy (info_bar);
+      break;
+  }
+}
+
+static void
+free_child_setup_data (ChildSetupData *data)
+{
+  if (data == NULL)
+    return;
+
+  if (data->cgroup_procs_fd != -1)
+    close (data->cgroup_procs_fd);
+
+  g_free (data->fd_list);
+  g_free (data);
+}
+
+static gboolean
+parse_cpu_list (const char *list,
+                cpu_set_t *set)
+{
+  char **ranges;
+  guint i;
+  gboolean ok = TRUE;
+
+  CPU_ZERO (set);
+
+  ranges = g_strsplit (list, ",", -1);
+  for (i = 0; ok && ranges[i] != NULL; i++) {
+    char *range = g_strstrip (ranges[i]);
+    char *end;
+    guint64 first, last;
+
+    first = last = g_ascii_strtoull (range, &end, 10);
+    if (end == range)
+      ok = FALSE;
+    else if (*end == '-') {
+      range = end + 1;
+      last = g_ascii_strtoull (range, &end, 10);
+      if (end == range)
+        ok = FALSE;
+    }
+
+    if (!ok || *end != '\0' || first > last || last >= CPU_SETSIZE) {
+      ok = FALSE;
+      break;
+    }
+
+    for ( ; first <= last; first++)
+      CPU_SET (first, set);
+  }
+  g_strfreev (ranges);
+
+  return ok;
+}
+
+static gboolean
+add_resource_limits (ChildSetupData *data,
+                     GVariant *limits,
+                     GError **error)
+{
+  GVariantIter iter;
+  const char *name;
+  guint64 value;
+  guint i;
+
+  g_variant_iter_init (&iter, limits);
+  while (g_variant_iter_next (&iter, "{&st}", &name, &value)) {
+    for (i = 0; i < G_N_ELEMENTS (rlimit_names); i++)
+      if (strcmp (name, rlimit_names[i].name) == 0)
+        break;
+
+    if (i == G_N_ELEMENTS (rlimit_names)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                   _("\"%s\" is not a valid resource limit"), name);
+      return FALSE;
+    }
+
+    data->rlimits[i].set = TRUE;
+    data->rlimits[i].value = value == G_MAXUINT64 ? RLIM_INFINITY : (rlim_t) value;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+enum_from_nick (GType type,
+                const char *nick,
+                int *value,
+                GError **error)
+{
+  GEnumClass *klass;
+  GEnumValue *eval;
+
+  klass = g_type_class_ref (type);
+  eval = g_enum_get_value_by_nick (klass, nick);
+  if (eval != NULL)
+    *value = eval->value;
+  else
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 _("\"%s\" is not a valid value for %s"), nick, g_type_name (type));
+  g_type_class_unref (klass);
+
+  return eval != NULL;
+}
+
+/* Resolves the profile's scheduling and resource limit settings, and
+ * the overrides passed to terminal_screen_exec(), into @data.
+ */
+static gboolean
+terminal_screen_resolve_child_resources (TerminalScreen *screen,
+                                         ChildSetupData *data,
+                                         GError **error)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  GVariant *overrides = priv->resource_overrides;
+  GVariant *limits;
+  const char *str;
+  char *affinity;
+  int nice, policy, io_class;
+  gboolean ok = FALSE;
+
+  nice = g_settings_get_int (profile, TERMINAL_PROFILE_NICE_KEY);
+  policy = g_settings_get_enum (profile, TERMINAL_PROFILE_SCHEDULING_POLICY_KEY);
+  io_class = g_settings_get_enum (profile, TERMINAL_PROFILE_IO_PRIORITY_CLASS_KEY);
+  affinity = g_settings_get_string (profile, TERMINAL_PROFILE_CPU_AFFINITY_KEY);
+
+  limits = g_settings_get_value (profile, TERMINAL_PROFILE_RESOURCE_LIMITS_KEY);
+  if (!add_resource_limits (data, limits, error)) {
+    g_variant_unref (limits);
+    goto out;
+  }
+  g_variant_unref (limits);
+
+  if (overrides != NULL) {
+    g_variant_lookup (overrides, "nice", "i", &nice);
+    if (g_variant_lookup (overrides, "scheduling-policy", "&s", &str) &&
+        !enum_from_nick (TERMINAL_TYPE_SCHEDULING_POLICY, str, &policy, error))
+      goto out;
+    if (g_variant_lookup (overrides, "io-priority-class", "&s", &str) &&
+        !enum_from_nick (TERMINAL_TYPE_IO_PRIORITY_CLASS, str, &io_class, error))
+      goto out;
+    if (g_variant_lookup (overrides, "cpu-affinity", "&s", &str)) {
+      g_free (affinity);
+      affinity = g_strdup (str);
+    }
+
+    limits = g_variant_lookup_value (overrides, "resource-limits", G_VARIANT_TYPE ("a{st}"));
+    if (limits != NULL) {
+      if (!add_resource_limits (data, limits, error)) {
+        g_variant_unref (limits);
+        goto out;
+      }
+      g_variant_unref (limits);
+    }
+  }
+
+  data->nice = CLAMP (nice, -20, 19);
+
+  switch (policy) {
+    case TERMINAL_SCHEDULING_POLICY_BATCH:
+      data->sched_policy = SCHED_BATCH;
+      break;
+    case TERMINAL_SCHEDULING_POLICY_IDLE:
+      data->sched_policy = SCHED_IDLE;
+      break;
+    default:
+      data->sched_policy = -1;
+      break;
+  }
+
+  switch (io_class) {
+    case TERMINAL_IO_PRIORITY_CLASS_BEST_EFFORT:
+      /* Same as the kernel's default for the nice value */
+      data->ioprio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | ((data->nice + 20) / 5);
+      break;
+    case TERMINAL_IO_PRIORITY_CLASS_IDLE:
+      data->ioprio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+      break;
+    default:
+      data->ioprio = -1;
+      break;
+  }
+
+  data->set_affinity = affinity[0] != '\0';
+  if (data->set_affinity && !parse_cpu_list (affinity, &data->affinity)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 _("\"%s\" is not a valid list of CPUs"), affinity);
+    goto out;
+  }
+
+  ok = TRUE;
+
+out:
+  g_free (affinity);
+  return ok;
+}
+
+static void
+terminal_screen_child_setup_resources (ChildSetupData *data)
+{
+  guint i;
+
+  /* These are best effort; the command runs anyway */
+
+  if (data->sched_policy != -1) {
+    struct sched_param param = { 0 };
+
+    sched_setscheduler (0, data->sched_policy, &param);
+  }
+
+  if (data->nice != 0)
+    setpriority (PRIO_PROCESS, 0, data->nice);
+
+#ifdef SYS_ioprio_set
+  if (data->ioprio != -1)
+    syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, data->ioprio);
+#endif
+
+  if (data->set_affinity)
+    sched_setaffinity (0, sizeof (data->affinity), &data->affinity);
+
+  for (i = 0; i < G_N_ELEMENTS (rlimit_names); i++) {
+    struct rlimit limit;
+
+    if (!data->rlimits[i].set ||
+        getrlimit (rlimit_names[i].resource, &limit) != 0)
+      continue;
+
+    /* Only ever lower it, so it works without privileges */
+    limit.rlim_cur = limit.rlim_max = MIN (data->rlimits[i].value, limit.rlim_max);
+    setrlimit (rlimit_names[i].resource, &limit);
+  }
+}
+
+static void
+terminal_screen_child_setup_fds (ChildSetupData *data)
+{
+  int *fds = data->fd_list;
+  int n_fds = data->fd_list_len;
+  const int *fd_array = data->fd_array;
+  gsize fd_array_len = data->fd_array_len;
+  gsize i;
+
+  /* At this point, vte_pty_child_setup() has been called,
+   * so all FDs are FD_CLOEXEC.
+   */
+
+  if (fd_array_len == 0)
+    return;
+
+  for (i = 0; i < fd_array_len; i++) {
+    int target_fd = fd_array[2 * i];
+    int idx = fd_array[2 * i + 1];
+    int fd, r;
+
+    g_assert (idx >= 0 && idx < n_fds);
+
+    /* We want to move fds[idx] to target_fd */
+
+    if (target_fd != fds[idx]) {
+      int j;
+
+      /* Need to check if @target_fd is one of the FDs in the FD list! */
+      for (j = 0; j < n_fds; j++) {
+        if (fds[j] == target_fd) {
+          do {
+            fd = fcntl (fds[j], F_DUPFD_CLOEXEC, 10);
+          } while (fd == -1 && errno == EINTR);
+          if (fd == -1)
+            _exit (127);
+
+          fds[j] = fd;
+          break;
+        }
+      }
+    }
+
+    if (target_fd == fds[idx]) {
+      /* Remove FD_CLOEXEC from target_fd */
+      do {
+        r = fcntl (target_fd, F_SETFD, 0 /* no FD_CLOEXEC */);
+      } while (r == -1 && errno == EINTR);
+      if (r == -1)
+        _exit (127);
+    } else {
+      /* Now we know that target_fd can be safely overwritten. */
+      errno = 0;
+      do {
+        fd = dup3 (fds[idx], target_fd, 0 /* no FD_CLOEXEC */);
+      } while (fd == -1 && errno == EINTR);
+      if (fd != target_fd)
+        _exit (127);
+    }
+
+    /* Don't need to close it here since it's FD_CLOEXEC or consumed */
+    fds[idx] = -1;
+  }
+}
+
+static void
+terminal_screen_child_setup (ChildSetupData *data)
+{
+  /* What VTE does itself when it spawns the child */
+  if (data->pty != NULL)
+    vte_pty_child_setup (data->pty);
+
+  /* Before moving the FDs, which may replace this one */
+  if (data->cgroup_procs_fd != -1) {
+    int r;
+
+    do {
+      r = write (data->cgroup_procs_fd, "0", 1);
+    } while (r == -1 && errno == EINTR);
+  }
+
+  terminal_screen_child_setup_fds (data);
+
+  /* After moving the FDs, since this may lower RLIMIT_NOFILE */
+  terminal_screen_child_setup_resources (data);
+}
+
+/* Puts the child into a cgroup of its own, if possible */
+static void
+terminal_screen_prepare_cgroup (TerminalScreen *screen,
+                                ChildSetupData *data)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  GError *error = NULL;
+
+  if (priv->cgroup == NULL)
+    priv->cgroup = terminal_cgroup_new (g_settings_get_boolean (terminal_app_get_global_settings (terminal_app_get ()),
+                                                                TERMINAL_SETTING_CGROUP_ASSUME_DELEGATED_KEY),
+                                        &error);
+  if (priv->cgroup == NULL) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] not using a cgroup: %s\n",
+                           screen, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  terminal_cgroup_set_limits (priv->cgroup,
+                              g_settings_get_uint (profile, TERMINAL_PROFILE_CGROUP_CPU_QUOTA_KEY),
+                              g_settings_get_uint64 (profile, TERMINAL_PROFILE_CGROUP_MEMORY_MAX_KEY),
+                              g_settings_get_uint (profile, TERMINAL_PROFILE_CGROUP_IO_WEIGHT_KEY));
+
+  data->cgroup_procs_fd = terminal_cgroup_open_procs (priv->cgroup, &error);
+  if (data->cgroup_procs_fd == -1) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] not using a cgroup: %s\n",
+                           screen, error->message);
+    g_error_free (error);
+  }
+}
+
+static void
+terminal_screen_sync_child_size (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  int rows, columns;
+
+  if (priv->child_pty == NULL)
+    return;
+
+  rows = vte_terminal_get_row_count (terminal);
+  columns = vte_terminal_get_column_count (terminal);
+  vte_pty_set_size (priv->child_pty, rows, columns, NULL);
+  terminal_recorder_set_size (priv->recorder, columns, rows);
+}
+
+static void
+terminal_screen_stop_recording (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  /* Nothing left to act on */
+  priv->draining_recorder = FALSE;
+  g_clear_object (&priv->recorded_pty);
+
+  if (priv->recorder == NULL)
+    return;
+
+  terminal_recorder_free (priv->recorder);
+  priv->recorder = NULL;
+  g_clear_object (&priv->child_pty);
+}
+
+/* Opens the other end of @master as a plain byte pipe */
+static int
+open_raw_pty_slave (int master,
+                    GError **error)
+{
+  struct termios attrs;
+  const char *name;
+  int fd, errsv;
+
+  name = ptsname (master);
+  if (name == NULL ||
+      (fd = open (name, O_RDWR | O_NOCTTY | O_CLOEXEC)) == -1) {
+    errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                 "Failed to open the terminal's PTY: %s", g_strerror (errsv));
+    return -1;
+  }
+
+  if (tcgetattr (fd, &attrs) == 0) {
+    cfmakeraw (&attrs);
+    tcsetattr (fd, TCSANOW, &attrs);
+  }
+
+  return fd;
+}
+
+/* Like vte_terminal_fork_command_full(), but with the child on a PTY of
+ * its own, and a recorder relaying between that and the terminal's.
+ */
+static gboolean
+terminal_screen_spawn_recorded (TerminalScreen *screen,
+                                VtePtyFlags pty_flags,
+                                const char *working_dir,
+                                char **argv,
+                                char **env,
+                                GSpawnFlags spawn_flags,
+                                ChildSetupData *data,
+                                GPid *pid,
+                                GError **error)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  GSettings *profile = priv->profile;
+  VtePty *child_pty = NULL, *terminal_pty = NULL;
+  TerminalRecorder *recorder = NULL;
+  char **child_env = NULL;
+  char *directory, *name;
+  int fd;
+  gboolean result = FALSE;
+
+  directory = g_settings_get_string (profile, TERMINAL_PROFILE_RECORD_DIRECTORY_KEY);
+  if (directory[0] == '\0')
+    {
+      g_free (directory);
+      directory = g_build_filename (g_get_user_data_dir (), "gnome-terminal", "recordings", NULL);
+    }
+  name = g_path_get_basename (argv[0]);
+
+  child_pty = vte_pty_new (pty_flags, error);
+  if (child_pty == NULL)
+    goto out;
+
+  /* Only the child's PTY is a session, so keep this one out of utmp */
+  terminal_pty = vte_terminal_pty_new (terminal,
+                                       VTE_PTY_NO_LASTLOG | VTE_PTY_NO_UTMP | VTE_PTY_NO_WTMP,
+                                       error);
+  if (terminal_pty == NULL)
+    goto out;
+
+  fd = open_raw_pty_slave (vte_pty_get_fd (terminal_pty), error);
+  if (fd == -1)
+    goto out;
+
+  vte_pty_set_size (child_pty,
+                    vte_terminal_get_row_count (terminal),
+                    vte_terminal_get_column_count (terminal),
+                    NULL);
+
+  recorder = terminal_recorder_new (vte_pty_get_fd (child_pty), fd,
+                                    directory, name,
+                                    g_settings_get_uint64 (profile, TERMINAL_PROFILE_RECORD_MAX_SIZE_KEY),
+                                    g_settings_get_boolean (profile, TERMINAL_PROFILE_RECORD_TIMING_KEY),
+                                    error);
+  if (recorder == NULL)
+    goto out;
+
+  terminal_recorder_set_size (recorder,
+                              vte_terminal_get_column_count (terminal),
+                              vte_terminal_get_row_count (terminal));
+
+  child_env = g_environ_setenv (g_strdupv (env), "TERM", vte_terminal_get_emulation (terminal), TRUE);
+
+  data->pty = child_pty;
+  result = g_spawn_async (working_dir, argv, child_env,
+                          spawn_flags | G_SPAWN_DO_NOT_REAP_CHILD,
+                          (GSpawnChildSetupFunc) terminal_screen_child_setup, data,
+                          pid, error);
+  data->pty = NULL;
+  if (!result)
+    goto out;
+
+  vte_terminal_set_pty_object (terminal, terminal_pty);
+  vte_terminal_watch_child (terminal, *pid);
+
+  priv->child_pty = child_pty;
+  priv->recorded_pty = g_object_ref (terminal_pty);
+  priv->recorder = recorder;
+  child_pty = NULL;
+  recorder = NULL;
+
+out:
+  terminal_recorder_free (recorder);
+  if (child_pty != NULL)
+    g_object_unref (child_pty);
+  if (terminal_pty != NULL)
+    g_object_unref (terminal_pty);
+  g_strfreev (child_env);
+  g_free (directory);
+  g_free (name);
+
+  return result;
+}
+
+static gboolean
+terminal_screen_spawn (TerminalScreen *screen,
+                       VtePtyFlags pty_flags,
+                       const char *working_dir,
+                       char **argv,
+                       char **env,
+                       GSpawnFlags spawn_flags,
+                       ChildSetupData *data,
+                       GPid *pid,
+                       GError **error)
+{
+  if (g_settings_get_boolean (screen->priv->profile, TERMINAL_PROFILE_RECORD_OUTPUT_KEY))
+    return terminal_screen_spawn_recorded (screen, pty_flags, working_dir, argv, env,
+                                           spawn_flags, data, pid, error);
+
+  return vte_terminal_fork_command_full (VTE_TERMINAL (screen),
+                                         pty_flags,
+                                         working_dir,
+                                         argv,
+                                         env,
+                                         spawn_flags,
+                                         (GSpawnChildSetupFunc) terminal_screen_child_setup,
+                                         data,
+                                         pid,
+                                         error);
+}
+
+static gboolean
+terminal_screen_do_exec (TerminalScreen *screen,
+                         ChildSetupData *data /* adopting */,
+                         GError        **error)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  GSettings *profile;
+  char **env, **argv;
+  char *shell = NULL;
+  GError *err = NULL;
+  const char *working_dir;
+  VtePtyFlags pty_flags = VTE_PTY_DEFAULT;
+  GSpawnFlags spawn_flags = 0;
+  GPid pid;
+  gboolean result = FALSE;
+  gboolean spawned;
+  const char *phase;
+  gint64 spawn_start;
+
+  if (priv->child_pid != -1) {
+    g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                         "Cannot launch a new child process while the terminal is still running another child process");
+    return FALSE;
+  }
+  if (priv->viewer != NULL) {
+    g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                         "Cannot launch a child process in a terminal that is viewing a file");
+    return FALSE;
+  }
+
+  priv->launch_child_source_id = 0;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] now launching the child process\n",
+                         screen);
+
+  phase = terminal_watchdog_enter ("terminal_screen_do_exec");
+
+  profile = priv->profile;
+
+  if (priv->initial_working_directory)
+    working_dir = priv->initial_working_directory;
+  else
+    working_dir = g_get_home_dir ();
+
+  terminal_trace_begin (priv->trace, "build-environment");
+  env = get_child_environment (screen, working_dir, &shell);
+  terminal_trace_end (priv->trace, "build-environment");
+
+  if (!g_settings_get_boolean (profile, TERMINAL_PROFILE_LOGIN_SHELL_KEY))
+    pty_flags |= VTE_PTY_NO_LASTLOG;
+  if (!g_settings_get_boolean (profile, TERMINAL_PROFILE_UPDATE_RECORDS_KEY))
+    pty_flags |= VTE_PTY_NO_UTMP | VTE_PTY_NO_WTMP;
+
+  if (data == NULL)
+    data = g_new0 (ChildSetupData, 1);
+  data->cgroup_procs_fd = -1;
 
-  *argv_p = argv;
+  terminal_screen_prepare_cgroup (screen, data);
+
+  terminal_trace_begin (priv->trace, "fork-exec");
+  spawn_start = g_get_monotonic_time ();
+  argv = NULL;
+  spawned = (get_child_command (screen, shell, &spawn_flags, &argv, &err) &&
+             terminal_screen_resolve_child_resources (screen, data, &err) &&
+             terminal_screen_spawn (screen,
+                                    pty_flags,
+                                    working_dir,
+                                    argv,
+                                    env,
+                                    spawn_flags,
+                                    data,
+                                    &pid,
+                                    &err));
+  terminal_trace_end (priv->trace, "fork-exec");
+
+  if (!spawned) {
+    GtkWidget *info_bar;
+
+    info_bar = terminal_info_bar_new (GTK_MESSAGE_ERROR,
+                                      _("_Profile Preferences"), RESPONSE_EDIT_PROFILE,
+                                      _("_Relaunch"), RESPONSE_RELAUNCH,
+                                      NULL);
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                   _("There was an error creating the child process for this terminal"));
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                   "%s", err->message);
+    g_signal_connect (info_bar, "response",
+                      G_CALLBACK (info_bar_response_cb), screen);
+
+    terminal_screen_show_info_bar (screen, info_bar, GTK_RESPONSE_CANCEL);
+
+    /* No output is coming */
+    terminal_screen_finish_trace (screen);
+
+    g_propagate_error (error, err);
+    goto out;
+  }
+
+  priv->child_pid = pid;
+  /* The foreground process group lives on the child's PTY */
+  if (priv->child_pty != NULL)
+    priv->pty_fd = vte_pty_get_fd (priv->child_pty);
+  else
+    priv->pty_fd = vte_terminal_get_pty (terminal);
+  priv->child_start_time = g_get_monotonic_time ();
+  priv->spawn_latency = priv->child_start_time - spawn_start;
+
+  /* A relaunch from elsewhere supersedes a pending restart */
+  terminal_screen_stop_restart (screen);
+
+  terminal_process_tracker_add_screen (terminal_app_get_process_tracker (terminal_app_get ()),
+                                       screen);
+
+  terminal_screen_deposit (screen, NULL, FALSE);
+
+  result = TRUE;
+
+out:
+  g_free (shell);
+  g_strfreev (argv);
+  g_strfreev (env);
+  free_child_setup_data (data);
+  terminal_watchdog_leave (phase);
+
+  return result;
+}
+
+static gboolean
+terminal_screen_launch_child_cb (TerminalScreen *screen)
+{
+  terminal_screen_do_exec (screen, NULL, NULL /* don't care */);
+  return FALSE; /* don't run again */
+}
+
+void
+_terminal_screen_launch_child_on_idle (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  if (priv->launch_child_source_id != 0)
+    return;
+
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] scheduling launching the child process on idle\n",
+                         screen);
+
+  priv->launch_child_source_id = g_idle_add ((GSourceFunc) terminal_screen_launch_child_cb, screen);
+}
+
+static TerminalScreenPopupInfo *
+terminal_screen_popup_info_new (TerminalScreen *screen)
+{
+  TerminalScreenPopupInfo *info;
+
+  info = g_slice_new0 (TerminalScreenPopupInfo);
+  info->ref_count = 1;
+  info->screen = g_object_ref (screen);
+  info->window = terminal_screen_get_window (screen);
+
+  return info;
+}
+
+TerminalScreenPopupInfo *
+terminal_screen_popup_info_ref (TerminalScreenPopupInfo *info)
+{
+  g_return_val_if_fail (info != NULL, NULL);
+
+  info->ref_count++;
+  return info;
+}
+
+void
+terminal_screen_popup_info_unref (TerminalScreenPopupInfo *info)
+{
+  g_return_if_fail (info != NULL);
+
+  if (--info->ref_count > 0)
+    return;
+
+  g_object_unref (info->screen);
+  g_free (info->string);
+  g_slice_free (TerminalScreenPopupInfo, info);
+}
+
+static gboolean
+terminal_screen_popup_menu (GtkWidget *widget)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  TerminalScreenPopupInfo *info;
+
+  info = terminal_screen_popup_info_new (screen);
+  info->button = 0;
+  info->timestamp = gtk_get_current_event_time ();
+
+  g_signal_emit (screen, signals[SHOW_POPUP_MENU], 0, info);
+  terminal_screen_popup_info_unref (info);
 
   return TRUE;
 }
 
-static char**
-get_child_environment (TerminalScreen *screen,
-                       const char *cwd,
-                       char **shell)
+static gboolean
+terminal_screen_button_press (GtkWidget      *widget,
+                              GdkEventButton *event)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (widget);
+  gboolean (* button_press_event) (GtkWidget*, GdkEventButton*) =
+    GTK_WIDGET_CLASS (terminal_screen_parent_class)->button_press_event;
+  int char_width, char_height, row, col;
+  char *matched_string;
+  int matched_flavor = 0;
+  guint state;
+  GtkBorder *inner_border = NULL;
+
+  state = event->state & gtk_accelerator_get_default_mod_mask ();
+
+  terminal_screen_get_cell_size (screen, &char_width, &char_height);
+
+  gtk_widget_style_get (widget, "inner-border", &inner_border, NULL);
+  row = (event->x - (inner_border ? inner_border->left : 0)) / char_width;
+  col = (event->y - (inner_border ? inner_border->top : 0)) / char_height;
+  gtk_border_free (inner_border);
+
+  /* FIXMEchpe: add vte API to do this check by widget coords instead of grid coords */
+  matched_string = terminal_screen_check_match (screen, row, col, &matched_flavor);
+
+  if (matched_string != NULL &&
+      (event->button == 1 || event->button == 2) &&
+      (state & GDK_CONTROL_MASK))
+    {
+      gboolean handled = FALSE;
+
+      g_signal_emit (screen, signals[MATCH_CLICKED], 0,
+                     matched_string,
+                     matched_flavor,
+                     state,
+                     &handled);
+      if (handled)
+        {
+          g_free (matched_string);
+          return TRUE; /* don't do anything else such as select with the click */
+        }
+    }
+
+  if (event->button == 3 &&
+      (state & (GDK_SHIFT_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK)) == 0)
+    {
+      TerminalScreenPopupInfo *info;
+
+      info = terminal_screen_popup_info_new (screen);
+      info->button = event->button;
+      info->state = state;
+      info->timestamp = event->time;
+      info->string = matched_string; /* adopted */
+      info->flavour = matched_flavor;
+
+      g_signal_emit (screen, signals[SHOW_POPUP_MENU], 0, info);
+      terminal_screen_popup_info_unref (info);
+
+      return TRUE;
+    }
+
+  g_free (matched_string);
+
+  /* default behavior is to let the terminal widget deal with it */
+  if (button_press_event)
+    return button_press_event (widget, event);
+
+  return FALSE;
+}
+
+static void
+terminal_screen_set_dynamic_title (TerminalScreen *screen,
+                                   const char     *title,
+				   gboolean	  userset)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+
+  g_assert (TERMINAL_IS_SCREEN (screen));
+  
+  if ((priv->user_title && !userset) ||
+      (priv->raw_title && title &&
+       strcmp (priv->raw_title, title) == 0))
+    return;
+
+  g_free (priv->raw_title);
+  priv->raw_title = g_strdup (title);
+  terminal_screen_cook_title (screen);
+}
+
+static void
+terminal_screen_set_dynamic_icon_title (TerminalScreen *screen,
+                                        const char     *icon_title,
+					gboolean       userset)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GObject *object = G_OBJECT (screen);
+  
+  g_assert (TERMINAL_IS_SCREEN (screen));
+
+  if ((priv->user_title && !userset) ||  
+      (priv->icon_title_set &&
+       priv->raw_icon_title &&
+       icon_title &&
+       strcmp (priv->raw_icon_title, icon_title) == 0))
+    return;
+
+  g_object_freeze_notify (object);
+
+  g_free (priv->raw_icon_title);
+  priv->raw_icon_title = g_strdup (icon_title);
+  priv->icon_title_set = TRUE;
+
+  g_object_notify (object, "icon-title-set");
+  terminal_screen_cook_icon_title (screen);
+
+  g_object_thaw_notify (object);
+}
+
+void
+terminal_screen_set_override_title (TerminalScreen *screen,
+                                    const char     *title)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  char *old_title;
+
+  old_title = priv->override_title;
+  priv->override_title = g_strdup (title);
+  g_free (old_title);
+
+  terminal_screen_set_dynamic_title (screen, title, FALSE);
+  terminal_screen_set_dynamic_icon_title (screen, title, FALSE);
+}
+
+const char*
+terminal_screen_get_dynamic_title (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+  
+  return screen->priv->raw_title;
+}
+
+const char*
+terminal_screen_get_dynamic_icon_title (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+  
+  return screen->priv->raw_icon_title;
+}
+
+/**
+ * terminal_screen_get_current_dir:
+ * @screen:
+ *
+ * Tries to determine the current working directory of the foreground process
+ * in @screen's PTY, falling back to the current working directory of the
+ * primary child.
+ * 
+ * Returns: a newly allocated string containing the current working directory,
+ *   or %NULL on failure
+ */
+char *
+terminal_screen_get_current_dir (TerminalScreen *screen)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GtkWidget *term = GTK_WIDGET (screen);
-  GtkWidget *window;
-  char **env;
-  char *e, *v;
-  GHashTable *env_table;
-  GHashTableIter iter;
-  GPtrArray *retval;
-  guint i;
+  const TerminalProcessInfo *info;
+  const char *uri;
 
-  window = gtk_widget_get_toplevel (term);
-  g_assert (window != NULL);
-  g_assert (gtk_widget_is_toplevel (window));
+  uri = vte_terminal_get_current_directory_uri (VTE_TERMINAL (screen));
+  if (uri != NULL)
+    return g_filename_from_uri (uri, NULL, NULL);
 
-  env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  /* No OSC 7 from the shell; use what the process tracker last saw in /proc */
+  info = terminal_process_tracker_lookup (terminal_app_get_process_tracker (terminal_app_get ()),
+                                          screen);
+  if (info != NULL && info->cwd != NULL)
+    return g_strdup (info->cwd);
 
-  /* First take the factory's environment */
-  env = g_listenv ();
-  for (i = 0; env[i]; ++i)
-    g_hash_table_insert (env_table, env[i], g_strdup (g_getenv (env[i])));
-  g_free (env); /* the strings themselves are now owned by the hash table */
+  if (screen->priv->initial_working_directory)
+    return g_strdup (screen->priv->initial_working_directory);
 
-  /* and then merge the child environment, if any */
-  env = priv->initial_env;
-  if (env)
-    {
-      for (i = 0; env[i]; ++i)
-        {
-          v = strchr (env[i], '=');
-          if (v)
-             g_hash_table_replace (env_table, g_strndup (env[i], v - env[i]), g_strdup (v + 1));
-           else
-             g_hash_table_replace (env_table, g_strdup (env[i]), NULL);
-        }
-    }
+  return NULL;
+}
 
-  g_hash_table_remove (env_table, "COLUMNS");
-  g_hash_table_remove (env_table, "LINES");
-  g_hash_table_remove (env_table, "GNOME_DESKTOP_ICON");
+void
+terminal_screen_set_font_scale (TerminalScreen *screen,
+                                double          factor)
+{
+  TerminalScreenPrivate *priv = screen->priv;
   
-  g_hash_table_replace (env_table, g_strdup ("COLORTERM"), g_strdup (EXECUTABLE_NAME));
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  if (factor < TERMINAL_SCALE_MINIMUM)
+    factor = TERMINAL_SCALE_MINIMUM;
+  if (factor > TERMINAL_SCALE_MAXIMUM)
+    factor = TERMINAL_SCALE_MAXIMUM;
   
-#ifdef GDK_WINDOWING_X11
-  if (GDK_IS_X11_SCREEN (gtk_widget_get_screen (window)))
+  priv->font_scale = factor;
+  
+  if (gtk_widget_get_realized (GTK_WIDGET (screen)))
     {
-      /* FIXME: moving the tab between windows, or the window between displays will make the next two invalid... */
-      g_hash_table_replace (env_table, g_strdup ("WINDOWID"),
-			    g_strdup_printf ("%ld",
-					     GDK_WINDOW_XID (gtk_widget_get_window (window))));
-      g_hash_table_replace (env_table, g_strdup ("DISPLAY"), g_strdup (gdk_display_get_name (gtk_widget_get_display (window))));
+      /* Update the font */
+      terminal_screen_change_font (screen);
     }
-#endif
-
-  /* We need to put the working directory also in PWD, so that
-   * e.g. bash starts in the right directory if @cwd is a symlink.
-   * See bug #502146.
-   */
-  g_hash_table_replace (env_table, g_strdup ("PWD"), g_strdup (cwd));
-
-  terminal_util_add_proxy_env (env_table);
+}
 
-  retval = g_ptr_array_sized_new (g_hash_table_size (env_table));
-  g_hash_table_iter_init (&iter, env_table);
-  while (g_hash_table_iter_next (&iter, (gpointer *) &e, (gpointer *) &v))
-    g_ptr_array_add (retval, g_strdup_printf ("%s=%s", e, v ? v : ""));
-  g_ptr_array_add (retval, NULL);
+double
+terminal_screen_get_font_scale (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 1.0);
+  
+  return screen->priv->font_scale;
+}
 
-  *shell = g_strdup (g_hash_table_lookup (env_table, "SHELL"));
+static void
+terminal_screen_window_title_changed (VteTerminal *vte_terminal,
+                                      TerminalScreen *screen)
+{
+  rate_counter_add (&screen->priv->title_changes);
 
-  g_hash_table_destroy (env_table);
-  return (char **) g_ptr_array_free (retval, FALSE);
+  terminal_screen_set_dynamic_title (screen,
+                                     vte_terminal_get_window_title (vte_terminal),
+				     FALSE);
 }
 
-enum {
-  RESPONSE_RELAUNCH,
-  RESPONSE_EDIT_PROFILE
-};
+static void
+terminal_screen_icon_title_changed (VteTerminal *vte_terminal,
+                                    TerminalScreen *screen)
+{
+  terminal_screen_set_dynamic_icon_title (screen,
+                                          vte_terminal_get_icon_title (vte_terminal),
+					  FALSE);
+}
 
 static void
-info_bar_response_cb (GtkWidget *info_bar,
-                      int response,
-                      TerminalScreen *screen)
+terminal_screen_show_exit_status (TerminalScreen *screen,
+                                  const char *reason)
 {
-  gtk_widget_grab_focus (GTK_WIDGET (screen));
+  GtkWidget *info_bar;
+  int status;
 
-  switch (response) {
-    case GTK_RESPONSE_CANCEL:
-      gtk_widget_destroy (info_bar);
-      g_signal_emit (screen, signals[CLOSE_SCREEN], 0);
-      break;
-    case RESPONSE_RELAUNCH:
-      gtk_widget_destroy (info_bar);
-      _terminal_screen_launch_child_on_idle (screen);
-      break;
-    case RESPONSE_EDIT_PROFILE:
-      terminal_app_edit_profile (terminal_app_get (),
-                                 terminal_screen_get_profile (screen),
-                                 GTK_WINDOW (terminal_screen_get_window (screen)),
-                                 "custom-command-entry");
-      break;
-    default:
-      gtk_widget_destroy (info_bar);
-      break;
+  status = vte_terminal_get_child_exit_status (VTE_TERMINAL (screen));
+
+  info_bar = terminal_info_bar_new (GTK_MESSAGE_INFO,
+                                    _("_Relaunch"), RESPONSE_RELAUNCH,
+                                    NULL);
+  if (WIFEXITED (status)) {
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                  _("The child process exited normally with status %d."), WEXITSTATUS (status));
+  } else if (WIFSIGNALED (status)) {
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                  _("The child process was aborted by signal %d."), WTERMSIG (status));
+  } else {
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
+                                  _("The child process was aborted."));
   }
+  if (reason != NULL)
+    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar), "%s", reason);
+
+  g_signal_connect (info_bar, "response",
+                    G_CALLBACK (info_bar_response_cb), screen);
+
+  terminal_screen_show_info_bar (screen, info_bar, RESPONSE_RELAUNCH);
 }
 
+/* Restart policy
+ *
+ * With exit-action "restart", a command that exits soon after it was
+ * started is restarted after restart-delay seconds, doubling with each
+ * quick exit in a row up to restart-delay-max. A command that exits
+ * more than restart-limit times within restart-limit-interval seconds
+ * is not restarted at all.
+ */
+
+enum {
+  RESPONSE_RESTART_NOW = 100
+};
+
 static void
-free_fd_setup_data (FDSetupData *data)
+terminal_screen_stop_restart (TerminalScreen *screen)
 {
-  if (data == NULL)
-    return;
+  TerminalScreenPrivate *priv = screen->priv;
 
-  g_free (data->fd_list);
-  g_free (data);
+  if (priv->restart_timer_id != 0)
+    {
+      terminal_timer_wheel_remove (terminal_app_get_timer_wheel (terminal_app_get ()),
+                                   priv->restart_timer_id);
+      priv->restart_timer_id = 0;
+    }
+
+  if (priv->restart_info_bar != NULL)
+    gtk_widget_destroy (priv->restart_info_bar);
+  priv->restart_label = NULL;
 }
 
 static void
-terminal_screen_child_setup (FDSetupData *data)
+terminal_screen_restart_child (TerminalScreen *screen)
 {
-  int *fds = data->fd_list;
-  int n_fds = data->fd_list_len;
-  const int *fd_array = data->fd_array;
-  gsize fd_array_len = data->fd_array_len;
-  gsize i;
-
-  /* At this point, vte_pty_child_setup() has been called,
-   * so all FDs are FD_CLOEXEC.
-   */
+  TerminalScreenPrivate *priv = screen->priv;
+  gint64 now;
 
-  if (fd_array_len == 0)
-    return;
+  terminal_screen_stop_restart (screen);
 
-  for (i = 0; i < fd_array_len; i++) {
-    int target_fd = fd_array[2 * i];
-    int idx = fd_array[2 * i + 1];
-    int fd, r;
+  now = g_get_monotonic_time ();
+  g_array_append_val (priv->restart_times, now);
+  priv->restart_count++;
+  g_object_notify (G_OBJECT (screen), "restart-count");
 
-    g_assert (idx >= 0 && idx < n_fds);
+  _terminal_screen_launch_child_on_idle (screen);
+}
 
-    /* We want to move fds[idx] to target_fd */
+static void
+terminal_screen_restart_countdown (TerminalScreen *screen);
 
-    if (target_fd != fds[idx]) {
-      int j;
+static void
+terminal_screen_restart_timeout_cb (TerminalScreen *screen)
+{
+  screen->priv->restart_timer_id = 0;
+  terminal_screen_restart_countdown (screen);
+}
 
-      /* Need to check if @target_fd is one of the FDs in the FD list! */
-      for (j = 0; j < n_fds; j++) {
-        if (fds[j] == target_fd) {
-          do {
-            fd = fcntl (fds[j], F_DUPFD_CLOEXEC, 10);
-          } while (fd == -1 && errno == EINTR);
-          if (fd == -1)
-            _exit (127);
+/* Updates the seconds left in the info bar, and restarts the child
+ * once there are none left.
+ */
+static void
+terminal_screen_restart_countdown (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  gint64 now, left, next;
+  guint seconds;
 
-          fds[j] = fd;
-          break;
-        }
-      }
+  now = g_get_monotonic_time ();
+  left = priv->restart_deadline - now;
+  if (left <= 0)
+    {
+      terminal_screen_restart_child (screen);
+      return;
     }
 
-    if (target_fd == fds[idx]) {
-      /* Remove FD_CLOEXEC from target_fd */
-      do {
-        r = fcntl (target_fd, F_SETFD, 0 /* no FD_CLOEXEC */);
-      } while (r == -1 && errno == EINTR);
-      if (r == -1)
-        _exit (127);
-    } else {
-      /* Now we know that target_fd can be safely overwritten. */
-      errno = 0;
-      do {
-        fd = dup3 (fds[idx], target_fd, 0 /* no FD_CLOEXEC */);
-      } while (fd == -1 && errno == EINTR);
-      if (fd != target_fd)
-        _exit (127);
+  seconds = (guint) ((left + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC);
+  /* The label goes away with the info bar */
+  if (priv->restart_info_bar != NULL)
+    {
+      char *text;
+
+      text = g_strdup_printf (ngettext ("The child process exited. Restarting it in %u second.",
+                                        "The child process exited. Restarting it in %u seconds.",
+                                        seconds),
+                              seconds);
+      gtk_label_set_text (GTK_LABEL (priv->restart_label), text);
+      g_free (text);
     }
 
-    /* Don't need to close it here since it's FD_CLOEXEC or consumed */
-    fds[idx] = -1;
-  }
+  /* Wake up when the count goes down */
+  next = priv->restart_deadline - (gint64) (seconds - 1) * G_USEC_PER_SEC;
+  priv->restart_timer_id = terminal_timer_wheel_add (terminal_app_get_timer_wheel (terminal_app_get ()),
+                                                     (guint) ((next - now + 999) / 1000),
+                                                     (TerminalTimerFunc) terminal_screen_restart_timeout_cb,
+                                                     screen);
 }
 
-static gboolean
-terminal_screen_do_exec (TerminalScreen *screen,
-                         FDSetupData    *data /* adopting */,
-                         GError        **error)
+static void
+restart_info_bar_response_cb (GtkWidget *info_bar,
+                              int response,
+                              TerminalScreen *screen)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  VteTerminal *terminal = VTE_TERMINAL (screen);
-  GSettings *profile;
-  char **env, **argv;
-  char *shell = NULL;
-  GError *err = NULL;
-  const char *working_dir;
-  VtePtyFlags pty_flags = VTE_PTY_DEFAULT;
-  GSpawnFlags spawn_flags = 0;
-  GPid pid;
-  gboolean result = FALSE;
+  gtk_widget_grab_focus (GTK_WIDGET (screen));
 
-  if (priv->child_pid != -1) {
-    g_set_error_literal (error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                         "Cannot launch a new child process while the terminal is still running another child process");
-    return FALSE;
+  switch (response) {
+    case RESPONSE_RESTART_NOW:
+      terminal_screen_restart_child (screen);
+      break;
+    default:
+      terminal_screen_stop_restart (screen);
+      screen->priv->restart_backoff = 0;
+      terminal_screen_show_exit_status (screen, NULL);
+      break;
   }
+}
+
+static void
+terminal_screen_schedule_restart (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSettings *profile = priv->profile;
+  guint delay, delay_max, limit, interval;
+  gint64 now;
+  guint i;
 
-  priv->launch_child_source_id = 0;
+  delay = g_settings_get_uint (profile, TERMINAL_PROFILE_RESTART_DELAY_KEY);
+  delay_max = g_settings_get_uint (profile, TERMINAL_PROFILE_RESTART_DELAY_MAX_KEY);
+  limit = g_settings_get_uint (profile, TERMINAL_PROFILE_RESTART_LIMIT_KEY);
+  interval = g_settings_get_uint (profile, TERMINAL_PROFILE_RESTART_LIMIT_INTERVAL_KEY);
+  now = g_get_monotonic_time ();
 
-  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
-                         "[screen %p] now launching the child process\n",
-                         screen);
+  /* Forget the restarts that are out of the interval */
+  for (i = 0; i < priv->restart_times->len; i++)
+    if (now - g_array_index (priv->restart_times, gint64, i) < (gint64) interval * G_USEC_PER_SEC)
+      break;
+  g_array_remove_range (priv->restart_times, 0, i);
 
-  profile = priv->profile;
+  if (limit != 0 && priv->restart_times->len >= limit)
+    {
+      char *reason;
+
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "[screen %p] restarted %u times in %us, giving up\n",
+                             screen, priv->restart_times->len, interval);
+
+      reason = g_strdup_printf (ngettext ("It was restarted %u time in the last %u seconds, and will not be restarted again.",
+                                          "It was restarted %u times in the last %u seconds, and will not be restarted again.",
+                                          priv->restart_times->len),
+                                priv->restart_times->len, interval);
+      terminal_screen_show_exit_status (screen, reason);
+      g_free (reason);
+
+      priv->restart_backoff = 0;
+      g_array_set_size (priv->restart_times, 0);
+      return;
+    }
 
-  if (priv->initial_working_directory)
-    working_dir = priv->initial_working_directory;
-  else
-    working_dir = g_get_home_dir ();
+  /* A command that ran for a while is restarted right away */
+  if (now - priv->child_start_time >= (gint64) delay_max * G_USEC_PER_SEC)
+    {
+      priv->restart_backoff = 0;
+      terminal_screen_restart_child (screen);
+      return;
+    }
 
-  env = get_child_environment (screen, working_dir, &shell);
+  for (i = 0; i < priv->restart_backoff && delay < delay_max; i++)
+    delay *= 2;
+  delay = MIN (delay, delay_max);
+  priv->restart_backoff++;
 
-  if (!g_settings_get_boolean (profile, TERMINAL_PROFILE_LOGIN_SHELL_KEY))
-    pty_flags |= VTE_PTY_NO_LASTLOG;
-  if (!g_settings_get_boolean (profile, TERMINAL_PROFILE_UPDATE_RECORDS_KEY))
-    pty_flags |= VTE_PTY_NO_UTMP | VTE_PTY_NO_WTMP;
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] child exited quickly, restarting in %us\n",
+                         screen, delay);
+
+  priv->restart_info_bar = terminal_info_bar_new (GTK_MESSAGE_WARNING,
+                                                  _("Restart _Now"), RESPONSE_RESTART_NOW,
+                                                  GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                                  NULL);
+  g_object_add_weak_pointer (G_OBJECT (priv->restart_info_bar),
+                             (gpointer *) &priv->restart_info_bar);
+  /* The countdown fills in the text */
+  priv->restart_label = terminal_info_bar_format_text (TERMINAL_INFO_BAR (priv->restart_info_bar),
+                                                       "%s", "");
+  g_signal_connect (priv->restart_info_bar, "response",
+                    G_CALLBACK (restart_info_bar_response_cb), screen);
+
+  terminal_screen_show_info_bar (screen, priv->restart_info_bar, GTK_RESPONSE_CANCEL);
+
+  priv->restart_deadline = g_get_monotonic_time () + (gint64) delay * G_USEC_PER_SEC;
+  terminal_screen_restart_countdown (screen);
+}
 
-  argv = NULL;
-  if (!get_child_command (screen, shell, &spawn_flags, &argv, &err) ||
-      !vte_terminal_fork_command_full (terminal,
-                                       pty_flags,
-                                       working_dir,
-                                       argv,
-                                       env,
-                                       spawn_flags,
-                                       (GSpawnChildSetupFunc) (data ? terminal_screen_child_setup : NULL), 
-                                       data,
-                                       &pid,
-                                       &err)) {
-    GtkWidget *info_bar;
+static void
+terminal_screen_eof (VteTerminal *terminal)
+{
+  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
+  TerminalScreenPrivate *priv = screen->priv;
 
-    info_bar = terminal_info_bar_new (GTK_MESSAGE_ERROR,
-                                      _("_Profile Preferences"), RESPONSE_EDIT_PROFILE,
-                                      _("_Relaunch"), RESPONSE_RELAUNCH,
-                                      NULL);
-    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                   _("There was an error creating the child process for this terminal"));
-    terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                   "%s", err->message);
-    g_signal_connect (info_bar, "response",
-                      G_CALLBACK (info_bar_response_cb), screen);
+  /* An adopted child can't be waited for, so this is all we get */
+  if (!priv->adopted)
+    return;
 
-    gtk_box_pack_start (GTK_BOX (terminal_screen_container_get_from_screen (screen)),
-                        info_bar, FALSE, FALSE, 0);
-    gtk_info_bar_set_default_response (GTK_INFO_BAR (info_bar), GTK_RESPONSE_CANCEL);
-    gtk_widget_show (info_bar);
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] adopted child hung up\n",
+                         screen);
 
-    g_propagate_error (error, err);
-    goto out;
-  }
+  priv->adopted = FALSE;
+  g_signal_emit_by_name (screen, "child-exited");
+}
 
-  priv->child_pid = pid;
-  priv->pty_fd = vte_terminal_get_pty (terminal);
+static void terminal_screen_do_exit_action (TerminalScreen *screen);
 
-  result = TRUE;
+static void
+terminal_screen_recorder_drained_cb (GBytes *tail,
+                                     TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  char buffer[4096];
+  ssize_t n;
+  int fd;
 
-out:
-  g_free (shell);
-  g_strfreev (argv);
-  g_strfreev (env);
-  free_fd_setup_data (data);
+  if (priv->draining_recorder)
+    {
+      priv->draining_recorder = FALSE;
 
-  return result;
-}
+      /* First what the relay wrote but VTE didn't read before the
+       * child exited, then what the relay still had
+       */
+      if (priv->recorded_pty != NULL)
+        {
+          fd = vte_pty_get_fd (priv->recorded_pty);
+          fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+          while ((n = read (fd, buffer, sizeof (buffer))) > 0)
+            vte_terminal_feed (terminal, buffer, n);
+        }
+      if (g_bytes_get_size (tail) > 0)
+        vte_terminal_feed (terminal,
+                           g_bytes_get_data (tail, NULL),
+                           g_bytes_get_size (tail));
+      g_clear_object (&priv->recorded_pty);
 
-static gboolean
-terminal_screen_launch_child_cb (TerminalScreen *screen)
-{
-  terminal_screen_do_exec (screen, NULL, NULL /* don't care */);
-  return FALSE; /* don't run again */
+      terminal_screen_do_exit_action (screen);
+    }
+
+  g_object_unref (screen);
 }
 
-void
-_terminal_screen_launch_child_on_idle (TerminalScreen *screen)
+static void
+terminal_screen_child_exited (VteTerminal *terminal)
 {
+  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
   TerminalScreenPrivate *priv = screen->priv;
 
-  if (priv->launch_child_source_id != 0)
-    return;
+  /* No need to chain up to VteTerminalClass::child_exited since it's NULL */
 
   _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
-                         "[screen %p] scheduling launching the child process on idle\n",
+                         "[screen %p] child process exited\n",
                          screen);
 
-  priv->launch_child_source_id = g_idle_add ((GSourceFunc) terminal_screen_launch_child_cb, screen);
-}
+  /* Bring back the contents, and whatever the child wrote last */
+  terminal_flood_governor_reset (priv->flood_governor);
+  terminal_screen_thaw (screen);
 
-static TerminalScreenPopupInfo *
-terminal_screen_popup_info_new (TerminalScreen *screen)
-{
-  TerminalScreenPopupInfo *info;
+  terminal_process_tracker_remove_screen (terminal_app_get_process_tracker (terminal_app_get ()),
+                                          screen);
 
-  info = g_slice_new0 (TerminalScreenPopupInfo);
-  info->ref_count = 1;
-  info->screen = g_object_ref (screen);
-  info->window = terminal_screen_get_window (screen);
+  priv->child_pid = -1;
+  priv->pty_fd = -1;
+  priv->adopted = FALSE;
+  terminal_screen_forget_deposit (screen);
 
-  return info;
+  /* Whatever input is left has nobody to read it */
+  terminal_feeder_free (priv->feeder);
+  priv->feeder = NULL;
+
+  /* Removes it, unless something the child started is still running */
+  terminal_cgroup_free (priv->cgroup);
+  priv->cgroup = NULL;
+
+  /* The relay may still have some of what the child wrote last */
+  if (priv->recorder != NULL)
+    {
+      priv->draining_recorder = TRUE;
+      terminal_recorder_stop (priv->recorder,
+                              (TerminalRecorderDrainedFunc) terminal_screen_recorder_drained_cb,
+                              g_object_ref (screen));
+      priv->recorder = NULL;
+      g_clear_object (&priv->child_pty);
+      return;
+    }
+
+  terminal_screen_do_exit_action (screen);
 }
 
-TerminalScreenPopupInfo *
-terminal_screen_popup_info_ref (TerminalScreenPopupInfo *info)
+static void
+terminal_screen_do_exit_action (TerminalScreen *screen)
 {
-  g_return_val_if_fail (info != NULL, NULL);
+  TerminalScreenPrivate *priv = screen->priv;
+  TerminalExitAction action;
 
-  info->ref_count++;
-  return info;
+  action = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_EXIT_ACTION_KEY);
+  
+  switch (action)
+    {
+    case TERMINAL_EXIT_CLOSE:
+      g_signal_emit (screen, signals[CLOSE_SCREEN], 0);
+      break;
+    case TERMINAL_EXIT_RESTART:
+      terminal_screen_schedule_restart (screen);
+      break;
+    case TERMINAL_EXIT_HOLD:
+      terminal_screen_show_exit_status (screen, NULL);
+      break;
+
+    default:
+      break;
+    }
 }
 
 void
-terminal_screen_popup_info_unref (TerminalScreenPopupInfo *info)
+terminal_screen_set_user_title (TerminalScreen *screen,
+                                const char *text)
 {
-  g_return_if_fail (info != NULL);
-
-  if (--info->ref_count > 0)
-    return;
+  TerminalScreenPrivate *priv = screen->priv;
 
-  g_object_unref (info->screen);
-  g_free (info->string);
-  g_slice_free (TerminalScreenPopupInfo, info);
+  /* The user set the title to nothing, let's understand that as a
+     request to revert to dynamically setting the title again. */
+  if (!text || !text[0])
+    priv->user_title = FALSE;
+  else
+    {
+      priv->user_title = TRUE;
+      terminal_screen_set_dynamic_title (screen, text, TRUE);
+      terminal_screen_set_dynamic_icon_title (screen, text, TRUE);
+    }
 }
 
-static gboolean
-terminal_screen_popup_menu (GtkWidget *widget)
+static void
+terminal_screen_drag_data_received (GtkWidget        *widget,
+                                    GdkDragContext   *context,
+                                    gint              x,
+                                    gint              y,
+                                    GtkSelectionData *selection_data,
+                                    guint             info,
+                                    guint             timestamp)
 {
   TerminalScreen *screen = TERMINAL_SCREEN (widget);
-  TerminalScreenPopupInfo *info;
+  TerminalScreenPrivate *priv = screen->priv;
+  const guchar *selection_data_data;
+  GdkAtom selection_data_target;
+  gint selection_data_length, selection_data_format;
 
-  info = terminal_screen_popup_info_new (screen);
-  info->button = 0;
-  info->timestamp = gtk_get_current_event_time ();
+  selection_data_data = gtk_selection_data_get_data (selection_data);
+  selection_data_target = gtk_selection_data_get_target (selection_data);
+  selection_data_length = gtk_selection_data_get_length (selection_data);
+  selection_data_format = gtk_selection_data_get_format (selection_data);
 
-  g_signal_emit (screen, signals[SHOW_POPUP_MENU], 0, info);
-  terminal_screen_popup_info_unref (info);
+#if 0
+  {
+    GList *tmp;
 
-  return TRUE;
-}
+    g_print ("info: %d\n", info);
+    tmp = context->targets;
+    while (tmp != NULL)
+      {
+        GdkAtom atom = GDK_POINTER_TO_ATOM (tmp->data);
+
+        g_print ("Target: %s\n", gdk_atom_name (atom));        
+        
+        tmp = tmp->next;
+      }
+
+    g_print ("Chosen target: %s\n", gdk_atom_name (selection_data->target));
+  }
+#endif
+
+  if (gtk_targets_include_uri (&selection_data_target, 1))
+    {
+      char **uris;
+      char *text;
+      gsize len;
+
+      uris = gtk_selection_data_get_uris (selection_data);
+      if (!uris)
+        return;
+
+      terminal_util_transform_uris_to_quoted_fuse_paths (uris);
+
+      text = terminal_util_concat_uris (uris, &len);
+      vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
+      g_free (text);
+
+      g_strfreev (uris);
+    }
+  else if (gtk_targets_include_text (&selection_data_target, 1))
+    {
+      char *text;
+
+      text = (char *) gtk_selection_data_get_text (selection_data);
+      if (text && text[0])
+        vte_terminal_feed_child (VTE_TERMINAL (screen), text, strlen (text));
+      g_free (text);
+    }
+  else switch (info)
+    {
+    case TARGET_COLOR:
+      {
+        guint16 *data = (guint16 *)selection_data_data;
+        GdkRGBA color;
+
+        /* We accept drops with the wrong format, since the KDE color
+         * chooser incorrectly drops application/x-color with format 8.
+         * So just check for the data length.
+         */
+        if (selection_data_length != 8)
+          return;
+
+        color.red = (double) data[0] / 65535.;
+        color.green = (double) data[1] / 65535.;
+        color.blue = (double) data[2] / 65535.;
+        color.alpha = 1.;
+        /* FIXME: use opacity from data[3] */
+
+        terminal_g_settings_set_rgba (priv->profile,
+                                      TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
+                                      &color);
+        g_settings_set_boolean (priv->profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY, FALSE);
+      }
+      break;
+
+    case TARGET_MOZ_URL:
+      {
+        char *utf8_data, *newline, *text;
+        char *uris[2];
+        gsize len;
+        
+        /* MOZ_URL is in UCS-2 but in format 8. BROKEN!
+         *
+         * The data contains the URL, a \n, then the
+         * title of the web page.
+         */
+        if (selection_data_format != 8 ||
+            selection_data_length == 0 ||
+            (selection_data_length % 2) != 0)
+          return;
+
+        utf8_data = g_utf16_to_utf8 ((const gunichar2*) selection_data_data,
+                                     selection_data_length / 2,
+                                     NULL, NULL, NULL);
+        if (!utf8_data)
+          return;
 
-static gboolean
-terminal_screen_button_press (GtkWidget      *widget,
-                              GdkEventButton *event)
-{
-  TerminalScreen *screen = TERMINAL_SCREEN (widget);
-  gboolean (* button_press_event) (GtkWidget*, GdkEventButton*) =
-    GTK_WIDGET_CLASS (terminal_screen_parent_class)->button_press_event;
-  int char_width, char_height, row, col;
-  char *matched_string;
-  int matched_flavor = 0;
-  guint state;
-  GtkBorder *inner_border = NULL;
+        newline = strchr (utf8_data, '\n');
+        if (newline)
+          *newline = '\0';
 
-  state = event->state & gtk_accelerator_get_default_mod_mask ();
+        uris[0] = utf8_data;
+        uris[1] = NULL;
+        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
 
-  terminal_screen_get_cell_size (screen, &char_width, &char_height);
+        text = terminal_util_concat_uris (uris, &len);
+        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
+        g_free (text);
+        g_free (uris[0]);
+      }
+      break;
 
-  gtk_widget_style_get (widget, "inner-border", &inner_border, NULL);
-  row = (event->x - (inner_border ? inner_border->left : 0)) / char_width;
-  col = (event->y - (inner_border ? inner_border->top : 0)) / char_height;
-  gtk_border_free (inner_border);
+    case TARGET_NETSCAPE_URL:
+      {
+        char *utf8_data, *newline, *text;
+        char *uris[2];
+        gsize len;
+        
+        /* The data contains the URL, a \n, then the
+         * title of the web page.
+         */
+        if (selection_data_length < 0 || selection_data_format != 8)
+          return;
 
-  /* FIXMEchpe: add vte API to do this check by widget coords instead of grid coords */
-  matched_string = terminal_screen_check_match (screen, row, col, &matched_flavor);
+        utf8_data = g_strndup ((char *) selection_data_data, selection_data_length);
+        newline = strchr (utf8_data, '\n');
+        if (newline)
+          *newline = '\0';
 
-  if (matched_string != NULL &&
-      (event->button == 1 || event->button == 2) &&
-      (state & GDK_CONTROL_MASK))
-    {
-      gboolean handled = FALSE;
+        uris[0] = utf8_data;
+        uris[1] = NULL;
+        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
 
-      g_signal_emit (screen, signals[MATCH_CLICKED], 0,
-                     matched_string,
-                     matched_flavor,
-                     state,
-                     &handled);
-      if (handled)
-        {
-          g_free (matched_string);
-          return TRUE; /* don't do anything else such as select with the click */
-        }
-    }
+        text = terminal_util_concat_uris (uris, &len);
+        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
+        g_free (text);
+        g_free (uris[0]);
+      }
+      break;
 
-  if (event->button == 3 &&
-      (state & (GDK_SHIFT_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK)) == 0)
-    {
-      TerminalScreenPopupInfo *info;
+    case TARGET_RESET_BG:
+      g_settings_reset (priv->profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY);
+      break;
 
-      info = terminal_screen_popup_info_new (screen);
-      info->button = event->button;
-      info->state = state;
-      info->timestamp = event->time;
-      info->string = matched_string; /* adopted */
-      info->flavour = matched_flavor;
+    case TARGET_TAB:
+      {
+        GtkWidget *container;
+        TerminalScreen *moving_screen;
+        TerminalWindow *source_window;
+        TerminalWindow *dest_window;
 
-      g_signal_emit (screen, signals[SHOW_POPUP_MENU], 0, info);
-      terminal_screen_popup_info_unref (info);
+        container = *(GtkWidget**) selection_data_data;
+        if (!GTK_IS_WIDGET (container))
+          return;
 
-      return TRUE;
-    }
+        moving_screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (container));
+        g_warn_if_fail (TERMINAL_IS_SCREEN (moving_screen));
+        if (!TERMINAL_IS_SCREEN (moving_screen))
+          return;
 
-  g_free (matched_string);
+        source_window = terminal_screen_get_window (moving_screen);
+        dest_window = terminal_screen_get_window (screen);
+        terminal_window_move_screen (source_window, dest_window, moving_screen, -1);
 
-  /* default behavior is to let the terminal widget deal with it */
-  if (button_press_event)
-    return button_press_event (widget, event);
+        gtk_drag_finish (context, TRUE, TRUE, timestamp);
+      }
+      break;
 
-  return FALSE;
+    default:
+      g_assert_not_reached ();
+    }
 }
 
-static void
-terminal_screen_set_dynamic_title (TerminalScreen *screen,
-                                   const char     *title,
-				   gboolean	  userset)
+void
+_terminal_screen_update_scrollbar (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
+  TerminalScreenContainer *container;
+  GtkPolicyType vpolicy;
 
-  g_assert (TERMINAL_IS_SCREEN (screen));
-  
-  if ((priv->user_title && !userset) ||
-      (priv->raw_title && title &&
-       strcmp (priv->raw_title, title) == 0))
+  container = terminal_screen_container_get_from_screen (screen);
+  if (container == NULL)
     return;
 
-  g_free (priv->raw_title);
-  priv->raw_title = g_strdup (title);
-  terminal_screen_cook_title (screen);
+  vpolicy = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY);
+
+  terminal_screen_container_set_policy (container, GTK_POLICY_NEVER, vpolicy);
 }
 
-static void
-terminal_screen_set_dynamic_icon_title (TerminalScreen *screen,
-                                        const char     *icon_title,
-					gboolean       userset)
+void
+terminal_screen_get_size (TerminalScreen *screen,
+			  int       *width_chars,
+			  int       *height_chars)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GObject *object = G_OBJECT (screen);
-  
-  g_assert (TERMINAL_IS_SCREEN (screen));
+  VteTerminal *terminal = VTE_TERMINAL (screen);
 
-  if ((priv->user_title && !userset) ||  
-      (priv->icon_title_set &&
-       priv->raw_icon_title &&
-       icon_title &&
-       strcmp (priv->raw_icon_title, icon_title) == 0))
-    return;
+  *width_chars = vte_terminal_get_column_count (terminal);
+  *height_chars = vte_terminal_get_row_count (terminal);
+}
 
-  g_object_freeze_notify (object);
+void
+terminal_screen_get_cell_size (TerminalScreen *screen,
+			       int                  *cell_width_pixels,
+			       int                  *cell_height_pixels)
+{
+  VteTerminal *terminal = VTE_TERMINAL (screen);
 
-  g_free (priv->raw_icon_title);
-  priv->raw_icon_title = g_strdup (icon_title);
-  priv->icon_title_set = TRUE;
+  *cell_width_pixels = vte_terminal_get_char_width (terminal);
+  *cell_height_pixels = vte_terminal_get_char_height (terminal);
+}
 
-  g_object_notify (object, "icon-title-set");
-  terminal_screen_cook_icon_title (screen);
+static char*
+terminal_screen_check_match (TerminalScreen *screen,
+			     int        column,
+			     int        row,
+                             int       *flavor)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  GSList *tags;
+  int tag;
+  char *match;
 
-  g_object_thaw_notify (object);
+  match = vte_terminal_match_check (VTE_TERMINAL (screen), column, row, &tag);
+  for (tags = priv->match_tags; tags != NULL; tags = tags->next)
+    {
+      TagData *tag_data = (TagData*) tags->data;
+      if (tag_data->tag == tag)
+	{
+	  if (flavor)
+	    *flavor = tag_data->flavor;
+	  return match;
+	}
+    }
+
+  g_free (match);
+  return NULL;
 }
 
+#include "terminal-options.h"
+
 void
-terminal_screen_set_override_title (TerminalScreen *screen,
-                                    const char     *title)
+terminal_screen_save_config (TerminalScreen *screen,
+                             GKeyFile *key_file,
+                             const char *group)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  char *old_title;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  const char *profile_id;
+  char *working_directory;
 
-  old_title = priv->override_title;
-  priv->override_title = g_strdup (title);
-  g_free (old_title);
+  g_settings_get (priv->profile, TERMINAL_PROFILE_NAME_KEY, "&s", &profile_id);
+  g_key_file_set_string (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_PROFILE_ID, profile_id);
 
-  terminal_screen_set_dynamic_title (screen, title, FALSE);
-  terminal_screen_set_dynamic_icon_title (screen, title, FALSE);
-}
+  if (priv->override_command)
+    terminal_util_key_file_set_argv (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_COMMAND,
+                                     -1, priv->override_command);
 
-const char*
-terminal_screen_get_dynamic_title (TerminalScreen *screen)
-{
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
-  
-  return screen->priv->raw_title;
+  if (priv->override_title)
+    g_key_file_set_string (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_TITLE, priv->override_title);
+
+  /* FIXMEchpe: use the initial_working_directory instead?? */
+  working_directory = terminal_screen_get_current_dir (screen);
+  if (working_directory)
+    terminal_util_key_file_set_string_escape (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_WORKING_DIRECTORY, working_directory);
+  g_free (working_directory);
+
+  g_key_file_set_double (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_ZOOM, priv->font_scale);
+
+  g_key_file_set_integer (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_WIDTH,
+                          vte_terminal_get_column_count (terminal));
+  g_key_file_set_integer (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_HEIGHT,
+                          vte_terminal_get_row_count (terminal));
 }
 
-const char*
-terminal_screen_get_dynamic_icon_title (TerminalScreen *screen)
+/**
+ * terminal_screen_has_foreground_process:
+ * @screen:
+ *
+ * Checks whether there's a foreground process running in
+ * this terminal. This asks the PTY for its foreground process group,
+ * since the app's #TerminalProcessTracker may not have noticed a process
+ * that started or exited just now, but doesn't read /proc. If the
+ * tracker is behind, it catches up on idle.
+ * 
+ * Returns: %TRUE iff there's a foreground process running in @screen
+ */
+gboolean
+terminal_screen_has_foreground_process (TerminalScreen *screen)
 {
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
-  
-  return screen->priv->raw_icon_title;
+  TerminalScreenPrivate *priv = screen->priv;
+  TerminalProcessTracker *tracker;
+  const TerminalProcessInfo *info;
+  pid_t pgrp;
+
+  if (priv->pty_fd == -1)
+    return FALSE;
+
+  pgrp = tcgetpgrp (priv->pty_fd);
+
+  tracker = terminal_app_get_process_tracker (terminal_app_get ());
+  info = terminal_process_tracker_lookup (tracker, screen);
+  if (info != NULL && info->pgrp != pgrp)
+    terminal_process_tracker_queue_refresh (tracker, screen);
+
+  return pgrp != -1 && pgrp != priv->child_pid;
 }
 
 /**
- * terminal_screen_get_current_dir:
+ * terminal_screen_get_foreground_process_name:
  * @screen:
  *
- * Tries to determine the current working directory of the foreground process
- * in @screen's PTY, falling back to the current working directory of the
- * primary child.
- * 
- * Returns: a newly allocated string containing the current working directory,
- *   or %NULL on failure
+ * Returns: (transfer none): the name of the process in the foreground
+ *   of @screen's PTY (which may be the shell), or %NULL if unknown or
+ *   the process tracker hasn't caught up with it yet
  */
-char *
-terminal_screen_get_current_dir (TerminalScreen *screen)
+const char *
+terminal_screen_get_foreground_process_name (TerminalScreen *screen)
 {
-  const char *uri;
+  TerminalScreenPrivate *priv;
+  const TerminalProcessInfo *info;
 
-  uri = vte_terminal_get_current_directory_uri (VTE_TERMINAL (screen));
-  if (uri != NULL)
-    return g_filename_from_uri (uri, NULL, NULL);
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-  if (screen->priv->initial_working_directory)
-    return g_strdup (screen->priv->initial_working_directory);
+  priv = screen->priv;
+  info = terminal_process_tracker_lookup (terminal_app_get_process_tracker (terminal_app_get ()),
+                                          screen);
+  if (info == NULL)
+    return NULL;
 
-  return NULL;
+  /* Don't name the process that was there before */
+  if (priv->pty_fd != -1 && tcgetpgrp (priv->pty_fd) != info->pgrp)
+    return NULL;
+
+  return info->name;
 }
 
-void
-terminal_screen_set_font_scale (TerminalScreen *screen,
-                                double          factor)
+/**
+ * terminal_screen_get_child_pid:
+ * @screen:
+ *
+ * Returns: the PID of @screen's child process, or -1 if it has none
+ */
+GPid
+terminal_screen_get_child_pid (TerminalScreen *screen)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), -1);
 
-  if (factor < TERMINAL_SCALE_MINIMUM)
-    factor = TERMINAL_SCALE_MINIMUM;
-  if (factor > TERMINAL_SCALE_MAXIMUM)
-    factor = TERMINAL_SCALE_MAXIMUM;
-  
-  priv->font_scale = factor;
-  
-  if (gtk_widget_get_realized (GTK_WIDGET (screen)))
-    {
-      /* Update the font */
-      terminal_screen_change_font (screen);
-    }
+  return screen->priv->child_pid;
 }
 
-double
-terminal_screen_get_font_scale (TerminalScreen *screen)
+/**
+ * terminal_screen_get_pty_fd:
+ * @screen:
+ *
+ * Returns: the PTY master file descriptor of @screen, or -1 if it has no child
+ */
+int
+terminal_screen_get_pty_fd (TerminalScreen *screen)
 {
-  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 1.0);
-  
-  return screen->priv->font_scale;
-}
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), -1);
 
-static void
-terminal_screen_window_title_changed (VteTerminal *vte_terminal,
-                                      TerminalScreen *screen)
-{
-  terminal_screen_set_dynamic_title (screen,
-                                     vte_terminal_get_window_title (vte_terminal),
-				     FALSE);
+  return screen->priv->pty_fd;
 }
 
-static void
-terminal_screen_icon_title_changed (VteTerminal *vte_terminal,
-                                    TerminalScreen *screen)
+/**
+ * terminal_screen_get_feeder:
+ * @screen: a #TerminalScreen
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Returns: (transfer none): the #TerminalFeeder writing input to
+ *   @screen's child, or %NULL if it has no child to write to
+ */
+TerminalFeeder *
+terminal_screen_get_feeder (TerminalScreen *screen,
+                            GError **error)
 {
-  terminal_screen_set_dynamic_icon_title (screen,
-                                          vte_terminal_get_icon_title (vte_terminal),
-					  FALSE);
-}
+  TerminalScreenPrivate *priv;
 
-static void
-terminal_screen_child_exited (VteTerminal *terminal)
-{
-  TerminalScreen *screen = TERMINAL_SCREEN (terminal);
-  TerminalScreenPrivate *priv = screen->priv;
-  TerminalExitAction action;
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-  /* No need to chain up to VteTerminalClass::child_exited since it's NULL */
+  priv = screen->priv;
+  if (priv->feeder != NULL)
+    return priv->feeder;
 
-  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
-                         "[screen %p] child process exited\n",
-                         screen);
+  if (priv->child_pid == -1 || priv->pty_fd == -1) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+                         "Terminal has no child to write to");
+    return NULL;
+  }
 
-  priv->child_pid = -1;
-  priv->pty_fd = -1;
-  
-  action = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_EXIT_ACTION_KEY);
-  
-  switch (action)
-    {
-    case TERMINAL_EXIT_CLOSE:
-      g_signal_emit (screen, signals[CLOSE_SCREEN], 0);
-      break;
-    case TERMINAL_EXIT_RESTART:
-      _terminal_screen_launch_child_on_idle (screen);
-      break;
-    case TERMINAL_EXIT_HOLD: {
-      GtkWidget *info_bar;
-      int status;
-
-      status = vte_terminal_get_child_exit_status (terminal);
-
-      info_bar = terminal_info_bar_new (GTK_MESSAGE_INFO,
-                                        _("_Relaunch"), RESPONSE_RELAUNCH,
-                                        NULL);
-      if (WIFEXITED (status)) {
-        terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                      _("The child process exited normally with status %d."), WEXITSTATUS (status));
-      } else if (WIFSIGNALED (status)) {
-        terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                      _("The child process was aborted by signal %d."), WTERMSIG (status));
-      } else {
-        terminal_info_bar_format_text (TERMINAL_INFO_BAR (info_bar),
-                                      _("The child process was aborted."));
-      }
-      g_signal_connect (info_bar, "response",
-                        G_CALLBACK (info_bar_response_cb), screen);
+  /* The feeder waits for the PTY to be attached again */
+  terminal_screen_thaw_async (screen);
 
-      gtk_box_pack_start (GTK_BOX (terminal_screen_container_get_from_screen (screen)),
-                          info_bar, FALSE, FALSE, 0);
-      gtk_info_bar_set_default_response (GTK_INFO_BAR (info_bar), RESPONSE_RELAUNCH);
-      gtk_widget_show (info_bar);
-      break;
-    }
+  priv->feeder = terminal_feeder_new (VTE_TERMINAL (screen), priv->pty_fd);
 
-    default:
-      break;
-    }
+  return priv->feeder;
 }
 
-void
-terminal_screen_set_user_title (TerminalScreen *screen,
-                                const char *text)
+/**
+ * terminal_screen_save_state:
+ * @screen: a #TerminalScreen
+ * @layout: (allow-none): an a{sv} of entries to add, or %NULL
+ * @with_contents: whether to include a snapshot of the scrollback
+ * @fd_list: the #GUnixFDList to add the PTY and snapshot FDs to
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Describes @screen and its child so that another server can adopt it
+ * with terminal_screen_adopt().
+ *
+ * Returns: (transfer floating): an a{sv}, or %NULL on error
+ */
+GVariant *
+terminal_screen_save_state (TerminalScreen *screen,
+                            GVariant *layout,
+                            gboolean with_contents,
+                            GUnixFDList *fd_list,
+                            GError **error)
 {
   TerminalScreenPrivate *priv = screen->priv;
+  GVariantBuilder builder;
+  GVariantIter iter;
+  GOutputStream *stream;
+  const char *profile_id, *key;
+  char *cwd, *path;
+  GVariant *value;
+  int idx, fd;
+  gboolean ok;
 
-  /* The user set the title to nothing, let's understand that as a
-     request to revert to dynamically setting the title again. */
-  if (!text || !text[0])
-    priv->user_title = FALSE;
-  else
-    {
-      priv->user_title = TRUE;
-      terminal_screen_set_dynamic_title (screen, text, TRUE);
-      terminal_screen_set_dynamic_icon_title (screen, text, TRUE);
-    }
-}
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-static void
-terminal_screen_drag_data_received (GtkWidget        *widget,
-                                    GdkDragContext   *context,
-                                    gint              x,
-                                    gint              y,
-                                    GtkSelectionData *selection_data,
-                                    guint             info,
-                                    guint             timestamp)
-{
-  TerminalScreen *screen = TERMINAL_SCREEN (widget);
-  TerminalScreenPrivate *priv = screen->priv;
-  const guchar *selection_data_data;
-  GdkAtom selection_data_target;
-  gint selection_data_length, selection_data_format;
+  if (priv->pty_fd == -1) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                         "The terminal has no child process");
+    return NULL;
+  }
 
-  selection_data_data = gtk_selection_data_get_data (selection_data);
-  selection_data_target = gtk_selection_data_get_target (selection_data);
-  selection_data_length = gtk_selection_data_get_length (selection_data);
-  selection_data_format = gtk_selection_data_get_format (selection_data);
+  idx = g_unix_fd_list_append (fd_list, priv->pty_fd, error);
+  if (idx == -1)
+    return NULL;
 
-#if 0
-  {
-    GList *tmp;
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
 
-    g_print ("info: %d\n", info);
-    tmp = context->targets;
-    while (tmp != NULL)
-      {
-        GdkAtom atom = GDK_POINTER_TO_ATOM (tmp->data);
+  if (layout != NULL) {
+    g_variant_iter_init (&iter, layout);
+    while (g_variant_iter_loop (&iter, "{&sv}", &key, &value))
+      g_variant_builder_add (&builder, "{sv}", key, value);
+  }
 
-        g_print ("Target: %s\n", gdk_atom_name (atom));        
-        
-        tmp = tmp->next;
-      }
+  g_settings_get (priv->profile, TERMINAL_PROFILE_NAME_KEY, "&s", &profile_id);
+  g_variant_builder_add (&builder, "{sv}", "profile", g_variant_new_string (profile_id));
+  g_variant_builder_add (&builder, "{sv}", "pid", g_variant_new_int32 (priv->child_pid));
+  g_variant_builder_add (&builder, "{sv}", "pty", g_variant_new_handle (idx));
+  g_variant_builder_add (&builder, "{sv}", "columns",
+                         g_variant_new_int32 (vte_terminal_get_column_count (VTE_TERMINAL (screen))));
+  g_variant_builder_add (&builder, "{sv}", "rows",
+                         g_variant_new_int32 (vte_terminal_get_row_count (VTE_TERMINAL (screen))));
+  g_variant_builder_add (&builder, "{sv}", "zoom", g_variant_new_double (priv->font_scale));
+  if (priv->override_title)
+    g_variant_builder_add (&builder, "{sv}", "title", g_variant_new_string (priv->override_title));
 
-    g_print ("Chosen target: %s\n", gdk_atom_name (selection_data->target));
+  cwd = terminal_screen_get_current_dir (screen);
+  if (cwd != NULL)
+    g_variant_builder_add (&builder, "{sv}", "cwd", g_variant_new_bytestring (cwd));
+  g_free (cwd);
+
+  if (!with_contents)
+    return g_variant_builder_end (&builder);
+
+  /* The snapshot goes to an unlinked file, so nothing is left behind */
+  fd = g_file_open_tmp ("gnome-terminal-XXXXXX.txt.gz", &path, error);
+  if (fd == -1)
+    goto fail;
+  g_unlink (path);
+  g_free (path);
+
+  terminal_screen_thaw (screen);
+
+  stream = g_unix_output_stream_new (fd, FALSE);
+  ok = terminal_screen_write_snapshot_stream (screen, stream, error);
+  g_object_unref (stream);
+
+  if (ok && lseek (fd, 0, SEEK_SET) == -1) {
+    int errsv = errno;
+
+    g_set_error_literal (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                         g_strerror (errsv));
+    ok = FALSE;
   }
-#endif
+  if (ok)
+    idx = g_unix_fd_list_append (fd_list, fd, error);
+  close (fd);
+  if (!ok || idx == -1)
+    goto fail;
 
-  if (gtk_targets_include_uri (&selection_data_target, 1))
-    {
-      char **uris;
-      char *text;
-      gsize len;
+  g_variant_builder_add (&builder, "{sv}", "contents", g_variant_new_handle (idx));
 
-      uris = gtk_selection_data_get_uris (selection_data);
-      if (!uris)
-        return;
+  return g_variant_builder_end (&builder);
 
-      terminal_util_transform_uris_to_quoted_fuse_paths (uris);
+fail:
+  g_variant_builder_clear (&builder);
+  return NULL;
+}
 
-      text = terminal_util_concat_uris (uris, &len);
-      vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
-      g_free (text);
+static int
+get_state_fd (GVariant *state,
+              const char *key,
+              GUnixFDList *fd_list,
+              GError **error)
+{
+  gint32 idx;
 
-      g_strfreev (uris);
-    }
-  else if (gtk_targets_include_text (&selection_data_target, 1))
-    {
-      char *text;
+  if (!g_variant_lookup (state, key, "h", &idx))
+    return -1;
 
-      text = (char *) gtk_selection_data_get_text (selection_data);
-      if (text && text[0])
-        vte_terminal_feed_child (VTE_TERMINAL (screen), text, strlen (text));
-      g_free (text);
-    }
-  else switch (info)
-    {
-    case TARGET_COLOR:
-      {
-        guint16 *data = (guint16 *)selection_data_data;
-        GdkRGBA color;
+  if (idx < 0 || idx >= g_unix_fd_list_get_length (fd_list)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                 "Bad handle for \"%s\"", key);
+    return -1;
+  }
 
-        /* We accept drops with the wrong format, since the KDE color
-         * chooser incorrectly drops application/x-color with format 8.
-         * So just check for the data length.
-         */
-        if (selection_data_length != 8)
-          return;
+  return g_unix_fd_list_get (fd_list, idx, error);
+}
 
-        color.red = (double) data[0] / 65535.;
-        color.green = (double) data[1] / 65535.;
-        color.blue = (double) data[2] / 65535.;
-        color.alpha = 1.;
-        /* FIXME: use opacity from data[3] */
+/**
+ * terminal_screen_adopt:
+ * @screen: a #TerminalScreen without a child
+ * @state: an a{sv} as returned by terminal_screen_save_state()
+ * @fd_list: the FDs @state refers to
+ * @key: the key @state was deposited under with the fd holder, or 0
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Takes over the child process, and optionally the contents, of a
+ * terminal of another server. The child can't be waited for; it's
+ * taken to have exited when its PTY hangs up.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+terminal_screen_adopt (TerminalScreen *screen,
+                       GVariant *state,
+                       GUnixFDList *fd_list,
+                       guint key,
+                       GError **error)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  VteTerminal *terminal = VTE_TERMINAL (screen);
+  GInputStream *stream;
+  GError *err = NULL;
+  VtePty *pty;
+  gint32 pid, columns, rows;
+  char *text;
+  int fd;
 
-        terminal_g_settings_set_rgba (priv->profile,
-                                      TERMINAL_PROFILE_BACKGROUND_COLOR_KEY,
-                                      &color);
-        g_settings_set_boolean (priv->profile, TERMINAL_PROFILE_USE_THEME_COLORS_KEY, FALSE);
-      }
-      break;
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
 
-    case TARGET_MOZ_URL:
-      {
-        char *utf8_data, *newline, *text;
-        char *uris[2];
-        gsize len;
-        
-        /* MOZ_URL is in UCS-2 but in format 8. BROKEN!
-         *
-         * The data contains the URL, a \n, then the
-         * title of the web page.
-         */
-        if (selection_data_format != 8 ||
-            selection_data_length == 0 ||
-            (selection_data_length % 2) != 0)
-          return;
+  if (priv->child_pid != -1 || priv->viewer != NULL) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_EXISTS,
+                         "The terminal already has a child process");
+    return FALSE;
+  }
 
-        utf8_data = g_utf16_to_utf8 ((const gunichar2*) selection_data_data,
-                                     selection_data_length / 2,
-                                     NULL, NULL, NULL);
-        if (!utf8_data)
-          return;
+  if (!g_variant_lookup (state, "pid", "i", &pid) || pid <= 0) {
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                         "No child process");
+    return FALSE;
+  }
 
-        newline = strchr (utf8_data, '\n');
-        if (newline)
-          *newline = '\0';
+  fd = get_state_fd (state, "pty", fd_list, error);
+  if (fd == -1) {
+    if (error != NULL && *error == NULL)
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                           "No PTY");
+    return FALSE;
+  }
 
-        uris[0] = utf8_data;
-        uris[1] = NULL;
-        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
+  pty = vte_pty_new_foreign (fd, error);
+  if (pty == NULL) {
+    close (fd);
+    return FALSE;
+  }
 
-        text = terminal_util_concat_uris (uris, &len);
-        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
-        g_free (text);
-        g_free (uris[0]);
-      }
-      break;
+  /* What scrolled by while the child changed servers comes after this */
+  fd = get_state_fd (state, "contents", fd_list, &err);
+  if (fd != -1) {
+    stream = g_unix_input_stream_new (fd, TRUE);
+    text = terminal_screen_read_snapshot_stream (stream);
+    g_object_unref (stream);
+
+    terminal_screen_feed_snapshot (screen, text);
+    vte_terminal_feed (terminal, "\r\n", 2);
+    g_free (text);
+  } else if (err != NULL) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] dropping the contents: %s\n",
+                           screen, err->message);
+    g_clear_error (&err);
+  }
 
-    case TARGET_NETSCAPE_URL:
-      {
-        char *utf8_data, *newline, *text;
-        char *uris[2];
-        gsize len;
-        
-        /* The data contains the URL, a \n, then the
-         * title of the web page.
-         */
-        if (selection_data_length < 0 || selection_data_format != 8)
-          return;
+  if (g_variant_lookup (state, "columns", "i", &columns) &&
+      g_variant_lookup (state, "rows", "i", &rows) &&
+      columns > 0 && rows > 0)
+    vte_terminal_set_size (terminal, columns, rows);
 
-        utf8_data = g_strndup ((char *) selection_data_data, selection_data_length);
-        newline = strchr (utf8_data, '\n');
-        if (newline)
-          *newline = '\0';
+  vte_terminal_set_pty_object (terminal, pty);
 
-        uris[0] = utf8_data;
-        uris[1] = NULL;
-        terminal_util_transform_uris_to_quoted_fuse_paths (uris); /* This may replace uris[0] */
+  priv->child_pid = pid;
+  priv->pty_fd = vte_pty_get_fd (pty);
+  priv->adopted = TRUE;
+  priv->child_start_time = g_get_monotonic_time ();
+  g_object_unref (pty);
 
-        text = terminal_util_concat_uris (uris, &len);
-        vte_terminal_feed_child (VTE_TERMINAL (screen), text, len);
-        g_free (text);
-        g_free (uris[0]);
-      }
-      break;
+  _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                         "[screen %p] adopted child %d\n",
+                         screen, pid);
 
-    case TARGET_RESET_BG:
-      g_settings_reset (priv->profile, TERMINAL_PROFILE_BACKGROUND_COLOR_KEY);
-      break;
+  terminal_process_tracker_add_screen (terminal_app_get_process_tracker (terminal_app_get ()),
+                                       screen);
 
-    case TARGET_TAB:
-      {
-        GtkWidget *container;
-        TerminalScreen *moving_screen;
-        TerminalWindow *source_window;
-        TerminalWindow *dest_window;
+  /* Replace the deposit, which may include contents and layout */
+  priv->handover_key = key;
+  terminal_screen_deposit (screen, NULL, FALSE);
 
-        container = *(GtkWidget**) selection_data_data;
-        if (!GTK_IS_WIDGET (container))
-          return;
+  return TRUE;
+}
 
-        moving_screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (container));
-        g_warn_if_fail (TERMINAL_IS_SCREEN (moving_screen));
-        if (!TERMINAL_IS_SCREEN (moving_screen))
-          return;
+/**
+ * terminal_screen_deposit:
+ * @screen: a #TerminalScreen
+ * @layout: (allow-none): an a{sv} of entries to add, or %NULL
+ * @with_contents: whether to include a snapshot of the scrollback
+ *
+ * Hands the state of @screen to the app's fd holder, if there is one,
+ * replacing what was deposited before.
+ *
+ * Returns: %TRUE if @screen's state is with the holder
+ */
+gboolean
+terminal_screen_deposit (TerminalScreen *screen,
+                         GVariant *layout,
+                         gboolean with_contents)
+{
+  TerminalScreenPrivate *priv = screen->priv;
+  TerminalHandover *handover;
+  GUnixFDList *fd_list;
+  GVariant *state;
+  GError *error = NULL;
+  guint key;
+
+  handover = terminal_app_get_handover (terminal_app_get ());
+  if (handover == NULL || priv->pty_fd == -1)
+    return FALSE;
 
-        source_window = terminal_screen_get_window (moving_screen);
-        dest_window = terminal_screen_get_window (screen);
-        terminal_window_move_screen (source_window, dest_window, moving_screen, -1);
+  fd_list = g_unix_fd_list_new ();
+  state = terminal_screen_save_state (screen, layout, with_contents, fd_list, &error);
+  if (state == NULL) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[screen %p] failed to save state: %s\n",
+                           screen, error->message);
+    g_error_free (error);
+    g_object_unref (fd_list);
+    return FALSE;
+  }
 
-        gtk_drag_finish (context, TRUE, TRUE, timestamp);
-      }
-      break;
+  key = terminal_handover_deposit (handover, priv->handover_key, state, fd_list);
+  g_object_unref (fd_list);
+  if (key == 0)
+    return FALSE;
 
-    default:
-      g_assert_not_reached ();
-    }
+  priv->handover_key = key;
+  return TRUE;
 }
 
+/**
+ * terminal_screen_forget_deposit:
+ * @screen: a #TerminalScreen
+ *
+ * Makes the app's fd holder let go of @screen's state.
+ */
 void
-_terminal_screen_update_scrollbar (TerminalScreen *screen)
+terminal_screen_forget_deposit (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  TerminalScreenContainer *container;
-  GtkPolicyType vpolicy;
+  TerminalHandover *handover;
 
-  container = terminal_screen_container_get_from_screen (screen);
-  if (container == NULL)
+  if (priv->handover_key == 0)
     return;
 
-  vpolicy = g_settings_get_enum (priv->profile, TERMINAL_PROFILE_SCROLLBAR_POLICY_KEY);
+  handover = terminal_app_get_handover (terminal_app_get ());
+  if (handover != NULL)
+    terminal_handover_forget (handover, priv->handover_key);
+  priv->handover_key = 0;
+}
 
-  terminal_screen_container_set_policy (container, GTK_POLICY_NEVER, vpolicy);
+/**
+ * terminal_screen_get_activity:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: whether @screen had output, or went silent, while it was
+ *   not visible; reset to %TERMINAL_ACTIVITY_NONE when it's shown
+ */
+TerminalActivity
+terminal_screen_get_activity (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), TERMINAL_ACTIVITY_NONE);
+
+  return screen->priv->activity;
 }
 
-void
-terminal_screen_get_size (TerminalScreen *screen,
-			  int       *width_chars,
-			  int       *height_chars)
+/**
+ * terminal_screen_get_cgroup:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: (transfer none): the cgroup the child of @screen runs in,
+ *   or %NULL if it runs in the server's cgroup
+ */
+TerminalCgroup *
+terminal_screen_get_cgroup (TerminalScreen *screen)
 {
-  VteTerminal *terminal = VTE_TERMINAL (screen);
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-  *width_chars = vte_terminal_get_column_count (terminal);
-  *height_chars = vte_terminal_get_row_count (terminal);
+  return screen->priv->cgroup;
+}
+
+/**
+ * terminal_screen_get_restart_count:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: how often the child of @screen has been restarted because
+ *   of the "restart" exit action
+ */
+guint
+terminal_screen_get_restart_count (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+  return screen->priv->restart_count;
+}
+
+/**
+ * terminal_screen_get_throttled:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: whether reading the output of @screen's child is being
+ *   throttled because it has been flooding the terminal
+ */
+gboolean
+terminal_screen_get_throttled (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
+
+  return terminal_flood_governor_get_throttled (screen->priv->flood_governor);
 }
 
+/**
+ * _terminal_screen_set_window_minimized:
+ * @screen: a #TerminalScreen
+ * @minimized: whether the window containing @screen is minimized
+ *
+ * Called by the window, since a minimized window's widgets stay mapped.
+ */
 void
-terminal_screen_get_cell_size (TerminalScreen *screen,
-			       int                  *cell_width_pixels,
-			       int                  *cell_height_pixels)
+_terminal_screen_set_window_minimized (TerminalScreen *screen,
+                                       gboolean minimized)
 {
-  VteTerminal *terminal = VTE_TERMINAL (screen);
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
 
-  *cell_width_pixels = vte_terminal_get_char_width (terminal);
-  *cell_height_pixels = vte_terminal_get_char_height (terminal);
+  screen->priv->window_minimized = minimized != FALSE;
+  terminal_screen_update_power_state (screen);
 }
 
-static char*
-terminal_screen_check_match (TerminalScreen *screen,
-			     int        column,
-			     int        row,
-                             int       *flavor)
+/**
+ * terminal_screen_get_low_power:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: %TRUE if @screen is not visible, so that work which only
+ *   updates what the user sees can be skipped
+ */
+gboolean
+terminal_screen_get_low_power (TerminalScreen *screen)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  GSList *tags;
-  int tag;
-  char *match;
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), FALSE);
 
-  match = vte_terminal_match_check (VTE_TERMINAL (screen), column, row, &tag);
-  for (tags = priv->match_tags; tags != NULL; tags = tags->next)
-    {
-      TagData *tag_data = (TagData*) tags->data;
-      if (tag_data->tag == tag)
-	{
-	  if (flavor)
-	    *flavor = tag_data->flavor;
-	  return match;
-	}
-    }
+  return screen->priv->low_power;
+}
 
-  g_free (match);
-  return NULL;
+/**
+ * terminal_screen_get_last_shown:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: %G_MAXINT64 if @screen is visible, otherwise the monotonic
+ *   time when it was last hidden
+ */
+gint64
+terminal_screen_get_last_shown (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), 0);
+
+  if (!screen->priv->low_power)
+    return G_MAXINT64;
+
+  return screen->priv->last_shown;
 }
 
-#include "terminal-options.h"
+/**
+ * terminal_screen_get_scrollback_lines:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: the number of scrollback lines @screen's profile asks for,
+ *   or -1 for unlimited
+ */
+glong
+terminal_screen_get_scrollback_lines (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), -1);
+
+  return screen->priv->scrollback_lines;
+}
 
+/**
+ * _terminal_screen_set_scrollback_limit:
+ * @screen: a #TerminalScreen
+ * @limit: the maximum number of scrollback lines, or -1 for no limit
+ *
+ * Caps the scrollback set by the profile; used by the app's
+ * scrollback budget.
+ */
 void
-terminal_screen_save_config (TerminalScreen *screen,
-                             GKeyFile *key_file,
-                             const char *group)
+_terminal_screen_set_scrollback_limit (TerminalScreen *screen,
+                                       glong limit)
+{
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+
+  screen->priv->scrollback_limit = limit;
+  terminal_screen_update_scrollback (screen);
+}
+
+static void
+terminal_screen_finish_trace (TerminalScreen *screen)
 {
   TerminalScreenPrivate *priv = screen->priv;
-  VteTerminal *terminal = VTE_TERMINAL (screen);
-  const char *profile_id;
-  char *working_directory;
 
-  g_settings_get (priv->profile, TERMINAL_PROFILE_NAME_KEY, "&s", &profile_id);
-  g_key_file_set_string (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_PROFILE_ID, profile_id);
+  if (priv->trace == NULL)
+    return;
 
-  if (priv->override_command)
-    terminal_util_key_file_set_argv (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_COMMAND,
-                                     -1, priv->override_command);
+  _terminal_debug_print (TERMINAL_DEBUG_PERF,
+                         "[screen %p] finished trace %s\n",
+                         screen, terminal_trace_get_id (priv->trace));
 
-  if (priv->override_title)
-    g_key_file_set_string (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_TITLE, priv->override_title);
+  g_signal_emit (screen, signals[TRACE_FINISHED], 0);
 
-  /* FIXMEchpe: use the initial_working_directory instead?? */
-  working_directory = terminal_screen_get_current_dir (screen);
-  if (working_directory)
-    terminal_util_key_file_set_string_escape (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_WORKING_DIRECTORY, working_directory);
-  g_free (working_directory);
+  terminal_trace_free (priv->trace);
+  priv->trace = NULL;
+}
 
-  g_key_file_set_double (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_ZOOM, priv->font_scale);
+/**
+ * terminal_screen_set_trace:
+ * @screen: a #TerminalScreen
+ * @trace: (transfer full) (allow-none): a #TerminalTrace
+ *
+ * Records the stages of bringing up @screen in @trace, up to the first
+ * frame drawn after the child's first output. Then #TerminalScreen::trace-finished
+ * is emitted and the trace is freed.
+ */
+void
+terminal_screen_set_trace (TerminalScreen *screen,
+                           TerminalTrace *trace)
+{
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
 
-  g_key_file_set_integer (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_WIDTH,
-                          vte_terminal_get_column_count (terminal));
-  g_key_file_set_integer (key_file, group, TERMINAL_CONFIG_TERMINAL_PROP_HEIGHT,
-                          vte_terminal_get_row_count (terminal));
+  terminal_trace_free (screen->priv->trace);
+  screen->priv->trace = trace;
 }
 
 /**
- * terminal_screen_has_foreground_process:
- * @screen:
+ * terminal_screen_get_trace:
+ * @screen: a #TerminalScreen
  *
- * Checks whether there's a foreground process running in
- * this terminal.
- * 
- * Returns: %TRUE iff there's a foreground process running in @screen
+ * Returns: (transfer none) (allow-none): the trace set with
+ *   terminal_screen_set_trace(), if it hasn't finished yet
  */
-gboolean
-terminal_screen_has_foreground_process (TerminalScreen *screen)
+TerminalTrace *
+terminal_screen_get_trace (TerminalScreen *screen)
 {
-  TerminalScreenPrivate *priv = screen->priv;
-  int fgpid;
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-  if (priv->pty_fd == -1)
-    return FALSE;
+  return screen->priv->trace;
+}
 
-  fgpid = tcgetpgrp (priv->pty_fd);
-  if (fgpid == -1 || fgpid == priv->child_pid)
-    return FALSE;
+/**
+ * terminal_screen_get_latency_report:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: (transfer floating): the keystroke latency percentiles of
+ *   @screen, as returned by terminal_latency_get_report(), or an empty
+ *   a{sv} if they haven't been measured
+ */
+GVariant *
+terminal_screen_get_latency_report (TerminalScreen *screen)
+{
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-  return TRUE;
+  if (screen->priv->latency == NULL)
+    return g_variant_new_array (G_VARIANT_TYPE ("{sv}"), NULL, 0);
 
-#if 0
-  char *cmdline, *basename, *name;
-  gsize len;
-  char filename[64];
+  return terminal_latency_get_report (screen->priv->latency);
+}
 
-  g_snprintf (filename, sizeof (filename), "/proc/%d/cmdline", fgpid);
-  if (!g_file_get_contents (filename, &cmdline, &len, NULL))
-    return TRUE;
+/**
+ * terminal_screen_get_stats:
+ * @screen: a #TerminalScreen
+ *
+ * Returns: (transfer floating): an a{sv} with the number of
+ *   "contents-changes" and "title-changes" of @screen and their rates
+ *   per second over the last complete 10 s, the "scrollback-lines" in
+ *   use, and, if it has a child, its "child-pid" and the
+ *   "spawn-latency" in µs it took to start
+ */
+GVariant *
+terminal_screen_get_stats (TerminalScreen *screen)
+{
+  TerminalScreenPrivate *priv;
+  GtkAdjustment *adjustment;
+  GVariantBuilder builder;
+  gint64 now;
+  glong lines;
 
-  basename = g_path_get_basename (cmdline);
-  g_free (cmdline);
-  if (!basename)
-    return TRUE;
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
 
-  name = g_filename_to_utf8 (basename, -1, NULL, NULL, NULL);
-  g_free (basename);
-  if (!name)
-    return TRUE;
+  priv = screen->priv;
+  now = g_get_monotonic_time ();
+  rate_counter_update (&priv->contents_changes, now);
+  rate_counter_update (&priv->title_changes, now);
+
+  /* The adjustment spans the scrollback and the screen */
+  adjustment = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (screen));
+  lines = (glong) (gtk_adjustment_get_upper (adjustment) -
+                   gtk_adjustment_get_lower (adjustment) -
+                   vte_terminal_get_row_count (VTE_TERMINAL (screen)));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+  g_variant_builder_add (&builder, "{sv}", "contents-changes",
+                         g_variant_new_uint64 (priv->contents_changes.total));
+  g_variant_builder_add (&builder, "{sv}", "contents-change-rate",
+                         g_variant_new_double (priv->contents_changes.rate));
+  g_variant_builder_add (&builder, "{sv}", "title-changes",
+                         g_variant_new_uint64 (priv->title_changes.total));
+  g_variant_builder_add (&builder, "{sv}", "title-change-rate",
+                         g_variant_new_double (priv->title_changes.rate));
+  g_variant_builder_add (&builder, "{sv}", "scrollback-lines",
+                         g_variant_new_int64 (MAX (lines, 0)));
 
-  if (process_name)
-    *process_name = name;
+  if (priv->child_pid != -1) {
+    g_variant_builder_add (&builder, "{sv}", "child-pid",
+                           g_variant_new_int32 (priv->child_pid));
+    if (!priv->adopted)
+      g_variant_builder_add (&builder, "{sv}", "spawn-latency",
+                             g_variant_new_int64 (priv->spawn_latency));
+  }
 
-  return TRUE;
-#endif
+  return g_variant_builder_end (&builder);
 }
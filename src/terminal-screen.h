@@ -26,6 +26,11 @@
 
 #include <vte/vte.h>
 
+#include "terminal-cgroup.h"
+#include "terminal-enums.h"
+#include "terminal-feeder.h"
+#include "terminal-trace.h"
+
 G_BEGIN_DECLS
 
 typedef enum {
@@ -70,6 +75,7 @@ struct _TerminalScreenClass
                                int flavour,
                                guint state);
   void (* close_screen)       (TerminalScreen *screen);
+  void (* trace_finished)     (TerminalScreen *screen);
 };
 
 GType terminal_screen_get_type (void) G_GNUC_CONST;
@@ -87,6 +93,12 @@ gboolean terminal_screen_exec (TerminalScreen *screen,
                                const char     *cwd,
                                GUnixFDList    *fd_list,
                                GVariant       *fd_array,
+                               GVariant       *resources,
+                               GError        **error);
+
+gboolean terminal_screen_view (TerminalScreen *screen,
+                               const char     *path,
+                               int             fd,
                                GError        **error);
 
 void _terminal_screen_launch_child_on_idle (TerminalScreen *screen);
@@ -139,6 +151,62 @@ void terminal_screen_save_config (TerminalScreen *screen,
 
 gboolean terminal_screen_has_foreground_process (TerminalScreen *screen);
 
+const char *terminal_screen_get_foreground_process_name (TerminalScreen *screen);
+
+GPid terminal_screen_get_child_pid (TerminalScreen *screen);
+
+int terminal_screen_get_pty_fd (TerminalScreen *screen);
+
+TerminalFeeder *terminal_screen_get_feeder (TerminalScreen *screen,
+                                            GError **error);
+
+GVariant *terminal_screen_save_state (TerminalScreen *screen,
+                                      GVariant *layout,
+                                      gboolean with_contents,
+                                      GUnixFDList *fd_list,
+                                      GError **error);
+
+gboolean terminal_screen_adopt (TerminalScreen *screen,
+                                GVariant *state,
+                                GUnixFDList *fd_list,
+                                guint key,
+                                GError **error);
+
+gboolean terminal_screen_deposit (TerminalScreen *screen,
+                                  GVariant *layout,
+                                  gboolean with_contents);
+
+void terminal_screen_forget_deposit (TerminalScreen *screen);
+
+TerminalActivity terminal_screen_get_activity (TerminalScreen *screen);
+
+guint terminal_screen_get_restart_count (TerminalScreen *screen);
+
+gboolean terminal_screen_get_throttled (TerminalScreen *screen);
+
+TerminalCgroup *terminal_screen_get_cgroup (TerminalScreen *screen);
+
+void _terminal_screen_set_window_minimized (TerminalScreen *screen,
+                                            gboolean minimized);
+
+gboolean terminal_screen_get_low_power (TerminalScreen *screen);
+
+gint64 terminal_screen_get_last_shown (TerminalScreen *screen);
+
+glong terminal_screen_get_scrollback_lines (TerminalScreen *screen);
+
+void _terminal_screen_set_scrollback_limit (TerminalScreen *screen,
+                                            glong limit);
+
+void terminal_screen_set_trace (TerminalScreen *screen,
+                                TerminalTrace *trace);
+
+TerminalTrace *terminal_screen_get_trace (TerminalScreen *screen);
+
+GVariant *terminal_screen_get_latency_report (TerminalScreen *screen);
+
+GVariant *terminal_screen_get_stats (TerminalScreen *screen);
+
 /* Allow scales a bit smaller and a bit larger than the usual pango ranges */
 #define TERMINAL_SCALE_XXX_SMALL   (PANGO_SCALE_XX_SMALL/1.2)
 #define TERMINAL_SCALE_XXXX_SMALL  (TERMINAL_SCALE_XXX_SMALL/1.2)
@@ -21,6 +21,7 @@
 
 #include <gtk/gtk.h>
 
+#include "terminal-app.h"
 #include "terminal-intl.h"
 #include "terminal-tab-label.h"
 #include "terminal-close-button.h"
@@ -33,6 +34,7 @@ struct _TerminalTabLabelPrivate
 {
   TerminalScreen *screen;
   GtkWidget *label;
+  GtkWidget *throttled_image;
   GtkWidget *close_button;
   gboolean bold;
   GtkPositionType tab_pos;
@@ -68,15 +70,28 @@ sync_tab_label (TerminalScreen *screen,
                 GParamSpec *pspec,
                 GtkWidget *label)
 {
-  GtkWidget *hbox;
   const char *title;
 
   title = terminal_screen_get_title (screen);
-  hbox = gtk_widget_get_parent (label);
 
   gtk_label_set_text (GTK_LABEL (label), title);
-  
-  gtk_widget_set_tooltip_text (hbox, title);
+}
+
+static void
+sync_tab_activity (TerminalScreen *screen,
+                   GParamSpec *pspec,
+                   TerminalTabLabel *tab_label)
+{
+  terminal_tab_label_set_bold (tab_label,
+                               terminal_screen_get_activity (screen) != TERMINAL_ACTIVITY_NONE);
+}
+
+static void
+sync_tab_throttled (TerminalScreen *screen,
+                    GParamSpec *pspec,
+                    GtkWidget *image)
+{
+  gtk_widget_set_visible (image, terminal_screen_get_throttled (screen));
 }
 
 static void
@@ -109,6 +124,85 @@ notify_tab_pos_cb (GtkNotebook *notebook,
 
 /* Class implementation */
 
+/* The tooltip is built on demand, so that the accounting data is current
+ * and we don't have to keep it up to date for every tab.
+ */
+static gboolean
+terminal_tab_label_query_tooltip (GtkWidget *widget,
+                                  int x,
+                                  int y,
+                                  gboolean keyboard_mode,
+                                  GtkTooltip *tooltip)
+{
+  TerminalTabLabel *tab_label = TERMINAL_TAB_LABEL (widget);
+  TerminalTabLabelPrivate *priv = tab_label->priv;
+  const TerminalProcessInfo *info;
+  GString *text;
+
+  text = g_string_new (terminal_screen_get_title (priv->screen));
+
+  info = terminal_process_tracker_lookup (terminal_app_get_process_tracker (terminal_app_get ()),
+                                          priv->screen);
+  if (info != NULL && info->name != NULL) {
+    g_string_append_c (text, '\n');
+    if (info->cwd != NULL) {
+      char *cwd;
+
+      cwd = g_filename_display_name (info->cwd);
+      /* Translators: this is the foreground process name and its working directory in the tab tooltip */
+      g_string_append_printf (text, _("%s in %s"), info->name, cwd);
+      g_free (cwd);
+    } else {
+      g_string_append (text, info->name);
+    }
+  }
+
+  switch (terminal_screen_get_activity (priv->screen)) {
+    case TERMINAL_ACTIVITY_OUTPUT:
+      g_string_append_c (text, '\n');
+      g_string_append (text, _("New output in the background"));
+      break;
+    case TERMINAL_ACTIVITY_SILENCE:
+      g_string_append_c (text, '\n');
+      g_string_append (text, _("Output in the background has stopped"));
+      break;
+    case TERMINAL_ACTIVITY_NONE:
+    default:
+      break;
+  }
+
+  if (terminal_screen_get_throttled (priv->screen)) {
+    g_string_append_c (text, '\n');
+    g_string_append (text, _("Output is being throttled"));
+  }
+
+  if (info != NULL && info->n_processes > 0) {
+    char *rss, *read_bytes, *write_bytes;
+
+    rss = g_format_size (info->rss);
+    read_bytes = g_format_size (info->read_bytes);
+    write_bytes = g_format_size (info->write_bytes);
+
+    g_string_append_c (text, '\n');
+    g_string_append_printf (text,
+                            ngettext ("CPU %.1f%%, memory %s, %u process",
+                                      "CPU %.1f%%, memory %s, %u processes",
+                                      info->n_processes),
+                            info->cpu_percent, rss, info->n_processes);
+    g_string_append_c (text, '\n');
+    g_string_append_printf (text, _("Read %s, written %s"), read_bytes, write_bytes);
+
+    g_free (rss);
+    g_free (read_bytes);
+    g_free (write_bytes);
+  }
+
+  gtk_tooltip_set_text (tooltip, text->str);
+  g_string_free (text, TRUE);
+
+  return TRUE;
+}
+
 static void
 terminal_tab_label_parent_set (GtkWidget *widget,
                                GtkWidget *old_parent)
@@ -170,7 +264,7 @@ terminal_tab_label_constructor (GType type,
   GObject *object;
   TerminalTabLabel *tab_label;
   TerminalTabLabelPrivate *priv;
-  GtkWidget *hbox, *label, *close_button;
+  GtkWidget *hbox, *label, *image, *close_button;
 
   object = G_OBJECT_CLASS (terminal_tab_label_parent_class)->constructor
              (type, n_construct_properties, construct_params);
@@ -183,6 +277,10 @@ terminal_tab_label_constructor (GType type,
   
   gtk_box_set_spacing (GTK_BOX (hbox), SPACING);
 
+  priv->throttled_image = image = gtk_image_new_from_icon_name ("media-playback-pause", GTK_ICON_SIZE_MENU);
+  gtk_widget_set_no_show_all (image, TRUE);
+  gtk_box_pack_start (GTK_BOX (hbox), image, FALSE, FALSE, 0);
+
   priv->label = label = gtk_label_new (NULL);
   gtk_misc_set_alignment (GTK_MISC (label), 0.0, 0.5);
   gtk_misc_set_padding (GTK_MISC (label), 0, 0);
@@ -199,9 +297,19 @@ terminal_tab_label_constructor (GType type,
   g_signal_connect (priv->screen, "notify::title",
                     G_CALLBACK (sync_tab_label), label);
 
+  sync_tab_activity (priv->screen, NULL, tab_label);
+  g_signal_connect_object (priv->screen, "notify::activity",
+                           G_CALLBACK (sync_tab_activity), tab_label, 0);
+
+  sync_tab_throttled (priv->screen, NULL, image);
+  g_signal_connect_object (priv->screen, "notify::throttled",
+                           G_CALLBACK (sync_tab_throttled), image, 0);
+
   g_signal_connect (close_button, "clicked",
 		    G_CALLBACK (close_button_clicked_cb), tab_label);
 
+  gtk_widget_set_has_tooltip (hbox, TRUE);
+
   gtk_widget_show_all (hbox);
 
   return object;
@@ -265,6 +373,7 @@ terminal_tab_label_class_init (TerminalTabLabelClass *klass)
 
   widget_class->parent_set = terminal_tab_label_parent_set;
   widget_class->get_preferred_width = terminal_tab_label_get_preferred_width;
+  widget_class->query_tooltip = terminal_tab_label_query_tooltip;
 
   signals[CLOSE_BUTTON_CLICKED] =
     g_signal_new (I_("close-button-clicked"),
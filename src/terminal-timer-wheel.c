@@ -0,0 +1,314 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-timer-wheel.h"
+
+/* A hashed timer wheel: timers are put into the slot of the tick they
+ * expire on, modulo N_SLOTS, so adding and removing a timer is O(1),
+ * and each tick only looks at one slot. Timers further out than one
+ * revolution just stay in their slot until their tick comes around.
+ *
+ * The wheel doesn't tick by itself: its main loop source is a one-shot
+ * timeout for the next tick that has a timer due, so a wheel with only
+ * long timers wakes up rarely, and an idle one not at all.
+ */
+#define N_SLOTS (64)
+
+typedef struct {
+  guint id;
+  guint64 expires; /* tick */
+  guint slot;
+  TerminalTimerFunc func;
+  gpointer user_data;
+} TimerEntry;
+
+struct _TerminalTimerWheel
+{
+  guint resolution; /* ms */
+  gint64 epoch; /* µs */
+  guint64 now; /* tick */
+  GList *slots[N_SLOTS]; /* of TimerEntry */
+  GHashTable *timers; /* id -> GList* link in its slot */
+  guint next_id;
+  guint source_id;
+  guint64 scheduled; /* tick the source is for */
+};
+
+static guint64
+timer_wheel_current_tick (TerminalTimerWheel *wheel)
+{
+  return (guint64) (g_get_monotonic_time () - wheel->epoch) / (wheel->resolution * 1000);
+}
+
+static void
+timer_wheel_expire_slot (TerminalTimerWheel *wheel,
+                         guint slot)
+{
+  GList *l;
+  TimerEntry *entry;
+
+  /* One at a time, starting over after each callback, since it may
+   * add or remove timers, including ones in this very slot that are
+   * due now as well.
+   */
+  for (;;) {
+    for (l = wheel->slots[slot]; l != NULL; l = l->next)
+      if (((TimerEntry *) l->data)->expires <= wheel->now)
+        break;
+    if (l == NULL)
+      break;
+
+    entry = l->data;
+    wheel->slots[slot] = g_list_delete_link (wheel->slots[slot], l);
+    g_hash_table_remove (wheel->timers, GUINT_TO_POINTER (entry->id));
+
+    entry->func (entry->user_data);
+    g_slice_free (TimerEntry, entry);
+  }
+}
+
+/* Returns: the first tick after the current one with a timer due */
+static guint64
+timer_wheel_next_expiry (TerminalTimerWheel *wheel)
+{
+  GHashTableIter iter;
+  GList *l;
+  guint64 tick, next = G_MAXUINT64;
+  guint i;
+
+  for (i = 1; i <= N_SLOTS; i++) {
+    tick = wheel->now + i;
+    for (l = wheel->slots[tick % N_SLOTS]; l != NULL; l = l->next)
+      if (((TimerEntry *) l->data)->expires == tick)
+        return tick;
+  }
+
+  /* Nothing due within a revolution */
+  g_hash_table_iter_init (&iter, wheel->timers);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &l))
+    next = MIN (next, ((TimerEntry *) l->data)->expires);
+
+  return next;
+}
+
+static gboolean timer_wheel_tick_cb (TerminalTimerWheel *wheel);
+
+static void
+timer_wheel_schedule (TerminalTimerWheel *wheel,
+                      guint64 tick)
+{
+  gint64 due, now;
+
+  if (wheel->source_id != 0)
+    g_source_remove (wheel->source_id);
+
+  now = g_get_monotonic_time ();
+  due = wheel->epoch + (gint64) tick * wheel->resolution * 1000;
+
+  wheel->scheduled = tick;
+  wheel->source_id = g_timeout_add ((guint) MAX ((due - now + 999) / 1000, 0),
+                                    (GSourceFunc) timer_wheel_tick_cb,
+                                    wheel);
+}
+
+static gboolean
+timer_wheel_tick_cb (TerminalTimerWheel *wheel)
+{
+  guint64 target;
+
+  wheel->source_id = 0;
+
+  target = timer_wheel_current_tick (wheel);
+
+  /* After a suspend, or a long stall, one revolution visits every slot */
+  if (target - wheel->now > N_SLOTS)
+    wheel->now = target - N_SLOTS;
+
+  while (wheel->now < target) {
+    wheel->now++;
+    timer_wheel_expire_slot (wheel, wheel->now % N_SLOTS);
+  }
+
+  /* Even if a callback added a timer and armed the source, an older
+   * timer may be due before it.
+   */
+  if (g_hash_table_size (wheel->timers) > 0)
+    timer_wheel_schedule (wheel, timer_wheel_next_expiry (wheel));
+
+  return FALSE;
+}
+
+/**
+ * terminal_timer_wheel_new:
+ * @resolution: the tick length, in ms
+ *
+ * Returns: (transfer full): a new #TerminalTimerWheel
+ */
+TerminalTimerWheel *
+terminal_timer_wheel_new (guint resolution)
+{
+  TerminalTimerWheel *wheel;
+
+  g_return_val_if_fail (resolution > 0, NULL);
+
+  wheel = g_slice_new0 (TerminalTimerWheel);
+  wheel->resolution = resolution;
+  wheel->epoch = g_get_monotonic_time ();
+  wheel->timers = g_hash_table_new (NULL, NULL);
+  wheel->next_id = 1;
+
+  return wheel;
+}
+
+/**
+ * terminal_timer_wheel_free:
+ * @wheel: a #TerminalTimerWheel
+ *
+ * Frees @wheel and drops all its timers without running them.
+ */
+void
+terminal_timer_wheel_free (TerminalTimerWheel *wheel)
+{
+  guint i;
+
+  g_return_if_fail (wheel != NULL);
+
+  if (wheel->source_id != 0)
+    g_source_remove (wheel->source_id);
+
+  for (i = 0; i < N_SLOTS; i++) {
+    GList *l;
+
+    for (l = wheel->slots[i]; l != NULL; l = l->next)
+      g_slice_free (TimerEntry, l->data);
+    g_list_free (wheel->slots[i]);
+  }
+
+  g_hash_table_destroy (wheel->timers);
+  g_slice_free (TerminalTimerWheel, wheel);
+}
+
+/**
+ * terminal_timer_wheel_add:
+ * @wheel: a #TerminalTimerWheel
+ * @delay: the delay in ms, rounded up to the wheel's resolution
+ * @func: the function to call when the timer expires
+ * @user_data: data to pass to @func
+ *
+ * Adds a one-shot timer.
+ *
+ * Returns: the ID of the timer, for terminal_timer_wheel_remove()
+ */
+guint
+terminal_timer_wheel_add (TerminalTimerWheel *wheel,
+                          guint delay,
+                          TerminalTimerFunc func,
+                          gpointer user_data)
+{
+  TimerEntry *entry;
+  guint64 ticks;
+
+  g_return_val_if_fail (wheel != NULL, 0);
+  g_return_val_if_fail (func != NULL, 0);
+
+  /* Without timers, there are no slots left to visit */
+  if (g_hash_table_size (wheel->timers) == 0)
+    wheel->now = timer_wheel_current_tick (wheel);
+
+  ticks = MAX (1, (delay + wheel->resolution - 1) / wheel->resolution);
+
+  entry = g_slice_new (TimerEntry);
+  entry->id = wheel->next_id++;
+  if (entry->id == 0) /* wrapped around */
+    entry->id = wheel->next_id++;
+  entry->expires = MAX (timer_wheel_current_tick (wheel), wheel->now) + ticks;
+  entry->slot = entry->expires % N_SLOTS;
+  entry->func = func;
+  entry->user_data = user_data;
+
+  wheel->slots[entry->slot] = g_list_prepend (wheel->slots[entry->slot], entry);
+  g_hash_table_insert (wheel->timers, GUINT_TO_POINTER (entry->id), wheel->slots[entry->slot]);
+
+  if (wheel->source_id == 0 || entry->expires < wheel->scheduled)
+    timer_wheel_schedule (wheel, entry->expires);
+
+  return entry->id;
+}
+
+/**
+ * terminal_timer_wheel_remove:
+ * @wheel: a #TerminalTimerWheel
+ * @id: a timer ID returned by terminal_timer_wheel_add()
+ *
+ * Removes a timer that has not expired yet. Removing an expired
+ * timer is allowed and does nothing.
+ */
+void
+terminal_timer_wheel_remove (TerminalTimerWheel *wheel,
+                             guint id)
+{
+  GList *link;
+  TimerEntry *entry;
+
+  g_return_if_fail (wheel != NULL);
+
+  link = g_hash_table_lookup (wheel->timers, GUINT_TO_POINTER (id));
+  if (link == NULL)
+    return;
+
+  entry = link->data;
+  g_hash_table_remove (wheel->timers, GUINT_TO_POINTER (id));
+  wheel->slots[entry->slot] = g_list_delete_link (wheel->slots[entry->slot], link);
+  g_slice_free (TimerEntry, entry);
+
+  /* Don't wake up for nothing */
+  if (g_hash_table_size (wheel->timers) == 0 && wheel->source_id != 0) {
+    g_source_remove (wheel->source_id);
+    wheel->source_id = 0;
+  }
+}
+
+/**
+ * terminal_timer_wheel_get_tick:
+ * @wheel: a #TerminalTimerWheel
+ *
+ * Returns the current tick. This only reads the monotonic clock, so
+ * it's cheap enough to call on every output.
+ *
+ * Returns: the number of ticks since @wheel was created
+ */
+guint64
+terminal_timer_wheel_get_tick (TerminalTimerWheel *wheel)
+{
+  g_return_val_if_fail (wheel != NULL, 0);
+
+  return timer_wheel_current_tick (wheel);
+}
+
+/**
+ * terminal_timer_wheel_get_resolution:
+ * @wheel: a #TerminalTimerWheel
+ *
+ * Returns: the tick length of @wheel, in ms
+ */
+guint
+terminal_timer_wheel_get_resolution (TerminalTimerWheel *wheel)
+{
+  g_return_val_if_fail (wheel != NULL, 0);
+
+  return wheel->resolution;
+}
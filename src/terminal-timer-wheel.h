@@ -0,0 +1,52 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_TIMER_WHEEL_H
+#define TERMINAL_TIMER_WHEEL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalTimerWheel TerminalTimerWheel;
+
+/**
+ * TerminalTimerFunc:
+ * @user_data: the data passed to terminal_timer_wheel_add()
+ *
+ * Called once when a timer expires. The timer is already removed
+ * from the wheel when this is called.
+ */
+typedef void (* TerminalTimerFunc) (gpointer user_data);
+
+TerminalTimerWheel *terminal_timer_wheel_new (guint resolution);
+
+void terminal_timer_wheel_free (TerminalTimerWheel *wheel);
+
+guint terminal_timer_wheel_add (TerminalTimerWheel *wheel,
+                                guint delay,
+                                TerminalTimerFunc func,
+                                gpointer user_data);
+
+void terminal_timer_wheel_remove (TerminalTimerWheel *wheel,
+                                  guint id);
+
+guint64 terminal_timer_wheel_get_tick (TerminalTimerWheel *wheel);
+
+guint terminal_timer_wheel_get_resolution (TerminalTimerWheel *wheel);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_TIMER_WHEEL_H */
@@ -0,0 +1,316 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-trace.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/* Request traces
+ *
+ * A trace collects the spans of one "open a terminal" request across
+ * processes: the clients pick an ID and pass it as the "trace-id" option
+ * of CreateInstance and Exec, and the server records its stages under
+ * that ID. Times are monotonic, which on Linux is the same clock in
+ * every process, so the client can merge the server's spans with its own.
+ */
+
+typedef struct {
+  char *name;
+  gint64 start; /* monotonic µs */
+  gint64 end; /* monotonic µs, or -1 while open */
+  int pid; /* of the process that recorded it */
+} Span;
+
+struct _TerminalTrace
+{
+  char *id;
+  GArray *spans; /* of Span, in order of start */
+};
+
+static void
+span_clear (Span *span)
+{
+  g_free (span->name);
+}
+
+static Span *
+terminal_trace_find_span (TerminalTrace *trace,
+                          const char *name)
+{
+  guint i;
+
+  /* The most recent one, in case a stage runs more than once */
+  for (i = trace->spans->len; i > 0; i--) {
+    Span *span = &g_array_index (trace->spans, Span, i - 1);
+
+    if (strcmp (span->name, name) == 0)
+      return span;
+  }
+
+  return NULL;
+}
+
+static void
+terminal_trace_insert_span (TerminalTrace *trace,
+                            const char *name,
+                            gint64 start,
+                            gint64 end,
+                            int pid)
+{
+  Span span;
+  guint i;
+
+  span.name = g_strdup (name);
+  span.start = start;
+  span.end = end;
+  span.pid = pid;
+
+  for (i = trace->spans->len; i > 0; i--)
+    if (g_array_index (trace->spans, Span, i - 1).start <= start)
+      break;
+  g_array_insert_val (trace->spans, i, span);
+}
+
+/**
+ * terminal_trace_new:
+ * @id: the trace ID
+ *
+ * Returns: (transfer full): a new #TerminalTrace
+ */
+TerminalTrace *
+terminal_trace_new (const char *id)
+{
+  TerminalTrace *trace;
+
+  trace = g_slice_new (TerminalTrace);
+  trace->id = g_strdup (id);
+  trace->spans = g_array_new (FALSE, FALSE, sizeof (Span));
+
+  return trace;
+}
+
+/**
+ * terminal_trace_new_for_options:
+ * @options: an a{sv} of CreateInstance or Exec options
+ *
+ * Returns: (transfer full) (allow-none): a new #TerminalTrace for the
+ *   "trace-id" option, or %NULL if the request isn't traced
+ */
+TerminalTrace *
+terminal_trace_new_for_options (GVariant *options)
+{
+  const char *id;
+
+  if (!g_variant_lookup (options, "trace-id", "&s", &id) || id[0] == '\0')
+    return NULL;
+
+  return terminal_trace_new (id);
+}
+
+/**
+ * terminal_trace_free:
+ * @trace: (allow-none): a #TerminalTrace
+ */
+void
+terminal_trace_free (TerminalTrace *trace)
+{
+  guint i;
+
+  if (trace == NULL)
+    return;
+
+  for (i = 0; i < trace->spans->len; i++)
+    span_clear (&g_array_index (trace->spans, Span, i));
+  g_array_free (trace->spans, TRUE);
+  g_free (trace->id);
+  g_slice_free (TerminalTrace, trace);
+}
+
+const char *
+terminal_trace_get_id (TerminalTrace *trace)
+{
+  return trace->id;
+}
+
+/**
+ * terminal_trace_begin:
+ * @trace: (allow-none): a #TerminalTrace
+ * @name: the stage
+ *
+ * Starts a span now. Does nothing if @trace is %NULL, so callers don't
+ * need to check whether the request is traced.
+ */
+void
+terminal_trace_begin (TerminalTrace *trace,
+                      const char *name)
+{
+  gint64 now;
+
+  if (trace == NULL)
+    return;
+
+  now = g_get_monotonic_time ();
+  terminal_trace_insert_span (trace, name, now, -1, (int) getpid ());
+}
+
+/**
+ * terminal_trace_end:
+ * @trace: (allow-none): a #TerminalTrace
+ * @name: the stage
+ *
+ * Ends the span started by terminal_trace_begin() for @name now.
+ */
+void
+terminal_trace_end (TerminalTrace *trace,
+                    const char *name)
+{
+  Span *span;
+
+  if (trace == NULL)
+    return;
+
+  span = terminal_trace_find_span (trace, name);
+  g_return_if_fail (span != NULL && span->end == -1);
+
+  span->end = g_get_monotonic_time ();
+}
+
+/**
+ * terminal_trace_add_span:
+ * @trace: (allow-none): a #TerminalTrace
+ * @name: the stage
+ * @start: the monotonic time the stage started
+ * @end: the monotonic time it ended, or -1 if it still runs
+ *
+ * Adds a span for a stage that wasn't bracketed by begin and end calls,
+ * e.g. the wait for a child's first output.
+ */
+void
+terminal_trace_add_span (TerminalTrace *trace,
+                         const char *name,
+                         gint64 start,
+                         gint64 end)
+{
+  if (trace == NULL)
+    return;
+
+  terminal_trace_insert_span (trace, name, start, end, (int) getpid ());
+}
+
+/**
+ * terminal_trace_get_end:
+ * @trace: (allow-none): a #TerminalTrace
+ * @name: the stage
+ *
+ * Returns: when the last span for @name ended, or 0 if there's no such
+ *   span or it hasn't ended yet
+ */
+gint64
+terminal_trace_get_end (TerminalTrace *trace,
+                        const char *name)
+{
+  Span *span;
+
+  if (trace == NULL)
+    return 0;
+
+  span = terminal_trace_find_span (trace, name);
+  if (span == NULL || span->end == -1)
+    return 0;
+
+  return span->end;
+}
+
+/**
+ * terminal_trace_get_spans:
+ * @trace: a #TerminalTrace
+ *
+ * Returns: (transfer floating): an a(sxxi) of the spans' names, start
+ *   and end times, and the IDs of the processes that recorded them, in
+ *   order of start time
+ */
+GVariant *
+terminal_trace_get_spans (TerminalTrace *trace)
+{
+  GVariantBuilder builder;
+  guint i;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sxxi)"));
+  for (i = 0; i < trace->spans->len; i++) {
+    Span *span = &g_array_index (trace->spans, Span, i);
+
+    g_variant_builder_add (&builder, "(sxxi)", span->name, span->start, span->end, span->pid);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * terminal_trace_add_spans:
+ * @trace: a #TerminalTrace
+ * @spans: an a(sxxi) as returned by terminal_trace_get_spans()
+ *
+ * Merges spans recorded by another process into @trace.
+ */
+void
+terminal_trace_add_spans (TerminalTrace *trace,
+                          GVariant *spans)
+{
+  GVariantIter iter;
+  const char *name;
+  gint64 start, end;
+  gint32 pid;
+
+  g_variant_iter_init (&iter, spans);
+  while (g_variant_iter_next (&iter, "(&sxxi)", &name, &start, &end, &pid))
+    terminal_trace_insert_span (trace, name, start, end, pid);
+}
+
+/**
+ * terminal_trace_to_json:
+ * @trace: a #TerminalTrace
+ *
+ * Returns: (transfer full): the spans as Chrome trace event JSON
+ */
+char *
+terminal_trace_to_json (TerminalTrace *trace)
+{
+  GString *json;
+  guint i;
+
+  json = g_string_new ("{\"traceEvents\":[\n");
+  for (i = 0; i < trace->spans->len; i++) {
+    Span *span = &g_array_index (trace->spans, Span, i);
+    char *name;
+
+    name = g_strescape (span->name, NULL);
+    g_string_append_printf (json,
+                            "{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\","
+                            "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ","
+                            "\"pid\":%d,\"tid\":%d}%s\n",
+                            name,
+                            span->start,
+                            span->end != -1 ? span->end - span->start : 0,
+                            span->pid, span->pid,
+                            i + 1 < trace->spans->len ? "," : "");
+    g_free (name);
+  }
+  g_string_append (json, "],\"displayTimeUnit\":\"ms\"}\n");
+
+  return g_string_free (json, FALSE);
+}
@@ -0,0 +1,56 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_TRACE_H
+#define TERMINAL_TRACE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalTrace TerminalTrace;
+
+TerminalTrace *terminal_trace_new (const char *id);
+
+TerminalTrace *terminal_trace_new_for_options (GVariant *options);
+
+void terminal_trace_free (TerminalTrace *trace);
+
+const char *terminal_trace_get_id (TerminalTrace *trace);
+
+void terminal_trace_begin (TerminalTrace *trace,
+                           const char *name);
+
+void terminal_trace_end (TerminalTrace *trace,
+                         const char *name);
+
+void terminal_trace_add_span (TerminalTrace *trace,
+                              const char *name,
+                              gint64 start,
+                              gint64 end);
+
+gint64 terminal_trace_get_end (TerminalTrace *trace,
+                               const char *name);
+
+GVariant *terminal_trace_get_spans (TerminalTrace *trace);
+
+void terminal_trace_add_spans (TerminalTrace *trace,
+                               GVariant *spans);
+
+char *terminal_trace_to_json (TerminalTrace *trace);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_TRACE_H */
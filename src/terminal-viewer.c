@@ -0,0 +1,406 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-viewer.h"
+
+#include <string.h>
+
+#include <gio/gunixinputstream.h>
+
+#include "terminal-debug.h"
+
+/* A viewer feeds a file or a pipe straight into a terminal, without a
+ * child process or a PTY. Files are followed like with "tail -F": the
+ * viewer starts near the end, reads whatever gets appended, and starts
+ * over when the file is truncated or replaced.
+ *
+ * Reads are large, and the next one only starts from a low-priority idle
+ * after feeding the last, so that VTE gets to process and draw in
+ * between and a fast writer gets blocked instead of filling memory.
+ */
+
+#define BUFFER_SIZE (256 * 1024)
+#define TAIL_SIZE   (64 * 1024) /* how much of an existing file to show */
+#define RATE_LIMIT  (100) /* ms between change notifications */
+
+typedef struct {
+  TerminalViewer *viewer; /* NULL once the viewer is gone */
+  char buffer[BUFFER_SIZE];
+} ReadOp;
+
+struct _TerminalViewer
+{
+  VteTerminal *terminal; /* unowned */
+
+  GFile *file; /* NULL for pipes */
+  GFileMonitor *monitor;
+  GInputStream *stream;
+  goffset offset;
+
+  GCancellable *cancellable;
+  ReadOp *op; /* while reading */
+  gboolean changed; /* while reading */
+  gboolean skip_line; /* started in the middle of one */
+  gboolean last_cr;
+  guint idle_id;
+
+  GString *converted;
+};
+
+static void terminal_viewer_read (TerminalViewer *viewer);
+
+/* Without a PTY, nothing turns LF into CR LF */
+static void
+terminal_viewer_feed (TerminalViewer *viewer,
+                      const char *data,
+                      gsize len)
+{
+  GString *converted = viewer->converted;
+  const char *p, *end, *nl;
+
+  if (viewer->skip_line) {
+    nl = memchr (data, '\n', len);
+    if (nl == NULL)
+      return;
+    len -= nl + 1 - data;
+    data = nl + 1;
+    viewer->skip_line = FALSE;
+  }
+  if (len == 0)
+    return;
+
+  g_string_truncate (converted, 0);
+  p = data;
+  end = data + len;
+  while ((nl = memchr (p, '\n', end - p)) != NULL) {
+    g_string_append_len (converted, p, nl - p);
+    if (!(nl > p ? nl[-1] == '\r' : viewer->last_cr))
+      g_string_append_c (converted, '\r');
+    g_string_append_c (converted, '\n');
+    p = nl + 1;
+  }
+  g_string_append_len (converted, p, end - p);
+  viewer->last_cr = data[len - 1] == '\r';
+
+  vte_terminal_feed (viewer->terminal, converted->str, converted->len);
+}
+
+static gboolean
+terminal_viewer_open (TerminalViewer *viewer,
+                      gboolean tail,
+                      GError **error)
+{
+  GFileInputStream *stream;
+  GFileInfo *info;
+  goffset size;
+
+  stream = g_file_read (viewer->file, NULL, error);
+  if (stream == NULL)
+    return FALSE;
+
+  if (viewer->stream != NULL)
+    g_object_unref (viewer->stream);
+  viewer->stream = G_INPUT_STREAM (stream);
+  viewer->offset = 0;
+  viewer->skip_line = FALSE;
+
+  if (!tail)
+    return TRUE;
+
+  info = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+  size = info ? g_file_info_get_size (info) : 0;
+  if (info)
+    g_object_unref (info);
+
+  if (size > TAIL_SIZE &&
+      g_seekable_seek (G_SEEKABLE (stream), size - TAIL_SIZE, G_SEEK_SET, NULL, NULL)) {
+    viewer->offset = size - TAIL_SIZE;
+    viewer->skip_line = TRUE;
+  }
+
+  return TRUE;
+}
+
+/* Returns TRUE if the file got shorter than what was read from it */
+static gboolean
+terminal_viewer_truncated (TerminalViewer *viewer)
+{
+  GFileInfo *info;
+  gboolean truncated;
+
+  info = g_file_input_stream_query_info (G_FILE_INPUT_STREAM (viewer->stream),
+                                         G_FILE_ATTRIBUTE_STANDARD_SIZE, NULL, NULL);
+  if (info == NULL)
+    return FALSE;
+
+  truncated = g_file_info_get_size (info) < viewer->offset;
+  g_object_unref (info);
+
+  return truncated;
+}
+
+static gboolean
+terminal_viewer_idle_cb (TerminalViewer *viewer)
+{
+  viewer->idle_id = 0;
+  terminal_viewer_read (viewer);
+
+  return FALSE;
+}
+
+static void
+terminal_viewer_read_cb (GInputStream *stream,
+                         GAsyncResult *result,
+                         ReadOp *op)
+{
+  TerminalViewer *viewer = op->viewer;
+  GError *error = NULL;
+  gssize n;
+
+  n = g_input_stream_read_finish (stream, result, &error);
+  if (viewer == NULL) {
+    /* Freed meanwhile */
+    g_clear_error (&error);
+    g_free (op);
+    return;
+  }
+
+  viewer->op = NULL;
+
+  if (n > 0) {
+    viewer->offset += n;
+    terminal_viewer_feed (viewer, op->buffer, n);
+    g_free (op);
+
+    viewer->idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                       (GSourceFunc) terminal_viewer_idle_cb,
+                                       viewer, NULL);
+    return;
+  }
+
+  g_free (op);
+
+  if (n < 0) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[viewer %p] read failed: %s\n",
+                           viewer, error->message);
+    g_error_free (error);
+    return;
+  }
+
+  /* End of file; a pipe is done, a file waits for more */
+  if (viewer->file == NULL)
+    return;
+
+  if (terminal_viewer_truncated (viewer) &&
+      g_seekable_seek (G_SEEKABLE (viewer->stream), 0, G_SEEK_SET, NULL, NULL)) {
+    _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                           "[viewer %p] file truncated\n",
+                           viewer);
+    viewer->offset = 0;
+    viewer->changed = TRUE;
+  }
+
+  if (viewer->changed)
+    terminal_viewer_read (viewer);
+}
+
+static void
+terminal_viewer_read (TerminalViewer *viewer)
+{
+  if (viewer->op != NULL || viewer->idle_id != 0) {
+    viewer->changed = TRUE;
+    return;
+  }
+
+  viewer->changed = FALSE;
+  viewer->op = g_new (ReadOp, 1);
+  viewer->op->viewer = viewer;
+  g_input_stream_read_async (viewer->stream,
+                             viewer->op->buffer, BUFFER_SIZE,
+                             G_PRIORITY_LOW,
+                             viewer->cancellable,
+                             (GAsyncReadyCallback) terminal_viewer_read_cb,
+                             viewer->op);
+}
+
+static void
+terminal_viewer_file_changed_cb (GFileMonitor *monitor,
+                                 GFile *file,
+                                 GFile *other_file,
+                                 GFileMonitorEvent event,
+                                 TerminalViewer *viewer)
+{
+  GError *error = NULL;
+
+  switch (event) {
+    case G_FILE_MONITOR_EVENT_CHANGED:
+      terminal_viewer_read (viewer);
+      break;
+
+    case G_FILE_MONITOR_EVENT_CREATED:
+      /* Rotated; drop the old file and start on the new one */
+      if (viewer->op != NULL) {
+        viewer->op->viewer = NULL;
+        viewer->op = NULL;
+        g_cancellable_cancel (viewer->cancellable);
+        g_object_unref (viewer->cancellable);
+        viewer->cancellable = g_cancellable_new ();
+      }
+      if (viewer->idle_id != 0) {
+        g_source_remove (viewer->idle_id);
+        viewer->idle_id = 0;
+      }
+
+      _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                             "[viewer %p] file replaced\n",
+                             viewer);
+
+      if (!terminal_viewer_open (viewer, FALSE, &error)) {
+        _terminal_debug_print (TERMINAL_DEBUG_PROCESSES,
+                               "[viewer %p] failed to reopen: %s\n",
+                               viewer, error->message);
+        g_error_free (error);
+        break;
+      }
+      terminal_viewer_read (viewer);
+      break;
+
+    default:
+      break;
+  }
+}
+
+static TerminalViewer *
+terminal_viewer_new (VteTerminal *terminal)
+{
+  TerminalViewer *viewer;
+
+  viewer = g_slice_new0 (TerminalViewer);
+  viewer->terminal = terminal;
+  viewer->cancellable = g_cancellable_new ();
+  viewer->converted = g_string_sized_new (BUFFER_SIZE + BUFFER_SIZE / 8);
+
+  return viewer;
+}
+
+/* Public API */
+
+/**
+ * terminal_viewer_new_for_path:
+ * @terminal: the #VteTerminal to feed
+ * @path: the file to follow
+ * @error: return location for a #GError
+ *
+ * Shows the end of @path in @terminal, and everything appended to it
+ * from then on.
+ *
+ * Returns: a new #TerminalViewer, or %NULL if @path can't be read
+ */
+TerminalViewer *
+terminal_viewer_new_for_path (VteTerminal *terminal,
+                              const char *path,
+                              GError **error)
+{
+  TerminalViewer *viewer;
+
+  g_return_val_if_fail (VTE_IS_TERMINAL (terminal), NULL);
+  g_return_val_if_fail (path != NULL, NULL);
+
+  viewer = terminal_viewer_new (terminal);
+  viewer->file = g_file_new_for_path (path);
+
+  if (!terminal_viewer_open (viewer, TRUE, error)) {
+    terminal_viewer_free (viewer);
+    return NULL;
+  }
+
+  viewer->monitor = g_file_monitor_file (viewer->file, G_FILE_MONITOR_NONE, NULL, error);
+  if (viewer->monitor == NULL) {
+    terminal_viewer_free (viewer);
+    return NULL;
+  }
+  g_file_monitor_set_rate_limit (viewer->monitor, RATE_LIMIT);
+  g_signal_connect (viewer->monitor, "changed",
+                    G_CALLBACK (terminal_viewer_file_changed_cb), viewer);
+
+  terminal_viewer_read (viewer);
+
+  return viewer;
+}
+
+/**
+ * terminal_viewer_new_for_fd:
+ * @terminal: the #VteTerminal to feed
+ * @fd: a file descriptor to read from, usually a pipe
+ *
+ * Feeds everything read from @fd into @terminal, until the end of file.
+ * The viewer takes ownership of @fd.
+ *
+ * Returns: a new #TerminalViewer
+ */
+TerminalViewer *
+terminal_viewer_new_for_fd (VteTerminal *terminal,
+                            int fd)
+{
+  TerminalViewer *viewer;
+
+  g_return_val_if_fail (VTE_IS_TERMINAL (terminal), NULL);
+  g_return_val_if_fail (fd != -1, NULL);
+
+  viewer = terminal_viewer_new (terminal);
+  viewer->stream = g_unix_input_stream_new (fd, TRUE);
+
+  terminal_viewer_read (viewer);
+
+  return viewer;
+}
+
+/**
+ * terminal_viewer_free:
+ * @viewer: a #TerminalViewer
+ *
+ * Stops feeding the terminal and closes the file.
+ */
+void
+terminal_viewer_free (TerminalViewer *viewer)
+{
+  if (viewer == NULL)
+    return;
+
+  if (viewer->op != NULL) {
+    viewer->op->viewer = NULL;
+    g_cancellable_cancel (viewer->cancellable);
+  }
+  if (viewer->idle_id != 0)
+    g_source_remove (viewer->idle_id);
+
+  if (viewer->monitor != NULL) {
+    g_signal_handlers_disconnect_by_func (viewer->monitor,
+                                          G_CALLBACK (terminal_viewer_file_changed_cb),
+                                          viewer);
+    g_file_monitor_cancel (viewer->monitor);
+    g_object_unref (viewer->monitor);
+  }
+
+  g_clear_object (&viewer->stream);
+  g_clear_object (&viewer->file);
+  g_object_unref (viewer->cancellable);
+  g_string_free (viewer->converted, TRUE);
+
+  g_slice_free (TerminalViewer, viewer);
+}
@@ -0,0 +1,37 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_VIEWER_H
+#define TERMINAL_VIEWER_H
+
+#include <gio/gio.h>
+#include <vte/vte.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalViewer TerminalViewer;
+
+TerminalViewer *terminal_viewer_new_for_path (VteTerminal *terminal,
+                                              const char *path,
+                                              GError **error);
+
+TerminalViewer *terminal_viewer_new_for_fd (VteTerminal *terminal,
+                                            int fd);
+
+void terminal_viewer_free (TerminalViewer *viewer);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_VIEWER_H */
@@ -0,0 +1,350 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "terminal-watchdog.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#include "terminal-debug.h"
+
+/* Main loop stall watchdog
+ *
+ * The main loop updates a heartbeat a few times per threshold. A thread
+ * checks it, and when it's older than the threshold, records the phase
+ * the main thread is in, as marked with terminal_watchdog_enter(), and
+ * a backtrace of the main thread, which it gets by sending it a signal.
+ * Once the heartbeat comes back, the report gets the stall's duration.
+ */
+
+#define HEARTBEAT_DIVISOR    (4)
+#define MAX_REPORTS          (16)
+#define MAX_FRAMES           (64)
+#define BACKTRACE_SIGNAL     (SIGPROF)
+#define BACKTRACE_WAIT       (100) /* ms */
+
+typedef struct {
+  gint64 time; /* wall clock, µs */
+  guint duration; /* ms; 0 while still stalled */
+  char *phase;
+  char **backtrace;
+} StallReport;
+
+struct _TerminalWatchdog
+{
+  GThread *thread;
+  GMutex mutex;
+  GCond cond;
+  gboolean quit;
+  guint threshold; /* ms */
+  guint interval; /* ms */
+  guint heartbeat_id;
+  gint64 last_beat; /* monotonic µs */
+  GQueue reports; /* of StallReport, oldest first */
+  guint n_stalls; /* including those whose reports were dropped */
+  pid_t main_tid;
+#ifdef HAVE_EXECINFO_H
+  struct sigaction old_action;
+#endif
+};
+
+/* Written only by the main thread */
+static const char * volatile current_phase;
+
+#ifdef HAVE_EXECINFO_H
+static void *stall_frames[MAX_FRAMES];
+static volatile int n_stall_frames;
+static volatile sig_atomic_t stall_frames_ready;
+
+static void
+backtrace_signal_handler (int signum)
+{
+  n_stall_frames = backtrace (stall_frames, MAX_FRAMES);
+  stall_frames_ready = 1;
+}
+#endif
+
+/* Called on the watchdog thread */
+static char **
+capture_main_backtrace (TerminalWatchdog *watchdog)
+{
+#ifdef HAVE_EXECINFO_H
+  char **symbols, **result;
+  int i;
+
+  stall_frames_ready = 0;
+  if (syscall (SYS_tgkill, getpid (), watchdog->main_tid, BACKTRACE_SIGNAL) != 0)
+    return NULL;
+
+  for (i = 0; i < BACKTRACE_WAIT && !stall_frames_ready; i++)
+    g_usleep (1000);
+  if (!stall_frames_ready)
+    return NULL;
+
+  symbols = backtrace_symbols (stall_frames, n_stall_frames);
+  if (symbols == NULL)
+    return NULL;
+
+  result = g_new0 (char *, n_stall_frames + 1);
+  for (i = 0; i < n_stall_frames; i++)
+    result[i] = g_strdup (symbols[i]);
+  free (symbols);
+
+  return result;
+#else
+  return NULL;
+#endif
+}
+
+static void
+stall_report_free (StallReport *report)
+{
+  g_free (report->phase);
+  g_strfreev (report->backtrace);
+  g_slice_free (StallReport, report);
+}
+
+static gboolean
+terminal_watchdog_heartbeat_cb (TerminalWatchdog *watchdog)
+{
+  g_mutex_lock (&watchdog->mutex);
+  watchdog->last_beat = g_get_monotonic_time ();
+  g_mutex_unlock (&watchdog->mutex);
+
+  return TRUE; /* run again */
+}
+
+static gpointer
+terminal_watchdog_thread (TerminalWatchdog *watchdog)
+{
+  StallReport *report = NULL;
+  gint64 stall_start = 0;
+
+  g_mutex_lock (&watchdog->mutex);
+
+  while (!watchdog->quit) {
+    gint64 now, beat;
+
+    g_cond_wait_until (&watchdog->cond, &watchdog->mutex,
+                       g_get_monotonic_time () + watchdog->interval * G_TIME_SPAN_MILLISECOND);
+    if (watchdog->quit)
+      break;
+
+    now = g_get_monotonic_time ();
+    beat = watchdog->last_beat;
+
+    if (report == NULL && now - beat > watchdog->threshold * G_TIME_SPAN_MILLISECOND) {
+      const char *phase = current_phase;
+      guint i;
+
+      report = g_slice_new0 (StallReport);
+      report->time = g_get_real_time ();
+      report->phase = g_strdup (phase);
+      stall_start = beat;
+
+      g_mutex_unlock (&watchdog->mutex);
+      report->backtrace = capture_main_backtrace (watchdog);
+      g_mutex_lock (&watchdog->mutex);
+
+      g_queue_push_tail (&watchdog->reports, report);
+      watchdog->n_stalls++;
+      while (g_queue_get_length (&watchdog->reports) > MAX_REPORTS)
+        stall_report_free (g_queue_pop_head (&watchdog->reports));
+
+      _terminal_debug_print (TERMINAL_DEBUG_WATCHDOG,
+                             "Main loop stalled for more than %u ms in %s\n",
+                             watchdog->threshold, phase ? phase : "(unknown)");
+      for (i = 0; report->backtrace != NULL && report->backtrace[i] != NULL; i++)
+        _terminal_debug_print (TERMINAL_DEBUG_WATCHDOG,
+                               "  %s\n", report->backtrace[i]);
+    } else if (report != NULL && beat != stall_start) {
+      /* The heartbeat is one interval late even without a stall */
+      report->duration = MAX ((beat - stall_start) / G_TIME_SPAN_MILLISECOND - watchdog->interval, 0);
+
+      _terminal_debug_print (TERMINAL_DEBUG_WATCHDOG,
+                             "Main loop was stalled for %u ms\n",
+                             report->duration);
+      report = NULL;
+    }
+  }
+
+  g_mutex_unlock (&watchdog->mutex);
+
+  return NULL;
+}
+
+/**
+ * terminal_watchdog_new:
+ * @threshold: the number of milliseconds after which the main loop is
+ *   considered stalled
+ *
+ * Starts watching the main loop. Must be called on the main thread.
+ *
+ * Returns: (transfer full): a new #TerminalWatchdog
+ */
+TerminalWatchdog *
+terminal_watchdog_new (guint threshold)
+{
+  TerminalWatchdog *watchdog;
+#ifdef HAVE_EXECINFO_H
+  struct sigaction action;
+  void *frame;
+#endif
+
+  watchdog = g_slice_new0 (TerminalWatchdog);
+  g_mutex_init (&watchdog->mutex);
+  g_cond_init (&watchdog->cond);
+  g_queue_init (&watchdog->reports);
+  watchdog->threshold = MAX (threshold, 1);
+  watchdog->interval = MAX (watchdog->threshold / HEARTBEAT_DIVISOR, 1);
+  watchdog->last_beat = g_get_monotonic_time ();
+  watchdog->main_tid = (pid_t) syscall (SYS_gettid);
+
+#ifdef HAVE_EXECINFO_H
+  /* Loads libgcc now, since the signal handler can't */
+  backtrace (&frame, 1);
+
+  action.sa_handler = backtrace_signal_handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset (&action.sa_mask);
+  sigaction (BACKTRACE_SIGNAL, &action, &watchdog->old_action);
+#endif
+
+  watchdog->heartbeat_id = g_timeout_add (watchdog->interval,
+                                          (GSourceFunc) terminal_watchdog_heartbeat_cb,
+                                          watchdog);
+  watchdog->thread = g_thread_new ("watchdog",
+                                   (GThreadFunc) terminal_watchdog_thread,
+                                   watchdog);
+
+  return watchdog;
+}
+
+/**
+ * terminal_watchdog_free:
+ * @watchdog: (allow-none): a #TerminalWatchdog
+ */
+void
+terminal_watchdog_free (TerminalWatchdog *watchdog)
+{
+  if (watchdog == NULL)
+    return;
+
+  g_mutex_lock (&watchdog->mutex);
+  watchdog->quit = TRUE;
+  g_cond_signal (&watchdog->cond);
+  g_mutex_unlock (&watchdog->mutex);
+  g_thread_join (watchdog->thread);
+
+  g_source_remove (watchdog->heartbeat_id);
+#ifdef HAVE_EXECINFO_H
+  sigaction (BACKTRACE_SIGNAL, &watchdog->old_action, NULL);
+#endif
+
+  g_queue_foreach (&watchdog->reports, (GFunc) stall_report_free, NULL);
+  g_queue_clear (&watchdog->reports);
+  g_cond_clear (&watchdog->cond);
+  g_mutex_clear (&watchdog->mutex);
+  g_slice_free (TerminalWatchdog, watchdog);
+}
+
+/**
+ * terminal_watchdog_get_reports:
+ * @watchdog: a #TerminalWatchdog
+ *
+ * Returns: (transfer floating): an aa{sv} of the most recent stalls,
+ *   oldest first
+ */
+GVariant *
+terminal_watchdog_get_reports (TerminalWatchdog *watchdog)
+{
+  GVariantBuilder builder;
+  GList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+
+  g_mutex_lock (&watchdog->mutex);
+  for (l = watchdog->reports.head; l != NULL; l = l->next) {
+    StallReport *report = l->data;
+
+    g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+    g_variant_builder_add (&builder, "{sv}", "time", g_variant_new_int64 (report->time));
+    g_variant_builder_add (&builder, "{sv}", "duration", g_variant_new_uint32 (report->duration));
+    if (report->phase != NULL)
+      g_variant_builder_add (&builder, "{sv}", "phase", g_variant_new_string (report->phase));
+    if (report->backtrace != NULL)
+      g_variant_builder_add (&builder, "{sv}", "backtrace",
+                             g_variant_new_strv ((const char * const *) report->backtrace, -1));
+    g_variant_builder_close (&builder);
+  }
+  g_mutex_unlock (&watchdog->mutex);
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * terminal_watchdog_get_n_stalls:
+ * @watchdog: a #TerminalWatchdog
+ *
+ * Returns: the number of stalls since @watchdog was started
+ */
+guint
+terminal_watchdog_get_n_stalls (TerminalWatchdog *watchdog)
+{
+  guint n_stalls;
+
+  g_mutex_lock (&watchdog->mutex);
+  n_stalls = watchdog->n_stalls;
+  g_mutex_unlock (&watchdog->mutex);
+
+  return n_stalls;
+}
+
+/**
+ * terminal_watchdog_enter:
+ * @phase: a static string naming what the main thread is about to do
+ *
+ * Marks the start of a phase that stall reports are attributed to.
+ * Cheap enough to be used whether or not a watchdog is running.
+ *
+ * Returns: the phase to pass to terminal_watchdog_leave()
+ */
+const char *
+terminal_watchdog_enter (const char *phase)
+{
+  const char *previous_phase = current_phase;
+
+  current_phase = phase;
+  return previous_phase;
+}
+
+/**
+ * terminal_watchdog_leave:
+ * @previous_phase: what terminal_watchdog_enter() returned
+ *
+ * Marks the end of a phase, restoring the one it was nested in.
+ */
+void
+terminal_watchdog_leave (const char *previous_phase)
+{
+  current_phase = previous_phase;
+}
@@ -0,0 +1,39 @@
+/*
+ * Gnome-terminal is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Gnome-terminal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMINAL_WATCHDOG_H
+#define TERMINAL_WATCHDOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _TerminalWatchdog TerminalWatchdog;
+
+TerminalWatchdog *terminal_watchdog_new (guint threshold);
+
+void terminal_watchdog_free (TerminalWatchdog *watchdog);
+
+GVariant *terminal_watchdog_get_reports (TerminalWatchdog *watchdog);
+
+guint terminal_watchdog_get_n_stalls (TerminalWatchdog *watchdog);
+
+const char *terminal_watchdog_enter (const char *phase);
+
+void terminal_watchdog_leave (const char *previous_phase);
+
+G_END_DECLS
+
+#endif /* !TERMINAL_WATCHDOG_H */
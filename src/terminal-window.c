@@ -72,6 +72,8 @@ struct _TerminalWindowPrivate
   GtkWidget *confirm_close_dialog;
   GtkWidget *search_find_dialog;
 
+  TerminalFrameStats *frame_stats; /* only while recording */
+
   /* Used to clear stray "demands attention" flashing on our window when we
    * unmap and map it to switch to an ARGB visual.
    */
@@ -100,6 +102,8 @@ struct _TerminalWindowPrivate
 #define STOCK_NEW_WINDOW  "window-new"
 #define STOCK_NEW_TAB     "tab-new"
 
+#define FRAME_STATS_CAPACITY (512)
+
 #define ENCODING_DATA_KEY "encoding"
 
 #if 1
@@ -195,6 +199,8 @@ static void terminal_reset_callback           (GtkAction *action,
                                                TerminalWindow *window);
 static void terminal_reset_clear_callback     (GtkAction *action,
                                                TerminalWindow *window);
+static void terminal_processes_callback       (GtkAction *action,
+                                               TerminalWindow *window);
 static void tabs_next_or_previous_tab_cb      (GtkAction *action,
                                                TerminalWindow *window);
 static void tabs_move_left_callback           (GtkAction *action,
@@ -735,6 +741,11 @@ terminal_window_update_encoding_menu (TerminalWindow *window)
   GSList *encodings, *l;
   const char *charset;
   TerminalEncoding *active_encoding;
+  const char *phase;
+  gint64 handler_start;
+
+  phase = terminal_watchdog_enter ("terminal_window_update_encoding_menu");
+  handler_start = terminal_frame_stats_begin_handler (priv->frame_stats);
 
   /* Remove the old UI */
   if (priv->encodings_ui_id != 0)
@@ -812,6 +823,9 @@ terminal_window_update_encoding_menu (TerminalWindow *window)
 
   g_slist_foreach (encodings, (GFunc) terminal_encoding_unref, NULL);
   g_slist_free (encodings);
+
+  terminal_frame_stats_end_handler (priv->frame_stats, handler_start);
+  terminal_watchdog_leave (phase);
 }
 
 static void
@@ -1470,6 +1484,8 @@ terminal_window_map_event (GtkWidget    *widget,
       GTK_WIDGET_CLASS (terminal_window_parent_class)->map_event;
   GtkAllocation widget_allocation;
 
+  _terminal_debug_perf_mark ("first window map");
+
   gtk_widget_get_allocation (widget, &widget_allocation);
   _terminal_debug_print (TERMINAL_DEBUG_GEOMETRY,
                          "[window %p] map-event, size %d : %d at (%d, %d)\n",
@@ -1518,6 +1534,20 @@ terminal_window_state_event (GtkWidget            *widget,
       action = gtk_action_group_get_action (priv->action_group, "PopupLeaveFullscreen");
       gtk_action_set_visible (action, is_fullscreen);
     }
+
+  if (event->changed_mask & GDK_WINDOW_STATE_ICONIFIED)
+    {
+      TerminalWindow *window = TERMINAL_WINDOW (widget);
+      GList *screens, *l;
+      gboolean is_minimized;
+
+      is_minimized = (event->new_window_state & GDK_WINDOW_STATE_ICONIFIED) != 0;
+
+      screens = terminal_mdi_container_list_screens (window->priv->mdi_container);
+      for (l = screens; l != NULL; l = l->next)
+        _terminal_screen_set_window_minimized (TERMINAL_SCREEN (l->data), is_minimized);
+      g_list_free (screens);
+    }
   
   if (window_state_event)
     return window_state_event (widget, event);
@@ -1618,6 +1648,70 @@ terminal_window_encoding_list_changed_cb (TerminalApp *app,
   terminal_window_update_encoding_menu (window);
 }
 
+/* Frame timings */
+
+static void
+terminal_window_frame_timings_changed_cb (GSettings *settings,
+                                          const char *key,
+                                          TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+
+  if (!g_settings_get_boolean (settings, TERMINAL_SETTING_FRAME_TIMINGS_KEY))
+    {
+      terminal_frame_stats_free (priv->frame_stats);
+      priv->frame_stats = NULL;
+    }
+  else if (priv->frame_stats == NULL)
+    priv->frame_stats = terminal_frame_stats_new (FRAME_STATS_CAPACITY);
+}
+
+static gboolean
+terminal_window_draw (GtkWidget *widget,
+                      cairo_t *cr)
+{
+  TerminalWindow *window = TERMINAL_WINDOW (widget);
+  TerminalWindowPrivate *priv = window->priv;
+  gboolean result;
+
+  terminal_frame_stats_begin_paint (priv->frame_stats);
+  result = GTK_WIDGET_CLASS (terminal_window_parent_class)->draw (widget, cr);
+  terminal_frame_stats_end_paint (priv->frame_stats);
+
+  return result;
+}
+
+static void
+terminal_window_size_allocate (GtkWidget *widget,
+                               GtkAllocation *allocation)
+{
+  TerminalWindow *window = TERMINAL_WINDOW (widget);
+  TerminalWindowPrivate *priv = window->priv;
+
+  terminal_frame_stats_begin_layout (priv->frame_stats);
+  GTK_WIDGET_CLASS (terminal_window_parent_class)->size_allocate (widget, allocation);
+  terminal_frame_stats_end_layout (priv->frame_stats);
+}
+
+static void
+debug_dump_frame_timings_callback (GtkAction *action,
+                                   TerminalWindow *window)
+{
+  TerminalWindowPrivate *priv = window->priv;
+  char *text;
+
+  if (priv->frame_stats == NULL)
+    {
+      g_printerr ("Frame timings are not being recorded; turn on the \"%s\" setting\n",
+                  TERMINAL_SETTING_FRAME_TIMINGS_KEY);
+      return;
+    }
+
+  text = terminal_frame_stats_format (priv->frame_stats);
+  g_printerr ("Frame timings of window %p:\n%s", window, text);
+  g_free (text);
+}
+
 static void
 terminal_window_init (TerminalWindow *window)
 {
@@ -1726,6 +1820,9 @@ terminal_window_init (TerminalWindow *window)
       { "TerminalResetClear", NULL, N_("Reset and C_lear"), NULL,
         NULL,
         G_CALLBACK (terminal_reset_clear_callback) },
+      { "TerminalProcesses", NULL, N_("Pr_ocesses…"), NULL,
+        NULL,
+        G_CALLBACK (terminal_processes_callback) },
 
       /* Terminal/Encodings menu */
       { "TerminalAddEncoding", NULL, N_("_Add or Remove…"), NULL,
@@ -1801,7 +1898,12 @@ terminal_window_init (TerminalWindow *window)
       { "PopupLeaveFullscreen", NULL, N_("L_eave Full Screen"), NULL,
         NULL,
         G_CALLBACK (popup_leave_fullscreen_callback) },
-      { "PopupInputMethods", NULL, N_("_Input Methods") }
+      { "PopupInputMethods", NULL, N_("_Input Methods") },
+
+      /* Not in any menu */
+      { "DebugDumpFrameTimings", NULL, NULL, "<shift><control><alt>F",
+        NULL,
+        G_CALLBACK (debug_dump_frame_timings_callback) }
     };
   
   const GtkToggleActionEntry toggle_menu_entries[] =
@@ -1942,6 +2044,13 @@ terminal_window_init (TerminalWindow *window)
   g_signal_connect (app, "encoding-list-changed",
                     G_CALLBACK (terminal_window_encoding_list_changed_cb), window);
 
+  terminal_window_frame_timings_changed_cb (terminal_app_get_global_settings (app),
+                                            TERMINAL_SETTING_FRAME_TIMINGS_KEY,
+                                            window);
+  g_signal_connect (terminal_app_get_global_settings (app),
+                    "changed::" TERMINAL_SETTING_FRAME_TIMINGS_KEY,
+                    G_CALLBACK (terminal_window_frame_timings_changed_cb), window);
+
   terminal_window_update_size_to_menu (window);
 
   /* We have to explicitly call this, since screen-changed is NOT
@@ -1970,6 +2079,8 @@ terminal_window_class_init (TerminalWindowClass *klass)
   widget_class->map_event = terminal_window_map_event;
   widget_class->window_state_event = terminal_window_state_event;
   widget_class->screen_changed = terminal_window_screen_changed;
+  widget_class->draw = terminal_window_draw;
+  widget_class->size_allocate = terminal_window_size_allocate;
 
   g_type_class_add_private (object_class, sizeof (TerminalWindowPrivate));
 }
@@ -2005,6 +2116,9 @@ terminal_window_dispose (GObject *object)
   g_signal_handlers_disconnect_by_func (app,
                                         G_CALLBACK (terminal_window_encoding_list_changed_cb),
                                         window);
+  g_signal_handlers_disconnect_by_func (terminal_app_get_global_settings (app),
+                                        G_CALLBACK (terminal_window_frame_timings_changed_cb),
+                                        window);
 
   clipboard = gtk_widget_get_clipboard (GTK_WIDGET (window), GDK_SELECTION_CLIPBOARD);
   g_signal_handlers_disconnect_by_func (clipboard,
@@ -2038,6 +2152,8 @@ terminal_window_finalize (GObject *object)
     gtk_dialog_response (GTK_DIALOG (priv->search_find_dialog),
                          GTK_RESPONSE_DELETE_EVENT);
 
+  terminal_frame_stats_free (priv->frame_stats);
+
   G_OBJECT_CLASS (terminal_window_parent_class)->finalize (object);
 }
 
@@ -2127,11 +2243,14 @@ sync_screen_title (TerminalScreen *screen,
                    TerminalWindow *window)
 {
   TerminalWindowPrivate *priv = window->priv;
+  gint64 handler_start;
   
   if (screen != priv->active_screen)
     return;
 
+  handler_start = terminal_frame_stats_begin_handler (priv->frame_stats);
   gtk_window_set_title (GTK_WINDOW (window), terminal_screen_get_title (screen));
+  terminal_frame_stats_end_handler (priv->frame_stats, handler_start);
 }
 
 static void
@@ -2228,19 +2347,25 @@ terminal_window_remove_screen (TerminalWindow *window,
   terminal_mdi_container_remove_screen (priv->mdi_container, screen);
 }
 
-void
-terminal_window_move_screen (TerminalWindow *source_window,
-                             TerminalWindow *dest_window,
-                             TerminalScreen *screen,
-                             int dest_position)
+/**
+ * terminal_window_detach_screen:
+ * @window: a #TerminalWindow
+ * @screen: a #TerminalScreen in @window
+ *
+ * Removes @screen from @window without destroying it, and without
+ * disturbing its child process.
+ *
+ * Returns: (transfer full): @screen, no longer inside any container
+ */
+TerminalScreen *
+terminal_window_detach_screen (TerminalWindow *window,
+                               TerminalScreen *screen)
 {
   TerminalScreenContainer *screen_container;
 
-  g_return_if_fail (TERMINAL_IS_WINDOW (source_window));
-  g_return_if_fail (TERMINAL_IS_WINDOW (dest_window));
-  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
-  g_return_if_fail (gtk_widget_get_toplevel (GTK_WIDGET (screen)) == GTK_WIDGET (source_window));
-  g_return_if_fail (dest_position >= -1);
+  g_return_val_if_fail (TERMINAL_IS_WINDOW (window), NULL);
+  g_return_val_if_fail (TERMINAL_IS_SCREEN (screen), NULL);
+  g_return_val_if_fail (gtk_widget_get_toplevel (GTK_WIDGET (screen)) == GTK_WIDGET (window), NULL);
 
   screen_container = terminal_screen_container_get_from_screen (screen);
   g_assert (TERMINAL_IS_SCREEN_CONTAINER (screen_container));
@@ -2252,12 +2377,28 @@ terminal_window_move_screen (TerminalWindow *source_window,
    */
   g_object_ref_sink (screen_container);
   g_object_ref_sink (screen);
-  terminal_window_remove_screen (source_window, screen);
+  terminal_window_remove_screen (window, screen);
 
   /* Now we can safely remove the screen from the container and let the container die */
   gtk_container_remove (GTK_CONTAINER (gtk_widget_get_parent (GTK_WIDGET (screen))), GTK_WIDGET (screen));
   g_object_unref (screen_container);
 
+  return screen;
+}
+
+void
+terminal_window_move_screen (TerminalWindow *source_window,
+                             TerminalWindow *dest_window,
+                             TerminalScreen *screen,
+                             int dest_position)
+{
+  g_return_if_fail (TERMINAL_IS_WINDOW (source_window));
+  g_return_if_fail (TERMINAL_IS_WINDOW (dest_window));
+  g_return_if_fail (TERMINAL_IS_SCREEN (screen));
+  g_return_if_fail (gtk_widget_get_toplevel (GTK_WIDGET (screen)) == GTK_WIDGET (source_window));
+  g_return_if_fail (dest_position >= -1);
+
+  terminal_window_detach_screen (source_window, screen);
   terminal_window_add_screen (dest_window, screen, dest_position);
   g_object_unref (screen);
 }
@@ -2280,6 +2421,21 @@ terminal_window_get_mdi_container (TerminalWindow *window)
   return GTK_WIDGET (priv->mdi_container);
 }
 
+/**
+ * terminal_window_get_frame_stats:
+ * @window: a #TerminalWindow
+ *
+ * Returns: (transfer none): the frame timings of @window, or %NULL
+ *   when the "frame-timings" setting is off
+ */
+TerminalFrameStats *
+terminal_window_get_frame_stats (TerminalWindow *window)
+{
+  g_return_val_if_fail (TERMINAL_IS_WINDOW (window), NULL);
+
+  return window->priv->frame_stats;
+}
+
 void
 terminal_window_set_size (TerminalWindow *window,
                           TerminalScreen *screen)
@@ -2452,6 +2608,11 @@ mdi_screen_added_cb (TerminalMdiContainer *container,
                          "[window %p] MDI: screen %p inserted\n",
                          window, screen);
 
+  if (gtk_widget_get_realized (GTK_WIDGET (window)))
+    _terminal_screen_set_window_minimized (screen,
+                                           (gdk_window_get_state (gtk_widget_get_window (GTK_WIDGET (window))) &
+                                            GDK_WINDOW_STATE_ICONIFIED) != 0);
+
   g_signal_connect (G_OBJECT (screen),
                     "profile-set",
                     G_CALLBACK (profile_set_callback),
@@ -2519,6 +2680,8 @@ mdi_screen_removed_cb (TerminalMdiContainer *container,
                          "[window %p] MDI: screen %p removed\n",
                          window, screen);
 
+  _terminal_screen_set_window_minimized (screen, FALSE);
+
   g_signal_handlers_disconnect_by_func (G_OBJECT (screen),
                                         G_CALLBACK (profile_set_callback),
                                         window);
@@ -2613,10 +2776,13 @@ terminal_window_update_geometry (TerminalWindow *window)
   GdkGeometry hints;
   int char_width;
   int char_height;
+  gint64 handler_start;
   
   if (priv->active_screen == NULL)
     return;
 
+  handler_start = terminal_frame_stats_begin_handler (priv->frame_stats);
+
   widget = GTK_WIDGET (priv->active_screen);
 
   /* We set geometry hints from the active term; best thing
@@ -2680,6 +2846,8 @@ terminal_window_update_geometry (TerminalWindow *window)
                              "[window %p] hints: increment unchanged, not setting\n",
                              window);
     }
+
+  terminal_frame_stats_end_handler (priv->frame_stats, handler_start);
 }
 
 static void
@@ -2769,6 +2937,7 @@ confirm_close_window_or_tab (TerminalWindow *window,
   GtkWidget *dialog;
   gboolean do_confirm;
   int n_tabs;
+  GString *names;
 
   if (priv->confirm_close_dialog)
     {
@@ -2782,9 +2951,17 @@ confirm_close_window_or_tab (TerminalWindow *window,
   if (!do_confirm)
     return FALSE;
 
+  /* This only asks each PTY for its foreground process group, and
+   * takes the names from the process tracker's cache, so it doesn't
+   * block on /proc even for windows with many tabs.
+   */
+  names = g_string_new (NULL);
+
   if (screen)
     {
       do_confirm = terminal_screen_has_foreground_process (screen);
+      if (do_confirm && terminal_screen_get_foreground_process_name (screen))
+        g_string_append (names, terminal_screen_get_foreground_process_name (screen));
       n_tabs = 1;
     }
   else
@@ -2799,19 +2976,30 @@ confirm_close_window_or_tab (TerminalWindow *window,
       for (t = tabs; t != NULL; t = t->next)
         {
           TerminalScreen *terminal_screen;
+          const char *name;
 
           terminal_screen = terminal_screen_container_get_screen (TERMINAL_SCREEN_CONTAINER (t->data));
-          if (terminal_screen_has_foreground_process (terminal_screen))
-            {
-              do_confirm = TRUE;
-              break;
-            }
+          if (!terminal_screen_has_foreground_process (terminal_screen))
+            continue;
+
+          do_confirm = TRUE;
+
+          name = terminal_screen_get_foreground_process_name (terminal_screen);
+          if (name == NULL)
+            continue;
+
+          if (names->len > 0)
+            g_string_append (names, ", ");
+          g_string_append (names, name);
         }
       g_list_free (tabs);
     }
 
   if (!do_confirm)
-    return FALSE;
+    {
+      g_string_free (names, TRUE);
+      return FALSE;
+    }
 
   dialog = priv->confirm_close_dialog =
     gtk_message_dialog_new (GTK_WINDOW (window),
@@ -2820,15 +3008,27 @@ confirm_close_window_or_tab (TerminalWindow *window,
                             GTK_BUTTONS_CANCEL,
                             "%s", n_tabs > 1 ? _("Close this window?") : _("Close this terminal?"));
 
-  if (n_tabs > 1)
+  if (n_tabs > 1 && names->len > 0)
+    gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+                                              _("There are still processes running in some terminals in this window (%s). "
+                                                "Closing the window will kill all of them."),
+                                              names->str);
+  else if (n_tabs > 1)
     gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
                                               "%s", _("There are still processes running in some terminals in this window. "
                                                       "Closing the window will kill all of them."));
+  else if (names->len > 0)
+    gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+                                              _("There is still a process running in this terminal (%s). "
+                                                "Closing the terminal will kill it."),
+                                              names->str);
   else
     gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
                                               "%s", _("There is still a process running in this terminal. "
                                                       "Closing the terminal will kill it."));
 
+  g_string_free (names, TRUE);
+
   gtk_window_set_title (GTK_WINDOW (dialog), ""); 
 
   gtk_dialog_add_button (GTK_DIALOG (dialog), n_tabs > 1 ? _("C_lose Window") : _("C_lose Terminal"), GTK_RESPONSE_ACCEPT);
@@ -2870,6 +3070,7 @@ save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer
   GFile *file;
   GOutputStream *stream;
   GError *error = NULL;
+  const char *phase;
 
   if (response_id != GTK_RESPONSE_ACCEPT)
     {
@@ -2885,6 +3086,8 @@ save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer
   if (filename_uri == NULL)
     return;
 
+  phase = terminal_watchdog_enter ("save_contents_dialog_on_response");
+
   file = g_file_new_for_uri (filename_uri);
   stream = G_OUTPUT_STREAM (g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
 
@@ -2901,6 +3104,8 @@ save_contents_dialog_on_response (GtkDialog *dialog, gint response_id, gpointer
       g_object_unref (stream);
     }
 
+  terminal_watchdog_leave (phase);
+
   if (error)
     {
       terminal_util_show_error_dialog (parent, NULL, error,
@@ -3430,6 +3635,13 @@ terminal_reset_clear_callback (GtkAction *action,
   vte_terminal_reset (VTE_TERMINAL (priv->active_screen), TRUE, TRUE);
 }
 
+static void
+terminal_processes_callback (GtkAction *action,
+                             TerminalWindow *window)
+{
+  terminal_app_show_processes (terminal_app_get (), GTK_WINDOW (window));
+}
+
 static void
 tabs_next_or_previous_tab_cb (GtkAction *action,
                               TerminalWindow *window)
@@ -22,6 +22,7 @@
 
 #include <gtk/gtk.h>
 
+#include "terminal-frame-stats.h"
 #include "terminal-screen.h"
 
 G_BEGIN_DECLS
@@ -63,6 +64,9 @@ void terminal_window_add_screen (TerminalWindow *window,
 void terminal_window_remove_screen (TerminalWindow *window,
                                     TerminalScreen *screen);
 
+TerminalScreen *terminal_window_detach_screen (TerminalWindow *window,
+                                               TerminalScreen *screen);
+
 void terminal_window_move_screen (TerminalWindow *source_window,
                                   TerminalWindow *dest_window,
                                   TerminalScreen *screen,
@@ -87,6 +91,8 @@ void terminal_window_set_size_force_grid (TerminalWindow *window,
 
 GtkWidget* terminal_window_get_mdi_container (TerminalWindow *window);
 
+TerminalFrameStats *terminal_window_get_frame_stats (TerminalWindow *window);
+
 G_END_DECLS
 
 #endif /* TERMINAL_WINDOW_H */
@@ -40,6 +40,10 @@
 #include "terminal-gdbus-generated.h"
 #include "terminal-defines.h"
 #include "terminal-client-utils.h"
+#include "terminal-trace.h"
+
+/* How long --timing waits for each terminal's first frame, in ms */
+#define TIMING_TIMEOUT (10000)
 
 /**
  * handle_options:
@@ -62,6 +66,7 @@ handle_options (TerminalFactory *factory,
 {
   GList *lw;
   GError *err;
+  TerminalTrace *trace;
 
 #if 0
   gdk_screen = terminal_app_get_screen_by_display_name (options->display_name,
@@ -71,6 +76,18 @@ handle_options (TerminalFactory *factory,
   /* Make sure we open at least one window */
   terminal_options_ensure_window (options);
 
+  /* Only ask the server to record spans if somebody is going to look.
+   * All terminals share the trace, one after the other.
+   */
+  if (options->timing || options->trace_file != NULL) {
+    char *trace_id;
+
+    trace_id = terminal_client_new_trace_id ();
+    trace = terminal_trace_new (trace_id);
+    g_free (trace_id);
+  } else
+    trace = NULL;
+
   for (lw = options->initial_windows;  lw != NULL; lw = lw->next)
     {
       InitialWindow *iw = lw->data;
@@ -104,6 +121,8 @@ handle_options (TerminalFactory *factory,
                                                           it->title ? it->title : options->default_title,
                                                           iw->start_maximized,
                                                           iw->start_fullscreen);
+          if (trace != NULL)
+            terminal_client_append_trace_id (&builder, terminal_trace_get_id (trace));
 
           if (window_id)
             g_variant_builder_add (&builder, "{sv}",
@@ -121,6 +140,7 @@ handle_options (TerminalFactory *factory,
             terminal_window_switch_screen (window, screen);
 #endif
 
+          terminal_trace_begin (trace, "CreateInstance");
           if (!terminal_factory_call_create_instance_sync 
                  (factory,
                   g_variant_builder_end (&builder),
@@ -133,6 +153,7 @@ handle_options (TerminalFactory *factory,
             /* Continue processing the remaining options! */
             continue;
           }
+          terminal_trace_end (trace, "CreateInstance");
 
           p = strstr (object_path, "/window/");
           if (p) {
@@ -146,9 +167,10 @@ handle_options (TerminalFactory *factory,
               window_id = (guint) value;
           }
 
+          /* TraceFinished is a signal */
           receiver = terminal_receiver_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
                                                                G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
-                                                               G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                               (trace != NULL ? 0 : G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS),
                                                                options->server_app_id ? options->server_app_id
                                                                                       : TERMINAL_APPLICATION_ID,
                                                                object_path,
@@ -169,10 +191,13 @@ handle_options (TerminalFactory *factory,
           terminal_client_append_exec_options (&builder,
                                                it->working_dir ? it->working_dir 
                                                                : options->default_working_dir);
+          if (trace != NULL)
+            terminal_client_append_trace_id (&builder, terminal_trace_get_id (trace));
 
           argv = it->exec_argv ? it->exec_argv : options->exec_argv,
           argc = argv ? g_strv_length (argv) : 0;
 
+          terminal_trace_begin (trace, "Exec");
           if (!terminal_receiver_call_exec_sync (receiver,
                                                  g_variant_builder_end (&builder),
                                                  g_variant_new_bytestring_array ((const char * const *) argv, argc),
@@ -181,12 +206,32 @@ handle_options (TerminalFactory *factory,
                                                 &err)) {
             g_printerr ("Error: %s\n", err->message);
             g_error_free (err);
+          } else {
+            terminal_trace_end (trace, "Exec");
+
+            if (trace != NULL &&
+                !terminal_client_wait_for_trace (receiver, trace, TIMING_TIMEOUT))
+              g_printerr ("Timed out waiting for the terminal's first frame\n");
           }
 
           g_object_unref (receiver);
         }
     }
 
+  if (trace != NULL) {
+    if (options->timing)
+      terminal_client_print_trace (trace);
+
+    err = NULL;
+    if (options->trace_file != NULL &&
+        !terminal_client_write_trace (trace, options->trace_file, &err)) {
+      g_printerr ("Failed to write trace: %s\n", err->message);
+      g_error_free (err);
+    }
+
+    terminal_trace_free (trace);
+  }
+
   return TRUE;
 }
 